@@ -0,0 +1,9 @@
+/*
+ * Trivial shared library for the libraries dimension of benchmark/report.js.
+ *
+ * Copies of it are preloaded into the benchmark process, each as a separate
+ * library, so that only the number of loaded libraries changes.
+ */
+int node_report_bench_library(void) {
+  return 0;
+}
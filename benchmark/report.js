@@ -0,0 +1,278 @@
+#!/usr/bin/env node
+'use strict';
+
+// Benchmark for report generation latency and memory usage.
+//
+// Each scaling dimension is varied independently, in a separate child process
+// per measurement, with everything else at its baseline. Results are written
+// to stdout (or the --output file) as JSON.
+//
+// Usage: node benchmark/report.js [--iterations <n>] [--format text|json|binary]
+//                                 [--dimension <name>] [--output <file>]
+
+const child_process = require('child_process');
+const fs = require('fs');
+const net = require('net');
+const os = require('os');
+const path = require('path');
+
+const DIMENSIONS = {
+  statWatchers: [0, 1000, 10000],
+  tcp: [0, 100, 500],
+  pipes: [0, 100, 500],
+  heapMB: [0, 64, 256],
+  stackDepth: [10, 100, 1000],
+  libraries: [0, 10, 50],
+  environment: [0, 1000, 10000],
+};
+
+const APIS = ['getReport', 'triggerReport'];
+
+function parseArgs(argv) {
+  const options = { iterations: 20, format: 'text', dimension: null, output: null };
+  for (let i = 0; i < argv.length; i++) {
+    const value = argv[i + 1];
+    switch (argv[i]) {
+      case '--iterations': options.iterations = parseInt(value, 10); i++; break;
+      case '--format': options.format = value; i++; break;
+      case '--dimension': options.dimension = value; i++; break;
+      case '--output': options.output = value; i++; break;
+      default:
+        console.error('Unrecognised argument: ' + argv[i]);
+        process.exit(1);
+    }
+  }
+  if (options.dimension !== null && !DIMENSIONS[options.dimension]) {
+    console.error('Unknown dimension: ' + options.dimension + ', expected one of ' +
+                  Object.keys(DIMENSIONS).join(', '));
+    process.exit(1);
+  }
+  return options;
+}
+
+/*
+ * Child process: set up one scenario, then time the report APIs.
+ */
+function summarise(samples) {
+  const sorted = samples.slice().sort((a, b) => a - b);
+  const total = sorted.reduce((sum, value) => sum + value, 0);
+  return {
+    mean: total / sorted.length,
+    min: sorted[0],
+    median: sorted[Math.floor(sorted.length / 2)],
+    max: sorted[sorted.length - 1],
+  };
+}
+
+function maxRss() {
+  // resourceUsage() is only available from Node.js 12.6
+  return process.resourceUsage ? process.resourceUsage().maxRSS * 1024 : undefined;
+}
+
+function measure(nodereport, api, iterations, directory) {
+  const samples = [];
+  const sections = {};
+  let reportBytes = 0;
+  let peakRss = process.memoryUsage().rss;
+  for (let i = 0; i < iterations; i++) {
+    const start = process.hrtime();
+    if (api === 'getReport') {
+      reportBytes = nodereport.getReport().length;
+    } else {
+      const file = path.join(directory, nodereport.triggerReport());
+      reportBytes = fs.statSync(file).size;
+      fs.unlinkSync(file);
+    }
+    const elapsed = process.hrtime(start);
+    samples.push(elapsed[0] * 1e3 + elapsed[1] / 1e6);
+    peakRss = Math.max(peakRss, process.memoryUsage().rss);
+
+    const timings = nodereport.getReportTimings();
+    Object.keys(timings.sections).forEach((name) => {
+      sections[name] = (sections[name] || 0) + timings.sections[name] / iterations;
+    });
+  }
+  return {
+    api: api,
+    latencyMs: summarise(samples),
+    sectionsMs: sections,
+    reportBytes: reportBytes,
+    peakRssBytes: peakRss,
+  };
+}
+
+function withStackDepth(depth, callback) {
+  return depth <= 0 ? callback() : withStackDepth(depth - 1, callback);
+}
+
+function setup(dimension, value, cleanup, callback) {
+  switch (dimension) {
+    case 'statWatchers': {
+      // Each watched file has its own libuv fs poll handle, which needs no
+      // file descriptor. The files do not have to exist.
+      const prefix = path.join(os.tmpdir(), 'node-report-bench-' + process.pid + '-');
+      for (let i = 0; i < value; i++) {
+        fs.watchFile(prefix + i, { interval: 3600000 }, () => {});
+        cleanup.push(fs.unwatchFile.bind(null, prefix + i));
+      }
+      // The first stat of each file is queued ahead of this one
+      return fs.stat(prefix + value, () => callback());
+    }
+    case 'tcp':
+    case 'pipes': {
+      // Each connection has a client and a server side handle
+      const server = net.createServer((socket) => cleanup.push(() => socket.destroy()));
+      const address = dimension === 'tcp' ? 0 :
+        process.platform === 'win32' ?
+          '\\\\.\\pipe\\node-report-bench-' + process.pid :
+          path.join(os.tmpdir(), 'node-report-bench-' + process.pid + '.sock');
+      cleanup.push(() => server.close());
+      server.listen(address, () => {
+        const target = dimension === 'tcp' ? { port: server.address().port } :
+                                             { path: address };
+        let connected = 0;
+        if (value === 0) return callback();
+        for (let i = 0; i < value; i++) {
+          const socket = net.connect(target, () => {
+            if (++connected === value) setImmediate(callback);
+          });
+          cleanup.push(() => socket.destroy());
+        }
+      });
+      return;
+    }
+    case 'heapMB': {
+      // Retain roughly the requested amount of JavaScript heap
+      const retained = [];
+      for (let i = 0; i < value * 1024; i++) {
+        retained.push(new Array(128).fill(i));
+      }
+      cleanup.push(() => retained.length);  // keep the arrays reachable
+      return callback();
+    }
+    default:
+      // stackDepth is applied around the measurement, libraries and environment
+      // by the parent
+      return callback();
+  }
+}
+
+function runChild(dimension, value, iterations, format) {
+  const nodereport = require('../api');
+  const directory = fs.mkdtempSync(path.join(os.tmpdir(), 'node-report-bench-'));
+  nodereport.setFormat(format);
+  nodereport.setDirectory(directory);
+
+  const cleanup = [];
+  setup(dimension, value, cleanup, () => {
+    const depth = dimension === 'stackDepth' ? value : 0;
+    const rssBefore = process.memoryUsage().rss;
+    const results = withStackDepth(depth, () => {
+      return APIS.map((api) => measure(nodereport, api, iterations, directory));
+    });
+    cleanup.forEach((fn) => fn());
+    fs.rmdirSync(directory);
+    process.stdout.write(JSON.stringify({
+      rssBeforeBytes: rssBefore,
+      maxRssBytes: maxRss(),
+      results: results,
+    }));
+    process.exit(0);
+  });
+}
+
+/*
+ * Parent process: run one child per dimension value and collect the results.
+ */
+const PRELOAD = { linux: 'LD_PRELOAD', darwin: 'DYLD_INSERT_LIBRARIES' };
+
+// Build benchmark/library.c, then preload copies of it into the child, each
+// loaded as a separate library. Returns the copies, or an error message.
+function preloadLibraries(env, count, directory) {
+  if (!PRELOAD[process.platform]) {
+    return 'Unsupported on ' + process.platform;
+  }
+  const library = path.join(directory, 'library.so');
+  if (!fs.existsSync(library)) {
+    const cc = child_process.spawnSync(process.env.CC || 'cc',
+                                       ['-shared', '-fPIC', '-o', library,
+                                        path.join(__dirname, 'library.c')]);
+    if (cc.error || cc.status !== 0) {
+      return 'Unable to build the benchmark library, no C compiler';
+    }
+  }
+  const copies = [];
+  for (let i = 0; i < count; i++) {
+    const copy = path.join(directory, 'library-' + i + '.so');
+    fs.writeFileSync(copy, fs.readFileSync(library));
+    copies.push(copy);
+  }
+  const variable = PRELOAD[process.platform];
+  env[variable] = copies.concat(env[variable] ? [env[variable]] : []).join(':');
+  return copies;
+}
+
+function runBenchmarks(options) {
+  const dimensions = options.dimension ? [options.dimension] : Object.keys(DIMENSIONS);
+  const output = {
+    nodeVersion: process.version,
+    platform: process.platform,
+    arch: process.arch,
+    cpus: os.cpus().length,
+    format: options.format,
+    iterations: options.iterations,
+    results: [],
+  };
+  const directory = fs.mkdtempSync(path.join(os.tmpdir(), 'node-report-bench-'));
+  dimensions.forEach((dimension) => {
+    DIMENSIONS[dimension].forEach((value) => {
+      const env = Object.assign({}, process.env);
+      const result = { dimension: dimension, value: value };
+      if (dimension === 'environment') {
+        for (let i = 0; i < value; i++) {
+          env['NODEREPORT_BENCH_' + i] = new Array(65).join('x');
+        }
+      }
+      let libraries = [];
+      if (dimension === 'libraries' && value !== 0) {
+        libraries = preloadLibraries(env, value, directory);
+        if (typeof libraries === 'string') {
+          result.error = libraries;
+          output.results.push(result);
+          console.error(dimension + '=' + value + ': ' + result.error);
+          return;
+        }
+      }
+      const args = [__filename, 'child', dimension, String(value),
+                    String(options.iterations), options.format];
+      if (dimension === 'stackDepth') {
+        args.unshift('--stack-size=8192');
+      }
+      const child = child_process.spawnSync(process.execPath, args,
+                                            { env: env, maxBuffer: 16 * 1024 * 1024 });
+      libraries.forEach((copy) => fs.unlinkSync(copy));
+      if (child.status !== 0) {
+        result.error = (child.stderr || '').toString().trim() || 'exit code ' + child.status;
+      } else {
+        Object.assign(result, JSON.parse(child.stdout.toString()));
+      }
+      output.results.push(result);
+      console.error(dimension + '=' + value + (result.error ? ': ' + result.error : ''));
+    });
+  });
+  fs.readdirSync(directory).forEach((file) => fs.unlinkSync(path.join(directory, file)));
+  fs.rmdirSync(directory);
+  const json = JSON.stringify(output, null, 2) + '\n';
+  if (options.output) {
+    fs.writeFileSync(options.output, json);
+  } else {
+    process.stdout.write(json);
+  }
+}
+
+if (process.argv[2] === 'child') {
+  runChild(process.argv[3], parseInt(process.argv[4], 10),
+           parseInt(process.argv[5], 10), process.argv[6]);
+} else {
+  runBenchmarks(parseArgs(process.argv.slice(2)));
+}
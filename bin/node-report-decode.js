@@ -0,0 +1,902 @@
+#!/usr/bin/env node
+'use strict';
+
+// Decoder for node-report binary format reports (.nrb files). Converts the
+// binary encoding written by BinaryWriter (see src/report_writer.h) back to
+// the text report layout, or to the JSON report layout with --json. Gzip
+// compressed reports (.nrb.gz files) are decompressed first.
+//
+// Usage: node-report-decode [--json] <report.nrb>
+
+const fs = require('fs');
+const zlib = require('zlib');
+
+// Value tags, see BinaryWriter::Tag
+const kObjectStart = 0x01;
+const kObjectEnd = 0x02;
+const kArrayStart = 0x03;
+const kArrayEnd = 0x04;
+const kString = 0x05;
+const kTrue = 0x06;
+const kFalse = 0x07;
+const kNull = 0x08;
+const kDouble = 0x09;
+const kInt = 0x0a;
+const kUint = 0x0b;
+
+const MAGIC = 'NRB';
+const VERSION = 1;
+
+function decode(buffer) {
+  if (buffer.length < 4 || buffer.toString('latin1', 0, 3) !== MAGIC) {
+    throw new Error('Not a node-report binary report');
+  }
+  if (buffer[3] !== VERSION) {
+    throw new Error('Unsupported node-report binary report version ' +
+                    buffer[3]);
+  }
+  let pos = 4;
+  const strings = [];
+
+  function varint() {
+    let value = 0;
+    let scale = 1;
+    let byte;
+    do {
+      if (pos >= buffer.length) {
+        throw new Error('Truncated node-report binary report');
+      }
+      byte = buffer[pos++];
+      value += (byte & 0x7f) * scale;
+      scale *= 128;
+    } while (byte & 0x80);
+    return value;
+  }
+
+  function stringRef() {
+    const ref = varint();
+    if (ref >= 2) {
+      return strings[ref - 2];
+    }
+    const length = varint();
+    if (pos + length > buffer.length) {
+      throw new Error('Truncated node-report binary report');
+    }
+    const value = buffer.toString('utf8', pos, pos + length);
+    pos += length;
+    if (ref === 1) {
+      strings.push(value);
+    }
+    return value;
+  }
+
+  // Reads the value following a tag. Returns undefined for the end tags.
+  function value(tag) {
+    switch (tag) {
+      case kObjectStart: {
+        const object = {};
+        for (;;) {
+          const member = buffer[pos++];
+          if (member === kObjectEnd) return object;
+          const key = stringRef();
+          object[key] = value(member);
+        }
+      }
+      case kArrayStart: {
+        const array = [];
+        for (;;) {
+          const element = buffer[pos++];
+          if (element === kArrayEnd) return array;
+          array.push(value(element));
+        }
+      }
+      case kString: return stringRef();
+      case kTrue: return true;
+      case kFalse: return false;
+      case kNull: return null;
+      case kDouble: {
+        const result = buffer.readDoubleLE(pos);
+        pos += 8;
+        return result;
+      }
+      case kInt: {
+        const zigzag = varint();
+        return zigzag % 2 ? -(zigzag + 1) / 2 : zigzag / 2;
+      }
+      case kUint: return varint();
+      default:
+        throw new Error('Invalid tag ' + tag + ' at offset ' + (pos - 1));
+    }
+  }
+
+  return value(buffer[pos++]);
+}
+
+// Text layout helpers, matching the formatting in src/node_report.cc
+const RULE = '================================================================================';
+
+function heading(title) {
+  const text = '==== ' + title + ' ';
+  return text + RULE.slice(text.length) + '\n';
+}
+
+function banner(title) {
+  return '\n' + RULE + '\n' + heading(title);
+}
+
+function pad(value, width, right) {
+  value = String(value);
+  while (value.length < width) {
+    value = right ? ' ' + value : value + ' ';
+  }
+  return value;
+}
+
+function integer(value) {
+  return String(value).replace(/\B(?=(\d{3})+(?!\d))/g, ',');
+}
+
+function seconds(value) {
+  return value.toFixed(6);
+}
+
+function change(value) {
+  return (value < 0 ? '-' : '+') + integer(Math.abs(value));
+}
+
+function percent(value) {
+  // Default ostream formatting, 6 significant digits
+  return String(Number(value.toPrecision(6)));
+}
+
+function versionText(header) {
+  let text = '\n';
+  if (!header.nodejsVersion) {
+    text += 'Unable to determine Node.js version\n';
+  } else {
+    text += 'Node.js version: ' + header.nodejsVersion + '\n';
+  }
+  const components = Object.keys(header.componentVersions || {});
+  if (header.nodejsVersion || components.length) {
+    let line = '(';
+    let wrap = 0;
+    components.forEach((name) => {
+      const entry = name + ': ' + header.componentVersions[name];
+      if (wrap === 0) {
+        wrap = entry.length;
+      } else {
+        wrap += entry.length + 2;
+        if (wrap > 80) {
+          line += ',\n ';
+          wrap = entry.length;
+        } else {
+          line += ', ';
+        }
+      }
+      line += entry;
+    });
+    text += line + ')\n';
+  }
+  text += '\nnode-report version: ' + header.nodereportVersion +
+          ' (built against Node.js ' + header.builtAgainstNodejsVersion;
+  if (header.glibcVersionCompiler) {
+    text += ', glibc ' + header.glibcVersionCompiler;
+  }
+  text += ', ' + header.wordSize + ' bit)\n';
+  if (header.osVersion) {
+    text += '\nOS version: ' + header.osVersion + '\n';
+  }
+  if (header.product) {
+    text += '\nProduct ' + header.product + '\n';
+  }
+  if (header.glibcVersionRuntime) {
+    text += '(glibc: ' + header.glibcVersionRuntime + ')\n';
+  }
+  if (header.machine) {
+    text += '\nMachine: ' + header.machine + '\n';
+  }
+  return text;
+}
+
+function nativeStackText(frames) {
+  if (frames.length === 0) {
+    return 'No frames to print\n';
+  }
+  return frames.map((frame, i) => {
+    if (frame.pc === undefined) {
+      return frame.symbol + '\n';  // z/OS backtrace_symbols() output
+    }
+    let line = pad(i, 2, true) + ': [pc=' + frame.pc + '] ';
+    if (frame.symbol !== undefined) {
+      line += frame.symbol;
+      if (frame.offset !== undefined) {
+        line += ' [+' + frame.offset + ']';
+      }
+      if (frame.file !== undefined) {
+        line += ' in ' + frame.file + ': line: ' + frame.line;
+      }
+      if (frame.library) {
+        line += ' [' + frame.library + ']';
+      }
+    }
+    return line + '\n';
+  }).join('');
+}
+
+function heapText(heap) {
+  let text = banner('JavaScript Heap and Garbage Collector');
+  Object.keys(heap.heapSpaces).forEach((name) => {
+    const space = heap.heapSpaces[name];
+    text += '\nHeap space name: ' + name +
+            '\n    Memory size: ' + integer(space.memorySize) +
+            ' bytes, committed memory: ' + integer(space.committedMemory) +
+            ' bytes\n    Capacity: ' + integer(space.capacity) +
+            ' bytes, used: ' + integer(space.used) +
+            ' bytes, available: ' + integer(space.available) + ' bytes';
+  });
+  text += '\n\nTotal heap memory size: ' + integer(heap.totalMemory) +
+          ' bytes\nTotal heap committed memory: ' +
+          integer(heap.totalCommittedMemory) +
+          ' bytes\nTotal used heap memory: ' + integer(heap.usedMemory) +
+          ' bytes\nTotal available heap memory: ' +
+          integer(heap.availableMemory) +
+          ' bytes\n\nHeap memory limit: ' + integer(heap.memoryLimit) + '\n';
+  if (heap.garbageCollection) {
+    text += gcText(heap.garbageCollection);
+  }
+  return text;
+}
+
+function heapChangesText(heap) {
+  let text = banner('JavaScript Heap and Garbage Collector');
+  const names = Object.keys(heap.heapSpaces);
+  names.forEach((name) => {
+    const space = heap.heapSpaces[name];
+    text += '\nHeap space name: ' + name +
+            '\n    Memory size: ' + integer(space.memorySize.value) +
+            ' bytes (' + change(space.memorySize.change) +
+            '), used: ' + integer(space.used.value) +
+            ' bytes (' + change(space.used.change) + ')';
+  });
+  if (names.length === 0) {
+    text += '\nNo heap space changes since the base report';
+  }
+  const total = (label, value) => {
+    return label + integer(value.value) + ' bytes (' + change(value.change) + ')';
+  };
+  text += '\n\n' + total('Total heap memory size: ', heap.totalMemory) +
+          '\n' + total('Total heap committed memory: ', heap.totalCommittedMemory) +
+          '\n' + total('Total used heap memory: ', heap.usedMemory) +
+          '\n' + total('Total available heap memory: ', heap.availableMemory) + '\n';
+  if (heap.memoryLimit.change !== 0) {
+    text += '\nHeap memory limit: ' + integer(heap.memoryLimit.value) +
+            ' (' + change(heap.memoryLimit.change) + ')\n';
+  }
+  text += '\nGarbage collections since the base report: ' +
+          heap.collectionsSinceBase + ', total pause ' +
+          heap.pauseSinceBase.toFixed(3) + ' ms\n';
+  return text + gcText(heap.garbageCollection);
+}
+
+function gcText(gc) {
+  let text = '\nGarbage collections: ' + gc.collections + ', total pause ' +
+             gc.totalPause.toFixed(3) + ' ms\n';
+  if (gc.recent.length === 0) {
+    return text;
+  }
+  text += '\nRecent garbage collections: ' + gc.recent.length +
+          ', total pause ' + gc.recentTotalPause.toFixed(3) +
+          ' ms, max pause ' + gc.recentMaxPause.toFixed(3) +
+          ' ms, 99th percentile ' + gc.recentP99Pause.toFixed(3) + ' ms\n' +
+          '  ' + pad('Ago (ms)', 12, true) + '  ' + pad('Type', 20) + ' ' +
+          pad('Pause (ms)', 10, true) + ' ' + pad('Used before', 16, true) +
+          ' ' + pad('Used after', 16, true) + '\n';
+  gc.recent.forEach((collection) => {
+    text += '  ' + pad(collection.ago.toFixed(3), 12, true) + '  ' +
+            pad(collection.type, 20) + ' ' +
+            pad(collection.pause.toFixed(3), 10, true) + ' ' +
+            pad(integer(collection.usedBefore), 16, true) + ' ' +
+            pad(integer(collection.usedAfter), 16, true) + '\n';
+  });
+  return text;
+}
+
+function usageText(report) {
+  let text = banner('Resource Usage');
+  const usage = report.resourceUsage;
+  text += '\nProcess total resource usage:';
+  if (usage) {
+    text += '\n  User mode CPU: ' + seconds(usage.userCpuSeconds) + ' secs' +
+            '\n  Kernel mode CPU: ' + seconds(usage.kernelCpuSeconds) + ' secs' +
+            '\n  Average CPU Consumption : ' +
+            percent(usage.cpuConsumptionPercent) + '%' +
+            '\n  Maximum resident set size: ';
+    if (usage.maxRss !== undefined) {
+      text += integer(usage.maxRss) + ' bytes\n  Page faults: ' +
+              usage.pageFaults.IORequired + ' (I/O required) ' +
+              usage.pageFaults.IONotRequired + ' (no I/O required)' +
+              '\n  Filesystem activity: ' + usage.fsActivity.reads +
+              ' reads ' + usage.fsActivity.writes + ' writes';
+    }
+  }
+  const thread = report.eventLoopThreadResourceUsage;
+  if (thread) {
+    text += '\n\nEvent loop thread resource usage:' +
+            '\n  User mode CPU: ' + seconds(thread.userCpuSeconds) + ' secs' +
+            '\n  Kernel mode CPU: ' + seconds(thread.kernelCpuSeconds) + ' secs' +
+            '\n  Average CPU Consumption : ' +
+            percent(thread.cpuConsumptionPercent) + '%';
+    if (thread.fsActivity) {
+      text += '\n  Filesystem activity: ' + thread.fsActivity.reads +
+              ' reads ' + thread.fsActivity.writes + ' writes';
+    }
+  }
+  text += '\n';
+  if (report.threadCpuUsage) {
+    text += threadCpuText(report.threadCpuUsage);
+  }
+  return text;
+}
+
+function usageChangesText(report) {
+  let text = banner('Resource Usage');
+  const usage = report.resourceUsageChanges;
+  text += '\nProcess resource usage since the base report';
+  if (usage) {
+    text += ', ' + usage.intervalSeconds.toFixed(3) + ' secs ago:' +
+            '\n  User mode CPU: ' + seconds(usage.userCpuSeconds) + ' secs' +
+            '\n  Kernel mode CPU: ' + seconds(usage.kernelCpuSeconds) + ' secs' +
+            '\n  Average CPU Consumption : ' +
+            percent(usage.cpuConsumptionPercent) + '%';
+    if (usage.maxRss !== undefined) {
+      text += '\n  Maximum resident set size: ' + integer(usage.maxRss.value) +
+              ' bytes (' + change(usage.maxRss.change) + ')\n  Page faults: ' +
+              usage.pageFaults.IORequired + ' (I/O required) ' +
+              usage.pageFaults.IONotRequired + ' (no I/O required)' +
+              '\n  Filesystem activity: ' + usage.fsActivity.reads +
+              ' reads ' + usage.fsActivity.writes + ' writes';
+    }
+  } else {
+    text += ':';
+  }
+  const thread = report.eventLoopThreadResourceUsageChanges;
+  if (thread) {
+    text += '\n\nEvent loop thread resource usage since the base report:' +
+            '\n  User mode CPU: ' + seconds(thread.userCpuSeconds) + ' secs' +
+            '\n  Kernel mode CPU: ' + seconds(thread.kernelCpuSeconds) + ' secs' +
+            '\n  Average CPU Consumption : ' +
+            percent(thread.cpuConsumptionPercent) + '%';
+    if (thread.fsActivity) {
+      text += '\n  Filesystem activity: ' + thread.fsActivity.reads +
+              ' reads ' + thread.fsActivity.writes + ' writes';
+    }
+  }
+  text += '\n';
+  if (report.threadCpuUsage) {
+    text += threadCpuText(report.threadCpuUsage);
+  }
+  return text;
+}
+
+function threadCpuText(threads) {
+  let text = '\nThread CPU usage, ' + threads.length +
+             ' threads (CPU% is since the previous report):\n' +
+             pad('TID', 9, true) + '  ' + pad('Name', 17) + pad('State', 7) +
+             pad('User CPU', 12, true) + pad('Kernel CPU', 12, true) + pad('CPU%', 8, true) +
+             pad('Last CPU', 10, true) + pad('Voluntary', 12, true) +
+             pad('Involuntary', 13, true) + '  Role\n';
+  threads.forEach((thread) => {
+    const switches = thread.voluntaryContextSwitches !== undefined;
+    text += pad(thread.tid, 9, true) + '  ' + pad(thread.name, 17) + pad(thread.state, 7) +
+            pad(thread.userCpuSeconds.toFixed(2), 12, true) +
+            pad(thread.kernelCpuSeconds.toFixed(2), 12, true) +
+            pad(thread.cpuConsumptionPercent !== undefined
+              ? thread.cpuConsumptionPercent.toFixed(1) : '-', 8, true) +
+            pad(thread.lastCpu, 10, true) +
+            pad(switches ? thread.voluntaryContextSwitches : '-', 12, true) +
+            pad(switches ? thread.involuntaryContextSwitches : '-', 13, true) +
+            (thread.role ? '  ' + thread.role : '') + '\n';
+  });
+  return text;
+}
+
+function memoryMapText(map) {
+  let text = banner('Memory Map');
+  text += '\nTotals from /proc/self/' + map.source + ':' +
+          '\n  Mapped: ' + integer(map.totals.mapped) +
+          ' bytes\n  Resident set size (Rss): ' + integer(map.totals.rss) +
+          ' bytes\n  Proportional set size (Pss): ' + integer(map.totals.pss) +
+          ' bytes\n  Anonymous: ' + integer(map.totals.anonymous) +
+          ' bytes\n  Swap: ' + integer(map.totals.swap) +
+          ' bytes\n  Transparent huge pages: ' + integer(map.totals.transparentHugePages) +
+          ' bytes\n\nMappings: ' + map.mappings + ', grouped into ' + map.objects +
+          ' objects\n';
+  text += '\nLargest objects by Rss (bytes):\n' +
+          pad('Rss', 16, true) + pad('Pss', 16, true) + pad('Anonymous', 16, true) +
+          pad('Swap', 16, true) + pad('Maps', 8, true) + '  Object\n';
+  map.largestObjects.forEach((object) => {
+    text += pad(integer(object.rss), 16, true) + pad(integer(object.pss), 16, true) +
+            pad(integer(object.anonymous), 16, true) + pad(integer(object.swap), 16, true) +
+            pad(object.mappings, 8, true) + '  ' + object.name +
+            (object.loadedLibrary ? ' (loaded library)' : '') + '\n';
+  });
+  return text;
+}
+
+function endpoint(address) {
+  return address.host + ':' + address.port;
+}
+
+function handleText(handle) {
+  let data = '';
+  switch (handle.type) {
+    case 'fs_event':
+    case 'fs_poll':
+      if (handle.filename !== undefined) data += 'filename: ' + handle.filename;
+      break;
+    case 'process':
+      data += 'pid: ' + handle.pid;
+      break;
+    case 'tcp':
+    case 'udp':
+      if (handle.localEndpoint) {
+        data += endpoint(handle.localEndpoint);
+        if (handle.remoteEndpoint) {
+          data += ' connected to ' + endpoint(handle.remoteEndpoint);
+        } else if (handle.connected === false) {
+          data += ' (not connected)';
+        }
+      }
+      break;
+    case 'timer':
+      data += 'repeat: ' + handle.repeat;
+      if (handle.timeoutIn !== undefined) {
+        data += ', timeout in: ' + handle.timeoutIn + ' ms';
+      } else {
+        data += ', timeout expired: ' + handle.expiredAgo + ' ms ago';
+      }
+      break;
+    case 'tty':
+      if (handle.width !== undefined) {
+        data += 'width: ' + handle.width + ', height: ' + handle.height;
+      }
+      break;
+    case 'signal':
+      data += 'signum: ' + handle.signum + ' (' + handle.signal + ')';
+      break;
+  }
+  if (handle.sendBufferSize !== undefined) {
+    if (handle.type === 'tcp' || handle.type === 'udp') data += ', ';
+    data += 'send buffer size: ' + handle.sendBufferSize +
+            ', recv buffer size: ' + handle.recvBufferSize;
+  }
+  if (handle.fd !== undefined) {
+    const names = ['stdin', 'stdout', 'stderr'];
+    data += ', ' + (names[handle.fd] || 'file descriptor: ' + handle.fd);
+  }
+  if (handle.writeQueueSize !== undefined) {
+    data += ', write queue size: ' + handle.writeQueueSize +
+            (handle.readable ? ', readable' : '') +
+            (handle.writable ? ', writable' : '');
+  }
+  const tcp = handle.tcpInfo;
+  if (tcp && tcp.acceptQueue !== undefined) {
+    data += ', accept queue: ' + tcp.acceptQueue + ' of ' + tcp.acceptBacklog;
+  } else if (tcp) {
+    data += ', rtt: ' + tcp.rtt.toFixed(3) + ' ms (variation ' +
+            tcp.rttVariation.toFixed(3) + ' ms), retransmits: ' + tcp.retransmits +
+            ', cwnd: ' + tcp.congestionWindow + ', unacked: ' + tcp.unacked +
+            ', bytes in flight: ' + tcp.bytesInFlight;
+  }
+  return '[' + (handle.ref ? 'R' : '-') + (handle.active ? 'A' : '-') + ']   ' +
+         pad(handle.type, 10) + handle.address + '  ' + data + '\n';
+}
+
+function handleTableText(handles, wordSize) {
+  const addressWidth = 4 + 2 * (wordSize / 8);
+  let text = pad('Flags', 7) + pad('Type', 10) + pad('Address', addressWidth) +
+             'Details\n';
+  handles.forEach((handle) => { text += handleText(handle); });
+  return text;
+}
+
+function tcpSummaryText(tcp, wordSize) {
+  if (!tcp) {
+    return '';
+  }
+  let text = '\nTCP connections: ' + integer(tcp.connections) +
+             '\n\nRound trip times (microseconds):\n' +
+             pad('From', 10, true) + pad('To', 10, true) + pad('Connections', 13, true) + '\n';
+  // The JSON histogram omits empty buckets, the text shows the range of
+  // buckets with connections in them
+  const histogram = tcp.rttHistogram;
+  const last = histogram[histogram.length - 1].from;
+  for (let from = histogram[0].from; from <= last; from = from === 0 ? 2 : from * 2) {
+    const bucket = histogram.find((entry) => entry.from === from) ||
+                   { to: from === 0 ? 2 : from * 2, connections: 0 };
+    text += pad(from, 10, true) + pad(bucket.to !== undefined ? bucket.to : '-', 10, true) +
+            pad(bucket.connections, 13, true) + '\n';
+  }
+  if (tcp.mostRetransmits.length === 0) {
+    text += '\nNo retransmits on any connection\n';
+  } else {
+    text += '\nConnections with the most retransmits:\n' +
+            handleTableText(tcp.mostRetransmits, wordSize);
+  }
+  return text;
+}
+
+function handlesText(handles, summary, tcp, wordSize) {
+  if (!summary) {
+    return handleTableText(handles, wordSize) + tcpSummaryText(tcp, wordSize);
+  }
+  let text = 'Handles: ' + integer(summary.count) + ', more than the handle limit of ' +
+             summary.limit + ', grouped by type, flags and remote address\n\n';
+  text += pad('Flags', 7) + pad('Type', 10) + pad('Count', 14) +
+          pad('Write queue', 14) + 'Remote address\n';
+  summary.groups.forEach((group) => {
+    text += '[' + (group.ref ? 'R' : '-') + (group.active ? 'A' : '-') + ']   ' +
+            pad(group.type, 10) + pad(integer(group.count), 14) +
+            pad(integer(group.writeQueueSize), 14) + (group.remoteAddress || '') + '\n';
+  });
+  if (summary.groupsOmitted > 0) {
+    text += '(' + summary.groupsOmitted + ' smaller groups not shown)\n';
+  }
+  if (summary.largestWriteQueues.length > 0) {
+    text += '\nLargest write queues:\n' +
+            handleTableText(summary.largestWriteQueues, wordSize);
+  }
+  text += '\nFirst ' + handles.length + ' handles:\n' + handleTableText(handles, wordSize);
+  return text + tcpSummaryText(tcp, wordSize);
+}
+
+const RLIMIT_DESCRIPTIONS = {
+  core_file_size_blocks: 'core file size (blocks)       ',
+  data_seg_size_kbytes: 'data seg size (kbytes)        ',
+  file_size_blocks: 'file size (blocks)            ',
+  max_locked_memory_bytes: 'max locked memory (bytes)     ',
+  max_memory_size_kbytes: 'max memory size (kbytes)      ',
+  open_files: 'open files                    ',
+  stack_size_bytes: 'stack size (bytes)            ',
+  cpu_time_seconds: 'cpu time (seconds)            ',
+  max_user_processes: 'max user processes            ',
+  virtual_memory_kbytes: 'virtual memory (kbytes)       ',
+};
+
+function handleChangesText(changes, wordSize) {
+  const addressWidth = 4 + 2 * (wordSize / 8);
+  let text = banner('Node.js libuv Handle Summary');
+  text += '\nHandles: ' + changes.count + ', ' + changes.added.length +
+          ' added and ' + changes.removed.length +
+          ' removed since the base report\n';
+  if (changes.added.length > 0) {
+    text += '\n(Flags: R=Ref, A=Active)\n';
+    text += pad('Flags', 7) + pad('Type', 10) + pad('Address', addressWidth) +
+            'Details\n';
+    changes.added.forEach((handle) => { text += handleText(handle); });
+  }
+  if (changes.removed.length > 0) {
+    text += '\nRemoved handles:\n';
+    changes.removed.forEach((handle) => {
+      text += '       ' + pad(handle.type, 10) + handle.address + '\n';
+    });
+  }
+  return text;
+}
+
+function fileDescriptorsText(fds) {
+  let text = banner('File Descriptors');
+  text += '\nOpen file descriptors: ' + integer(fds.open);
+  if (fds.softLimit !== undefined) {
+    text += ' of a soft limit of ' + integer(fds.softLimit);
+  }
+  text += '\nNot owned by a libuv handle or event loop: ' + integer(fds.notOwned) + '\n';
+  if (fds.classified < fds.open) {
+    text += 'Descriptors not classified, beyond the first ' + fds.classified + ': ' +
+            integer(fds.open - fds.classified) + '\n';
+  }
+  text += '\nDescriptors by type:\n' +
+          pad('Count', 10, true) + pad('Not owned', 12, true) + '  Type\n';
+  fds.types.forEach((type) => {
+    text += pad(type.count, 10, true) + pad(type.notOwned, 12, true) + '  ' + type.type + '\n';
+  });
+  if (fds.targets.length > 0) {
+    text += '\nFiles and devices with the most descriptors:\n' +
+            pad('Count', 10, true) + pad('Not owned', 12, true) + '  Path\n';
+    fds.targets.forEach((target) => {
+      text += pad(target.count, 10, true) + pad(target.notOwned, 12, true) + '  ' +
+              target.path + '\n';
+    });
+  }
+  return text;
+}
+
+function threadsText(threads, wordSize) {
+  let text = banner('Threads');
+  text += '\nReport triggered on thread ' + threads.reportThreadId +
+          ', other threads running JavaScript: ' + threads.otherThreads.length + '\n';
+  threads.otherThreads.forEach((thread) => {
+    text += '\nThread ' + thread.threadId + ' (' +
+            (thread.mainThread ? 'main thread' : 'worker thread');
+    if (thread.osThreadId !== undefined) {
+      text += ', OS thread id ' + thread.osThreadId;
+    }
+    text += ')\n';
+    if (!thread.captured) {
+      text += '  Not captured, the thread did not respond in time\n';
+      return;
+    }
+    if (thread.javascriptStack) {
+      text += '\nJavaScript stack:\n';
+      thread.javascriptStack.forEach((line) => { text += line + '\n'; });
+    }
+    if (thread.javascriptHeap) {
+      const heap = thread.javascriptHeap;
+      text += '\nHeap memory: total ' + integer(heap.totalMemory) +
+              ' bytes, used ' + integer(heap.usedMemory) +
+              ' bytes, available ' + integer(heap.availableMemory) +
+              ' bytes, limit ' + integer(heap.memoryLimit) + ' bytes\n';
+    }
+    if (thread.libuvHandles) {
+      text += '\nHandles:\n' +
+              handlesText(thread.libuvHandles, thread.libuvHandleSummary, thread.tcpSummary,
+                          wordSize);
+    }
+  });
+  return text;
+}
+
+function limitText(name, limit) {
+  const description = RLIMIT_DESCRIPTIONS[name] || pad(name, 30);
+  if (typeof limit === 'string') {
+    return '  ' + description + '  ' + limit + '\n';
+  }
+  return '  ' + description + ' ' + pad(limit.soft, 16, true) +
+         pad(limit.hard, 16, true) + '\n';
+}
+
+const NO_CHANGES = '  No changes since the base report\n';
+
+function systemText(report) {
+  let text = banner('System Information');
+  const env = report.environmentVariables;
+  if (env) {
+    text += '\nEnvironment variables\n';
+    Object.keys(env).forEach((name) => {
+      text += '  ' + name + '=' + env[name] + '\n';
+    });
+  }
+  const envChanges = report.environmentVariableChanges;
+  if (envChanges) {
+    text += '\nEnvironment variable changes\n';
+    const names = Object.keys(envChanges.set);
+    names.forEach((name) => {
+      text += '  + ' + name + '=' + envChanges.set[name] + '\n';
+    });
+    envChanges.removed.forEach((name) => { text += '  - ' + name + '\n'; });
+    if (names.length === 0 && envChanges.removed.length === 0) {
+      text += NO_CHANGES;
+    }
+  }
+  const limits = report.userLimits;
+  if (limits) {
+    text += '\nResource limits                        soft limit      hard limit\n';
+    Object.keys(limits).forEach((name) => {
+      text += limitText(name, limits[name]);
+    });
+  }
+  const limitChanges = report.userLimitChanges;
+  if (limitChanges) {
+    text += '\nResource limit changes                 soft limit      hard limit\n';
+    const names = Object.keys(limitChanges);
+    names.forEach((name) => { text += limitText(name, limitChanges[name]); });
+    if (names.length === 0) {
+      text += NO_CHANGES;
+    }
+  }
+  if (report.sharedObjects) {
+    text += '\nLoaded libraries\n';
+    report.sharedObjects.forEach((library) => {
+      text += '  ' + library + '\n';
+    });
+  }
+  const libraryChanges = report.sharedObjectChanges;
+  if (libraryChanges) {
+    text += '\nLoaded library changes\n';
+    libraryChanges.added.forEach((library) => { text += '  + ' + library + '\n'; });
+    libraryChanges.removed.forEach((library) => { text += '  - ' + library + '\n'; });
+    if (libraryChanges.added.length === 0 && libraryChanges.removed.length === 0) {
+      text += NO_CHANGES;
+    }
+  }
+  return text;
+}
+
+function samplesText(samples) {
+  let text = banner('Recent Stack Samples');
+  text += '\nSampling interval: ' + samples.interval + ' ms, ' + samples.samples +
+          ' samples over ' + (samples.duration / 1e3).toFixed(3) + ' s, ' +
+          samples.skipped + ' skipped while JavaScript was not running\n';
+  if (samples.samples === 0) {
+    return text;
+  }
+  text += '\nTop functions (samples):\n';
+  text += pad('Self', 8, true) + pad('Total', 8, true) + '  Function\n';
+  samples.topFunctions.forEach((fn) => {
+    text += pad(fn.self, 8, true) + pad(fn.total, 8, true) + '  ' + fn.name + '\n';
+  });
+  text += '\nFolded stacks:\n';
+  samples.foldedStacks.forEach((stack) => { text += stack + '\n'; });
+  return text;
+}
+
+function threadpoolText(pool) {
+  let text = banner('libuv Threadpool');
+  text += '\nThreadpool size: ' + pool.threadpoolSize +
+          (pool.uvThreadpoolSize !== undefined
+            ? ' (UV_THREADPOOL_SIZE=' + pool.uvThreadpoolSize + ')\n'
+            : ' (UV_THREADPOOL_SIZE not set)\n') +
+          'Probe interval: ' + pool.probeInterval + ' ms, ' + pool.probes +
+          ' probes over ' + (pool.duration / 1e3).toFixed(3) + ' s\n';
+  if (pool.probes !== 0) {
+    text += 'Queue-to-start latency: last ' + pool.lastLatency.toFixed(3) +
+            ' ms, mean ' + pool.meanLatency.toFixed(3) + ' ms, max ' +
+            pool.maxLatency.toFixed(3) + ' ms\n';
+  }
+  if (pool.waitingLatency !== undefined) {
+    text += 'Probe waiting for a thread for ' + pool.waitingLatency.toFixed(3) + ' ms\n';
+  }
+  if (pool.probes === 0) {
+    return text;
+  }
+  // The JSON histogram omits empty buckets, the text shows the range of
+  // buckets with probes in them
+  text += '\nQueue-to-start latency histogram (microseconds):\n' +
+          pad('From', 10, true) + pad('To', 10, true) + pad('Probes', 10, true) + '\n';
+  const histogram = pool.latencyHistogram;
+  const last = histogram[histogram.length - 1].from;
+  for (let from = histogram[0].from; from <= last; from = from === 0 ? 2 : from * 2) {
+    const bucket = histogram.find((entry) => entry.from === from) ||
+                   { to: from === 0 ? 2 : from * 2, probes: 0 };
+    text += pad(from, 10, true) + pad(bucket.to !== undefined ? bucket.to : '-', 10, true) +
+            pad(bucket.probes, 10, true) + '\n';
+  }
+  return text;
+}
+
+function timingsText(timings) {
+  let text = banner('Report Timings');
+  text += '\nSection                               time (ms)\n';
+  Object.keys(timings.sections).forEach((name) => {
+    text += '  ' + pad(name, 30) + ' ' +
+            pad(timings.sections[name].toFixed(3), 14, true) + '\n';
+  });
+  text += '\nEvent loop blocked time (ms)   ' +
+          pad(timings.loopBlocked.toFixed(3), 16, true) + '\n';
+  text += 'Total report time (ms)         ' +
+          pad(timings.total.toFixed(3), 16, true) + '\n';
+  return text;
+}
+
+function render(report) {
+  const header = report.header;
+  let text = RULE + '\n' + heading('Node Report');
+  text += '\nEvent: ' + header.event + ', location: "' + header.location + '"\n';
+  if (header.filename !== undefined) {
+    text += 'Filename: ' + header.filename + '\n';
+  }
+  if (header.suppressedReports !== undefined) {
+    text += 'Reports suppressed: ' +
+            Object.keys(header.suppressedReports).map((event) => {
+              return event + ' ' + header.suppressedReports[event];
+            }).join(', ') + '\n';
+  }
+  text += 'Dump event time:  ' + header.dumpEventTime + '\n' +
+          'Module load time: ' + header.moduleLoadTime + '\n' +
+          'Process ID: ' + header.processId + '\n';
+  if (header.deltaFrom !== undefined) {
+    // Delta reports leave out what is in the base report, see setDelta()
+    text += 'Delta from: ' + header.deltaFrom + '\n';
+  } else {
+    if (header.commandLine !== undefined) {
+      text += 'Command line: ' + header.commandLine + '\n';
+    }
+    text += versionText(header);
+  }
+
+  // Sections may be omitted, see setSections()
+  if (report.javascriptStack) {
+    text += banner('JavaScript Stack Trace') + '\n';
+    report.javascriptStack.forEach((line) => { text += line + '\n'; });
+  }
+
+  if (report.nativeStack) {
+    text += banner('Native Stack Trace') + '\n';
+    text += nativeStackText(report.nativeStack);
+    const cache = report.nativeSymbolCache;
+    if (cache && report.nativeStack.length > 0) {
+      text += '\nSymbol cache: ' + cache.hits + ' hits, ' + cache.misses +
+              ' misses, ' + cache.entries + ' entries\n';
+    }
+  }
+
+  if (report.javascriptException) {
+    text += banner('JavaScript Exception Details') + '\n';
+    report.javascriptException.forEach((line) => { text += line + '\n'; });
+  }
+
+  if (report.stackSamples) {
+    text += samplesText(report.stackSamples);
+  }
+
+  if (report.javascriptHeap) {
+    text += heapText(report.javascriptHeap);
+  }
+  if (report.javascriptHeapChanges) {
+    text += heapChangesText(report.javascriptHeapChanges);
+  }
+  if (report.resourceUsage || report.eventLoopThreadResourceUsage) {
+    text += usageText(report);
+  }
+  if (report.resourceUsageChanges || report.eventLoopThreadResourceUsageChanges) {
+    text += usageChangesText(report);
+  }
+  if (report.memoryMap) {
+    text += memoryMapText(report.memoryMap);
+  }
+  if (report.libuvThreadpool) {
+    text += threadpoolText(report.libuvThreadpool);
+  }
+
+  if (report.libuvHandles) {
+    text += banner('Node.js libuv Handle Summary');
+    text += '\n(Flags: R=Ref, A=Active)\n';
+    text += handlesText(report.libuvHandles, report.libuvHandleSummary, report.tcpSummary,
+                        header.wordSize);
+  }
+  if (report.libuvHandleChanges) {
+    text += handleChangesText(report.libuvHandleChanges, header.wordSize);
+  }
+  if (report.threads) {
+    text += threadsText(report.threads, header.wordSize);
+  }
+  if (report.fileDescriptors) {
+    text += fileDescriptorsText(report.fileDescriptors);
+  }
+
+  if (report.environmentVariables || report.userLimits || report.sharedObjects ||
+      report.environmentVariableChanges || report.userLimitChanges ||
+      report.sharedObjectChanges) {
+    text += systemText(report);
+  }
+  if (report.reportTimings) {
+    text += timingsText(report.reportTimings);
+  }
+  text += '\n' + RULE + '\n';
+  return text;
+}
+
+module.exports = { decode, render };
+
+if (require.main === module) {
+  const args = process.argv.slice(2);
+  const json = args[0] === '--json';
+  if (json) args.shift();
+  if (args.length !== 1) {
+    console.error('Usage: node-report-decode [--json] <report.nrb>');
+    process.exit(1);
+  }
+  let report;
+  try {
+    let buffer = fs.readFileSync(args[0]);
+    if (buffer.length >= 2 && buffer[0] === 0x1f && buffer[1] === 0x8b) {
+      buffer = zlib.gunzipSync(buffer);
+    }
+    report = decode(buffer);
+  } catch (err) {
+    console.error('node-report-decode: ' + args[0] + ': ' + err.message);
+    process.exit(1);
+  }
+  process.stdout.write(json ? JSON.stringify(report, null, 2) + '\n'
+                            : render(report));
+}
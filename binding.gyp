@@ -2,7 +2,11 @@
   "targets": [
     {
       "target_name": "api",
-      "sources": [ "src/node_report.cc", "src/module.cc", "src/utilities.cc" ],
+      "sources": [ "src/node_report.cc", "src/module.cc", "src/utilities.cc",
+                   "src/report_writer.cc", "src/elf_symbolizer.cc",
+                   "src/stack_sampler.cc", "src/gzip_stream.cc",
+                   "src/memory_map.cc", "src/thread_usage.cc",
+                   "src/threadpool_probe.cc", "src/fd_inventory.cc" ],
       "include_dirs": [ '<!(node -e "require(\'nan\')")' ],
       "conditions": [
         ["OS=='linux'", {
@@ -2,14 +2,37 @@
 
 const api = require('./api');
 
-// NODEREPORT_EVENTS env var overrides the defaults
-const options = process.env.NODEREPORT_EVENTS || 'exception+fatalerror+signal+apicall';
-api.setEvents(options);
+// NODEREPORT_EVENTS env var overrides the defaults, the options are set by
+// the main thread only
+var isMainThread = true;
+try {
+  isMainThread = require('worker_threads').isMainThread;
+} catch (e) {
+  // worker_threads is not available
+}
+if (isMainThread) {
+  const options = process.env.NODEREPORT_EVENTS || 'exception+fatalerror+signal+apicall';
+  api.setEvents(options);
+}
 
 exports.triggerReport = api.triggerReport;
 exports.getReport = api.getReport;
+exports.getReportTimings = api.getReportTimings;
 exports.setEvents = api.setEvents;
+exports.setSections = api.setSections;
 exports.setSignal = api.setSignal;
 exports.setFileName = api.setFileName;
 exports.setDirectory = api.setDirectory;
 exports.setVerbose = api.setVerbose;
+exports.setAsync = api.setAsync;
+exports.setDelta = api.setDelta;
+exports.setResolveNames = api.setResolveNames;
+exports.setHandleLimit = api.setHandleLimit;
+exports.setFormat = api.setFormat;
+exports.setCompression = api.setCompression;
+exports.setEmergencyArena = api.setEmergencyArena;
+exports.setStallThreshold = api.setStallThreshold;
+exports.setSamplingInterval = api.setSamplingInterval;
+exports.setThreadpoolProbe = api.setThreadpoolProbe;
+exports.setRateLimit = api.setRateLimit;
+exports.setRetention = api.setRetention;
@@ -0,0 +1,601 @@
+#include "elf_symbolizer.h"
+
+#ifdef NR_ELF_SYMBOLIZER
+#include <elf.h>
+#include <fcntl.h>
+#include <link.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace nodereport {
+
+// Line number tables larger than this are not indexed, to bound the memory
+// used for objects built with full debug information.
+#define NR_MAX_DEBUG_LINE_SIZE (64 * 1024 * 1024)
+
+// Symbol table entry, the name is an offset into the mapped string table
+struct ElfSymbol {
+  uintptr_t address;
+  uintptr_t size;
+  uint32_t name;
+};
+
+// Line number table row, the file is an index into ElfObject::files
+struct LineRow {
+  uintptr_t address;
+  uint32_t file;
+  uint32_t line;              // 0 for the end of a sequence
+};
+
+// A loaded object, with its lazily built symbol and line number index
+class ElfObject {
+ public:
+  ElfObject(const std::string& path, uintptr_t bias)
+      : path(path), bias(bias), indexed(false), map_(MAP_FAILED), map_size_(0),
+        strtab_(nullptr), strtab_size_(0) {}
+  ~ElfObject() {
+    if (map_ != MAP_FAILED) {
+      munmap(map_, map_size_);
+    }
+  }
+
+  bool Contains(uintptr_t pc) const;
+  void BuildIndex();
+  bool Lookup(uintptr_t pc, ElfFrameInfo* info) const;
+
+  std::string path;
+  uintptr_t bias;                                       // load address minus link address
+  std::vector<std::pair<uintptr_t, uintptr_t> > ranges; // loaded segments, runtime addresses
+  bool indexed;
+
+ private:
+  const ElfW(Shdr)* FindSection(const ElfW(Ehdr)* header, const char* name) const;
+  const char* SectionData(const ElfW(Shdr)* section) const;
+  void ReadSymbols(const ElfW(Ehdr)* header);
+  void ReadLineTable(const ElfW(Ehdr)* header);
+
+  void* map_;
+  size_t map_size_;
+  const char* strtab_;
+  size_t strtab_size_;
+  std::vector<ElfSymbol> symbols_;                      // sorted by address
+  std::vector<LineRow> lines_;                          // sorted by address
+  std::vector<std::string> files_;
+};
+
+static std::vector<std::unique_ptr<ElfObject> > objects;
+static bool objects_valid = false;
+
+/*******************************************************************************
+ * Reader for DWARF data, with bounds checking. Reads past the end of the data
+ * return zero and leave the reader in an error state.
+ ******************************************************************************/
+class DwarfReader {
+ public:
+  DwarfReader(const uint8_t* data, size_t size) : p_(data), end_(data + size), ok_(true) {}
+
+  bool ok() const { return ok_; }
+  const uint8_t* position() const { return p_; }
+  size_t remaining() const { return end_ - p_; }
+
+  void Skip(uint64_t size) {
+    if (size > remaining()) {
+      ok_ = false;
+      p_ = end_;
+    } else {
+      p_ += size;
+    }
+  }
+  uint64_t Fixed(size_t size) {
+    uint64_t value = 0;
+    if (size > remaining() || size > sizeof(value)) {
+      Skip(size);
+      return 0;
+    }
+    memcpy(&value, p_, size);  // loaded objects have the native byte order
+    p_ += size;
+    return value;
+  }
+  uint8_t U8() { return static_cast<uint8_t>(Fixed(1)); }
+  uint16_t U16() { return static_cast<uint16_t>(Fixed(2)); }
+  uint32_t U32() { return static_cast<uint32_t>(Fixed(4)); }
+  uint64_t Uleb() {
+    uint64_t value = 0;
+    for (unsigned int shift = 0; ok_; shift += 7) {
+      uint8_t byte = U8();
+      if (shift < 64) value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if (!(byte & 0x80)) break;
+    }
+    return value;
+  }
+  int64_t Sleb() {
+    int64_t value = 0;
+    unsigned int shift = 0;
+    uint8_t byte = 0x80;
+    while (ok_ && (byte & 0x80)) {
+      byte = U8();
+      if (shift < 64) value |= static_cast<int64_t>(byte & 0x7f) << shift;
+      shift += 7;
+    }
+    if (shift < 64 && (byte & 0x40)) {
+      value |= -(static_cast<int64_t>(1) << shift);
+    }
+    return value;
+  }
+  const char* String() {
+    const uint8_t* start = p_;
+    const void* nul = memchr(p_, '\0', remaining());
+    if (nul == nullptr) {
+      ok_ = false;
+      p_ = end_;
+      return "";
+    }
+    p_ = static_cast<const uint8_t*>(nul) + 1;
+    return reinterpret_cast<const char*>(start);
+  }
+
+ private:
+  const uint8_t* p_;
+  const uint8_t* end_;
+  bool ok_;
+};
+
+// String sections referenced from DWARF 5 line table headers
+struct DwarfStrings {
+  const char* str;
+  size_t str_size;
+  const char* line_str;
+  size_t line_str_size;
+};
+
+static const char* StringAt(const char* section, size_t size, uint64_t offset) {
+  if (section == nullptr || offset >= size || memchr(section + offset, '\0', size - offset) == nullptr) {
+    return "";
+  }
+  return section + offset;
+}
+
+/*******************************************************************************
+ * Function to read an attribute value from a DWARF 5 line table header entry.
+ * Returns false for forms that are not valid in a line table header.
+ ******************************************************************************/
+static bool ReadForm(DwarfReader* reader, uint64_t form, bool dwarf64,
+                     const DwarfStrings& strings, const char** string, uint64_t* value) {
+  *string = nullptr;
+  *value = 0;
+  switch (form) {
+    case 0x08: *string = reader->String(); break;                        // DW_FORM_string
+    case 0x0e:                                                           // DW_FORM_strp
+      *string = StringAt(strings.str, strings.str_size, reader->Fixed(dwarf64 ? 8 : 4));
+      break;
+    case 0x1f:                                                           // DW_FORM_line_strp
+      *string = StringAt(strings.line_str, strings.line_str_size, reader->Fixed(dwarf64 ? 8 : 4));
+      break;
+    case 0x1a: reader->Uleb(); *string = ""; break;                      // DW_FORM_strx
+    case 0x25: case 0x26: case 0x27: case 0x28:                         // DW_FORM_strx1-4
+      reader->Skip(form - 0x24);
+      *string = "";
+      break;
+    case 0x0b: *value = reader->U8(); break;                             // DW_FORM_data1
+    case 0x05: *value = reader->U16(); break;                            // DW_FORM_data2
+    case 0x06: *value = reader->U32(); break;                            // DW_FORM_data4
+    case 0x07: *value = reader->Fixed(8); break;                         // DW_FORM_data8
+    case 0x0f: *value = reader->Uleb(); break;                           // DW_FORM_udata
+    case 0x1e: reader->Skip(16); break;                                  // DW_FORM_data16
+    case 0x09: reader->Skip(reader->Uleb()); break;                      // DW_FORM_block
+    default: return false;
+  }
+  return reader->ok();
+}
+
+/*******************************************************************************
+ * Function to read the directory or file name table from a DWARF 5 line table
+ * header. Each entry is stored as "directory index, path".
+ ******************************************************************************/
+static bool ReadEntryTable(DwarfReader* reader, bool dwarf64, const DwarfStrings& strings,
+                           std::vector<std::pair<uint64_t, std::string> >* entries) {
+  uint8_t format_count = reader->U8();
+  std::vector<std::pair<uint64_t, uint64_t> > formats;
+  for (uint8_t i = 0; i < format_count; i++) {
+    uint64_t content_type = reader->Uleb();
+    formats.push_back(std::make_pair(content_type, reader->Uleb()));
+  }
+  uint64_t count = reader->Uleb();
+  for (uint64_t i = 0; i < count && reader->ok(); i++) {
+    std::pair<uint64_t, std::string> entry(0, "");
+    for (const auto& format : formats) {
+      const char* string;
+      uint64_t value;
+      if (!ReadForm(reader, format.second, dwarf64, strings, &string, &value)) {
+        return false;
+      }
+      if (format.first == 1 && string != nullptr) {                     // DW_LNCT_path
+        entry.second = string;
+      } else if (format.first == 2) {                                    // DW_LNCT_directory_index
+        entry.first = value;
+      }
+    }
+    entries->push_back(entry);
+  }
+  return reader->ok();
+}
+
+static std::string JoinPath(const std::string& directory, const std::string& name) {
+  if (name.empty() || name[0] == '/' || directory.empty()) {
+    return name;
+  }
+  return directory + "/" + name;
+}
+
+/*******************************************************************************
+ * Function to run the line number program for one unit of a .debug_line
+ * section, appending the rows. Returns false if the unit cannot be read.
+ ******************************************************************************/
+static bool ReadLineUnit(DwarfReader* unit, bool dwarf64, const DwarfStrings& strings,
+                         std::vector<std::string>* files, std::vector<LineRow>* rows) {
+  uint16_t version = unit->U16();
+  if (version < 2 || version > 5) {
+    return false;
+  }
+  if (version >= 5) {
+    unit->U8();  // address_size
+    unit->U8();  // segment_selector_size
+  }
+  uint64_t header_length = unit->Fixed(dwarf64 ? 8 : 4);
+  if (header_length > unit->remaining()) {
+    return false;
+  }
+  DwarfReader program(unit->position() + header_length, unit->remaining() - header_length);
+  uint8_t min_instruction_length = unit->U8();
+  if (version >= 4) {
+    unit->U8();  // maximum_operations_per_instruction, VLIW only
+  }
+  bool default_is_stmt = unit->U8() != 0;
+  int8_t line_base = static_cast<int8_t>(unit->U8());
+  uint8_t line_range = unit->U8();
+  uint8_t opcode_base = unit->U8();
+  if (line_range == 0 || opcode_base == 0) {
+    return false;
+  }
+  std::vector<uint8_t> opcode_lengths(opcode_base, 0);
+  for (uint8_t i = 1; i < opcode_base; i++) {
+    opcode_lengths[i] = unit->U8();
+  }
+
+  // Map the unit's file numbers to entries in the object's file list
+  std::vector<uint32_t> unit_files;
+  if (version >= 5) {
+    std::vector<std::pair<uint64_t, std::string> > directories;
+    std::vector<std::pair<uint64_t, std::string> > names;
+    if (!ReadEntryTable(unit, dwarf64, strings, &directories) ||
+        !ReadEntryTable(unit, dwarf64, strings, &names)) {
+      return false;
+    }
+    for (const auto& name : names) {
+      // Directory 0 is the compilation directory, the others may be relative to it
+      std::string directory = name.first < directories.size() ?
+                              directories[name.first].second : "";
+      if (name.first != 0 && !directories.empty()) {
+        directory = JoinPath(directories[0].second, directory);
+      }
+      unit_files.push_back(files->size());
+      files->push_back(JoinPath(directory, name.second));
+    }
+  } else {
+    std::vector<std::string> directories(1, "");  // 0 is the compilation directory
+    for (const char* directory = unit->String(); *directory != '\0'; directory = unit->String()) {
+      directories.push_back(directory);
+    }
+    unit_files.push_back(0);  // file numbers start at 1
+    for (const char* name = unit->String(); *name != '\0'; name = unit->String()) {
+      uint64_t directory = unit->Uleb();
+      unit->Uleb();  // modification time
+      unit->Uleb();  // file length
+      unit_files.push_back(files->size());
+      files->push_back(JoinPath(directory < directories.size() ? directories[directory] : "", name));
+    }
+  }
+  if (!unit->ok()) {
+    return false;
+  }
+
+  // Run the line number program. Only the address, file and line registers
+  // are tracked.
+  uintptr_t address = 0;
+  uint64_t file = 1;
+  int64_t line = 1;
+  bool is_stmt = default_is_stmt;
+  auto emit = [&](bool end_sequence) {
+    if (file < unit_files.size()) {
+      LineRow row = {address, unit_files[file], end_sequence ? 0 : static_cast<uint32_t>(line)};
+      rows->push_back(row);
+    }
+  };
+  auto reset = [&]() {
+    address = 0;
+    file = 1;
+    line = 1;
+    is_stmt = default_is_stmt;
+  };
+  while (program.remaining() > 0 && program.ok()) {
+    uint8_t opcode = program.U8();
+    if (opcode >= opcode_base) {
+      // Special opcode: advance the address and line, then append a row
+      uint8_t adjusted = opcode - opcode_base;
+      address += (adjusted / line_range) * min_instruction_length;
+      line += line_base + adjusted % line_range;
+      emit(false);
+      continue;
+    }
+    switch (opcode) {
+      case 0: {  // extended opcode
+        uint64_t length = program.Uleb();
+        if (length == 0 || length > program.remaining()) {
+          return false;
+        }
+        const uint8_t* next = program.position() + length;
+        uint8_t extended = program.U8();
+        if (extended == 1) {                                             // DW_LNE_end_sequence
+          emit(true);
+          reset();
+        } else if (extended == 2) {                                      // DW_LNE_set_address
+          address = static_cast<uintptr_t>(program.Fixed(length - 1));
+        }
+        program.Skip(next - program.position());
+        break;
+      }
+      case 1: emit(false); break;                                        // DW_LNS_copy
+      case 2: address += program.Uleb() * min_instruction_length; break; // DW_LNS_advance_pc
+      case 3: line += program.Sleb(); break;                             // DW_LNS_advance_line
+      case 4: file = program.Uleb(); break;                              // DW_LNS_set_file
+      case 6: is_stmt = !is_stmt; break;                                 // DW_LNS_negate_stmt
+      case 8:                                                            // DW_LNS_const_add_pc
+        address += ((255 - opcode_base) / line_range) * min_instruction_length;
+        break;
+      case 9: address += program.U16(); break;                           // DW_LNS_fixed_advance_pc
+      default:
+        // Other standard opcodes only have ULEB128 operands
+        for (uint8_t i = 0; i < opcode_lengths[opcode]; i++) {
+          program.Uleb();
+        }
+        break;
+    }
+  }
+  return program.ok();
+}
+
+/*******************************************************************************
+ * ElfObject member functions.
+ ******************************************************************************/
+bool ElfObject::Contains(uintptr_t pc) const {
+  for (const auto& range : ranges) {
+    if (pc >= range.first && pc < range.second) {
+      return true;
+    }
+  }
+  return false;
+}
+
+const ElfW(Shdr)* ElfObject::FindSection(const ElfW(Ehdr)* header, const char* name) const {
+  const ElfW(Shdr)* sections = reinterpret_cast<const ElfW(Shdr)*>(
+      static_cast<const char*>(map_) + header->e_shoff);
+  if (header->e_shstrndx >= header->e_shnum) {
+    return nullptr;
+  }
+  const ElfW(Shdr)* names = &sections[header->e_shstrndx];
+  const char* data = SectionData(names);
+  for (int i = 0; data != nullptr && i < header->e_shnum; i++) {
+    const char* section_name = StringAt(data, names->sh_size, sections[i].sh_name);
+    if (!strcmp(section_name, name) && !(sections[i].sh_flags & SHF_COMPRESSED)) {
+      return &sections[i];
+    }
+  }
+  return nullptr;
+}
+
+const char* ElfObject::SectionData(const ElfW(Shdr)* section) const {
+  if (section->sh_type == SHT_NOBITS || section->sh_offset > map_size_ ||
+      section->sh_size > map_size_ - section->sh_offset) {
+    return nullptr;
+  }
+  return static_cast<const char*>(map_) + section->sh_offset;
+}
+
+void ElfObject::ReadSymbols(const ElfW(Ehdr)* header) {
+  const ElfW(Shdr)* sections = reinterpret_cast<const ElfW(Shdr)*>(
+      static_cast<const char*>(map_) + header->e_shoff);
+  // Prefer the full symbol table, the dynamic symbol table is a subset of it
+  const ElfW(Shdr)* symtab = nullptr;
+  for (int i = 0; i < header->e_shnum; i++) {
+    if (sections[i].sh_type == SHT_SYMTAB ||
+        (sections[i].sh_type == SHT_DYNSYM && symtab == nullptr)) {
+      symtab = &sections[i];
+    }
+  }
+  if (symtab == nullptr || symtab->sh_link >= header->e_shnum) {
+    return;
+  }
+  const ElfW(Sym)* symbols = reinterpret_cast<const ElfW(Sym)*>(SectionData(symtab));
+  strtab_ = SectionData(&sections[symtab->sh_link]);
+  if (symbols == nullptr || strtab_ == nullptr) {
+    return;
+  }
+  strtab_size_ = sections[symtab->sh_link].sh_size;
+  for (size_t i = 0; i < symtab->sh_size / sizeof(ElfW(Sym)); i++) {
+    const ElfW(Sym)& symbol = symbols[i];
+    unsigned char type = ELF64_ST_TYPE(symbol.st_info);
+    if ((type == STT_FUNC || type == STT_GNU_IFUNC) && symbol.st_shndx != SHN_UNDEF &&
+        symbol.st_value != 0 && symbol.st_name < strtab_size_) {
+      ElfSymbol entry = {static_cast<uintptr_t>(symbol.st_value),
+                         static_cast<uintptr_t>(symbol.st_size), symbol.st_name};
+      symbols_.push_back(entry);
+    }
+  }
+  std::stable_sort(symbols_.begin(), symbols_.end(),
+                   [](const ElfSymbol& a, const ElfSymbol& b) { return a.address < b.address; });
+}
+
+void ElfObject::ReadLineTable(const ElfW(Ehdr)* header) {
+  const ElfW(Shdr)* debug_line = FindSection(header, ".debug_line");
+  if (debug_line == nullptr || debug_line->sh_size > NR_MAX_DEBUG_LINE_SIZE) {
+    return;
+  }
+  const char* data = SectionData(debug_line);
+  if (data == nullptr) {
+    return;
+  }
+  DwarfStrings strings = {nullptr, 0, nullptr, 0};
+  if (const ElfW(Shdr)* str = FindSection(header, ".debug_str")) {
+    strings.str = SectionData(str);
+    strings.str_size = str->sh_size;
+  }
+  if (const ElfW(Shdr)* line_str = FindSection(header, ".debug_line_str")) {
+    strings.line_str = SectionData(line_str);
+    strings.line_str_size = line_str->sh_size;
+  }
+
+  DwarfReader section(reinterpret_cast<const uint8_t*>(data), debug_line->sh_size);
+  while (section.remaining() > 0 && section.ok()) {
+    uint64_t length = section.U32();
+    bool dwarf64 = length == 0xffffffff;
+    if (dwarf64) {
+      length = section.Fixed(8);
+    }
+    if (length > section.remaining()) {
+      break;
+    }
+    DwarfReader unit(section.position(), length);
+    size_t rows = lines_.size();
+    if (!ReadLineUnit(&unit, dwarf64, strings, &files_, &lines_)) {
+      lines_.resize(rows);  // discard a partially read unit
+    }
+    section.Skip(length);
+  }
+  std::stable_sort(lines_.begin(), lines_.end(),
+                   [](const LineRow& a, const LineRow& b) { return a.address < b.address; });
+}
+
+void ElfObject::BuildIndex() {
+  indexed = true;
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(ElfW(Ehdr))) {
+    map_size_ = st.st_size;
+    map_ = mmap(nullptr, map_size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (map_ == MAP_FAILED) {
+    return;
+  }
+  const ElfW(Ehdr)* header = static_cast<const ElfW(Ehdr)*>(map_);
+  if (memcmp(header->e_ident, ELFMAG, SELFMAG) != 0 ||
+      header->e_ident[EI_CLASS] != (sizeof(void*) == 8 ? ELFCLASS64 : ELFCLASS32) ||
+      header->e_shentsize != sizeof(ElfW(Shdr)) || header->e_shoff > map_size_ ||
+      header->e_shnum > (map_size_ - header->e_shoff) / sizeof(ElfW(Shdr))) {
+    return;
+  }
+  ReadSymbols(header);
+  ReadLineTable(header);
+}
+
+bool ElfObject::Lookup(uintptr_t pc, ElfFrameInfo* info) const {
+  // Return addresses point after the call instruction, look up the byte before
+  const uintptr_t address = pc - bias - 1;
+  auto symbol = std::upper_bound(symbols_.begin(), symbols_.end(), address,
+                                 [](uintptr_t a, const ElfSymbol& s) { return a < s.address; });
+  if (symbol == symbols_.begin()) {
+    return false;
+  }
+  --symbol;
+  if (symbol->size != 0 && address >= symbol->address + symbol->size) {
+    return false;
+  }
+  info->symbol = strtab_ + symbol->name;
+  info->offset = pc - bias - symbol->address;
+  info->library = path;
+  info->file.clear();
+  info->line = 0;
+
+  auto row = std::upper_bound(lines_.begin(), lines_.end(), address,
+                              [](uintptr_t a, const LineRow& r) { return a < r.address; });
+  if (row != lines_.begin()) {
+    --row;
+    if (row->line != 0 && row->address >= symbol->address) {
+      info->file = files_[row->file];
+      info->line = row->line;
+    }
+  }
+  return true;
+}
+
+/*******************************************************************************
+ * Function to refresh the list of loaded objects. Objects that are still
+ * loaded at the same address keep their index.
+ ******************************************************************************/
+static int LoadedObjectCallback(struct dl_phdr_info* info, size_t size, void* data) {
+  std::vector<std::unique_ptr<ElfObject> >* loaded =
+      static_cast<std::vector<std::unique_ptr<ElfObject> >*>(data);
+  std::string path = info->dlpi_name != nullptr ? info->dlpi_name : "";
+  if (path.empty()) {
+    if (!loaded->empty()) {
+      return 0;  // the vDSO, there is no file to read
+    }
+    // The first entry is the executable
+    char buf[4096];
+    ssize_t length = readlink("/proc/self/exe", buf, sizeof(buf) - 1);
+    if (length <= 0) {
+      return 0;
+    }
+    path.assign(buf, length);
+  }
+  for (auto& object : objects) {
+    if (object && object->path == path && object->bias == info->dlpi_addr) {
+      loaded->push_back(std::move(object));
+      return 0;
+    }
+  }
+  std::unique_ptr<ElfObject> object(new ElfObject(path, info->dlpi_addr));
+  for (int i = 0; i < info->dlpi_phnum; i++) {
+    const ElfW(Phdr)& segment = info->dlpi_phdr[i];
+    if (segment.p_type == PT_LOAD) {
+      uintptr_t start = info->dlpi_addr + segment.p_vaddr;
+      object->ranges.push_back(std::make_pair(start, start + segment.p_memsz));
+    }
+  }
+  loaded->push_back(std::move(object));
+  return 0;
+}
+
+bool ElfSymbolize(uintptr_t pc, ElfFrameInfo* info) {
+  if (!objects_valid) {
+    std::vector<std::unique_ptr<ElfObject> > loaded;
+    dl_iterate_phdr(LoadedObjectCallback, &loaded);
+    objects.swap(loaded);  // objects no longer loaded are unmapped here
+    objects_valid = true;
+  }
+  for (auto& object : objects) {
+    if (object->Contains(pc)) {
+      if (!object->indexed) {
+        object->BuildIndex();
+      }
+      return object->Lookup(pc, info);
+    }
+  }
+  return false;
+}
+
+void ElfSymbolizerReset() {
+  objects_valid = false;
+}
+
+}  // namespace nodereport
+#endif  // NR_ELF_SYMBOLIZER
@@ -0,0 +1,43 @@
+#ifndef SRC_ELF_SYMBOLIZER_H_
+#define SRC_ELF_SYMBOLIZER_H_
+
+#include <stdint.h>
+#include <string>
+
+// The ELF symbolizer reads the symbol tables of the loaded objects directly,
+// so it finds the local symbols that dladdr() cannot see.
+#if defined(__linux__)
+#define NR_ELF_SYMBOLIZER
+#endif
+
+namespace nodereport {
+
+#ifdef NR_ELF_SYMBOLIZER
+// Symbolic information for an instruction address
+struct ElfFrameInfo {
+  std::string symbol;          // symbol name, not demangled
+  uintptr_t offset;            // offset of the address from the symbol
+  std::string file;            // source file, empty if no line information
+  unsigned int line;
+  std::string library;         // path of the object containing the address
+};
+
+/*******************************************************************************
+ * Look up an instruction address in the symbol and line number tables of the
+ * loaded ELF objects. The index for an object is built the first time an
+ * address in it is looked up, and kept until ElfSymbolizerReset() is called.
+ * Returns false if no symbol covers the address.
+ *
+ * The caller must serialise calls to these functions.
+ ******************************************************************************/
+bool ElfSymbolize(uintptr_t pc, ElfFrameInfo* info);
+
+// Refresh the list of loaded objects on the next lookup, for use when a shared
+// library has been loaded or unloaded. Indexes for objects that are still
+// loaded are kept.
+void ElfSymbolizerReset();
+#endif
+
+}  // namespace nodereport
+
+#endif  // SRC_ELF_SYMBOLIZER_H_
@@ -0,0 +1,127 @@
+#include "fd_inventory.h"
+#include "linux_dirent.h"
+
+#ifdef NR_FD_INVENTORY
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <unordered_map>
+
+namespace nodereport {
+
+// Buffer for the descriptor directory listing, enough for about 1,000
+// descriptors a call
+#define NR_FD_DIRENT_BUFFER_SIZE (32 * 1024)
+
+enum FdType { kSocket, kPipe, kEventFd, kEpoll, kAnonInode, kFile, kDevice, kOther, kFdTypes };
+static const char* fd_type_names[kFdTypes] = {
+  "socket", "pipe", "eventfd", "epoll", "anon_inode", "file", "device", "other"
+};
+
+#define STARTS_WITH(target, prefix) (strncmp(target, prefix, sizeof(prefix) - 1) == 0)
+
+// Classify a descriptor by its /proc/self/fd link, for example socket:[1234],
+// pipe:[1234], anon_inode:[eventfd] or the path of a file
+static FdType ClassifyTarget(const char* target) {
+  if (STARTS_WITH(target, "socket:")) return kSocket;
+  if (STARTS_WITH(target, "pipe:")) return kPipe;
+  if (STARTS_WITH(target, "anon_inode:")) {
+    const char* name = target + sizeof("anon_inode:") - 1;
+    if (strcmp(name, "[eventfd]") == 0) return kEventFd;
+    if (strcmp(name, "[eventpoll]") == 0) return kEpoll;
+    return kAnonInode;
+  }
+  if (target[0] == '/') {
+    return STARTS_WITH(target, "/dev/") && !STARTS_WITH(target, "/dev/shm/") ? kDevice : kFile;
+  }
+  return kOther;
+}
+
+static bool MoreTypeDescriptors(const FdTypeCount& a, const FdTypeCount& b) {
+  return a.count > b.count;
+}
+
+static bool MoreTargetDescriptors(const FdTarget& a, const FdTarget& b) {
+  return a.count > b.count;
+}
+
+bool ReadFdInventory(const std::vector<int>& owned, FdInventory* info, size_t top) {
+  *info = FdInventory();
+  const int dir_fd = open("/proc/self/fd", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dir_fd < 0) {
+    return false;
+  }
+  std::vector<int> owned_sorted(owned);
+  std::sort(owned_sorted.begin(), owned_sorted.end());
+
+  FdTypeCount types[kFdTypes];
+  for (int type = 0; type < kFdTypes; type++) {
+    types[type].type = fd_type_names[type];
+    types[type].count = 0;
+    types[type].not_owned = 0;
+  }
+  std::unordered_map<std::string, FdTarget> targets;
+  char dirents[NR_FD_DIRENT_BUFFER_SIZE];
+  char target[PATH_MAX];
+  ForEachNumericEntry(dir_fd, dirents, sizeof(dirents), [&](const char* name) {
+    const int fd = static_cast<int>(strtol(name, nullptr, 10));
+    if (fd == dir_fd) {
+      return;
+    }
+    info->count++;
+    const bool not_owned = !std::binary_search(owned_sorted.begin(), owned_sorted.end(), fd);
+    if (not_owned) {
+      info->not_owned++;
+    }
+    if (info->examined == NR_FD_EXAMINE_LIMIT) {
+      return;
+    }
+    // The descriptor may have been closed since the directory was read
+    const ssize_t length = readlinkat(dir_fd, name, target, sizeof(target) - 1);
+    if (length < 0) {
+      info->count--;
+      if (not_owned) {
+        info->not_owned--;
+      }
+      return;
+    }
+    target[length] = '\0';
+    info->examined++;
+    const FdType type = ClassifyTarget(target);
+    types[type].count++;
+    types[type].not_owned += not_owned;
+    if (type == kFile || type == kDevice) {
+      FdTarget& path = targets[std::string(target, length)];
+      if (path.count++ == 0) {
+        path.path.assign(target, length);
+      }
+      path.not_owned += not_owned;
+    }
+  });
+  close(dir_fd);
+
+  for (int type = 0; type < kFdTypes; type++) {
+    if (types[type].count != 0) {
+      info->types.push_back(types[type]);
+    }
+  }
+  std::stable_sort(info->types.begin(), info->types.end(), MoreTypeDescriptors);
+
+  info->targets.reserve(targets.size());
+  for (auto& entry : targets) {
+    info->targets.push_back(std::move(entry.second));
+  }
+  top = std::min(top, info->targets.size());
+  std::partial_sort(info->targets.begin(), info->targets.begin() + top,
+                    info->targets.end(), MoreTargetDescriptors);
+  info->targets.resize(top);
+  return true;
+}
+
+}  // namespace nodereport
+
+#endif  // NR_FD_INVENTORY
@@ -0,0 +1,56 @@
+#ifndef SRC_FD_INVENTORY_H_
+#define SRC_FD_INVENTORY_H_
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+// The descriptors are listed from /proc/self/fd, which only Linux provides.
+#if defined(__linux__)
+#define NR_FD_INVENTORY
+#endif
+
+namespace nodereport {
+
+#ifdef NR_FD_INVENTORY
+// Descriptors beyond this many are counted, but not classified with readlink()
+#define NR_FD_EXAMINE_LIMIT 65536
+
+// Descriptors of one type: socket, pipe, eventfd, epoll, anon_inode, file,
+// device or other
+struct FdTypeCount {
+  const char* type;
+  size_t count;
+  size_t not_owned;            // not owned by a libuv handle or event loop
+};
+
+// Descriptors open on the same file or device
+struct FdTarget {
+  std::string path;
+  size_t count;
+  size_t not_owned;
+};
+
+struct FdInventory {
+  size_t count;                // open descriptors
+  size_t examined;             // classified by type and target
+  size_t not_owned;            // of all the open descriptors
+  std::vector<FdTypeCount> types;   // most descriptors first
+  std::vector<FdTarget> targets;    // most descriptors first
+};
+
+/*******************************************************************************
+ * List the open file descriptors of the process from /proc/self/fd, and
+ * classify them by type and target with readlink(). The directory is read
+ * with getdents64() through a fixed size buffer, and at most
+ * NR_FD_EXAMINE_LIMIT descriptors are classified, so the time taken is
+ * bounded however many are open. 'owned' lists the descriptors of the libuv
+ * handles and event loops. Only the 'top' targets with the most descriptors
+ * are kept. Returns false if /proc/self/fd cannot be read.
+ ******************************************************************************/
+bool ReadFdInventory(const std::vector<int>& owned, FdInventory* info, size_t top);
+#endif
+
+}  // namespace nodereport
+
+#endif  // SRC_FD_INVENTORY_H_
@@ -0,0 +1,78 @@
+#include "gzip_stream.h"
+
+#include <string.h>
+
+namespace nodereport {
+
+GzipStreamBuf::GzipStreamBuf(std::ostream& sink)
+    : sink_(sink), initialised_(false), finished_(false) {
+  memset(&stream_, 0, sizeof(stream_));
+  // A window size of 15 + 16 selects the gzip header and trailer
+  initialised_ = deflateInit2(&stream_, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+                              Z_DEFAULT_STRATEGY) == Z_OK;
+  setp(in_, in_ + sizeof(in_));
+}
+
+GzipStreamBuf::~GzipStreamBuf() {
+  Finish();
+  if (initialised_) {
+    deflateEnd(&stream_);
+  }
+}
+
+// Compress the buffered input, writing out the compressed data. Returns false
+// if compression failed or the sink stream is in error.
+bool GzipStreamBuf::Deflate(int flush) {
+  if (!initialised_) {
+    setp(in_, in_ + sizeof(in_));  // discard the data
+    return false;
+  }
+  stream_.next_in = reinterpret_cast<Bytef*>(in_);
+  stream_.avail_in = static_cast<uInt>(pptr() - in_);
+  int rc;
+  do {
+    stream_.next_out = reinterpret_cast<Bytef*>(out_);
+    stream_.avail_out = sizeof(out_);
+    rc = deflate(&stream_, flush);
+    if (rc == Z_STREAM_ERROR) {
+      break;
+    }
+    sink_.write(out_, sizeof(out_) - stream_.avail_out);
+  } while (stream_.avail_out == 0);
+  setp(in_, in_ + sizeof(in_));
+  return rc != Z_STREAM_ERROR && sink_.good();
+}
+
+GzipStreamBuf::int_type GzipStreamBuf::overflow(int_type c) {
+  if (finished_ || !Deflate(Z_NO_FLUSH)) {
+    return traits_type::eof();
+  }
+  if (!traits_type::eq_int_type(c, traits_type::eof())) {
+    *pptr() = traits_type::to_char_type(c);
+    pbump(1);
+  }
+  return traits_type::not_eof(c);
+}
+
+// Pass the buffered input to zlib without flushing the deflate stream, since
+// the report streams are flushed at every std::endl and a sync flush each
+// time would empty the compression window
+int GzipStreamBuf::sync() {
+  if (finished_ || !Deflate(Z_NO_FLUSH)) {
+    return -1;
+  }
+  sink_.flush();
+  return 0;
+}
+
+bool GzipStreamBuf::Finish() {
+  if (finished_) {
+    return initialised_;
+  }
+  const bool ok = Deflate(Z_FINISH);
+  finished_ = true;
+  sink_.flush();
+  return ok;
+}
+
+}  // namespace nodereport
@@ -0,0 +1,45 @@
+#ifndef SRC_GZIP_STREAM_H_
+#define SRC_GZIP_STREAM_H_
+
+#include "zlib.h"
+
+#include <iostream>
+#include <streambuf>
+
+namespace nodereport {
+
+/*******************************************************************************
+ * Stream buffer that gzip compresses everything written to it on to another
+ * output stream, using the zlib library that ships with Node.js. Data is
+ * compressed in fixed size blocks as it is written, so the uncompressed report
+ * is never held in memory. Flushing the stream writes out the compressed data
+ * that zlib has completed, but does not flush the deflate stream, which would
+ * cost compression. Finish() writes the rest and the gzip trailer.
+ ******************************************************************************/
+class GzipStreamBuf : public std::streambuf {
+ public:
+  explicit GzipStreamBuf(std::ostream& sink);
+  ~GzipStreamBuf();
+
+  // Compress any remaining data and write the gzip trailer. Returns false if
+  // the compressed data could not be written.
+  bool Finish();
+
+ protected:
+  int_type overflow(int_type c) override;
+  int sync() override;
+
+ private:
+  bool Deflate(int flush);
+
+  std::ostream& sink_;
+  z_stream stream_;
+  bool initialised_;
+  bool finished_;
+  char in_[16 * 1024];
+  char out_[16 * 1024];
+};
+
+}  // namespace nodereport
+
+#endif  // SRC_GZIP_STREAM_H_
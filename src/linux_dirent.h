@@ -0,0 +1,48 @@
+#ifndef SRC_LINUX_DIRENT_H_
+#define SRC_LINUX_DIRENT_H_
+
+// Directory listing with getdents64(), for the /proc directories read by the
+// thread table and the file descriptor inventory (Linux only).
+#if defined(__linux__)
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace nodereport {
+
+// Layout of the records returned by getdents64(), which glibc does not declare
+struct LinuxDirent64 {
+  uint64_t d_ino;
+  int64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[1];
+};
+
+/*******************************************************************************
+ * Call visit(name) for each entry of an open /proc directory whose name is a
+ * number, such as a thread id or a file descriptor. The directory is read into
+ * the caller's buffer, so no memory is allocated for the listing.
+ ******************************************************************************/
+template <typename Visitor>
+void ForEachNumericEntry(int dir_fd, char* buffer, size_t size, Visitor visit) {
+  for (;;) {
+    const long bytes = syscall(SYS_getdents64, dir_fd, buffer, size);
+    if (bytes <= 0) {
+      return;
+    }
+    for (long offset = 0; offset < bytes;) {
+      const LinuxDirent64* entry = reinterpret_cast<const LinuxDirent64*>(buffer + offset);
+      offset += entry->d_reclen;
+      if (entry->d_name[0] >= '0' && entry->d_name[0] <= '9') {
+        visit(entry->d_name);
+      }
+    }
+  }
+}
+
+}  // namespace nodereport
+
+#endif
+#endif  // SRC_LINUX_DIRENT_H_
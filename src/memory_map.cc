@@ -0,0 +1,206 @@
+#include "memory_map.h"
+
+#ifdef NR_MEMORY_MAP
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <link.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <set>
+#include <unordered_map>
+
+namespace nodereport {
+
+// Size of the buffer the /proc files are read through. The lines are short,
+// apart from mapping headers with long paths, which are cut at this length.
+#define NR_SMAPS_BUFFER_SIZE (16 * 1024)
+
+// smaps fields that are totalled, values are in kB
+static const struct {
+  const char* name;
+  size_t length;
+  uint64_t MemoryUsage::* field;
+} smaps_fields[] = {
+  {"Size:", sizeof("Size:") - 1, &MemoryUsage::size},
+  {"Rss:", sizeof("Rss:") - 1, &MemoryUsage::rss},
+  {"Pss:", sizeof("Pss:") - 1, &MemoryUsage::pss},
+  {"Anonymous:", sizeof("Anonymous:") - 1, &MemoryUsage::anonymous},
+  {"Swap:", sizeof("Swap:") - 1, &MemoryUsage::swap},
+  {"AnonHugePages:", sizeof("AnonHugePages:") - 1, &MemoryUsage::anon_huge_pages},
+};
+
+/*******************************************************************************
+ * Read a /proc file through a fixed size buffer, calling line(start, end) for
+ * each line without copying it. Returns false if the file cannot be read.
+ ******************************************************************************/
+template <typename LineCallback>
+static bool ForEachLine(const char* path, LineCallback line) {
+  const int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  char buffer[NR_SMAPS_BUFFER_SIZE];
+  size_t used = 0;
+  bool skipping = false;  // discarding the rest of a line that did not fit
+  for (;;) {
+    const ssize_t bytes = read(fd, buffer + used, sizeof(buffer) - used);
+    if (bytes < 0 && errno == EINTR) {
+      continue;
+    }
+    if (bytes <= 0) {
+      close(fd);
+      if (bytes == 0 && used > 0 && !skipping) {
+        line(buffer, buffer + used);
+      }
+      return bytes == 0;
+    }
+    const char* start = buffer;
+    const char* end = buffer + used + bytes;
+    const char* newline;
+    while ((newline = static_cast<const char*>(memchr(start, '\n', end - start))) != nullptr) {
+      if (!skipping) {
+        line(start, newline);
+      }
+      skipping = false;
+      start = newline + 1;
+    }
+    used = end - start;
+    if (used == sizeof(buffer)) {
+      line(buffer, buffer + used);
+      skipping = true;
+      used = 0;
+    } else {
+      memmove(buffer, start, used);
+    }
+  }
+}
+
+// Add a "Name:   1234 kB" line to the usage, if it is one of smaps_fields
+static void AddField(const char* start, const char* end, MemoryUsage* usage) {
+  for (const auto& field : smaps_fields) {
+    if (static_cast<size_t>(end - start) > field.length &&
+        memcmp(start, field.name, field.length) == 0) {
+      // The line ends in " kB", so strtoull() stops before the end
+      usage->*field.field += strtoull(start + field.length, nullptr, 10) * 1024;
+      return;
+    }
+  }
+}
+
+static void AddUsage(MemoryUsage* total, const MemoryUsage& usage) {
+  total->size += usage.size;
+  total->rss += usage.rss;
+  total->pss += usage.pss;
+  total->anonymous += usage.anonymous;
+  total->swap += usage.swap;
+  total->anon_huge_pages += usage.anon_huge_pages;
+}
+
+// Skip over the address, permissions, offset, device and inode fields of a
+// mapping header line, returning the start of the path.
+static const char* MappingPath(const char* start, const char* end) {
+  const char* cursor = start;
+  for (int field = 0; field < 5; field++) {
+    while (cursor < end && *cursor != ' ') cursor++;
+    while (cursor < end && *cursor == ' ') cursor++;
+  }
+  return cursor;
+}
+
+static bool LargerRss(const MemoryObject& a, const MemoryObject& b) {
+  return a.usage.rss > b.usage.rss;
+}
+
+static int LibraryPathCallback(struct dl_phdr_info* info, size_t size, void* data) {
+  std::set<std::string>* libraries = static_cast<std::set<std::string>*>(data);
+  if (info->dlpi_name != nullptr && *info->dlpi_name != '\0') {
+    // smaps shows the resolved path of the mapped file
+    char path[PATH_MAX];
+    if (realpath(info->dlpi_name, path) != nullptr) {
+      libraries->insert(path);
+    }
+    libraries->insert(info->dlpi_name);
+  }
+  return 0;
+}
+
+bool ReadMemoryMap(MemoryMapInfo* info, size_t top) {
+  *info = MemoryMapInfo();
+  std::unordered_map<std::string, MemoryObject> objects;
+  MemoryObject* object = nullptr;   // object for the current mapping
+  MemoryUsage usage = MemoryUsage();  // usage of the current mapping
+
+  auto finish_mapping = [&]() {
+    if (object != nullptr) {
+      AddUsage(&object->usage, usage);
+      AddUsage(&info->totals, usage);
+      usage = MemoryUsage();
+    }
+  };
+  bool read = ForEachLine("/proc/self/smaps", [&](const char* start, const char* end) {
+    // Field names start with an upper case letter, mapping headers with the
+    // start address in lower case hex
+    if (start == end || (*start >= 'A' && *start <= 'Z')) {
+      if (object != nullptr) {
+        AddField(start, end, &usage);
+      }
+      return;
+    }
+    finish_mapping();
+    info->mappings++;
+    const char* path = MappingPath(start, end);
+    size_t length = end - path;
+    if (length == 0) {
+      path = "[anonymous]";
+      length = sizeof("[anonymous]") - 1;
+    }
+    // Consecutive mappings usually belong to the same object
+    if (object != nullptr && object->name.size() == length &&
+        memcmp(object->name.data(), path, length) == 0) {
+      object->mappings++;
+      return;
+    }
+    std::string name(path, length);
+    object = &objects[name];
+    if (object->mappings++ == 0) {
+      object->name = name;
+    }
+  });
+  if (!read) {
+    return false;
+  }
+  finish_mapping();
+  info->objects = objects.size();
+
+  // Prefer the kernel's totals, which are consistent with each other
+  MemoryUsage rollup = MemoryUsage();
+  info->rollup = ForEachLine("/proc/self/smaps_rollup", [&](const char* start, const char* end) {
+    AddField(start, end, &rollup);
+  });
+  if (info->rollup) {
+    rollup.size = info->totals.size;  // not included in the rollup
+    info->totals = rollup;
+  }
+
+  for (auto& entry : objects) {
+    info->largest.push_back(std::move(entry.second));
+  }
+  top = std::min(top, info->largest.size());
+  std::partial_sort(info->largest.begin(), info->largest.begin() + top,
+                    info->largest.end(), LargerRss);
+  info->largest.resize(top);
+
+  std::set<std::string> libraries;
+  dl_iterate_phdr(LibraryPathCallback, &libraries);
+  for (MemoryObject& largest : info->largest) {
+    largest.library = libraries.count(largest.name) != 0;
+  }
+  return true;
+}
+
+}  // namespace nodereport
+
+#endif  // NR_MEMORY_MAP
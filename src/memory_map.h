@@ -0,0 +1,56 @@
+#ifndef SRC_MEMORY_MAP_H_
+#define SRC_MEMORY_MAP_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// The memory map is read from /proc/self/smaps, which only Linux provides.
+#if defined(__linux__)
+#define NR_MEMORY_MAP
+#endif
+
+namespace nodereport {
+
+#ifdef NR_MEMORY_MAP
+// Memory usage of one or more mappings, in bytes
+struct MemoryUsage {
+  uint64_t size;
+  uint64_t rss;
+  uint64_t pss;
+  uint64_t anonymous;
+  uint64_t swap;
+  uint64_t anon_huge_pages;    // transparent huge pages
+};
+
+// The mappings backed by one object: a file, or a pseudo-path such as [heap]
+// or [stack]. Mappings with no backing object are grouped as [anonymous].
+struct MemoryObject {
+  std::string name;
+  bool library;                // a shared object loaded by the dynamic linker
+  size_t mappings;
+  MemoryUsage usage;
+};
+
+struct MemoryMapInfo {
+  bool rollup;                 // Rss, Pss, anonymous, swap and THP totals are
+                               // from /proc/self/smaps_rollup
+  MemoryUsage totals;
+  size_t mappings;
+  size_t objects;
+  std::vector<MemoryObject> largest;  // largest Rss first
+};
+
+/*******************************************************************************
+ * Read the memory map of the process from /proc/self/smaps_rollup and
+ * /proc/self/smaps. The files are streamed through a fixed size buffer and
+ * parsed in place, so the cost is a hash lookup per mapping, and only the
+ * 'top' objects with the largest Rss are kept. Returns false if smaps cannot
+ * be read.
+ ******************************************************************************/
+bool ReadMemoryMap(MemoryMapInfo* info, size_t top);
+#endif
+
+}  // namespace nodereport
+
+#endif  // SRC_MEMORY_MAP_H_
@@ -1,11 +1,17 @@
 #include "node_report.h"
+#include "stack_sampler.h"
 
+#include <atomic>
 #include <sstream>
 
 namespace nodereport {
 
 // Internal/static function declarations
 static void OnFatalError(const char* location, const char* message);
+#ifdef NR_HEAP_PRESSURE
+static void HeapPressureInterruptCallback(Isolate* isolate, void* data);
+static void SetupHeapPressureHook(Isolate* isolate);
+#endif
 bool OnUncaughtException(v8::Isolate* isolate);
 #ifdef _WIN32
 static void PrintStackFromStackTrace(Isolate* isolate, FILE* fp);
@@ -18,6 +24,8 @@ static void RegisterSignalHandler(int signo, void (*handler)(int),
 static void RestoreSignalHandler(int signo, struct sigaction* saved_sa);
 static void SignalDump(int signo);
 static void SetupSignalHandler();
+inline void* ReportStallThreadMain(void* unused);
+static void SetupStallWatchdog();
 #endif
 
 // Default node-report option settings
@@ -32,12 +40,27 @@ static uv_sem_t report_semaphore;  // semaphore for hand-off to watchdog
 static uv_async_t nodereport_trigger_async;  // async handle for event loop
 static uv_mutex_t node_isolate_mutex;  // mutex for watchdog thread
 static struct sigaction saved_sa;  // saved signal action
+static bool isolate_mutex_initialised = false;
+// Event loop stall detection, see ReportStallThreadMain()
+static unsigned int stall_threshold = NR_STALL_THRESHOLD_DEFAULT;  // milliseconds
+static uv_check_t stall_check_handle;
+static uv_async_t stall_async_handle;
+static uv_cond_t stall_cond;  // signalled when stall reports are turned back on
+static std::atomic<unsigned long> loop_heartbeat(0);  // incremented as the loop runs
+static std::atomic<uint64_t> stall_start(0);  // uv_hrtime() when the stall was first seen
 #endif
 
 // State variables for v8 hooks and signal initialisation
 static bool exception_hook_initialised = false;
 static bool error_hook_initialised = false;
 static bool signal_thread_initialised = false;
+static bool stall_watchdog_initialised = false;
+#ifdef NR_HEAP_PRESSURE
+static bool heap_pressure_hook_initialised = false;
+static bool heap_pressure_armed = false;  // report when the heap is next near its limit
+static bool heap_pressure_pending = false;  // heap limit raised, report requested
+static size_t heap_pressure_limit = 0;  // heap limit before it was raised
+#endif
 
 static v8::Isolate* node_isolate;
 extern std::string version_string;
@@ -92,17 +115,54 @@ NAN_METHOD(GetReport) {
   }
 
   GetNodeReport(isolate, kJavaScript, "JavaScript API", __func__, error, out);
-  // Return value is the contents of a report as a string.
-  info.GetReturnValue().Set(Nan::New(out.str()).ToLocalChecked());
+  // Return value is the contents of a report as a string, or as a Buffer for
+  // the binary format.
+  const std::string report = out.str();
+  if (nodereport_format == kBinary) {
+    info.GetReturnValue().Set(Nan::CopyBuffer(report.data(), report.size()).ToLocalChecked());
+  } else {
+    info.GetReturnValue().Set(Nan::New(report).ToLocalChecked());
+  }
+}
+NAN_METHOD(GetReportTimings) {
+  ReportTimings timings;
+  if (!GetLastReportTimings(&timings)) {
+    return;  // no report has been completed, returns undefined
+  }
+  // Return value is an object with the section and total times in milliseconds
+  v8::Local<v8::Object> sections = Nan::New<v8::Object>();
+  for (const SectionTiming& section : timings.sections) {
+    Nan::Set(sections, Nan::New(section.name).ToLocalChecked(),
+             Nan::New<v8::Number>(section.duration / 1e6));
+  }
+  v8::Local<v8::Object> result = Nan::New<v8::Object>();
+  Nan::Set(result, Nan::New("sections").ToLocalChecked(), sections);
+  Nan::Set(result, Nan::New("loopBlocked").ToLocalChecked(),
+           Nan::New<v8::Number>(timings.loop_blocked / 1e6));
+  Nan::Set(result, Nan::New("total").ToLocalChecked(),
+           Nan::New<v8::Number>(timings.total / 1e6));
+  info.GetReturnValue().Set(result);
 }
 
 /*******************************************************************************
- * External JavaScript APIs for node-report configuration
+ * External JavaScript APIs for node-report configuration. The options are
+ * process wide, so they are only set by the main thread.
  *
  ******************************************************************************/
+static bool OnMainThread(Isolate* isolate, const char* option) {
+  if (isolate == node_isolate) {
+    return true;
+  }
+  fprintf(stderr, "node-report: the %s can only be set on the main thread\n", option);
+  return false;
+}
+
 NAN_METHOD(SetEvents) {
-  Nan::Utf8String parameter(info[0]);
   v8::Isolate* isolate = info.GetIsolate();
+  if (!OnMainThread(isolate, "report events")) {
+    return;
+  }
+  Nan::Utf8String parameter(info[0]);
   unsigned int previous_events = nodereport_events; // save previous settings
   nodereport_events = ProcessNodeReportEvents(*parameter);
 
@@ -112,6 +172,13 @@ NAN_METHOD(SetEvents) {
     error_hook_initialised = true;
   }
 
+#ifdef NR_HEAP_PRESSURE
+  // If report newly requested on heap pressure, arm the near heap limit callback
+  if ((nodereport_events & NR_HEAPPRESSURE) && !(previous_events & NR_HEAPPRESSURE)) {
+    SetupHeapPressureHook(isolate);
+  }
+#endif
+
   // If report newly requested for exceptions, tell V8 to capture stack trace and set up the callback
   if ((nodereport_events & NR_EXCEPTION) && (exception_hook_initialised == false)) {
     isolate->SetCaptureStackTraceForUncaughtExceptions(true, 32, v8::StackTrace::kDetailed);
@@ -130,9 +197,30 @@ NAN_METHOD(SetEvents) {
   if (!(nodereport_events & NR_SIGNAL) && (previous_events & NR_SIGNAL)) {
     RestoreSignalHandler(nodereport_signal, &saved_sa);
   }
+  // If report newly requested on event loop stalls set up the watchdog thread
+  if ((nodereport_events & NR_STALL) && (stall_watchdog_initialised == false)) {
+    SetupStallWatchdog();
+  }
+  // If report requested again on event loop stalls wake the idle watchdog thread
+  if ((nodereport_events & NR_STALL) && !(previous_events & NR_STALL) &&
+      stall_watchdog_initialised) {
+    uv_mutex_lock(&node_isolate_mutex);
+    uv_cond_signal(&stall_cond);
+    uv_mutex_unlock(&node_isolate_mutex);
+  }
 #endif
 }
+NAN_METHOD(SetSections) {
+  if (!OnMainThread(info.GetIsolate(), "report sections")) {
+    return;
+  }
+  Nan::Utf8String parameter(info[0]);
+  ProcessNodeReportSections(*parameter, &nodereport_sections);
+}
 NAN_METHOD(SetSignal) {
+  if (!OnMainThread(info.GetIsolate(), "report signal")) {
+    return;
+  }
 #ifndef _WIN32
   Nan::Utf8String parameter(info[0]);
   unsigned int previous_signal = nodereport_signal; // save previous setting
@@ -146,17 +234,117 @@ NAN_METHOD(SetSignal) {
 #endif
 }
 NAN_METHOD(SetFileName) {
+  if (!OnMainThread(info.GetIsolate(), "report filename")) {
+    return;
+  }
   Nan::Utf8String parameter(info[0]);
   ProcessNodeReportFileName(*parameter);
 }
 NAN_METHOD(SetDirectory) {
+  if (!OnMainThread(info.GetIsolate(), "report directory")) {
+    return;
+  }
   Nan::Utf8String parameter(info[0]);
   ProcessNodeReportDirectory(*parameter);
 }
 NAN_METHOD(SetVerbose) {
+  if (!OnMainThread(info.GetIsolate(), "verbose option")) {
+    return;
+  }
   Nan::Utf8String parameter(info[0]);
   nodereport_verbose = ProcessNodeReportVerboseSwitch(*parameter);
 }
+NAN_METHOD(SetAsync) {
+  if (!OnMainThread(info.GetIsolate(), "async option")) {
+    return;
+  }
+  Nan::Utf8String parameter(info[0]);
+  nodereport_async = ProcessNodeReportAsyncSwitch(*parameter);
+}
+NAN_METHOD(SetDelta) {
+  if (!OnMainThread(info.GetIsolate(), "delta option")) {
+    return;
+  }
+  Nan::Utf8String parameter(info[0]);
+  nodereport_delta = ProcessNodeReportDeltaSwitch(*parameter);
+}
+NAN_METHOD(SetResolveNames) {
+  if (!OnMainThread(info.GetIsolate(), "resolve names option")) {
+    return;
+  }
+  Nan::Utf8String parameter(info[0]);
+  nodereport_resolve_names = ProcessNodeReportResolveNamesSwitch(*parameter);
+}
+NAN_METHOD(SetHandleLimit) {
+  if (!OnMainThread(info.GetIsolate(), "handle limit")) {
+    return;
+  }
+  Nan::Utf8String parameter(info[0]);
+  nodereport_handle_limit = ProcessNodeReportHandleLimit(*parameter);
+}
+NAN_METHOD(SetFormat) {
+  if (!OnMainThread(info.GetIsolate(), "report format")) {
+    return;
+  }
+  Nan::Utf8String parameter(info[0]);
+  nodereport_format = ProcessNodeReportFormat(*parameter);
+}
+NAN_METHOD(SetCompression) {
+  if (!OnMainThread(info.GetIsolate(), "report compression")) {
+    return;
+  }
+  Nan::Utf8String parameter(info[0]);
+  nodereport_compression = ProcessNodeReportCompression(*parameter);
+}
+NAN_METHOD(SetEmergencyArena) {
+  if (!OnMainThread(info.GetIsolate(), "emergency arena size")) {
+    return;
+  }
+  Nan::Utf8String parameter(info[0]);
+  SetEmergencyArenaSize(ProcessNodeReportArenaSize(*parameter));
+}
+NAN_METHOD(SetStallThreshold) {
+  if (!OnMainThread(info.GetIsolate(), "stall threshold")) {
+    return;
+  }
+#ifndef _WIN32
+  Nan::Utf8String parameter(info[0]);
+  stall_threshold = ProcessNodeReportStallThreshold(*parameter);
+#endif
+}
+NAN_METHOD(SetSamplingInterval) {
+  if (!OnMainThread(info.GetIsolate(), "sampling interval")) {
+    return;
+  }
+  Nan::Utf8String parameter(info[0]);
+  SetStackSamplerInterval(info.GetIsolate(), ProcessNodeReportSamplingInterval(*parameter));
+}
+NAN_METHOD(SetThreadpoolProbe) {
+  if (!OnMainThread(info.GetIsolate(), "threadpool probe")) {
+    return;
+  }
+  Nan::Utf8String parameter(info[0]);
+  SetThreadpoolProbeInterval(info.GetIsolate(),
+                             ProcessNodeReportThreadpoolProbeInterval(*parameter));
+}
+NAN_METHOD(SetRetention) {
+  if (!OnMainThread(info.GetIsolate(), "retention policy")) {
+    return;
+  }
+  Nan::Utf8String parameter(info[0]);
+  RetentionPolicy policy;
+  if (ProcessNodeReportRetention(*parameter, &policy)) {
+    SetReportRetention(policy);
+  }
+}
+NAN_METHOD(SetRateLimit) {
+  if (!OnMainThread(info.GetIsolate(), "rate limits")) {
+    return;
+  }
+  Nan::Utf8String parameter(info[0]);
+  ProcessNodeReportRateLimits(*parameter, &nodereport_rate_limits);
+  ResetReportRateLimits();
+}
 
 /*******************************************************************************
  * Callbacks for triggering report on fatal error, uncaught exception and
@@ -176,6 +364,80 @@ static void OnFatalError(const char* location, const char* message) {
   raise(SIGABRT);
 }
 
+#ifdef NR_HEAP_PRESSURE
+/*******************************************************************************
+ * Callbacks for triggering a report when the JavaScript heap is near its limit
+ *  - OnNearHeapLimit() - V8 callback during GC, raises the heap limit
+ *  - HeapPressureInterruptCallback() - writes the report and restores the limit
+ *  - OnHeapPressureGC() - re-arms the trigger once heap usage has fallen
+ *
+ * The report cannot be written during GC, so the heap limit is raised just
+ * enough for the application to continue until the interrupt is serviced and
+ * the report has been written. If the heap is still growing after that, the
+ * process will fail with an out of memory error as it would have done. One
+ * report is written until the heap usage falls below half the limit again.
+ ******************************************************************************/
+static size_t OnNearHeapLimit(void* data, size_t current_heap_limit, size_t initial_heap_limit) {
+  if (!heap_pressure_armed || !(nodereport_events & NR_HEAPPRESSURE)) {
+    return current_heap_limit;
+  }
+  heap_pressure_armed = false;
+  heap_pressure_pending = true;
+  heap_pressure_limit = current_heap_limit;
+  Isolate* isolate = static_cast<Isolate*>(data);
+  isolate->RequestInterrupt(HeapPressureInterruptCallback, nullptr);
+  const size_t extension = current_heap_limit / 10 > NR_HEAP_EXTENSION_MIN ?
+                           current_heap_limit / 10 : NR_HEAP_EXTENSION_MIN;
+  return current_heap_limit + extension;
+}
+
+static void HeapPressureInterruptCallback(Isolate* isolate, void* data) {
+  if (nodereport_events & NR_HEAPPRESSURE) {
+    v8::HeapStatistics heap_stats;
+    isolate->GetHeapStatistics(&heap_stats);
+    char message[96];
+    snprintf(message, sizeof(message), "JavaScript heap near limit, %llu MB used, old space limit %llu MB",
+             static_cast<unsigned long long>(heap_stats.used_heap_size() >> 20),
+             static_cast<unsigned long long>(heap_pressure_limit >> 20));
+    if (nodereport_verbose) {
+      fprintf(stdout, "node-report: HeapPressureInterruptCallback %s, triggering report\n", message);
+    }
+    TriggerNodeReport(isolate, kHeapPressure, message, __func__, nullptr, MaybeLocal<Value>());
+  }
+  // Restore the heap limit. V8 keeps it above the current heap size, and only
+  // restores a limit when the callback is removed, so register it again.
+  isolate->RemoveNearHeapLimitCallback(OnNearHeapLimit, heap_pressure_limit);
+  isolate->AddNearHeapLimitCallback(OnNearHeapLimit, isolate);
+  heap_pressure_pending = false;
+}
+
+static void OnHeapPressureGC(Isolate* isolate, v8::GCType type, v8::GCCallbackFlags flags) {
+  if (heap_pressure_armed || heap_pressure_pending || !(nodereport_events & NR_HEAPPRESSURE)) {
+    return;
+  }
+  // The limit passed to OnNearHeapLimit() is for the old generation only
+  v8::HeapStatistics heap_stats;
+  isolate->GetHeapStatistics(&heap_stats);
+  if (heap_stats.used_heap_size() < heap_pressure_limit / 2) {
+    heap_pressure_armed = true;
+  }
+}
+
+// Arm the heap pressure trigger, registering the V8 callbacks on first use
+static void SetupHeapPressureHook(Isolate* isolate) {
+  if (!heap_pressure_hook_initialised) {
+    isolate->AddNearHeapLimitCallback(OnNearHeapLimit, isolate);
+    isolate->AddGCEpilogueCallback(OnHeapPressureGC);
+#if V8_MAJOR_VERSION >= 7
+    // Return to the initial limit once the heap has shrunk after a report
+    isolate->AutomaticallyRestoreInitialHeapLimit(0.5);
+#endif
+    heap_pressure_hook_initialised = true;
+  }
+  heap_pressure_armed = !heap_pressure_pending;
+}
+#endif
+
 bool OnUncaughtException(v8::Isolate* isolate) {
   // Trigger report if requested
   if (nodereport_events & NR_EXCEPTION) {
@@ -254,6 +516,21 @@ static void SignalDumpInterruptCallback(Isolate* isolate, void* data) {
     report_signal = 0;
   }
 }
+static void StallInterruptCallback(Isolate* isolate, void* data) {
+  // The stall may have ended before the interrupt was serviced, for example if
+  // the event loop was blocked in native code rather than JavaScript.
+  const unsigned long heartbeat = reinterpret_cast<uintptr_t>(data);
+  if (heartbeat != loop_heartbeat || !(nodereport_events & NR_STALL)) {
+    return;
+  }
+  char message[64];
+  snprintf(message, sizeof(message), "event loop blocked for %llu ms",
+           static_cast<unsigned long long>((uv_hrtime() - stall_start) / 1000000));
+  if (nodereport_verbose) {
+    fprintf(stdout, "node-report: StallInterruptCallback %s, triggering report\n", message);
+  }
+  TriggerNodeReport(isolate, kStall, message, __func__, nullptr, MaybeLocal<Value>());
+}
 static void SignalDumpAsyncCallback(uv_async_t* handle) {
   if (report_signal != 0) {
     if (nodereport_verbose) {
@@ -298,6 +575,8 @@ static void SignalDump(int signo) {
   // Check atomic for report already pending, storing the signal number
   if (__sync_val_compare_and_swap(&report_signal, 0, signo) == 0) {
     uv_sem_post(&report_semaphore);  // Hand-off to watchdog thread
+  } else {
+    CountSuppressedReport(kSignal_UV);  // merged with the pending signal
   }
 }
 
@@ -352,10 +631,13 @@ static void SetupSignalHandler() {
     fprintf(stderr, "node-report: initialization failed, uv_sem_init() returned %d\n", rc);
     Nan::ThrowError("node-report: initialization failed, uv_sem_init() returned error\n");
   }
-  rc = uv_mutex_init(&node_isolate_mutex);
-  if (rc != 0) {
-    fprintf(stderr, "node-report: initialization failed, uv_mutex_init() returned %d\n", rc);
-    Nan::ThrowError("node-report: initialization failed, uv_mutex_init() returned error\n");
+  if (!isolate_mutex_initialised) {
+    rc = uv_mutex_init(&node_isolate_mutex);
+    if (rc != 0) {
+      fprintf(stderr, "node-report: initialization failed, uv_mutex_init() returned %d\n", rc);
+      Nan::ThrowError("node-report: initialization failed, uv_mutex_init() returned error\n");
+    }
+    isolate_mutex_initialised = true;
   }
 
   if (StartWatchdogThread(ReportSignalThreadMain) == 0) {
@@ -369,19 +651,131 @@ static void SetupSignalHandler() {
     signal_thread_initialised = true;
   }
 }
-#endif
 
 /*******************************************************************************
- * Native module initializer function, called when the module is require'd
+ * Event loop stall detection (platforms except Windows)
+ *  - StallCheckCallback() - loop has finished waiting, count an iteration
+ *  - StallAsyncCallback() - loop has answered the watchdog, count a heartbeat
+ *  - ReportStallThreadMain() - watchdog thread, polls the loop heartbeat
+ *  - SetupStallWatchdog() - initialisation of loop handles and thread
  *
+ * The loop is stalled if its heartbeat has not changed for longer than the
+ * threshold. A busy loop beats in its check phase. When the heartbeat has not
+ * changed since the last poll, the watchdog sends an async wakeup, which the
+ * loop answers at once if it is waiting for events, but not while it is
+ * blocked in any callback, including the I/O callbacks run from the poll
+ * phase. The report is triggered by an interrupt, so the JavaScript stack
+ * shows the code that is blocking the loop. One report is written per stall.
+ * While stall reports are turned off the watchdog waits on a condition
+ * variable, so it neither polls nor wakes the loop.
  ******************************************************************************/
-NAN_MODULE_INIT(Initialize) {
-  v8::Isolate* isolate = Isolate::GetCurrent();
+static void StallCheckCallback(uv_check_t* handle) {
+  loop_heartbeat++;
+}
+
+static void StallAsyncCallback(uv_async_t* handle) {
+  loop_heartbeat++;
+}
+
+inline void* ReportStallThreadMain(void* unused) {
+  unsigned long last_heartbeat = loop_heartbeat;
+  unsigned long reported_heartbeat = last_heartbeat - 1;
+  uint64_t unchanged_since = uv_hrtime();
+  for (;;) {
+    const unsigned int threshold = stall_threshold;
+    const unsigned int poll_ms = threshold / 4 > NR_STALL_THRESHOLD_MIN ? threshold / 4 : NR_STALL_THRESHOLD_MIN;
+    struct timespec poll_time = {poll_ms / 1000, (poll_ms % 1000) * 1000000L};
+    nanosleep(&poll_time, nullptr);
+
+    if (!(nodereport_events & NR_STALL)) {
+      uv_mutex_lock(&node_isolate_mutex);
+      while (!(nodereport_events & NR_STALL)) {
+        uv_cond_wait(&stall_cond, &node_isolate_mutex);
+      }
+      uv_mutex_unlock(&node_isolate_mutex);
+      // The loop was not watched while waiting, start a new stall period
+      last_heartbeat = loop_heartbeat;
+      unchanged_since = uv_hrtime();
+      continue;
+    }
+
+    const uint64_t now = uv_hrtime();
+    const unsigned long heartbeat = loop_heartbeat;
+    if (heartbeat != last_heartbeat) {
+      last_heartbeat = heartbeat;
+      unchanged_since = now;
+      continue;
+    }
+    // Wake the loop in case it is waiting for events, not stalled
+    uv_async_send(&stall_async_handle);
+    if (heartbeat == reported_heartbeat ||
+        now - unchanged_since < threshold * 1000000ULL) {
+      continue;
+    }
+    reported_heartbeat = heartbeat;
+    stall_start = unchanged_since;
+    if (nodereport_verbose) {
+      fprintf(stdout, "node-report: event loop stall detected\n");
+    }
+    uv_mutex_lock(&node_isolate_mutex);
+    if (auto isolate = node_isolate) {
+      isolate->RequestInterrupt(StallInterruptCallback,
+                                reinterpret_cast<void*>(static_cast<uintptr_t>(heartbeat)));
+    }
+    uv_mutex_unlock(&node_isolate_mutex);
+  }
+  return nullptr;
+}
+
+static void SetupStallWatchdog() {
+  int rc;
+  if (!isolate_mutex_initialised) {
+    rc = uv_mutex_init(&node_isolate_mutex);
+    if (rc != 0) {
+      fprintf(stderr, "node-report: initialization failed, uv_mutex_init() returned %d\n", rc);
+      Nan::ThrowError("node-report: initialization failed, uv_mutex_init() returned error\n");
+      return;
+    }
+    isolate_mutex_initialised = true;
+  }
+  rc = uv_cond_init(&stall_cond);
+  if (rc != 0) {
+    fprintf(stderr, "node-report: initialization failed, uv_cond_init() returned %d\n", rc);
+    Nan::ThrowError("node-report: initialization failed, uv_cond_init() returned error\n");
+    return;
+  }
+
+  // The handles do not keep the event loop alive
+  rc = uv_async_init(uv_default_loop(), &stall_async_handle, StallAsyncCallback);
+  if (rc != 0) {
+    fprintf(stderr, "node-report: initialization failed, uv_async_init() returned %d\n", rc);
+    Nan::ThrowError("node-report: initialization failed, uv_async_init() returned error\n");
+    return;
+  }
+  uv_unref(reinterpret_cast<uv_handle_t*>(&stall_async_handle));
+  uv_check_init(uv_default_loop(), &stall_check_handle);
+  uv_check_start(&stall_check_handle, StallCheckCallback);
+  uv_unref(reinterpret_cast<uv_handle_t*>(&stall_check_handle));
+
+  if (StartWatchdogThread(ReportStallThreadMain) == 0) {
+    stall_watchdog_initialised = true;
+  }
+}
+#endif
+
+/*******************************************************************************
+ * Native module initializer function, called when the module is require'd on
+ * the main thread or on a worker thread. Each thread is registered, so that
+ * reports include its JavaScript stack, heap and handles, but the options and
+ * the report triggers are set up once, by the main thread.
+ ******************************************************************************/
+static void InitializeMainThread(Isolate* isolate) {
   node_isolate = isolate;
 
   SetLoadTime();
   SetVersionString(isolate);
   SetCommandLine();
+  SetupGCHistory(isolate);
 
   const char* verbose_switch = secure_getenv("NODEREPORT_VERBOSE");
   if (verbose_switch != nullptr) {
@@ -391,6 +785,10 @@ NAN_MODULE_INIT(Initialize) {
   if (trigger_events != nullptr) {
     nodereport_events = ProcessNodeReportEvents(trigger_events);
   }
+  const char* report_sections = secure_getenv("NODEREPORT_SECTIONS");
+  if (report_sections != nullptr) {
+    ProcessNodeReportSections(report_sections, &nodereport_sections);
+  }
   const char* trigger_signal = secure_getenv("NODEREPORT_SIGNAL");
   if (trigger_signal != nullptr) {
     nodereport_signal = ProcessNodeReportSignal(trigger_signal);
@@ -403,6 +801,59 @@ NAN_MODULE_INIT(Initialize) {
   if (directory_name != nullptr) {
     ProcessNodeReportDirectory(directory_name);
   }
+  const char* async_switch = secure_getenv("NODEREPORT_ASYNC");
+  if (async_switch != nullptr) {
+    nodereport_async = ProcessNodeReportAsyncSwitch(async_switch);
+  }
+  const char* delta_switch = secure_getenv("NODEREPORT_DELTA");
+  if (delta_switch != nullptr) {
+    nodereport_delta = ProcessNodeReportDeltaSwitch(delta_switch);
+  }
+  const char* resolve_names_switch = secure_getenv("NODEREPORT_RESOLVE_NAMES");
+  if (resolve_names_switch != nullptr) {
+    nodereport_resolve_names = ProcessNodeReportResolveNamesSwitch(resolve_names_switch);
+  }
+  const char* handle_limit = secure_getenv("NODEREPORT_HANDLE_LIMIT");
+  if (handle_limit != nullptr) {
+    nodereport_handle_limit = ProcessNodeReportHandleLimit(handle_limit);
+  }
+  const char* report_format = secure_getenv("NODEREPORT_FORMAT");
+  if (report_format != nullptr) {
+    nodereport_format = ProcessNodeReportFormat(report_format);
+  }
+  const char* report_compression = secure_getenv("NODEREPORT_COMPRESSION");
+  if (report_compression != nullptr) {
+    nodereport_compression = ProcessNodeReportCompression(report_compression);
+  }
+  const char* arena_size = secure_getenv("NODEREPORT_EMERGENCY_ARENA");
+  if (arena_size != nullptr) {
+    SetEmergencyArenaSize(ProcessNodeReportArenaSize(arena_size));
+  } else {
+    SetEmergencyArenaSize(NR_ARENA_SIZE_DEFAULT);
+  }
+#ifndef _WIN32
+  const char* stall = secure_getenv("NODEREPORT_STALL_THRESHOLD");
+  if (stall != nullptr) {
+    stall_threshold = ProcessNodeReportStallThreshold(stall);
+  }
+#endif
+  const char* retention = secure_getenv("NODEREPORT_RETENTION");
+  RetentionPolicy policy;
+  if (retention != nullptr && ProcessNodeReportRetention(retention, &policy)) {
+    SetReportRetention(policy);
+  }
+  const char* rate_limit = secure_getenv("NODEREPORT_RATE_LIMIT");
+  if (rate_limit != nullptr) {
+    ProcessNodeReportRateLimits(rate_limit, &nodereport_rate_limits);
+  }
+  const char* sampling_interval = secure_getenv("NODEREPORT_SAMPLING_INTERVAL");
+  if (sampling_interval != nullptr) {
+    SetStackSamplerInterval(isolate, ProcessNodeReportSamplingInterval(sampling_interval));
+  }
+  const char* probe_interval = secure_getenv("NODEREPORT_THREADPOOL_PROBE");
+  if (probe_interval != nullptr) {
+    SetThreadpoolProbeInterval(isolate, ProcessNodeReportThreadpoolProbeInterval(probe_interval));
+  }
 
   // If report requested for fatalerror, set up the V8 callback
   if (nodereport_events & NR_FATALERROR) {
@@ -410,6 +861,13 @@ NAN_MODULE_INIT(Initialize) {
     error_hook_initialised = true;
   }
 
+#ifdef NR_HEAP_PRESSURE
+  // If report requested on heap pressure, set up the near heap limit callback
+  if (nodereport_events & NR_HEAPPRESSURE) {
+    SetupHeapPressureHook(isolate);
+  }
+#endif
+
   // If report requested for exceptions, tell V8 to capture stack trace and set up the callback
   if (nodereport_events & NR_EXCEPTION) {
     isolate->SetCaptureStackTraceForUncaughtExceptions(true, 32, v8::StackTrace::kDetailed);
@@ -424,15 +882,40 @@ NAN_MODULE_INIT(Initialize) {
   if (nodereport_events & NR_SIGNAL) {
     SetupSignalHandler();
   }
+  // If report requested on event loop stalls set up the watchdog thread
+  if (nodereport_events & NR_STALL) {
+    SetupStallWatchdog();
+  }
 #endif
+}
+
+NAN_MODULE_INIT(Initialize) {
+  v8::Isolate* isolate = Isolate::GetCurrent();
+  if (RegisterReportThread(isolate)) {
+    InitializeMainThread(isolate);
+  }
 
   Nan::SetMethod(target, "triggerReport", TriggerReport);
   Nan::SetMethod(target, "getReport", GetReport);
+  Nan::SetMethod(target, "getReportTimings", GetReportTimings);
   Nan::SetMethod(target, "setEvents", SetEvents);
+  Nan::SetMethod(target, "setSections", SetSections);
   Nan::SetMethod(target, "setSignal", SetSignal);
   Nan::SetMethod(target, "setFileName", SetFileName);
   Nan::SetMethod(target, "setDirectory", SetDirectory);
   Nan::SetMethod(target, "setVerbose", SetVerbose);
+  Nan::SetMethod(target, "setAsync", SetAsync);
+  Nan::SetMethod(target, "setDelta", SetDelta);
+  Nan::SetMethod(target, "setResolveNames", SetResolveNames);
+  Nan::SetMethod(target, "setHandleLimit", SetHandleLimit);
+  Nan::SetMethod(target, "setFormat", SetFormat);
+  Nan::SetMethod(target, "setCompression", SetCompression);
+  Nan::SetMethod(target, "setEmergencyArena", SetEmergencyArena);
+  Nan::SetMethod(target, "setStallThreshold", SetStallThreshold);
+  Nan::SetMethod(target, "setSamplingInterval", SetSamplingInterval);
+  Nan::SetMethod(target, "setThreadpoolProbe", SetThreadpoolProbe);
+  Nan::SetMethod(target, "setRateLimit", SetRateLimit);
+  Nan::SetMethod(target, "setRetention", SetRetention);
 
   if (nodereport_verbose) {
 #ifdef _WIN32
@@ -445,7 +928,7 @@ NAN_MODULE_INIT(Initialize) {
   }
 }
 
-NODE_MODULE(nodereport, Initialize)
+NAN_MODULE_WORKER_ENABLED(nodereport, Initialize)
 
 }  // namespace nodereport
 
@@ -1,10 +1,26 @@
 #include "node_report.h"
+#include "elf_symbolizer.h"
+#include "fd_inventory.h"
+#include "gzip_stream.h"
+#include "memory_map.h"
+#include "stack_sampler.h"
+#include "thread_usage.h"
 #include "v8.h"
 #include "uv.h"
 
 #include <fcntl.h>
+#include <stdarg.h>
 #include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <deque>
 #include <fstream>
+#include <functional>
+#include <iterator>
+#include <list>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
 
 #if !defined(_MSC_VER)
 #include <strings.h>
@@ -29,6 +45,9 @@
 #if defined(__linux__) || defined(__sun)
 #include <link.h>
 #endif
+#ifdef __linux__
+#include <sys/syscall.h>  // SYS_gettid
+#endif
 #ifdef _AIX
 #include <sys/ldr.h>  // ld_info structure
 #endif
@@ -36,6 +55,7 @@
 // and on some Linux distributions, e.g. Alpine Linux.
 #if !defined(_AIX) && !(defined(__linux__) && !defined(__GLIBC__)) && !defined(__MVS__)
 #include <execinfo.h>
+#define NR_NATIVE_SYMBOLS  // native frames are resolved by ResolveNativeStack()
 #endif
 #include <sys/utsname.h>
 #endif
@@ -73,32 +93,198 @@ using v8::String;
 using v8::V8;
 
 // Internal/static function declarations
-static void WriteNodeReport(Isolate* isolate, DumpEvent event, const char* message, const char* location, char* filename, std::ostream &out, MaybeLocal<Value> error, TIME_TYPE* time);
+static void CaptureSnapshot(Isolate* isolate, DumpEvent event, const char* message, const char* location, const char* filename, MaybeLocal<Value> error, TIME_TYPE* tm_struct, ReportSnapshot* snapshot);
+static void WriteNodeReport(ReportSnapshot& snapshot, std::ostream &out);
+static void WriteStructuredReport(ReportSnapshot& snapshot, ReportWriter& writer, std::ostream &out);
+static void FormatTime(const TIME_TYPE* tm_struct, char* buf, size_t size);
+static unsigned int EventSections(DumpEvent event);
+static bool RepeatableEvent(DumpEvent event);
+static bool ReportAllowed(DumpEvent event);
+static void TakeSuppressedReports(std::vector<std::pair<std::string, unsigned long long> >* suppressed);
+static void WriteReportFile(ReportSnapshot& snapshot, const char* directory);
+static void QueueReportFile(ReportSnapshot* snapshot, const char* directory);
+static void DrainReportQueue();
+static void RetainReportFile(const char* directory, const char* filename);
 static void PrintCommandLine(std::ostream& out);
 static void PrintVersionInformation(std::ostream& out);
+static void PrintVersionInformation(ReportWriter& writer);
 static void PrintJavaScriptStack(std::ostream& out, Isolate* isolate, DumpEvent event, const char* location);
 static void PrintJavaScriptErrorStack(std::ostream& out, Isolate* isolate, MaybeLocal<Value> error);
 static void PrintStackFromStackTrace(std::ostream& out, Isolate* isolate, DumpEvent event);
 static void PrintStackFrame(std::ostream& out, Isolate* isolate, Local<StackFrame> frame, int index, void* pc);
-static void PrintNativeStack(std::ostream& out);
+static void CaptureNativeStack(ReportSnapshot* snapshot);
+static void PrintNativeStack(std::ostream& out, const ReportSnapshot& snapshot);
+static void PrintNativeStack(ReportWriter& writer, const ReportSnapshot& snapshot);
+#ifndef _WIN32
+static void CaptureThreadUsage(ThreadUsage* usage);
+static void PrintResourceUsage(std::ostream& out, const ReportSnapshot& snapshot);
+static void PrintResourceUsage(ReportWriter& writer, const ReportSnapshot& snapshot);
+#ifdef NR_MEMORY_MAP
+static void PrintMemoryMap(std::ostream& out);
+static void PrintMemoryMap(ReportWriter& writer);
+#endif
+#ifdef NR_THREAD_TABLE
+static void CaptureThreadCpuTable(ReportSnapshot* snapshot);
+static void PrintThreadCpuTable(std::ostream& out, const ReportSnapshot& snapshot);
+static void PrintThreadCpuTable(ReportWriter& writer, const ReportSnapshot& snapshot);
+#endif
+#ifdef NR_FD_INVENTORY
+static void CaptureHandleDescriptors(uv_loop_t* loop, std::vector<int>* fds);
+static void PrintFdInventory(std::ostream& out, const ReportSnapshot& snapshot);
+static void PrintFdInventory(ReportWriter& writer, const ReportSnapshot& snapshot);
+#endif
+#endif
+static void CaptureStackSamples(StackSampleInfo* info);
+static void PrintStackSamples(std::ostream& out, const StackSampleInfo& info);
+static void PrintStackSamples(ReportWriter& writer, const StackSampleInfo& info);
+static void PrintThreadpoolProbe(std::ostream& out, const ThreadpoolProbeInfo& info);
+static void PrintThreadpoolProbe(ReportWriter& writer, const ThreadpoolProbeInfo& info);
+static void CaptureHeapStatistics(HeapInfo* heap, Isolate* isolate);
+static void CaptureGCStatistics(HeapInfo* heap, Isolate* isolate);
+static void PrintGCStatistics(std::ostream& out, const HeapInfo& heap);
+static void PrintGCStatistics(ReportWriter& writer, const HeapInfo& heap);
+static void PrintGCHistory(std::ostream& out, const HeapInfo& heap);
+static void PrintGCHistory(ReportWriter& writer, const HeapInfo& heap);
+static void RequestThreads(Isolate* isolate, unsigned int sections, ReportSnapshot* snapshot);
+static void CollectThreads(ReportSnapshot* snapshot);
+static void PrintThreads(std::ostream& out, const ReportSnapshot& snapshot);
+static void PrintThreads(ReportWriter& writer, const ReportSnapshot& snapshot);
+static void PrintEnvironmentVariables(std::ostream& out, const std::vector<std::string>& variables);
+static void PrintEnvironmentVariables(ReportWriter& writer, const std::vector<std::string>& variables);
+static bool ComputeReportDelta(const ReportSnapshot& snapshot, ReportDelta* delta);
+static void PrintHeapChanges(std::ostream& out, const HeapInfo& heap, const ReportDelta& delta);
+static void PrintHeapChanges(ReportWriter& writer, const HeapInfo& heap, const ReportDelta& delta);
+#ifndef _WIN32
+static void PrintResourceUsageChanges(std::ostream& out, const ReportDelta& delta);
+static void PrintResourceUsageChanges(ReportWriter& writer, const ReportDelta& delta);
+static void PrintUserLimitChanges(std::ostream& out, const ReportDelta& delta);
+static void PrintUserLimitChanges(ReportWriter& writer, const ReportDelta& delta);
+#endif
+static void PrintHandleChanges(std::ostream& out, const ReportDelta& delta);
+static void PrintHandleChanges(ReportWriter& writer, const ReportDelta& delta);
+static void PrintEnvironmentChanges(std::ostream& out, const ReportDelta& delta);
+static void PrintEnvironmentChanges(ReportWriter& writer, const ReportDelta& delta);
+static void PrintLibraryChanges(std::ostream& out, const ReportDelta& delta);
+static void PrintLibraryChanges(ReportWriter& writer, const ReportDelta& delta);
 #ifndef _WIN32
-static void PrintResourceUsage(std::ostream& out);
+static void PrintUserLimits(std::ostream& out);
+static void PrintUserLimits(ReportWriter& writer);
+#endif
+static void PrintLoadedLibraries(std::ostream& out);
+static void PrintLoadedLibraries(ReportWriter& writer);
+static void FinishReportTimings(ReportTimings* timings);
+static void PrintReportTimings(std::ostream& out, const ReportTimings& timings);
+static void PrintReportTimings(ReportWriter& writer, const ReportTimings& timings);
+static void PublishReportTimings(const ReportTimings& timings);
+static void GetEnvironmentVariables(std::vector<std::string>* variables);
+static bool GetLoadedLibraries(std::vector<std::string>* libraries);
+#ifdef NR_EMERGENCY_REPORT
+static void WriteEmergencyReport(Isolate* isolate, const char* message, const char* location,
+                                 const char* filename, const TIME_TYPE* tm_struct,
+                                 const char* directory, unsigned int sections);
+static bool EmergencyReportAvailable();
 #endif
-static void PrintGCStatistics(std::ostream& out, Isolate* isolate);
-static void PrintSystemInformation(std::ostream& out, Isolate* isolate);
-static void PrintLoadedLibraries(std::ostream& out, Isolate* isolate);
 
 // Global variables
 static int seq = 0;  // sequence number for report filenames
 const char* v8_states[] = {"JS", "GC", "COMPILER", "OTHER", "EXTERNAL", "IDLE"};
-static bool report_active = false; // recursion protection
+static std::atomic<bool> report_active(false);  // recursion protection
+unsigned int nodereport_async = 0;  // write signal and API reports on the writer thread
+unsigned int nodereport_delta = 0;  // write signal, stall and API reports as delta reports
+unsigned int nodereport_resolve_names = 0;  // show cached host names for socket endpoints
+size_t nodereport_handle_limit = 0;  // handles listed before aggregating, 0 for no limit
+ReportFormat nodereport_format = kText;
+ReportCompression nodereport_compression = kUncompressed;
+SectionMasks nodereport_sections = {NR_SECTION_ALL, NR_SECTION_ALL, NR_SECTION_ALL, NR_SECTION_ALL,
+                                    NR_SECTION_ALL, NR_SECTION_ALL};
+RateLimits nodereport_rate_limits = {};  // no limits
 char report_filename[NR_MAXNAME + 1] = "";
 char report_directory[NR_MAXPATH + 1] = ""; // defaults to current working directory
 std::string version_string = UNKNOWN_NODEVERSION_STRING;
+std::string nodejs_version = "";
+std::vector<std::pair<std::string, std::string> > component_versions;
 std::string commandline_string = "";
 TIME_TYPE loadtime_tm_struct; // module load time
 time_t load_time; // module load time absolute
 
+// Report writer thread, see QueueReportFile()
+struct ReportJob {
+  ReportSnapshot* snapshot;
+  std::string directory;
+};
+static bool writer_thread_initialised = false;
+static bool writer_busy = false;
+static uv_thread_t writer_thread;
+static uv_mutex_t writer_mutex;
+static uv_cond_t writer_cond;  // signalled when a job is queued or completed
+static std::deque<ReportJob> writer_queue;
+
+// Summary of a report written to file, kept in memory as the base for the
+// next delta report, see ComputeReportDelta()
+struct ReportSummary {
+  std::string filename;
+  uint64_t time;                 // uv_hrtime() when the report was captured
+  unsigned int sections;         // NR_SECTION_* flags for the sections summarised
+  HeapInfo heap;                 // without the GC history
+#ifndef _WIN32
+  bool has_usage;
+  struct rusage usage;
+  ThreadUsage loop_thread_usage;
+  std::vector<std::pair<bool, struct rlimit> > limits;  // in rlimit_strings order
+#endif
+  std::unordered_map<const void*, uv_handle_type> handles;
+  bool handles_aggregated = false;  // only some handles were captured, see CaptureHandles()
+  std::unordered_map<std::string, size_t> environment;  // name to hash of the value
+  std::set<std::string> libraries;
+};
+
+// Differences between a report and the base report, the previous report
+// written to file. Sections not in 'sections' are written in full.
+struct ReportDelta {
+  unsigned int sections;         // NR_SECTION_* flags for the sections written as changes
+  ReportSummary base;
+  ReportSummary current;
+  std::vector<const HandleInfo*> handles_added;
+  std::vector<std::pair<const void*, uv_handle_type> > handles_removed;
+  std::vector<std::string> environment_set;      // "name=value", new or changed
+  std::vector<std::string> environment_removed;  // names
+  std::vector<size_t> limits_changed;            // indexes into rlimit_strings
+  std::vector<std::string> libraries_added;
+  std::vector<std::string> libraries_removed;
+};
+static uv_once_t delta_once = UV_ONCE_INIT;
+static uv_mutex_t delta_mutex;
+static bool delta_base_available = false;
+static ReportSummary delta_base;
+
+// Check whether a report section is written as changes from the base report
+static bool DeltaSection(const ReportSnapshot& snapshot, unsigned int section) {
+  return snapshot.delta != nullptr && (snapshot.delta->sections & section);
+}
+
+// Timings of the last completed report, see GetLastReportTimings()
+static uv_once_t timings_once = UV_ONCE_INIT;
+static uv_mutex_t timings_mutex;
+static bool timings_available = false;
+static ReportTimings last_report_timings;
+
+// Records the time taken by a report section, from construction to the end of
+// the enclosing scope
+class SectionTimer {
+ public:
+  SectionTimer(ReportTimings* timings, const char* name)
+      : timings_(timings), name_(name), start_(uv_hrtime()) {}
+  ~SectionTimer() {
+    SectionTiming timing = {name_, uv_hrtime() - start_};
+    timings_->sections.push_back(timing);
+  }
+
+ private:
+  ReportTimings* timings_;
+  const char* name_;
+  uint64_t start_;
+};
+
 
 /*******************************************************************************
  * External function to trigger a node report, writing to file.
@@ -107,9 +293,22 @@ time_t load_time; // module load time absolute
  * the actual filename is returned.
  ******************************************************************************/
 void TriggerNodeReport(Isolate* isolate, DumpEvent event, const char* message, const char* location, char* name, MaybeLocal<Value> error) {
-  // Recursion check for report in progress, bail out
-  if (report_active) return;
-  report_active = true;
+  // Recursion check for report in progress, bail out. The trigger is counted
+  // in the next report, as for one over its rate limit.
+  if (report_active.exchange(true)) {
+    CountSuppressedReport(event);
+    return;
+  }
+
+  // Drop the report if the trigger event is over its rate limit. The count is
+  // included in the next report that is written.
+  if (!ReportAllowed(event)) {
+    if (name != nullptr) {
+      name[0] = '\0';  // no report file name to return
+    }
+    report_active = false;
+    return;
+  }
 
   // Obtain the current time and the pid (platform dependent)
   TIME_TYPE tm_struct;
@@ -134,28 +333,90 @@ void TriggerNodeReport(Isolate* isolate, DumpEvent event, const char* message, c
     snprintf(filename, sizeof(filename), "%s", report_filename);
   } else {
     // Construct the report filename, with timestamp, pid and sequence number
+    const char* extension = nodereport_format == kJSON ? "json" :
+                            nodereport_format == kBinary ? "nrb" : "txt";
+    const char* suffix = nodereport_compression == kGzip ? ".gz" : "";
+#ifdef NR_EMERGENCY_REPORT
+    if (event == kFatalError && EmergencyReportAvailable()) {
+      extension = "txt";  // the emergency report is always uncompressed text
+      suffix = "";
+    }
+#endif
     snprintf(filename, sizeof(filename), "%s", "node-report");
     seq++;
 #ifdef _WIN32
     snprintf(&filename[strlen(filename)], sizeof(filename) - strlen(filename),
-             ".%4d%02d%02d.%02d%02d%02d.%d.%03d.txt",
+             ".%4d%02d%02d.%02d%02d%02d.%d.%03d.%s%s",
              tm_struct.wYear, tm_struct.wMonth, tm_struct.wDay,
              tm_struct.wHour, tm_struct.wMinute, tm_struct.wSecond,
-             pid, seq);
+             pid, seq, extension, suffix);
 #else  // UNIX, OSX
     snprintf(&filename[strlen(filename)], sizeof(filename) - strlen(filename),
-             ".%4d%02d%02d.%02d%02d%02d.%d.%03d.txt",
+             ".%4d%02d%02d.%02d%02d%02d.%d.%03d.%s%s",
              tm_struct.tm_year+1900, tm_struct.tm_mon+1, tm_struct.tm_mday,
              tm_struct.tm_hour, tm_struct.tm_min, tm_struct.tm_sec,
-             pid, seq);
+             pid, seq, extension, suffix);
+#endif
+  }
+
+  // Exception and fatal error reports are followed by the process aborting,
+  // which skips the atexit() handler, so reports still queued for the writer
+  // thread are written out first. Waiting does not allocate.
+  if (!RepeatableEvent(event)) {
+    DrainReportQueue();
+  }
+
+#ifdef NR_EMERGENCY_REPORT
+  // Fatal errors are reported without allocating, see WriteEmergencyReport()
+  if (event == kFatalError && EmergencyReportAvailable()) {
+    WriteEmergencyReport(isolate, message, location, filename, &tm_struct, report_directory,
+                         EventSections(event));
+    report_active = false;
+    return;
+  }
 #endif
+
+  // Capture the isolate and event loop data on this thread
+  ReportSnapshot* snapshot = new ReportSnapshot();
+  CaptureSnapshot(isolate, event, message, location, filename, error, &tm_struct, snapshot);
+  TakeSuppressedReports(&snapshot->suppressed);
+
+  // Reports for signals, stalls and API calls can be formatted and written on
+  // the writer thread, so the event loop resumes as soon as the capture is
+  // done. Exception and fatal error reports are always written synchronously,
+  // as the process is about to terminate.
+  if (nodereport_async && RepeatableEvent(event)) {
+    QueueReportFile(snapshot, report_directory);
+  } else {
+    WriteReportFile(*snapshot, report_directory);
+    delete snapshot;
+  }
+
+  if (name != nullptr) {
+    snprintf(name, NR_MAXNAME + 1, "%s", filename);  // return the report file name
   }
+  report_active = false;
+}
 
-  // Open the report file stream for writing. Supports stdout/err, user-specified or (default) generated name
+/*******************************************************************************
+ * Function to write a report to the file named in the snapshot, in the given
+ * directory. Supports stdout/err, user-specified or (default) generated name.
+ *
+ ******************************************************************************/
+static void WriteReportFile(ReportSnapshot& snapshot, const char* directory) {
+  const char* filename = snapshot.filename.c_str();
+  if (snapshot.threads_generation != 0) {
+    SectionTimer timer(&snapshot.timings, "collectThreads");
+    CollectThreads(&snapshot);
+  }
 #ifdef __MVS__
   __auto_ascii _a;
 #endif
   std::ofstream outfile;
+  // Binary and compressed reports must not have line endings translated.
+  const std::ios::openmode mode =
+      snapshot.format == kBinary || snapshot.compression != kUncompressed ? std::ios::binary
+                                                                        : std::ios::openmode();
   std::ostream* outstream = &std::cout;
   if (!strncmp(filename, "stdout", sizeof("stdout") - 1)) {
     outstream = &std::cout;
@@ -163,21 +424,21 @@ void TriggerNodeReport(Isolate* isolate, DumpEvent event, const char* message, c
     outstream = &std::cerr;
   } else {
     // Regular file. Append filename to directory path if one was specified
-    if (strlen(report_directory) > 0) {
+    if (strlen(directory) > 0) {
       char pathname[NR_MAXPATH + NR_MAXNAME + 1] = "";
 #ifdef _WIN32
-      snprintf(pathname, sizeof(pathname), "%s%s%s", report_directory, "\\", filename);
+      snprintf(pathname, sizeof(pathname), "%s%s%s", directory, "\\", filename);
 #else
-      snprintf(pathname, sizeof(pathname), "%s%s%s", report_directory, "/", filename);
+      snprintf(pathname, sizeof(pathname), "%s%s%s", directory, "/", filename);
 #endif
-      outfile.open(pathname, std::ios::out);
+      outfile.open(pathname, std::ios::out | mode);
     } else {
-      outfile.open(filename, std::ios::out);
+      outfile.open(filename, std::ios::out | mode);
     }
     // Check for errors on the file open
     if (!outfile.is_open()) {
-      if (strlen(report_directory) > 0) {
-        std::cerr << "\nFailed to open Node.js report file: " << filename << " directory: " << report_directory << " (errno: " << errno << ")\n";
+      if (strlen(directory) > 0) {
+        std::cerr << "\nFailed to open Node.js report file: " << filename << " directory: " << directory << " (errno: " << errno << ")\n";
       } else {
         std::cerr << "\nFailed to open Node.js report file: " << filename << " (errno: " << errno << ")\n";
       }
@@ -190,169 +451,1293 @@ void TriggerNodeReport(Isolate* isolate, DumpEvent event, const char* message, c
   // Pass our stream about by reference, not by copying it.
   std::ostream &out = outfile.is_open() ? outfile : *outstream;
 
-  WriteNodeReport(isolate, event, message, location, filename, out, error, &tm_struct);
+  // Compare with the previous report, see ComputeReportDelta()
+  ReportDelta delta;
+  if (nodereport_delta && outfile.is_open() && ComputeReportDelta(snapshot, &delta)) {
+    snapshot.delta = &delta;
+  }
+
+  if (outfile.is_open() && snapshot.compression == kGzip) {
+    // Compress the report as it is written, see GzipStreamBuf
+    GzipStreamBuf gzip(outfile);
+    std::ostream compressed(&gzip);
+    WriteNodeReport(snapshot, compressed);
+    if (!gzip.Finish()) {
+      std::cerr << "\nFailed to write compressed Node.js report file: " << filename << "\n";
+    }
+  } else {
+    WriteNodeReport(snapshot, out);
+  }
+  snapshot.delta = nullptr;
 
   // Do not close stdout/stderr, only close files we opened.
   if(outfile.is_open()) {
     outfile.close();
+    RetainReportFile(directory, filename);
   }
+  PublishReportTimings(snapshot.timings);
 
   std::cerr << "Node.js report completed\n";
-  if (name != nullptr) {
-    snprintf(name, NR_MAXNAME + 1, "%s", filename);  // return the report file name
+}
+
+/*******************************************************************************
+ * Functions to hand a captured report over to the report writer thread.
+ *  - QueueReportFile() - queue a snapshot, starting the thread on first use
+ *  - ReportWriterThreadMain() - implementation of the writer thread
+ *  - DrainReportQueue() - wait for queued reports to be written, at exit and
+ *    before an exception or fatal error report
+ ******************************************************************************/
+static void ReportWriterThreadMain(void* unused) {
+  uv_mutex_lock(&writer_mutex);
+  for (;;) {
+    while (writer_queue.empty()) {
+      uv_cond_wait(&writer_cond, &writer_mutex);
+    }
+    ReportJob job = writer_queue.front();
+    writer_queue.pop_front();
+    writer_busy = true;
+    uv_mutex_unlock(&writer_mutex);
+
+    WriteReportFile(*job.snapshot, job.directory.c_str());
+    delete job.snapshot;
+
+    uv_mutex_lock(&writer_mutex);
+    writer_busy = false;
+    uv_cond_broadcast(&writer_cond);
+  }
+}
+
+static void DrainReportQueue() {
+  if (!writer_thread_initialised) {
+    return;
+  }
+  uv_mutex_lock(&writer_mutex);
+  while (!writer_queue.empty() || writer_busy) {
+    uv_cond_wait(&writer_cond, &writer_mutex);
   }
+  uv_mutex_unlock(&writer_mutex);
+}
 
+static void QueueReportFile(ReportSnapshot* snapshot, const char* directory) {
+  if (!writer_thread_initialised) {
+    if (uv_mutex_init(&writer_mutex) != 0 || uv_cond_init(&writer_cond) != 0 ||
+        uv_thread_create(&writer_thread, ReportWriterThreadMain, nullptr) != 0) {
+      // Unable to start the writer thread, fall back to a synchronous report
+      std::cerr << "node-report: unable to start report writer thread\n";
+      WriteReportFile(*snapshot, directory);
+      delete snapshot;
+      return;
+    }
+    // Reports still queued when the process exits are written out first
+    atexit(DrainReportQueue);
+    writer_thread_initialised = true;
+  }
+  ReportJob job;
+  job.snapshot = snapshot;
+  job.directory = directory;
+  snapshot->timings.loop_released = uv_hrtime();
+  uv_mutex_lock(&writer_mutex);
+  writer_queue.push_back(job);
+  uv_cond_broadcast(&writer_cond);
+  uv_mutex_unlock(&writer_mutex);
 }
 
 /*******************************************************************************
- * External function to trigger a node report, writing to a supplied stream.
+ * Functions to enforce the report file retention policy.
  *
- *******************************************************************************/
-void GetNodeReport(Isolate* isolate, DumpEvent event, const char* message, const char* location, MaybeLocal<Value> error, std::ostream& out) {
-  // Obtain the current time and the pid (platform dependent)
-  TIME_TYPE tm_struct;
+ * The report files in the report directory are listed once, oldest first,
+ * when the first report is written after the policy is set. After that each
+ * new report is added to the end of the list and the oldest reports are
+ * deleted from the front until the directory is within the limits, so the
+ * cost per report does not depend on the number of files. Only files named
+ * like generated reports are managed, and the report just written is never
+ * deleted. Reports can be written on the event loop thread and on the report
+ * writer thread, so the list is protected by a mutex.
+ ******************************************************************************/
+struct RetainedReport {
+  std::string path;
+  unsigned long long size;
+  time_t time;                 // last modified
+};
+
+static uv_once_t retention_once = UV_ONCE_INIT;
+static uv_mutex_t retention_mutex;
+static RetentionPolicy retention_policy = {0, 0, 0};
+static bool retention_listed = false;  // retained_reports lists retention_directory
+static std::string retention_directory;
+static std::deque<RetainedReport> retained_reports;  // oldest first
+static unsigned long long retained_bytes = 0;
+
+static void InitRetention() {
+  if (uv_mutex_init(&retention_mutex) != 0) {
+    abort();
+  }
+}
+
+void SetReportRetention(const RetentionPolicy& policy) {
+  uv_once(&retention_once, InitRetention);
+  uv_mutex_lock(&retention_mutex);
+  retention_policy = policy;
+  retention_listed = false;  // list the directory again on the next report
+  retained_reports.clear();
+  retained_bytes = 0;
+  uv_mutex_unlock(&retention_mutex);
+}
+
+// Check for the node-report.<...>.<txt|json|nrb>[.gz] generated file names
+static bool IsReportFileName(const char* name) {
+  static const char prefix[] = "node-report.";
+  static const char* const suffixes[] = {".txt", ".json", ".nrb", ".txt.gz", ".json.gz",
+                                         ".nrb.gz"};
+  const size_t length = strlen(name);
+  if (strncmp(name, prefix, sizeof(prefix) - 1) != 0) {
+    return false;
+  }
+  for (const char* suffix : suffixes) {
+    const size_t suffix_length = strlen(suffix);
+    if (length > sizeof(prefix) - 1 + suffix_length &&
+        !strcmp(name + length - suffix_length, suffix)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool StatReportFile(const std::string& path, RetainedReport* report) {
+  uv_fs_t req;
+  const int rc = uv_fs_stat(nullptr, &req, path.c_str(), nullptr);
+  if (rc == 0) {
+    report->path = path;
+    report->size = req.statbuf.st_size;
+    report->time = static_cast<time_t>(req.statbuf.st_mtim.tv_sec);
+  }
+  uv_fs_req_cleanup(&req);
+  return rc == 0;
+}
+
+static std::string ReportFilePath(const std::string& directory, const char* filename) {
 #ifdef _WIN32
-  GetLocalTime(&tm_struct);
-#else  // UNIX, OSX
-  struct timeval time_val;
-  gettimeofday(&time_val, nullptr);
-  localtime_r(&time_val.tv_sec, &tm_struct);
+  return directory + "\\" + filename;
+#else
+  return directory + "/" + filename;
 #endif
-  WriteNodeReport(isolate, event, message, location, nullptr, out, error, &tm_struct);
+}
+
+static void ListReportFiles(const std::string& directory) {
+  retained_reports.clear();
+  retained_bytes = 0;
+  uv_fs_t req;
+  uv_dirent_t entry;
+  if (uv_fs_scandir(nullptr, &req, directory.c_str(), 0, nullptr) >= 0) {
+    while (uv_fs_scandir_next(&req, &entry) != UV_EOF) {
+      RetainedReport report;
+      if ((entry.type == UV_DIRENT_FILE || entry.type == UV_DIRENT_UNKNOWN) &&
+          IsReportFileName(entry.name) &&
+          StatReportFile(ReportFilePath(directory, entry.name), &report)) {
+        retained_reports.push_back(report);
+        retained_bytes += report.size;
+      }
+    }
+  }
+  uv_fs_req_cleanup(&req);
+  std::sort(retained_reports.begin(), retained_reports.end(),
+            [](const RetainedReport& a, const RetainedReport& b) {
+              return a.time != b.time ? a.time < b.time : a.path < b.path;
+            });
+  retention_directory = directory;
+  retention_listed = true;
+}
+
+static bool OverRetentionLimits(time_t now) {
+  const RetainedReport& oldest = retained_reports.front();
+  return (retention_policy.max_files != 0 && retained_reports.size() > retention_policy.max_files) ||
+         (retention_policy.max_bytes != 0 && retained_bytes > retention_policy.max_bytes) ||
+         (retention_policy.max_age != 0 && now - oldest.time > retention_policy.max_age);
+}
+
+static void RetainReportFile(const char* directory, const char* filename) {
+  uv_once(&retention_once, InitRetention);
+  uv_mutex_lock(&retention_mutex);
+  const RetentionPolicy& policy = retention_policy;
+  if ((policy.max_files == 0 && policy.max_bytes == 0 && policy.max_age == 0) ||
+      !IsReportFileName(filename)) {
+    uv_mutex_unlock(&retention_mutex);
+    return;
+  }
+  const std::string dir = strlen(directory) > 0 ? directory : ".";
+  RetainedReport report;
+  if (!retention_listed || dir != retention_directory) {
+    ListReportFiles(dir);  // includes the new report
+  } else if (StatReportFile(ReportFilePath(dir, filename), &report)) {
+    retained_reports.push_back(report);
+    retained_bytes += report.size;
+  }
+
+  const time_t now = time(nullptr);
+  while (retained_reports.size() > 1 && OverRetentionLimits(now)) {
+    const RetainedReport& oldest = retained_reports.front();
+    uv_fs_t req;
+    if (uv_fs_unlink(nullptr, &req, oldest.path.c_str(), nullptr) == 0) {
+      std::cerr << "Removed Node.js report file: " << oldest.path << "\n";
+    }
+    uv_fs_req_cleanup(&req);
+    retained_bytes -= oldest.size;
+    retained_reports.pop_front();
+  }
+  uv_mutex_unlock(&retention_mutex);
 }
 
 /*******************************************************************************
- * Internal function to coordinate and write the various sections of the node
- * report to the supplied stream
- *******************************************************************************/
-static void WriteNodeReport(Isolate* isolate, DumpEvent event, const char* message, const char* location, char* filename, std::ostream &out, MaybeLocal<Value> error, TIME_TYPE* tm_struct) {
+ * Functions to register the threads running JavaScript and capture their part
+ * of a report.
+ *  - RegisterReportThread() - record the isolate and event loop of a thread
+ *    loading the addon, the main thread or a worker thread
+ *  - RequestThreads() - on the triggering thread, request a capture from all
+ *    the other threads
+ *  - CaptureThread() - on each other thread, capture its JavaScript stack,
+ *    heap statistics and libuv handles
+ *  - CollectThreads() - when the report is written, wait for the captures to
+ *    complete and add them to the snapshot
+ *
+ * The other threads are asked for their data with an isolate interrupt, which
+ * runs if the thread is executing JavaScript, and an async handle on its event
+ * loop, which runs if the loop is waiting for events. Whichever runs first
+ * captures the data. Threads that do not respond within the timeout, for
+ * example because they are blocked in native code, are listed as such. The
+ * wait is on the report writer thread for an asynchronous report, so the
+ * triggering event loop is not held up by a busy worker.
+ ******************************************************************************/
+struct RegisteredThread {
+  unsigned int id;
+  bool main_thread;
+  Isolate* isolate;
+  uv_loop_t* loop;
+  uv_async_t* async;           // wakes the event loop for a capture
+  long os_thread_id;
+  uint64_t requested;          // capture generation requested
+  uint64_t completed;          // capture generation completed
+  unsigned int sections;       // NR_SECTION_* flags requested
+  ThreadReport report;
+};
+static uv_once_t threads_once = UV_ONCE_INIT;
+static uv_mutex_t threads_mutex;
+static uv_cond_t threads_cond;  // signalled when a thread completes a capture or exits
+static std::list<RegisteredThread> report_threads;
+static unsigned int next_thread_id = 0;
+static uint64_t capture_generation = 0;
+static bool threads_capture_active = false;  // only one report collects the threads at a time
 
-#ifdef _WIN32
-  DWORD pid = GetCurrentProcessId();
-#else  // UNIX, OSX
-  pid_t pid = getpid();
-#endif
+static void InitReportThreads() {
+  if (uv_mutex_init(&threads_mutex) != 0 || uv_cond_init(&threads_cond) != 0) {
+    abort();
+  }
+}
 
-  // Save formatting for output stream.
-  std::ios oldState(nullptr);
-  oldState.copyfmt(out);
+// Find a registered thread by number, call with threads_mutex held
+static RegisteredThread* FindReportThread(unsigned int id) {
+  for (RegisteredThread& thread : report_threads) {
+    if (thread.id == id) {
+      return &thread;
+    }
+  }
+  return nullptr;
+}
 
-  // File stream opened OK, now start printing the report content, starting with the title
-  // and header information (event, filename, timestamp and pid)
-  out << "================================================================================\n";
-  out << "==== Node Report ===============================================================\n";
-  out << "\nEvent: " << message << ", location: \"" << location << "\"\n";
-  if( filename != nullptr ) {
-    out << "Filename: " << filename << "\n";
+// Event loop of the thread running an isolate, the default loop if unknown
+static uv_loop_t* GetThreadLoop(Isolate* isolate) {
+  uv_loop_t* loop = uv_default_loop();
+  uv_once(&threads_once, InitReportThreads);
+  uv_mutex_lock(&threads_mutex);
+  for (const RegisteredThread& thread : report_threads) {
+    if (thread.isolate == isolate) {
+      loop = thread.loop;
+    }
   }
+  uv_mutex_unlock(&threads_mutex);
+  return loop;
+}
 
-  // Print dump event and module load date/time stamps
-  char timebuf[64];
-#ifdef _WIN32
-  snprintf(timebuf, sizeof(timebuf), "%4d/%02d/%02d %02d:%02d:%02d",
-          tm_struct->wYear, tm_struct->wMonth, tm_struct->wDay,
-          tm_struct->wHour, tm_struct->wMinute, tm_struct->wSecond);
-  out << "Dump event time:  "<< timebuf << "\n";
-  snprintf(timebuf, sizeof(timebuf), "%4d/%02d/%02d %02d:%02d:%02d",
-          loadtime_tm_struct.wYear, loadtime_tm_struct.wMonth, loadtime_tm_struct.wDay,
-          loadtime_tm_struct.wHour, loadtime_tm_struct.wMinute, loadtime_tm_struct.wSecond);
-  out << "Module load time: " << timebuf << "\n";
-#else  // UNIX, OSX
-  snprintf(timebuf, sizeof(timebuf), "%4d/%02d/%02d %02d:%02d:%02d",
-          tm_struct->tm_year+1900, tm_struct->tm_mon+1, tm_struct->tm_mday,
-          tm_struct->tm_hour, tm_struct->tm_min, tm_struct->tm_sec);
-  out << "Dump event time:  "<< timebuf << "\n";
-      snprintf(timebuf, sizeof(timebuf), "%4d/%02d/%02d %02d:%02d:%02d",
-          loadtime_tm_struct.tm_year+1900, loadtime_tm_struct.tm_mon+1, loadtime_tm_struct.tm_mday,
-          loadtime_tm_struct.tm_hour, loadtime_tm_struct.tm_min, loadtime_tm_struct.tm_sec);
-  out << "Module load time: " << timebuf << "\n";
+static void CaptureThread(Isolate* isolate, unsigned int id, bool idle) {
+  uv_mutex_lock(&threads_mutex);
+  RegisteredThread* thread = FindReportThread(id);
+  if (thread == nullptr || thread->completed == thread->requested) {
+    uv_mutex_unlock(&threads_mutex);
+    return;  // already captured by the interrupt or the async callback
+  }
+  const uint64_t generation = thread->requested;
+  const unsigned int sections = thread->sections;
+  uv_loop_t* loop = thread->loop;
+  uv_mutex_unlock(&threads_mutex);
+
+  ThreadReport report;
+  report.captured = true;
+  report.idle = idle;
+  report.sections = sections;
+  if (sections & NR_SECTION_JSSTACK) {
+    if (idle) {
+      report.javascript_stack = "Event loop idle, no stack trace available\n";
+    } else {
+      v8::HandleScope scope(isolate);
+      std::ostringstream javascript_stack;
+      PrintStackFromStackTrace(javascript_stack, isolate, kSignal_JS);
+      report.javascript_stack = javascript_stack.str();
+    }
+  }
+  if (sections & NR_SECTION_HEAP) {
+    CaptureHeapStatistics(&report.heap, isolate);
+  }
+  if (sections & NR_SECTION_HANDLES) {
+    CaptureHandles(loop, &report.handles, &report.handle_aggregate);
+  }
+#ifdef NR_FD_INVENTORY
+  if (sections & NR_SECTION_FDS) {
+    CaptureHandleDescriptors(loop, &report.handle_fds);
+  }
 #endif
-  // Print native process ID
-  out << "Process ID: " << pid << std::endl;
 
+  uv_mutex_lock(&threads_mutex);
+  thread = FindReportThread(id);
+  if (thread != nullptr && thread->requested == generation) {
+    thread->report = std::move(report);
+    thread->completed = generation;
+    uv_cond_broadcast(&threads_cond);
+  }
+  uv_mutex_unlock(&threads_mutex);
+}
 
-  // Print out the command line.
-  PrintCommandLine(out);
-  out << std::flush;
+static void ThreadCaptureInterrupt(Isolate* isolate, void* data) {
+  CaptureThread(isolate, static_cast<unsigned int>(reinterpret_cast<uintptr_t>(data)), false);
+}
 
-  // Print Node.js and OS version information
-  PrintVersionInformation(out);
-  out << std::flush;
+static void ThreadCaptureAsyncCallback(uv_async_t* handle) {
+  CaptureThread(Isolate::GetCurrent(),
+                static_cast<unsigned int>(reinterpret_cast<uintptr_t>(handle->data)), true);
+}
 
-// Print summary JavaScript stack backtrace
-  PrintJavaScriptStack(out, isolate, event, location);
-  out << std::flush;
+#if NODE_MAJOR_VERSION >= 10
+static void OnThreadAsyncClose(uv_handle_t* handle) {
+  delete reinterpret_cast<uv_async_t*>(handle);
+}
 
-  // Print native stack backtrace
-  PrintNativeStack(out);
-  out << std::flush;
+// The isolate is about to be disposed, it must no longer be interrupted
+static void UnregisterReportThread(void* data) {
+  const unsigned int id = static_cast<unsigned int>(reinterpret_cast<uintptr_t>(data));
+  uv_mutex_lock(&threads_mutex);
+  for (auto thread = report_threads.begin(); thread != report_threads.end(); ++thread) {
+    if (thread->id == id) {
+      uv_close(reinterpret_cast<uv_handle_t*>(thread->async), OnThreadAsyncClose);
+      report_threads.erase(thread);
+      break;
+    }
+  }
+  uv_cond_broadcast(&threads_cond);
+  uv_mutex_unlock(&threads_mutex);
+}
+#endif
 
-  // Print the stack trace and message from the Error object.
-  // (If one was provided.)
-  PrintJavaScriptErrorStack(out, isolate, error);
-  out << std::flush;
+// Returns true for the main thread, which sets up the report triggers
+bool RegisterReportThread(Isolate* isolate) {
+  uv_once(&threads_once, InitReportThreads);
+#if NODE_MAJOR_VERSION >= 10
+  uv_loop_t* loop = node::GetCurrentEventLoop(isolate);
+#else
+  uv_loop_t* loop = uv_default_loop();
+#endif
+  uv_async_t* async = new uv_async_t;
+  if (uv_async_init(loop, async, ThreadCaptureAsyncCallback) != 0) {
+    delete async;
+    return loop == uv_default_loop();
+  }
+  uv_unref(reinterpret_cast<uv_handle_t*>(async));
 
-  // Print V8 Heap and Garbage Collector information
-  PrintGCStatistics(out, isolate);
-  out << std::flush;
+  uv_mutex_lock(&threads_mutex);
+  RegisteredThread thread;
+  thread.id = next_thread_id++;
+  thread.main_thread = loop == uv_default_loop();
+  thread.isolate = isolate;
+  thread.loop = loop;
+  thread.async = async;
+#ifdef __linux__
+  thread.os_thread_id = syscall(SYS_gettid);
+#else
+  thread.os_thread_id = 0;
+#endif
+  thread.requested = 0;
+  thread.completed = 0;
+  thread.sections = 0;
+  async->data = reinterpret_cast<void*>(static_cast<uintptr_t>(thread.id));
+  report_threads.push_back(thread);
+  uv_mutex_unlock(&threads_mutex);
 
-  // Print OS and current thread resource usage
-#ifndef _WIN32
-  PrintResourceUsage(out);
-  out << std::flush;
+#if NODE_MAJOR_VERSION >= 10
+  node::AddEnvironmentCleanupHook(isolate, UnregisterReportThread,
+                                  reinterpret_cast<void*>(static_cast<uintptr_t>(thread.id)));
 #endif
+  return thread.main_thread;
+}
 
-  // Print libuv handle summary
-  out << "\n================================================================================";
-  out << "\n==== Node.js libuv Handle Summary ==============================================\n";
-  out << "\n(Flags: R=Ref, A=Active)\n";
-  out << std::left << std::setw(7) << "Flags" << std::setw(10) << "Type"
-      << std::setw(4 + 2 * sizeof(void*)) << "Address" << "Details"
-      << std::endl;
-  uv_walk(uv_default_loop(), walkHandle, (void*)&out);
+static void RequestThreads(Isolate* isolate, unsigned int sections, ReportSnapshot* snapshot) {
+  snapshot->thread_id = 0;
+  uv_once(&threads_once, InitReportThreads);
+  uv_mutex_lock(&threads_mutex);
+  if (threads_capture_active) {
+    uv_mutex_unlock(&threads_mutex);
+    return;  // another report is collecting the threads, and may be waiting for this one
+  }
+  // Request all the captures first, so the threads respond in parallel
+  const uint64_t generation = ++capture_generation;
+  for (RegisteredThread& thread : report_threads) {
+    if (thread.isolate == isolate) {
+      snapshot->thread_id = thread.id;
+      continue;
+    }
+    thread.requested = generation;
+    thread.sections = sections;
+    thread.isolate->RequestInterrupt(ThreadCaptureInterrupt,
+                                     reinterpret_cast<void*>(static_cast<uintptr_t>(thread.id)));
+    uv_async_send(thread.async);
+    snapshot->threads_requested.push_back(thread.id);
+  }
+  if (!snapshot->threads_requested.empty()) {
+    threads_capture_active = true;
+    snapshot->threads_generation = generation;
+    snapshot->threads_deadline = uv_hrtime() + NR_THREAD_CAPTURE_TIMEOUT * 1000000ULL;
+  }
+  uv_mutex_unlock(&threads_mutex);
+}
 
-  // Print operating system information
-  PrintSystemInformation(out, isolate);
+static void CollectThreads(ReportSnapshot* snapshot) {
+  const uint64_t generation = snapshot->threads_generation;
+  if (generation == 0) {
+    return;
+  }
+  uv_mutex_lock(&threads_mutex);
+  for (;;) {
+    bool waiting = false;
+    for (const RegisteredThread& thread : report_threads) {
+      if (thread.requested == generation && thread.completed != generation) {
+        waiting = true;
+      }
+    }
+    const uint64_t now = uv_hrtime();
+    if (!waiting || now >= snapshot->threads_deadline) {
+      break;
+    }
+    uv_cond_timedwait(&threads_cond, &threads_mutex, snapshot->threads_deadline - now);
+  }
 
-  out << "\n================================================================================\n";
-  out << std::flush;
+  for (unsigned int id : snapshot->threads_requested) {
+    RegisteredThread* thread = FindReportThread(id);
+    if (thread == nullptr) {
+      continue;  // thread exited while the report was collected
+    }
+    if (thread->completed == generation) {
+      snapshot->threads.push_back(std::move(thread->report));
+      thread->report = ThreadReport();
+    } else {
+      snapshot->threads.push_back(ThreadReport());
+      snapshot->threads.back().captured = false;
+      snapshot->threads.back().idle = false;
+      snapshot->threads.back().sections = 0;
+      thread->requested = thread->completed;  // a late capture is not needed
+    }
+    ThreadReport& report = snapshot->threads.back();
+    report.id = thread->id;
+    report.main_thread = thread->main_thread;
+    report.os_thread_id = thread->os_thread_id;
+  }
+  snapshot->threads_generation = 0;
+  snapshot->threads_requested.clear();
+  threads_capture_active = false;
+  uv_mutex_unlock(&threads_mutex);
+}
 
-  // Restore output stream formatting.
-  out.copyfmt(oldState);
+static void PrintThreads(std::ostream& out, const ReportSnapshot& snapshot) {
+  out << "\n================================================================================";
+  out << "\n==== Threads ===================================================================\n";
+  out << "\nReport triggered on thread " << snapshot.thread_id << ", other threads running JavaScript: "
+      << snapshot.threads.size() << "\n";
+  for (const ThreadReport& thread : snapshot.threads) {
+    out << "\nThread " << thread.id << " (" << (thread.main_thread ? "main thread" : "worker thread");
+    if (thread.os_thread_id != 0) {
+      out << ", OS thread id " << thread.os_thread_id;
+    }
+    out << ")\n";
+    if (!thread.captured) {
+      out << "  Not captured, the thread did not respond within " << NR_THREAD_CAPTURE_TIMEOUT
+          << " ms\n";
+      continue;
+    }
+    if (thread.sections & NR_SECTION_JSSTACK) {
+      out << "\nJavaScript stack:\n" << thread.javascript_stack;
+    }
+    if (thread.sections & NR_SECTION_HEAP) {
+      out << "\nHeap memory: total ";
+      WriteInteger(out, thread.heap.total_heap_size);
+      out << " bytes, used ";
+      WriteInteger(out, thread.heap.used_heap_size);
+      out << " bytes, available ";
+      WriteInteger(out, thread.heap.total_available_size);
+      out << " bytes, limit ";
+      WriteInteger(out, thread.heap.heap_size_limit);
+      out << " bytes\n";
+    }
+    if (thread.sections & NR_SECTION_HANDLES) {
+      out << "\nHandles:\n";
+      PrintHandles(out, thread.handles, thread.handle_aggregate);
+    }
+  }
+}
 
-  report_active = false;
+static void PrintThreads(ReportWriter& writer, const ReportSnapshot& snapshot) {
+  writer.ObjectStart("threads");
+  writer.KeyValue("reportThreadId", snapshot.thread_id);
+  writer.ArrayStart("otherThreads");
+  for (const ThreadReport& thread : snapshot.threads) {
+    writer.ObjectStart();
+    writer.KeyValue("threadId", thread.id);
+    writer.KeyValue("mainThread", thread.main_thread);
+    if (thread.os_thread_id != 0) {
+      writer.KeyValue("osThreadId", thread.os_thread_id);
+    }
+    writer.KeyValue("captured", thread.captured);
+    if (thread.captured) {
+      writer.KeyValue("idle", thread.idle);
+    }
+    if (thread.sections & NR_SECTION_JSSTACK) {
+      writer.ArrayStart("javascriptStack");
+      std::istringstream javascript_stack(thread.javascript_stack);
+      std::string line;
+      while (std::getline(javascript_stack, line)) {
+        if (!line.empty()) {
+          writer.Element(line);
+        }
+      }
+      writer.ArrayEnd();
+    }
+    if (thread.sections & NR_SECTION_HEAP) {
+      writer.ObjectStart("javascriptHeap");
+      writer.KeyValue("totalMemory", thread.heap.total_heap_size);
+      writer.KeyValue("usedMemory", thread.heap.used_heap_size);
+      writer.KeyValue("availableMemory", thread.heap.total_available_size);
+      writer.KeyValue("memoryLimit", thread.heap.heap_size_limit);
+      writer.ObjectEnd();
+    }
+    if (thread.sections & NR_SECTION_HANDLES) {
+      PrintHandles(writer, thread.handles, thread.handle_aggregate);
+    }
+    writer.ObjectEnd();
+  }
+  writer.ArrayEnd();
+  writer.ObjectEnd();
 }
 
 /*******************************************************************************
- * Function to print process command line.
+ * External function to trigger a node report, writing to a supplied stream.
  *
- ******************************************************************************/
-static void PrintCommandLine(std::ostream& out) {
-  if (commandline_string != "") {
-    out << "Command line: " << commandline_string << "\n";
+ *******************************************************************************/
+void GetNodeReport(Isolate* isolate, DumpEvent event, const char* message, const char* location, MaybeLocal<Value> error, std::ostream& out) {
+  // Obtain the current time and the pid (platform dependent)
+  TIME_TYPE tm_struct;
+#ifdef _WIN32
+  GetLocalTime(&tm_struct);
+#else  // UNIX, OSX
+  struct timeval time_val;
+  gettimeofday(&time_val, nullptr);
+  localtime_r(&time_val.tv_sec, &tm_struct);
+#endif
+  ReportSnapshot snapshot;
+  CaptureSnapshot(isolate, event, message, location, nullptr, error, &tm_struct, &snapshot);
+  if (snapshot.threads_generation != 0) {
+    SectionTimer timer(&snapshot.timings, "collectThreads");
+    CollectThreads(&snapshot);
   }
+  WriteNodeReport(snapshot, out);
+  PublishReportTimings(snapshot.timings);
 }
 
 /*******************************************************************************
- * Function to print Node.js version, OS version and machine information
- *
- ******************************************************************************/
-static void PrintVersionInformation(std::ostream& out) {
+ * Internal function to capture the report content that is bound to the
+ * isolate or the event loop. Runs on the event loop thread.
+ *******************************************************************************/
+static void CaptureSnapshot(Isolate* isolate, DumpEvent event, const char* message, const char* location, const char* filename, MaybeLocal<Value> error, TIME_TYPE* tm_struct, ReportSnapshot* snapshot) {
+  ReportTimings* timings = &snapshot->timings;
+  timings->start_time = uv_hrtime();
+  timings->loop_released = 0;
+  snapshot->event = event;
+  snapshot->format = nodereport_format;
+  snapshot->compression = nodereport_compression;
+  snapshot->sections = EventSections(event);
+  snapshot->message = message != nullptr ? message : "";
+  snapshot->location = location != nullptr ? location : "";
+  snapshot->filename = filename != nullptr ? filename : "";
+  snapshot->tm_struct = *tm_struct;
+  snapshot->delta_allowed = RepeatableEvent(event);
+  const unsigned int sections = snapshot->sections;
 
-  // Print Node.js and deps component versions
-  out << "\n" << version_string;
+  // Capture native stack backtrace first, while it is still the current stack
+  if (sections & NR_SECTION_NATIVESTACK) {
+    SectionTimer timer(timings, "captureNativeStack");
+    CaptureNativeStack(snapshot);
+  }
 
-  // Print node-report module version
-  // e.g. node-report version: 1.0.6 (built against Node.js v6.9.1)
-  out << std::endl << "node-report version: " << NODEREPORT_VERSION
-      << " (built against Node.js v" << NODE_VERSION_STRING;
-#if defined(__GLIBC__)
-  out << ", glibc " << __GLIBC__ << "." << __GLIBC_MINOR__;
+  // Capture summary JavaScript stack backtrace
+  if (sections & NR_SECTION_JSSTACK) {
+    SectionTimer timer(timings, "captureJavaScriptStack");
+    std::ostringstream javascript_stack;
+    PrintJavaScriptStack(javascript_stack, isolate, event, location);
+    snapshot->javascript_stack = javascript_stack.str();
+  }
+
+  // Capture the stack trace and message from the Error object.
+  // (If one was provided.)
+  if (sections & NR_SECTION_JSSTACK) {
+    SectionTimer timer(timings, "captureJavaScriptException");
+    std::ostringstream exception_details;
+    PrintJavaScriptErrorStack(exception_details, isolate, error);
+    snapshot->exception_details = exception_details.str();
+  }
+
+  // Capture the recent JavaScript stack samples, if the sampler is running
+  snapshot->samples.interval = 0;
+  if ((sections & NR_SECTION_SAMPLES) && GetStackSamplerInterval() != 0) {
+    SectionTimer timer(timings, "captureStackSamples");
+    CaptureStackSamples(&snapshot->samples);
+  }
+
+  // Capture the threadpool latencies, if the probe is running
+  snapshot->threadpool.interval = 0;
+  if ((sections & NR_SECTION_THREADPOOL) && GetThreadpoolProbeInterval() != 0) {
+    SectionTimer timer(timings, "captureThreadpool");
+    GetThreadpoolProbeInfo(&snapshot->threadpool);
+  }
+
+  // Capture V8 Heap and Garbage Collector information
+  if (sections & NR_SECTION_HEAP) {
+    SectionTimer timer(timings, "captureJavaScriptHeap");
+    CaptureGCStatistics(&snapshot->heap, isolate);
+  }
+
+  // Capture current thread resource usage
+#ifndef _WIN32
+  if (sections & NR_SECTION_RESOURCES) {
+    SectionTimer timer(timings, "captureResourceUsage");
+    CaptureThreadUsage(&snapshot->loop_thread_usage);
+  }
 #endif
-  // Print Process word size
-  out << ", " << sizeof(void *) * 8 << " bit" << ")" << std::endl;
+#ifdef NR_THREAD_TABLE
+  if (sections & NR_SECTION_RESOURCES) {
+    SectionTimer timer(timings, "captureThreadCpuUsage");
+    CaptureThreadCpuTable(snapshot);
+  }
+#endif
+
+  // Capture libuv handle information
+  if (sections & NR_SECTION_HANDLES) {
+    SectionTimer timer(timings, "captureLibuvHandles");
+    CaptureHandles(GetThreadLoop(isolate), &snapshot->handles, &snapshot->handle_aggregate);
+  }
+
+  // Capture the descriptors owned by libuv, for the file descriptor inventory
+#ifdef NR_FD_INVENTORY
+  if (sections & NR_SECTION_FDS) {
+    SectionTimer timer(timings, "captureHandleDescriptors");
+    CaptureHandleDescriptors(GetThreadLoop(isolate), &snapshot->handle_fds);
+  }
+#endif
+
+  // Copy the environment, which JavaScript code on this thread can change
+  if (sections & NR_SECTION_ENVIRONMENT) {
+    SectionTimer timer(timings, "captureEnvironmentVariables");
+    GetEnvironmentVariables(&snapshot->environment);
+  }
+
+  // Ask the other threads for their JavaScript stacks, heaps and handles,
+  // which are collected when the report is written, see CollectThreads()
+  const unsigned int thread_sections = sections & (NR_SECTION_JSSTACK | NR_SECTION_HEAP |
+                                                   NR_SECTION_HANDLES | NR_SECTION_FDS);
+  if (thread_sections != 0 && RepeatableEvent(event)) {
+    SectionTimer timer(timings, "requestThreads");
+    RequestThreads(isolate, thread_sections, snapshot);
+  }
+}
+
+/*******************************************************************************
+ * Internal function to coordinate and write the various sections of the node
+ * report to the supplied stream. Runs on the event loop thread or the report
+ * writer thread, so must not call into V8 or libuv.
+ *******************************************************************************/
+static void WriteNodeReport(ReportSnapshot& snapshot, std::ostream &out) {
+  if (snapshot.format == kJSON) {
+    JSONWriter writer(out);
+    WriteStructuredReport(snapshot, writer, out);
+    return;
+  } else if (snapshot.format == kBinary) {
+    BinaryWriter writer(out);
+    WriteStructuredReport(snapshot, writer, out);
+    return;
+  }
+
+#ifdef _WIN32
+  DWORD pid = GetCurrentProcessId();
+#else  // UNIX, OSX
+  pid_t pid = getpid();
+#endif
+  const TIME_TYPE* tm_struct = &snapshot.tm_struct;
+  ReportTimings* timings = &snapshot.timings;
+  const unsigned int sections = snapshot.sections;
+
+  // Save formatting for output stream.
+  std::ios oldState(nullptr);
+  oldState.copyfmt(out);
+
+  {
+    SectionTimer timer(timings, "header");
+    // File stream opened OK, now start printing the report content, starting with the title
+    // and header information (event, filename, timestamp and pid)
+    out << "================================================================================\n";
+    out << "==== Node Report ===============================================================\n";
+    out << "\nEvent: " << snapshot.message << ", location: \"" << snapshot.location << "\"\n";
+    if (!snapshot.filename.empty()) {
+      out << "Filename: " << snapshot.filename << "\n";
+    }
+    if (!snapshot.suppressed.empty()) {
+      out << "Reports suppressed:";
+      for (size_t i = 0; i < snapshot.suppressed.size(); i++) {
+        out << (i == 0 ? " " : ", ") << snapshot.suppressed[i].first << " "
+            << snapshot.suppressed[i].second;
+      }
+      out << "\n";
+    }
+
+    // Print dump event and module load date/time stamps
+    char timebuf[64];
+    FormatTime(tm_struct, timebuf, sizeof(timebuf));
+    out << "Dump event time:  "<< timebuf << "\n";
+    FormatTime(&loadtime_tm_struct, timebuf, sizeof(timebuf));
+    out << "Module load time: " << timebuf << "\n";
+    // Print native process ID
+    out << "Process ID: " << pid << std::endl;
+
+    if (snapshot.delta != nullptr) {
+      // The command line and versions are in the base report
+      out << "Delta from: " << snapshot.delta->base.filename << "\n";
+    } else {
+      // Print out the command line.
+      PrintCommandLine(out);
+      out << std::flush;
+
+      // Print Node.js and OS version information
+      PrintVersionInformation(out);
+    }
+    out << std::flush;
+  }
+
+  // Print summary JavaScript stack backtrace
+  if (sections & NR_SECTION_JSSTACK) {
+    SectionTimer timer(timings, "javascriptStack");
+    out << "\n================================================================================";
+    out << "\n==== JavaScript Stack Trace ====================================================\n\n";
+    out << snapshot.javascript_stack;
+    out << std::flush;
+  }
+
+  // Print native stack backtrace
+  if (sections & NR_SECTION_NATIVESTACK) {
+    SectionTimer timer(timings, "nativeStack");
+    PrintNativeStack(out, snapshot);
+    out << std::flush;
+  }
+
+  // Print the stack trace and message from the Error object.
+  // (If one was provided.)
+  if (!snapshot.exception_details.empty()) {
+    SectionTimer timer(timings, "javascriptException");
+    out << "\n================================================================================";
+    out << "\n==== JavaScript Exception Details ==============================================\n\n";
+    out << snapshot.exception_details;
+    out << std::flush;
+  }
+
+  // Print the recent JavaScript stack samples
+  if (snapshot.samples.interval != 0) {
+    SectionTimer timer(timings, "stackSamples");
+    PrintStackSamples(out, snapshot.samples);
+    out << std::flush;
+  }
+
+  // Print V8 Heap and Garbage Collector information
+  if (sections & NR_SECTION_HEAP) {
+    SectionTimer timer(timings, "javascriptHeap");
+    if (DeltaSection(snapshot, NR_SECTION_HEAP)) {
+      PrintHeapChanges(out, snapshot.heap, *snapshot.delta);
+    } else {
+      PrintGCStatistics(out, snapshot.heap);
+    }
+    out << std::flush;
+  }
+
+  // Print OS and current thread resource usage
+#ifndef _WIN32
+  if (sections & NR_SECTION_RESOURCES) {
+    SectionTimer timer(timings, "resourceUsage");
+    if (DeltaSection(snapshot, NR_SECTION_RESOURCES)) {
+      PrintResourceUsageChanges(out, *snapshot.delta);
+    } else {
+      PrintResourceUsage(out, snapshot);
+#ifdef NR_THREAD_TABLE
+      PrintThreadCpuTable(out, snapshot);
+#endif
+    }
+    out << std::flush;
+  }
+#endif
+
+  // Print the memory map, by backing object
+#ifdef NR_MEMORY_MAP
+  if (sections & NR_SECTION_MEMORY) {
+    SectionTimer timer(timings, "memoryMap");
+    PrintMemoryMap(out);
+    out << std::flush;
+  }
+#endif
+
+  // Print the libuv threadpool latencies
+  if (snapshot.threadpool.interval != 0) {
+    SectionTimer timer(timings, "threadpool");
+    PrintThreadpoolProbe(out, snapshot.threadpool);
+    out << std::flush;
+  }
+
+  // Print libuv handle summary
+  if (sections & NR_SECTION_HANDLES) {
+    SectionTimer timer(timings, "libuvHandles");
+    out << "\n================================================================================";
+    out << "\n==== Node.js libuv Handle Summary ==============================================\n";
+    if (DeltaSection(snapshot, NR_SECTION_HANDLES)) {
+      PrintHandleChanges(out, *snapshot.delta);
+    } else {
+      out << "\n(Flags: R=Ref, A=Active)\n";
+      PrintHandles(out, snapshot.handles, snapshot.handle_aggregate);
+    }
+  }
+
+  // Print the JavaScript stacks, heaps and handles of the other threads
+  if (!snapshot.threads.empty()) {
+    SectionTimer timer(timings, "threads");
+    PrintThreads(out, snapshot);
+    out << std::flush;
+  }
+
+  // Print the open file descriptors, by type and target
+#ifdef NR_FD_INVENTORY
+  if (sections & NR_SECTION_FDS) {
+    SectionTimer timer(timings, "fileDescriptors");
+    PrintFdInventory(out, snapshot);
+    out << std::flush;
+  }
+#endif
+
+  // Print operating system information
+  if (sections & (NR_SECTION_ENVIRONMENT | NR_SECTION_LIMITS | NR_SECTION_LIBRARIES)) {
+    out << "\n================================================================================";
+    out << "\n==== System Information ========================================================\n";
+  }
+  if (sections & NR_SECTION_ENVIRONMENT) {
+    SectionTimer timer(timings, "environmentVariables");
+    if (DeltaSection(snapshot, NR_SECTION_ENVIRONMENT)) {
+      PrintEnvironmentChanges(out, *snapshot.delta);
+    } else {
+      PrintEnvironmentVariables(out, snapshot.environment);
+    }
+  }
+#ifndef _WIN32
+  if (sections & NR_SECTION_LIMITS) {
+    SectionTimer timer(timings, "userLimits");
+    if (DeltaSection(snapshot, NR_SECTION_LIMITS)) {
+      PrintUserLimitChanges(out, *snapshot.delta);
+    } else {
+      PrintUserLimits(out);
+    }
+  }
+#endif
+  if (sections & NR_SECTION_LIBRARIES) {
+    SectionTimer timer(timings, "sharedObjects");
+    if (DeltaSection(snapshot, NR_SECTION_LIBRARIES)) {
+      PrintLibraryChanges(out, *snapshot.delta);
+    } else {
+      PrintLoadedLibraries(out);
+    }
+  }
+  out << std::flush;
+
+  // Print the time taken to produce the report
+  FinishReportTimings(timings);
+  PrintReportTimings(out, *timings);
+
+  out << "\n================================================================================\n";
+  out << std::flush;
+
+  // Restore output stream formatting.
+  out.copyfmt(oldState);
+}
+
+/*******************************************************************************
+ * Internal function to coordinate and write the various sections of the node
+ * report in the JSON or binary format. Each section is streamed out as it is
+ * written.
+ *******************************************************************************/
+static void WriteStructuredReport(ReportSnapshot& snapshot, ReportWriter& writer, std::ostream &out) {
+  ReportTimings* timings = &snapshot.timings;
+  const unsigned int sections = snapshot.sections;
+  writer.ObjectStart();
+
+  // Report header information (event, filename, timestamp and pid)
+  {
+    SectionTimer timer(timings, "header");
+    char timebuf[64];
+    writer.ObjectStart("header");
+    writer.KeyValue("event", snapshot.message);
+    writer.KeyValue("location", snapshot.location);
+    if (!snapshot.filename.empty()) {
+      writer.KeyValue("filename", snapshot.filename);
+    }
+    if (!snapshot.suppressed.empty()) {
+      writer.ObjectStart("suppressedReports");
+      for (const auto& suppressed : snapshot.suppressed) {
+        writer.KeyValue(suppressed.first.c_str(), suppressed.second);
+      }
+      writer.ObjectEnd();
+    }
+    FormatTime(&snapshot.tm_struct, timebuf, sizeof(timebuf));
+    writer.KeyValue("dumpEventTime", timebuf);
+    FormatTime(&loadtime_tm_struct, timebuf, sizeof(timebuf));
+    writer.KeyValue("moduleLoadTime", timebuf);
+#ifdef _WIN32
+    writer.KeyValue("processId", static_cast<unsigned long>(GetCurrentProcessId()));
+#else  // UNIX, OSX
+    writer.KeyValue("processId", static_cast<long>(getpid()));
+#endif
+    if (snapshot.delta != nullptr) {
+      // The command line and versions are in the base report
+      writer.KeyValue("deltaFrom", snapshot.delta->base.filename);
+    } else {
+      if (commandline_string != "") {
+        // SetCommandLine() leaves a separator after the last argument.
+        writer.KeyValue("commandLine",
+                        commandline_string.substr(0, commandline_string.find_last_not_of(' ') + 1));
+      }
+      PrintVersionInformation(writer);
+    }
+    writer.ObjectEnd();
+    out << std::flush;
+  }
+
+  // JavaScript stack backtrace, one element per line
+  std::string line;
+  if (sections & NR_SECTION_JSSTACK) {
+    SectionTimer timer(timings, "javascriptStack");
+    writer.ArrayStart("javascriptStack");
+    std::istringstream javascript_stack(snapshot.javascript_stack);
+    while (std::getline(javascript_stack, line)) {
+      if (!line.empty()) {
+        writer.Element(line);
+      }
+    }
+    writer.ArrayEnd();
+    out << std::flush;
+  }
+
+  // Native stack backtrace
+  if (sections & NR_SECTION_NATIVESTACK) {
+    SectionTimer timer(timings, "nativeStack");
+    PrintNativeStack(writer, snapshot);
+    out << std::flush;
+  }
+
+  // The stack trace and message from the Error object, if one was provided
+  if (!snapshot.exception_details.empty()) {
+    SectionTimer timer(timings, "javascriptException");
+    writer.ArrayStart("javascriptException");
+    std::istringstream exception_details(snapshot.exception_details);
+    while (std::getline(exception_details, line)) {
+      if (!line.empty()) {
+        writer.Element(line);
+      }
+    }
+    writer.ArrayEnd();
+    out << std::flush;
+  }
+
+  // Recent JavaScript stack samples
+  if (snapshot.samples.interval != 0) {
+    SectionTimer timer(timings, "stackSamples");
+    PrintStackSamples(writer, snapshot.samples);
+    out << std::flush;
+  }
+
+  // V8 Heap and Garbage Collector information
+  if (sections & NR_SECTION_HEAP) {
+    SectionTimer timer(timings, "javascriptHeap");
+    if (DeltaSection(snapshot, NR_SECTION_HEAP)) {
+      PrintHeapChanges(writer, snapshot.heap, *snapshot.delta);
+    } else {
+      PrintGCStatistics(writer, snapshot.heap);
+    }
+    out << std::flush;
+  }
+
+  // OS and current thread resource usage
+#ifndef _WIN32
+  if (sections & NR_SECTION_RESOURCES) {
+    SectionTimer timer(timings, "resourceUsage");
+    if (DeltaSection(snapshot, NR_SECTION_RESOURCES)) {
+      PrintResourceUsageChanges(writer, *snapshot.delta);
+    } else {
+      PrintResourceUsage(writer, snapshot);
+#ifdef NR_THREAD_TABLE
+      PrintThreadCpuTable(writer, snapshot);
+#endif
+    }
+    out << std::flush;
+  }
+#endif
+
+  // Memory map, by backing object
+#ifdef NR_MEMORY_MAP
+  if (sections & NR_SECTION_MEMORY) {
+    SectionTimer timer(timings, "memoryMap");
+    PrintMemoryMap(writer);
+    out << std::flush;
+  }
+#endif
+
+  // libuv threadpool latencies
+  if (snapshot.threadpool.interval != 0) {
+    SectionTimer timer(timings, "threadpool");
+    PrintThreadpoolProbe(writer, snapshot.threadpool);
+    out << std::flush;
+  }
+
+  // libuv handle summary
+  if (sections & NR_SECTION_HANDLES) {
+    SectionTimer timer(timings, "libuvHandles");
+    if (DeltaSection(snapshot, NR_SECTION_HANDLES)) {
+      PrintHandleChanges(writer, *snapshot.delta);
+    } else {
+      PrintHandles(writer, snapshot.handles, snapshot.handle_aggregate);
+    }
+    out << std::flush;
+  }
+
+  // JavaScript stacks, heaps and handles of the other threads
+  if (!snapshot.threads.empty()) {
+    SectionTimer timer(timings, "threads");
+    PrintThreads(writer, snapshot);
+    out << std::flush;
+  }
+
+  // Open file descriptors, by type and target
+#ifdef NR_FD_INVENTORY
+  if (sections & NR_SECTION_FDS) {
+    SectionTimer timer(timings, "fileDescriptors");
+    PrintFdInventory(writer, snapshot);
+    out << std::flush;
+  }
+#endif
+
+  // Operating system information
+  if (sections & NR_SECTION_ENVIRONMENT) {
+    SectionTimer timer(timings, "environmentVariables");
+    if (DeltaSection(snapshot, NR_SECTION_ENVIRONMENT)) {
+      PrintEnvironmentChanges(writer, *snapshot.delta);
+    } else {
+      PrintEnvironmentVariables(writer, snapshot.environment);
+    }
+  }
+#ifndef _WIN32
+  if (sections & NR_SECTION_LIMITS) {
+    SectionTimer timer(timings, "userLimits");
+    if (DeltaSection(snapshot, NR_SECTION_LIMITS)) {
+      PrintUserLimitChanges(writer, *snapshot.delta);
+    } else {
+      PrintUserLimits(writer);
+    }
+  }
+#endif
+  if (sections & NR_SECTION_LIBRARIES) {
+    SectionTimer timer(timings, "sharedObjects");
+    if (DeltaSection(snapshot, NR_SECTION_LIBRARIES)) {
+      PrintLibraryChanges(writer, *snapshot.delta);
+    } else {
+      PrintLoadedLibraries(writer);
+    }
+  }
+  out << std::flush;
+
+  // The time taken to produce the report
+  FinishReportTimings(timings);
+  PrintReportTimings(writer, *timings);
+
+  writer.ObjectEnd();
+  out << std::flush;
+}
+
+/*******************************************************************************
+ * Function to obtain the report sections selected for a trigger event.
+ *
+ ******************************************************************************/
+static unsigned int EventSections(DumpEvent event) {
+  switch (event) {
+    case kException: return nodereport_sections.exception;
+    case kFatalError: return nodereport_sections.fatalerror;
+    case kSignal_JS:
+    case kSignal_UV: return nodereport_sections.signal;
+    case kJavaScript: return nodereport_sections.apicall;
+    case kStall: return nodereport_sections.stall;
+    case kHeapPressure: return nodereport_sections.heappressure;
+  }
+  return NR_SECTION_ALL;
+}
+
+// Events that can recur while the process keeps running: signals, stalls and
+// API calls. Reports for these can be written on the writer thread, as deltas
+// and with the other threads included.
+static bool RepeatableEvent(DumpEvent event) {
+  return event == kSignal_JS || event == kSignal_UV || event == kJavaScript || event == kStall;
+}
+
+/*******************************************************************************
+ * Functions to rate limit reports for each trigger event.
+ *
+ * Each event has a token bucket holding up to the configured number of
+ * reports, refilled continuously over the configured period. A trigger that
+ * finds the bucket empty is counted rather than reported, as is one that
+ * arrives while a report is in progress or a signal merged with one already
+ * pending. The buckets are refilled with the report_active flag held, so they
+ * are not reentered, and do not allocate. The counts are atomic, as they are
+ * also incremented without the flag, and from the signal handler.
+ ******************************************************************************/
+struct ReportBucket {
+  double tokens;
+  uint64_t refill_time;            // uv_hrtime() of the last refill, 0 if full
+  std::atomic<unsigned long long> suppressed;  // triggers dropped since the last report
+};
+
+static const char* const rate_limit_events[] = {"exception", "fatalerror", "signal", "apicall",
+                                                "stall", "heappressure"};
+static ReportBucket report_buckets[arraysize(rate_limit_events)];
+
+static size_t EventIndex(DumpEvent event) {
+  switch (event) {
+    case kException: return 0;
+    case kFatalError: return 1;
+    case kSignal_JS:
+    case kSignal_UV: return 2;
+    case kJavaScript: return 3;
+    case kStall: return 4;
+    case kHeapPressure: return 5;
+  }
+  return 3;
+}
+
+static const RateLimit& EventRateLimit(DumpEvent event) {
+  switch (event) {
+    case kException: return nodereport_rate_limits.exception;
+    case kFatalError: return nodereport_rate_limits.fatalerror;
+    case kSignal_JS:
+    case kSignal_UV: return nodereport_rate_limits.signal;
+    case kJavaScript: return nodereport_rate_limits.apicall;
+    case kStall: return nodereport_rate_limits.stall;
+    case kHeapPressure: return nodereport_rate_limits.heappressure;
+  }
+  return nodereport_rate_limits.apicall;
+}
+
+static bool ReportAllowed(DumpEvent event) {
+  const RateLimit& limit = EventRateLimit(event);
+  if (limit.reports == 0) {
+    return true;
+  }
+  ReportBucket* bucket = &report_buckets[EventIndex(event)];
+  const uint64_t now = uv_hrtime();
+  if (bucket->refill_time == 0) {
+    bucket->tokens = limit.reports;
+  } else {
+    const double refill = (now - bucket->refill_time) / 1e9 * limit.reports / limit.seconds;
+    bucket->tokens = std::min(bucket->tokens + refill, static_cast<double>(limit.reports));
+  }
+  bucket->refill_time = now;
+  if (bucket->tokens < 1) {
+    CountSuppressedReport(event);
+    return false;
+  }
+  bucket->tokens -= 1;
+  return true;
+}
+
+// Async signal safe, the counts are lock free atomics
+void CountSuppressedReport(DumpEvent event) {
+  report_buckets[EventIndex(event)].suppressed++;
+}
+
+static void TakeSuppressedReports(std::vector<std::pair<std::string, unsigned long long> >* suppressed) {
+  for (size_t i = 0; i < arraysize(rate_limit_events); i++) {
+    const unsigned long long count = report_buckets[i].suppressed.exchange(0);
+    if (count != 0) {
+      suppressed->push_back(std::make_pair(rate_limit_events[i], count));
+    }
+  }
+}
 
-  // Print operating system and machine information (Windows)
+// Refill the buckets after the rate limits are changed. Must be called on the
+// event loop thread.
+void ResetReportRateLimits() {
+  for (ReportBucket& bucket : report_buckets) {
+    bucket.refill_time = 0;
+  }
+}
+
+/*******************************************************************************
+ * Function to format a date/time stamp for the report.
+ *
+ ******************************************************************************/
+static void FormatTime(const TIME_TYPE* tm_struct, char* buf, size_t size) {
+#ifdef _WIN32
+  snprintf(buf, size, "%4d/%02d/%02d %02d:%02d:%02d",
+          tm_struct->wYear, tm_struct->wMonth, tm_struct->wDay,
+          tm_struct->wHour, tm_struct->wMinute, tm_struct->wSecond);
+#else  // UNIX, OSX
+  snprintf(buf, size, "%4d/%02d/%02d %02d:%02d:%02d",
+          tm_struct->tm_year+1900, tm_struct->tm_mon+1, tm_struct->tm_mday,
+          tm_struct->tm_hour, tm_struct->tm_min, tm_struct->tm_sec);
+#endif
+}
+
+/*******************************************************************************
+ * Function to print process command line.
+ *
+ ******************************************************************************/
+static void PrintCommandLine(std::ostream& out) {
+  if (commandline_string != "") {
+    out << "Command line: " << commandline_string << "\n";
+  }
+}
+
+/*******************************************************************************
+ * Function to obtain OS version and machine information
+ *
+ ******************************************************************************/
+struct OSInformation {
+  std::string os_version;
+  std::string product;       // z/OS product information
+  std::string libc_version;  // runtime glibc version
+  std::string machine;
+};
+
+static void GetOSInformation(OSInformation* info) {
+  std::ostringstream out;
+  // Obtain operating system and machine information (Windows)
 #ifdef _WIN32
   {
     const DWORD level = 101;
@@ -399,18 +1784,18 @@ static void PrintVersionInformation(std::ostream& out) {
         default:
           os_name = (isServer ? "Windows Server" : "Windows Client");
       }
-      out <<  "\nOS version: " << os_name << "\n";
+      info->os_version = os_name;
 
-      // Convert and print the machine name and comment fields (these are LPWSTR types)
+      // Convert the machine name and comment fields (these are LPWSTR types)
       size_t count;
       char name_buf[256];
       wcstombs_s(&count, name_buf, sizeof(name_buf), os_info->sv101_name, _TRUNCATE);
+      info->machine = name_buf;
       if (os_info->sv101_comment != NULL) {
         char comment_buf[256];
         wcstombs_s(&count, comment_buf, sizeof(comment_buf), os_info->sv101_comment, _TRUNCATE);
-        out << "\nMachine: " << name_buf << " " << comment_buf << "\n";
-      } else {
-        out << "\nMachine: " << name_buf << "\n";
+        info->machine += " ";
+        info->machine += comment_buf;
       }
 
       if (os_info != NULL) {
@@ -420,23 +1805,23 @@ static void PrintVersionInformation(std::ostream& out) {
       // NetServerGetInfo() call failed, fallback to use GetComputerName() instead
       TCHAR machine_name[256];
       DWORD machine_name_size = 256;
-      out << "\nOS version: Windows\n";
+      info->os_version = "Windows";
       if (GetComputerName(machine_name, &machine_name_size)) {
-        out << "\nMachine: " << machine_name << "\n";
+        info->machine = machine_name;
       }
     }
   }
 #else
-  // Print operating system and machine information (Unix/OSX)
+  // Obtain operating system and machine information (Unix/OSX)
   struct utsname os_info;
   if (uname(&os_info) >= 0) {
 #if defined(_AIX)
-    out << "\nOS version: " << os_info.sysname << " " << os_info.version << "."
-        << os_info.release << "\n";
+    out << os_info.sysname << " " << os_info.version << "." << os_info.release;
 #else
-    out << "\nOS version: " << os_info.sysname << " " << os_info.release << " "
-        << os_info.version << "\n";
+    out << os_info.sysname << " " << os_info.release << " " << os_info.version;
 #endif
+    info->os_version = out.str();
+    out.str("");
 #if defined(__MVS__)
     char *r;
     __asm(" llgt %0,1208 \n"
@@ -446,39 +1831,103 @@ static void PrintVersionInformation(std::ostream& out) {
           : "=r"(r)::);
     if (r != NULL) {
       const char *prod = (int)r[80]==4 ? " (MVS LE)" : "";
-      out << "\nProduct " << (int)r[80] << prod << " Version " << (int)r[81] << " Release " << (int)r[82] << " Modification " << (int)r[83] << std::endl;
+      out << (int)r[80] << prod << " Version " << (int)r[81] << " Release " << (int)r[82] << " Modification " << (int)r[83];
+      info->product = out.str();
+      out.str("");
     }
     char hn[256];
     memset(hn,0,sizeof(hn));
     gethostname(hn,sizeof(hn));
-    out <<  "\nMachine: " << hn << " " << os_info.nodename << " " << os_info.machine << "\n";
+    out << hn << " " << os_info.nodename << " " << os_info.machine;
 #else
     const char *(*libc_version)();
     *(void**)(&libc_version) = dlsym(RTLD_DEFAULT, "gnu_get_libc_version");
     if (libc_version != NULL) {
-      out << "(glibc: " << (*libc_version)() << ")" << std::endl;
+      info->libc_version = (*libc_version)();
     }
 #if defined(_AIX)
     char hn[256];
     memset(hn,0,sizeof(hn));
     gethostname(hn,sizeof(hn));
-    out <<  "\nMachine: " << hn << " " << os_info.nodename << " " << os_info.machine << "\n";
+    out << hn << " " << os_info.nodename << " " << os_info.machine;
 #else
-    out <<  "\nMachine: " << os_info.nodename << " " << os_info.machine << "\n";
+    out << os_info.nodename << " " << os_info.machine;
 #endif
 #endif
+    info->machine = out.str();
   }
 #endif
 }
 
 /*******************************************************************************
- * Function to print the JavaScript stack, if available
+ * Functions to print Node.js version, OS version and machine information
  *
  ******************************************************************************/
-static void PrintJavaScriptStack(std::ostream& out, Isolate* isolate, DumpEvent event, const char* location) {
-  out << "\n================================================================================";
-  out << "\n==== JavaScript Stack Trace ====================================================\n\n";
+static void PrintVersionInformation(std::ostream& out) {
+
+  // Print Node.js and deps component versions
+  out << "\n" << version_string;
+
+  // Print node-report module version
+  // e.g. node-report version: 1.0.6 (built against Node.js v6.9.1)
+  out << std::endl << "node-report version: " << NODEREPORT_VERSION
+      << " (built against Node.js v" << NODE_VERSION_STRING;
+#if defined(__GLIBC__)
+  out << ", glibc " << __GLIBC__ << "." << __GLIBC_MINOR__;
+#endif
+  // Print Process word size
+  out << ", " << sizeof(void *) * 8 << " bit" << ")" << std::endl;
 
+  // Print operating system and machine information
+  OSInformation os_info;
+  GetOSInformation(&os_info);
+  if (!os_info.os_version.empty()) {
+    out << "\nOS version: " << os_info.os_version << "\n";
+  }
+  if (!os_info.product.empty()) {
+    out << "\nProduct " << os_info.product << std::endl;
+  }
+  if (!os_info.libc_version.empty()) {
+    out << "(glibc: " << os_info.libc_version << ")" << std::endl;
+  }
+  if (!os_info.machine.empty()) {
+    out << "\nMachine: " << os_info.machine << "\n";
+  }
+}
+
+static void PrintVersionInformation(ReportWriter& writer) {
+  writer.KeyValue("nodejsVersion", nodejs_version);
+  writer.ObjectStart("componentVersions");
+  for (size_t i = 0; i < component_versions.size(); i++) {
+    writer.KeyValue(component_versions[i].first.c_str(), component_versions[i].second);
+  }
+  writer.ObjectEnd();
+  writer.KeyValue("nodereportVersion", NODEREPORT_VERSION);
+  writer.KeyValue("builtAgainstNodejsVersion", "v" NODE_VERSION_STRING);
+#if defined(__GLIBC__)
+  char glibc_version[32];
+  snprintf(glibc_version, sizeof(glibc_version), "%d.%d", __GLIBC__, __GLIBC_MINOR__);
+  writer.KeyValue("glibcVersionCompiler", glibc_version);
+#endif
+  writer.KeyValue("wordSize", static_cast<unsigned int>(sizeof(void *) * 8));
+
+  OSInformation os_info;
+  GetOSInformation(&os_info);
+  writer.KeyValue("osVersion", os_info.os_version);
+  if (!os_info.product.empty()) {
+    writer.KeyValue("product", os_info.product);
+  }
+  if (!os_info.libc_version.empty()) {
+    writer.KeyValue("glibcVersionRuntime", os_info.libc_version);
+  }
+  writer.KeyValue("machine", os_info.machine);
+}
+
+/*******************************************************************************
+ * Function to print the JavaScript stack, if available
+ *
+ ******************************************************************************/
+static void PrintJavaScriptStack(std::ostream& out, Isolate* isolate, DumpEvent event, const char* location) {
 #ifdef _WIN32
   switch (event) {
   case kFatalError:
@@ -516,6 +1965,8 @@ static void PrintJavaScriptStack(std::ostream& out, Isolate* isolate, DumpEvent
     break;
   case kSignal_JS:
   case kSignal_UV:
+  case kStall:
+  case kHeapPressure:
     // Print the stack using StackTrace::StackTrace() and GetStackSample() APIs
     PrintStackFromStackTrace(out, isolate, event);
     break;
@@ -532,8 +1983,6 @@ static void PrintJavaScriptErrorStack(std::ostream& out, Isolate* isolate, Maybe
     return;
   }
 
-  out << "\n================================================================================";
-  out << "\n==== JavaScript Exception Details ==============================================\n\n";
 #if NODE_MAJOR_VERSION > 5
   Local<Message> message = v8::Exception::CreateMessage(isolate, error.ToLocalChecked());
 #else
@@ -653,11 +2102,14 @@ static void PrintStackFrame(std::ostream& out, Isolate* isolate, Local<StackFram
 
 #ifdef _WIN32
 /*******************************************************************************
- * Function to print a native stack backtrace
+ * Functions to capture and print a native stack backtrace
  *
  ******************************************************************************/
-void PrintNativeStack(std::ostream& out) {
-  void* frames[64];
+static void CaptureNativeStack(ReportSnapshot* snapshot) {
+  snapshot->native_frame_count = CaptureStackBackTrace(2, 64, snapshot->native_frames, nullptr);
+}
+
+static void PrintNativeStack(std::ostream& out, const ReportSnapshot& snapshot) {
   out << "\n================================================================================";
   out << "\n==== Native Stack Trace ========================================================\n\n";
 
@@ -666,12 +2118,10 @@ void PrintNativeStack(std::ostream& out) {
   SymInitialize(hProcess, nullptr, TRUE);
   char buf[64];
 
-  WORD numberOfFrames = CaptureStackBackTrace(2, 64, frames, nullptr);
-
   // Walk the frames printing symbolic information if available
-  for (int i = 0; i < numberOfFrames; i++) {
+  for (int i = 0; i < snapshot.native_frame_count; i++) {
     DWORD64 dwOffset64 = 0;
-    DWORD64 dwAddress = reinterpret_cast<DWORD64>(frames[i]);
+    DWORD64 dwAddress = reinterpret_cast<DWORD64>(snapshot.native_frames[i]);
     char buffer[sizeof(SYMBOL_INFO) + MAX_SYM_NAME * sizeof(TCHAR)];
     PSYMBOL_INFO pSymbol = reinterpret_cast<PSYMBOL_INFO>(buffer);
     pSymbol->SizeOfStruct = sizeof(SYMBOL_INFO);
@@ -694,39 +2144,124 @@ void PrintNativeStack(std::ostream& out) {
     }
   }
 }
+
+static void PrintNativeStack(ReportWriter& writer, const ReportSnapshot& snapshot) {
+  HANDLE hProcess = GetCurrentProcess();
+  SymSetOptions(SYMOPT_LOAD_LINES | SYMOPT_UNDNAME | SYMOPT_DEFERRED_LOADS);
+  SymInitialize(hProcess, nullptr, TRUE);
+  char buf[64];
+
+  writer.ArrayStart("nativeStack");
+  for (int i = 0; i < snapshot.native_frame_count; i++) {
+    DWORD64 dwOffset64 = 0;
+    DWORD64 dwAddress = reinterpret_cast<DWORD64>(snapshot.native_frames[i]);
+    char buffer[sizeof(SYMBOL_INFO) + MAX_SYM_NAME * sizeof(TCHAR)];
+    PSYMBOL_INFO pSymbol = reinterpret_cast<PSYMBOL_INFO>(buffer);
+    pSymbol->SizeOfStruct = sizeof(SYMBOL_INFO);
+    pSymbol->MaxNameLen = MAX_SYM_NAME;
+
+    writer.ObjectStart();
+    snprintf(buf, sizeof(buf), "0x%p", reinterpret_cast<void*>(dwAddress));
+    writer.KeyValue("pc", buf);
+    if (SymFromAddr(hProcess, dwAddress, &dwOffset64, pSymbol)) {
+      DWORD dwOffset = 0;
+      IMAGEHLP_LINE64 line;
+      line.SizeOfStruct = sizeof(line);
+      writer.KeyValue("symbol", pSymbol->Name);
+      if (SymGetLineFromAddr64(hProcess, dwAddress, &dwOffset, &line)) {
+        writer.KeyValue("offset", static_cast<unsigned long>(dwOffset));
+        writer.KeyValue("file", line.FileName);
+        writer.KeyValue("line", static_cast<unsigned long>(line.LineNumber));
+      } else {
+        writer.KeyValue("offset", static_cast<unsigned long long>(dwOffset64));
+      }
+    }
+    writer.ObjectEnd();
+  }
+  writer.ArrayEnd();
+}
 #elif _AIX
 /*******************************************************************************
- * Function to print a native stack backtrace - AIX
+ * Functions to capture and print a native stack backtrace - AIX
  *
  ******************************************************************************/
-void PrintNativeStack(std::ostream& out) {
+static void CaptureNativeStack(ReportSnapshot* snapshot) {
+  snapshot->native_frame_count = 0;
+}
+
+static void PrintNativeStack(std::ostream& out, const ReportSnapshot& snapshot) {
   out << "\n================================================================================";
   out << "\n==== Native Stack Trace ========================================================\n\n";
   out << "Native stack trace not supported on AIX\n";
 }
+
+static void PrintNativeStack(ReportWriter& writer, const ReportSnapshot& snapshot) {
+  writer.ArrayStart("nativeStack");
+  writer.ArrayEnd();
+}
 #elif (defined(__linux__) && !defined(__GLIBC__))
 /*******************************************************************************
- * Function to print a native stack backtrace - Alpine Linux etc
+ * Functions to capture and print a native stack backtrace - Alpine Linux etc
  *
  ******************************************************************************/
-void PrintNativeStack(std::ostream& out) {
+static void CaptureNativeStack(ReportSnapshot* snapshot) {
+  snapshot->native_frame_count = 0;
+}
+
+static void PrintNativeStack(std::ostream& out, const ReportSnapshot& snapshot) {
   out << "\n================================================================================";
   out << "\n==== Native Stack Trace ========================================================\n\n";
   out << "Native stack trace not supported on Linux platforms without GLIBC\n";
 }
+
+static void PrintNativeStack(ReportWriter& writer, const ReportSnapshot& snapshot) {
+  writer.ArrayStart("nativeStack");
+  writer.ArrayEnd();
+}
 #else
 /*******************************************************************************
- * Function to print a native stack backtrace - Linux/OSX
+ * Functions to capture and print a native stack backtrace - Linux/OSX
  *
+ * Only the instruction addresses are captured on the event loop thread, the
+ * symbolic information is looked up when the report is printed.
  ******************************************************************************/
-void PrintNativeStack(std::ostream& out) {
-  void* frames[256];
+#ifndef __MVS__
+// Symbolic information for a native stack frame, see ResolveNativeStack()
+struct NativeSymbol {
+  bool found;
+  std::string symbol;
+  bool has_offset;             // offset is only available from the ELF symbolizer
+  uintptr_t offset;
+  std::string file;            // empty if no line information
+  unsigned int line;
+  std::string library;
+};
+
+// Symbol cache hit and miss counts for a report
+struct SymbolCacheStats {
+  bool enabled;
+  size_t hits;
+  size_t misses;
+  size_t entries;
+};
+
+static void ResolveNativeStack(void* const* frames, int start, int size,
+                               std::vector<NativeSymbol>* symbols, SymbolCacheStats* stats,
+                               bool add_to_cache = true);
+#endif
+
+static void CaptureNativeStack(ReportSnapshot* snapshot) {
+  // Get the native backtrace (array of instruction addresses)
+  snapshot->native_frame_count = backtrace(snapshot->native_frames, arraysize(snapshot->native_frames));
+}
+
+static void PrintNativeStack(std::ostream& out, const ReportSnapshot& snapshot) {
+  void* const* frames = snapshot.native_frames;
+  const int size = snapshot.native_frame_count;
   char buf[64];
   out << "\n================================================================================";
   out << "\n==== Native Stack Trace ========================================================\n\n";
 
-  // Get the native backtrace (array of instruction addresses)
-  const int size = backtrace(frames, arraysize(frames));
   if (size <= 0) {
     out << "Native backtrace failed, error " << size << "\n";
     return;
@@ -747,388 +2282,2548 @@ void PrintNativeStack(std::ostream& out) {
 #else
   // Print the native frames, omitting the top 3 frames as they are in node-report code
   // backtrace_symbols_fd(frames, size, fileno(fp));
+  std::vector<NativeSymbol> symbols;
+  SymbolCacheStats stats;
+  ResolveNativeStack(frames, 2, size, &symbols, &stats);
   for (int i = 2; i < size; i++) {
     // print frame index and instruction address
     snprintf(buf, sizeof(buf), "%2d: [pc=%p] ", i-2, frames[i]);
     out << buf;
-    // If we can translate the address using dladdr() print additional symbolic information
-    Dl_info info;
-    if (dladdr(frames[i], &info)) {
-      if (info.dli_sname != nullptr) {
-        if (char* demangled = abi::__cxa_demangle(info.dli_sname, 0, 0, 0)) {
-          out << demangled; // print demangled symbol name
-          free(demangled);
-        } else {
-          out << info.dli_sname; // just print the symbol name
-        }
+    // If we can translate the address print additional symbolic information
+    const NativeSymbol& symbol = symbols[i - 2];
+    if (symbol.found) {
+      out << symbol.symbol;
+      if (symbol.has_offset) {
+        out << " [+" << symbol.offset << "]";
+      }
+      if (!symbol.file.empty()) {
+        out << " in " << symbol.file << ": line: " << symbol.line;
       }
-      if (info.dli_fname != nullptr) {
-        out << " [" << info.dli_fname << "]"; // print shared object name
+      if (!symbol.library.empty()) {
+        out << " [" << symbol.library << "]"; // print shared object name
       }
     }
     out << std::endl;
   }
+  if (stats.enabled) {
+    out << "\nSymbol cache: " << stats.hits << " hits, " << stats.misses << " misses, "
+        << stats.entries << " entries\n";
+  }
 #endif
 }
+
+static void PrintNativeStack(ReportWriter& writer, const ReportSnapshot& snapshot) {
+  void* const* frames = snapshot.native_frames;
+  const int size = snapshot.native_frame_count;
+  char buf[64];
+  writer.ArrayStart("nativeStack");
+#ifdef __MVS__
+  char **res = size > 0 ? backtrace_symbols(frames, size) : nullptr;
+  if (res != nullptr) {
+    for (int i = 0; i < size; i++) {
+      writer.ObjectStart();
+      writer.KeyValue("symbol", res[i]);
+      writer.ObjectEnd();
+    }
+    free(res);
+  }
+  writer.ArrayEnd();
+#else
+  std::vector<NativeSymbol> symbols;
+  SymbolCacheStats stats;
+  ResolveNativeStack(frames, 2, size, &symbols, &stats);
+  for (int i = 2; i < size; i++) {
+    writer.ObjectStart();
+    snprintf(buf, sizeof(buf), "%p", frames[i]);
+    writer.KeyValue("pc", buf);
+    const NativeSymbol& symbol = symbols[i - 2];
+    if (symbol.found) {
+      writer.KeyValue("symbol", symbol.symbol);
+      if (symbol.has_offset) {
+        writer.KeyValue("offset", static_cast<unsigned long long>(symbol.offset));
+      }
+      if (!symbol.file.empty()) {
+        writer.KeyValue("file", symbol.file);
+        writer.KeyValue("line", symbol.line);
+      }
+      writer.KeyValue("library", symbol.library);
+    }
+    writer.ObjectEnd();
+  }
+  writer.ArrayEnd();
+  if (stats.enabled) {
+    writer.ObjectStart("nativeSymbolCache");
+    writer.KeyValue("hits", stats.hits);
+    writer.KeyValue("misses", stats.misses);
+    writer.KeyValue("entries", stats.entries);
+    writer.ObjectEnd();
+  }
 #endif
+}
 
+#ifndef __MVS__
 /*******************************************************************************
- * Function to print V8 JavaScript heap information.
+ * Functions to look up the symbol and shared object names for native stack
+ * frames. The ELF symbolizer is used where available, as it also finds local
+ * symbols and source lines, otherwise dladdr(). Symbol names are demangled
+ * where possible.
  *
- * This uses the existing V8 HeapStatistics and HeapSpaceStatistics APIs.
- * The isolate->GetGCStatistics(&heap_stats) internal V8 API could potentially
- * provide some more useful information - the GC history and the handle counts
+ * The results are kept in a cache keyed by instruction address, as reports
+ * triggered repeatedly usually have mostly the same native frames. The cache
+ * is emptied when a shared library is loaded or unloaded, and when it is full
+ * the oldest entry is evicted. It is not used on platforms where library
+ * changes cannot be detected.
  ******************************************************************************/
-static void PrintGCStatistics(std::ostream& out, Isolate* isolate) {
-  HeapStatistics v8_heap_stats;
-  isolate->GetHeapStatistics(&v8_heap_stats);
+#define NR_SYMBOL_CACHE_SIZE 4096
 
-  out << "\n================================================================================";
-  out << "\n==== JavaScript Heap and Garbage Collector =====================================\n";
-  HeapSpaceStatistics v8_heap_space_stats;
-  // Loop through heap spaces
-  for (size_t i = 0; i < isolate->NumberOfHeapSpaces(); i++) {
-    isolate->GetHeapSpaceStatistics(&v8_heap_space_stats, i);
-    out << "\nHeap space name: " << v8_heap_space_stats.space_name();
-    out << "\n    Memory size: ";
-    WriteInteger(out, v8_heap_space_stats.space_size());
-    out << " bytes, committed memory: ";
-    WriteInteger(out, v8_heap_space_stats.physical_space_size());
-    out << " bytes\n    Capacity: ";
-    WriteInteger(out, v8_heap_space_stats.space_used_size() +
-                           v8_heap_space_stats.space_available_size());
-    out << " bytes, used: ";
-    WriteInteger(out, v8_heap_space_stats.space_used_size());
-    out << " bytes, available: ";
-    WriteInteger(out, v8_heap_space_stats.space_available_size());
-    out << " bytes";
-  }
+static uv_once_t symbol_cache_once = UV_ONCE_INIT;
+static uv_mutex_t symbol_cache_mutex;
+static std::unordered_map<void*, NativeSymbol> symbol_cache;
+static std::deque<void*> symbol_cache_order;  // oldest entry first
+static unsigned long long symbol_cache_adds = 0;
+static unsigned long long symbol_cache_subs = 0;
 
-  out << "\n\nTotal heap memory size: ";
-  WriteInteger(out, v8_heap_stats.total_heap_size());
-  out << " bytes\nTotal heap committed memory: ";
-  WriteInteger(out, v8_heap_stats.total_physical_size());
-  out << " bytes\nTotal used heap memory: ";
-  WriteInteger(out, v8_heap_stats.used_heap_size());
-  out << " bytes\nTotal available heap memory: ";
-  WriteInteger(out, v8_heap_stats.total_available_size());
-  out << " bytes\n\nHeap memory limit: ";
-  WriteInteger(out, v8_heap_stats.heap_size_limit());
-  out << "\n";
+#ifdef __linux__
+static int LibraryCountersCallback(struct dl_phdr_info* info, size_t size, void* data) {
+  // dlpi_adds and dlpi_subs are only present from glibc 2.4
+  if (size < offsetof(struct dl_phdr_info, dlpi_subs) + sizeof(info->dlpi_subs)) {
+    return -1;
+  }
+  unsigned long long* counters = static_cast<unsigned long long*>(data);
+  counters[0] = info->dlpi_adds;
+  counters[1] = info->dlpi_subs;
+  return 1;  // the counters are the same for every library, stop here
 }
+#elif __APPLE__
+static unsigned long long dyld_adds = 0;
+static unsigned long long dyld_subs = 0;
 
-#ifndef _WIN32
-/*******************************************************************************
- * Function to print resource usage (Linux/OSX only).
- *
- ******************************************************************************/
-static void PrintResourceUsage(std::ostream& out) {
-  char buf[64];
-  double cpu_abs;
-  double cpu_percentage;
-  time_t current_time; // current time absolute
-  time(&current_time);
-  auto uptime = difftime(current_time, load_time);
-  if (uptime == 0)
-    uptime = 1; // avoid division by zero.
-  out << "\n================================================================================";
-  out << "\n==== Resource Usage ============================================================\n";
+static void DyldAddImage(const struct mach_header* header, intptr_t slide) {
+  __sync_fetch_and_add(&dyld_adds, 1);
+}
 
-  // Process and current thread usage statistics
-  struct rusage stats;
-  out << "\nProcess total resource usage:";
-  if (getrusage(RUSAGE_SELF, &stats) == 0) {
-#if defined(__APPLE__) || defined(_AIX) || defined(__MVS__)
-    snprintf( buf, sizeof(buf), "%ld.%06d", stats.ru_utime.tv_sec, stats.ru_utime.tv_usec);
-    out << "\n  User mode CPU: " << buf << " secs";
-    snprintf( buf, sizeof(buf), "%ld.%06d", stats.ru_stime.tv_sec, stats.ru_stime.tv_usec);
-    out << "\n  Kernel mode CPU: " << buf << " secs";
-#else
-    snprintf( buf, sizeof(buf), "%ld.%06ld", stats.ru_utime.tv_sec, stats.ru_utime.tv_usec);
-    out << "\n  User mode CPU: " << buf << " secs";
-    snprintf( buf, sizeof(buf), "%ld.%06ld", stats.ru_stime.tv_sec, stats.ru_stime.tv_usec);
-    out << "\n  Kernel mode CPU: " << buf << " secs";
+static void DyldRemoveImage(const struct mach_header* header, intptr_t slide) {
+  __sync_fetch_and_add(&dyld_subs, 1);
+}
 #endif
-    cpu_abs = stats.ru_utime.tv_sec + 0.000001 * stats.ru_utime.tv_usec + stats.ru_stime.tv_sec + 0.000001 *  stats.ru_stime.tv_usec;
-    cpu_percentage = (cpu_abs / uptime) * 100.0;
-    out << "\n  Average CPU Consumption : "<< cpu_percentage << "%";
-    out << "\n  Maximum resident set size: ";
-#if !defined(__MVS__)
-    WriteInteger(out, stats.ru_maxrss * 1024);
-    out << " bytes\n  Page faults: " << stats.ru_majflt << " (I/O required) "
-        << stats.ru_minflt << " (no I/O required)";
-    out << "\n  Filesystem activity: " << stats.ru_inblock << " reads "
-        <<  stats.ru_oublock << " writes";
+
+static void InitSymbolCache() {
+  if (uv_mutex_init(&symbol_cache_mutex) != 0) {
+    abort();
+  }
+#ifdef __APPLE__
+  _dyld_register_func_for_add_image(DyldAddImage);
+  _dyld_register_func_for_remove_image(DyldRemoveImage);
 #endif
+}
+
+// Obtain the number of shared library loads and unloads since process start.
+// Returns false if they are not available on this platform.
+static bool GetLibraryCounters(unsigned long long* adds, unsigned long long* subs) {
+#ifdef __linux__
+  unsigned long long counters[2];
+  if (dl_iterate_phdr(LibraryCountersCallback, counters) != 1) {
+    return false;
   }
-#ifdef RUSAGE_THREAD
-  out << "\n\nEvent loop thread resource usage:";
-  memset(&stats, 0, sizeof(stats));
-  if (getrusage(RUSAGE_THREAD, &stats) == 0) {
-#if defined(__APPLE__) || defined(_AIX)
-    snprintf( buf, sizeof(buf), "%ld.%06d", stats.ru_utime.tv_sec, stats.ru_utime.tv_usec);
-    out << "\n  User mode CPU: " << buf << " secs";
-    snprintf( buf, sizeof(buf), "%ld.%06d", stats.ru_stime.tv_sec, stats.ru_stime.tv_usec);
-    out << "\n  Kernel mode CPU: " << buf << " secs";
+  *adds = counters[0];
+  *subs = counters[1];
+  return true;
+#elif __APPLE__
+  *adds = __sync_fetch_and_add(&dyld_adds, 0);
+  *subs = __sync_fetch_and_add(&dyld_subs, 0);
+  return true;
 #else
-    snprintf( buf, sizeof(buf), "%ld.%06ld", stats.ru_utime.tv_sec, stats.ru_utime.tv_usec);
-    out << "\n  User mode CPU: " << buf << " secs";
-    snprintf( buf, sizeof(buf), "%ld.%06ld", stats.ru_stime.tv_sec, stats.ru_stime.tv_usec);
-    out << "\n  Kernel mode CPU: " << buf << " secs";
+  return false;
 #endif
-    cpu_abs = stats.ru_utime.tv_sec + 0.000001 * stats.ru_utime.tv_usec + stats.ru_stime.tv_sec + 0.000001 * stats.ru_stime.tv_usec;
-    cpu_percentage = (cpu_abs / uptime) * 100.0;
-    out << "\n  Average CPU Consumption : " << cpu_percentage << "%";
-    out << "\n  Filesystem activity: " << stats.ru_inblock << " reads "
-        << stats.ru_oublock << " writes";
+}
+
+static void Demangle(const char* name, std::string* symbol) {
+  if (char* demangled = abi::__cxa_demangle(name, 0, 0, 0)) {
+    *symbol = demangled;
+    free(demangled);
+  } else {
+    *symbol = name;
   }
-#elif defined(__APPLE__)
-  // Currently RUSAGE_THREAD is not currently supported on Mac.
-  mach_msg_type_number_t count = THREAD_BASIC_INFO_COUNT;
-  mach_port_t thread = pthread_mach_thread_np(pthread_self());
-  thread_basic_info thr_info;
+}
 
-  kern_return_t rc = thread_info(thread, THREAD_BASIC_INFO, (thread_info_t) &thr_info, &count);
+static void GetNativeSymbol(void* pc, NativeSymbol* symbol) {
+  symbol->symbol.clear();
+  symbol->has_offset = false;
+  symbol->file.clear();
+  symbol->line = 0;
+  symbol->library.clear();
+#ifdef NR_ELF_SYMBOLIZER
+  ElfFrameInfo frame;
+  if (ElfSymbolize(reinterpret_cast<uintptr_t>(pc), &frame)) {
+    symbol->found = true;
+    Demangle(frame.symbol.c_str(), &symbol->symbol);
+    symbol->has_offset = true;
+    symbol->offset = frame.offset;
+    symbol->file = frame.file;
+    symbol->line = frame.line;
+    symbol->library = frame.library;
+    return;
+  }
+#endif
+  Dl_info info;
+  symbol->found = dladdr(pc, &info) != 0;
+  if (!symbol->found) {
+    return;
+  }
+  if (info.dli_sname != nullptr) {
+    Demangle(info.dli_sname, &symbol->symbol);
+  }
+  if (info.dli_fname != nullptr) {
+    symbol->library = info.dli_fname;
+  }
+}
 
-  if (rc == KERN_SUCCESS) {
-    out << "\n\nEvent loop thread resource usage:";
-    snprintf( buf, sizeof(buf), "%d.%06d", thr_info.user_time.seconds, thr_info.user_time.microseconds);
-    out << "\n  User mode CPU: " << buf << " secs";
-    snprintf( buf, sizeof(buf), "%d.%06d", thr_info.system_time.seconds, thr_info.system_time.microseconds);
-    out << "\n  Kernel mode CPU: " << buf << " secs";
-    cpu_abs = thr_info.user_time.seconds + 0.000001 * thr_info.user_time.microseconds
-        + thr_info.system_time.seconds + 0.000001 * thr_info.system_time.microseconds;
-    cpu_percentage = (cpu_abs / uptime) * 100.0;
-    out << "\n  Average CPU Consumption : " << cpu_percentage << "%";
+// Frames that are unlikely to recur, such as stack sample addresses in
+// collected JIT code, are looked up in the cache but not added to it
+static void ResolveNativeStack(void* const* frames, int start, int size,
+                               std::vector<NativeSymbol>* symbols, SymbolCacheStats* stats,
+                               bool add_to_cache) {
+  symbols->resize(size > start ? size - start : 0);
+  stats->hits = 0;
+  stats->misses = 0;
+
+  uv_once(&symbol_cache_once, InitSymbolCache);
+  uv_mutex_lock(&symbol_cache_mutex);
+  unsigned long long adds = 0, subs = 0;
+  stats->enabled = GetLibraryCounters(&adds, &subs);
+  if (!stats->enabled || adds != symbol_cache_adds || subs != symbol_cache_subs) {
+    symbol_cache.clear();
+    symbol_cache_order.clear();
+    symbol_cache_adds = adds;
+    symbol_cache_subs = subs;
+#ifdef NR_ELF_SYMBOLIZER
+    ElfSymbolizerReset();
+#endif
   }
-#endif // RUSAGE_THREAD
-  out << std::endl;
+  for (int i = start; i < size; i++) {
+    NativeSymbol* symbol = &(*symbols)[i - start];
+    if (stats->enabled) {
+      auto entry = symbol_cache.find(frames[i]);
+      if (entry != symbol_cache.end()) {
+        *symbol = entry->second;
+        stats->hits++;
+        continue;
+      }
+    }
+    GetNativeSymbol(frames[i], symbol);
+    stats->misses++;
+    if (stats->enabled && add_to_cache) {
+      if (symbol_cache.size() >= NR_SYMBOL_CACHE_SIZE) {
+        symbol_cache.erase(symbol_cache_order.front());
+        symbol_cache_order.pop_front();
+      }
+      symbol_cache[frames[i]] = *symbol;
+      symbol_cache_order.push_back(frames[i]);
+    }
+  }
+  stats->entries = symbol_cache.size();
+  uv_mutex_unlock(&symbol_cache_mutex);
 }
 #endif
+#endif
 
 /*******************************************************************************
- * Function to print operating system information.
+ * Functions to aggregate and print the JavaScript stack samples.
  *
+ * The sampler only records instruction addresses. When the report is
+ * captured they are looked up against the JIT code objects logged by V8,
+ * which can move or be collected once the event loop runs again. The other
+ * addresses, builtins and C++ code, are resolved as native symbols when the
+ * report is written, which may be on the report writer thread. Samples that
+ * have fallen out of the ring buffer are not included.
  ******************************************************************************/
-static void PrintSystemInformation(std::ostream& out, Isolate* isolate) {
-  out << "\n================================================================================";
-  out << "\n==== System Information ========================================================\n";
+#define NR_SAMPLE_TOP_FUNCTIONS 20
 
-#ifdef _WIN32
-  out << "\nEnvironment variables\n";
-  LPTSTR lpszVariable;
-  LPTCH lpvEnv;
+static void CaptureStackSamples(StackSampleInfo* info) {
+  std::vector<StackSample> samples;
+  info->interval = GetStackSamplerInterval();
+  info->skipped = GetStackSamples(&samples);
+  info->count = samples.size();
+  info->duration = samples.size() > 1 ? samples.back().time - samples.front().time : 0;
+  info->frames.clear();
+  info->frame_counts.clear();
+  info->code_names.clear();
 
-  // Get pointer to the environment block
-  lpvEnv = GetEnvironmentStrings();
-  if (lpvEnv != nullptr) {
-    // Variable strings are separated by null bytes, and the block is terminated by a null byte.
-    lpszVariable = reinterpret_cast<LPTSTR>(lpvEnv);
-    while (*lpszVariable) {
-      out << "  " << lpszVariable << "\n", lpszVariable;
-      lpszVariable += lstrlen(lpszVariable) + 1;
+  // Look up each distinct address once, keeping only the JIT code names
+  std::unordered_set<void*> seen;
+  std::string name;
+  for (const StackSample& sample : samples) {
+    info->frames.insert(info->frames.end(), sample.frames, sample.frames + sample.frame_count);
+    info->frame_counts.push_back(sample.frame_count);
+    for (unsigned int i = 0; i < sample.frame_count; i++) {
+      if (seen.insert(sample.frames[i]).second && GetCodeName(sample.frames[i], &name)) {
+        info->code_names[sample.frames[i]] = name;
+      }
     }
-    FreeEnvironmentStrings(lpvEnv);
   }
-#else
-  out << "\nEnvironment variables\n";
-  int index = 1;
-  char* env_var = *environ;
+}
 
-  while (env_var != nullptr) {
-    out << "  " << env_var << "\n";
-    env_var = *(environ + index++);
+// Resolve the native frames, then count the samples for each function and for
+// each distinct stack
+static void AggregateStackSamples(const StackSampleInfo& info,
+                                  std::vector<SampledFunction>* top_functions,
+                                  std::vector<std::pair<std::string, unsigned int> >* folded) {
+  std::unordered_map<void*, std::string> names(info.code_names);
+  std::vector<void*> unresolved;
+  for (void* frame : info.frames) {
+    if (names.find(frame) == names.end()) {
+      names[frame];
+      unresolved.push_back(frame);
+    }
+  }
+#ifdef NR_NATIVE_SYMBOLS
+  std::vector<NativeSymbol> symbols;
+  SymbolCacheStats stats;
+  ResolveNativeStack(unresolved.data(), 0, static_cast<int>(unresolved.size()), &symbols, &stats,
+                     false);
+  for (size_t i = 0; i < unresolved.size(); i++) {
+    names[unresolved[i]] = symbols[i].symbol;
   }
-
-const static struct {
-  const char* description;
-  int id;
-} rlimit_strings[] = {
-  {"core file size (blocks)       ", RLIMIT_CORE},
-  {"data seg size (kbytes)        ", RLIMIT_DATA},
-  {"file size (blocks)            ", RLIMIT_FSIZE},
-#if !(defined(_AIX) || defined(__sun) || defined(__MVS__))
-  {"max locked memory (bytes)     ", RLIMIT_MEMLOCK},
-#endif
-#if !(defined(__sun) || defined(__MVS__))
-  {"max memory size (kbytes)      ", RLIMIT_RSS},
-#endif
-  {"open files                    ", RLIMIT_NOFILE},
-  {"stack size (bytes)            ", RLIMIT_STACK},
-  {"cpu time (seconds)            ", RLIMIT_CPU},
-#if !(defined(__sun) || defined(__MVS__))
-  {"max user processes            ", RLIMIT_NPROC},
 #endif
-  {"virtual memory (kbytes)       ", RLIMIT_AS}
-};
-
-  out << "\nResource limits                        soft limit      hard limit\n";
-  struct rlimit limit;
-  char buf[64];
+  for (auto& entry : names) {
+    std::string& name = entry.second;
+    if (name.empty()) {
+      name = "[unknown]";
+    }
+    // Semicolons separate the frames of a folded stack
+    std::replace(name.begin(), name.end(), ';', ':');
+  }
 
-  for (size_t i = 0; i < arraysize(rlimit_strings); i++) {
-    if (getrlimit(rlimit_strings[i].id, &limit) == 0) {
-      out << "  " << rlimit_strings[i].description << " ";
-      if (limit.rlim_cur == RLIM_INFINITY) {
-        out << "       unlimited";
-      } else {
-#if defined(_AIX) || defined(__sun)
-        snprintf(buf, sizeof(buf), "%16ld", limit.rlim_cur);
-        out << buf;
-#elif (defined(__linux__) && !defined(__GLIBC__))
-        snprintf(buf, sizeof(buf), "%16lld", limit.rlim_cur);
-        out << buf;
+  std::unordered_map<std::string, SampledFunction> functions;
+  std::unordered_map<std::string, unsigned int> stacks;
+  std::vector<const SampledFunction*> seen;
+  void* const* frames = info.frames.data();
+  for (unsigned int frame_count : info.frame_counts) {
+    if (frame_count == 0) {
+      continue;
+    }
+    std::string stack;
+    seen.clear();
+    for (unsigned int i = frame_count; i-- > 0; ) {
+      const std::string& name = names[frames[i]];
+      SampledFunction& function = functions[name];
+      if (std::find(seen.begin(), seen.end(), &function) == seen.end()) {
+        function.total++;  // count recursive functions once per sample
+        seen.push_back(&function);
+      }
+      if (i == 0) {
+        function.self++;
+      }
+      if (!stack.empty()) {
+        stack += ';';
+      }
+      stack += name;
+    }
+    stacks[stack]++;
+    frames += frame_count;
+  }
+
+  for (auto& entry : functions) {
+    entry.second.name = entry.first;
+    top_functions->push_back(entry.second);
+  }
+  std::sort(top_functions->begin(), top_functions->end(),
+            [](const SampledFunction& a, const SampledFunction& b) {
+              return a.self != b.self ? a.self > b.self : a.total > b.total;
+            });
+  if (top_functions->size() > NR_SAMPLE_TOP_FUNCTIONS) {
+    top_functions->resize(NR_SAMPLE_TOP_FUNCTIONS);
+  }
+  folded->assign(stacks.begin(), stacks.end());
+  std::sort(folded->begin(), folded->end(),
+            [](const std::pair<std::string, unsigned int>& a,
+               const std::pair<std::string, unsigned int>& b) {
+              return a.second != b.second ? a.second > b.second : a.first < b.first;
+            });
+}
+
+static void PrintStackSamples(std::ostream& out, const StackSampleInfo& info) {
+  out << "\n================================================================================";
+  out << "\n==== Recent Stack Samples ======================================================\n\n";
+  char duration[32];
+  snprintf(duration, sizeof(duration), "%.3f", info.duration / 1e9);
+  out << "Sampling interval: " << info.interval << " ms, " << info.count << " samples over "
+      << duration << " s, " << info.skipped << " skipped while JavaScript was not running\n";
+  if (info.count == 0) {
+    return;
+  }
+  std::vector<SampledFunction> functions;
+  std::vector<std::pair<std::string, unsigned int> > stacks;
+  AggregateStackSamples(info, &functions, &stacks);
+
+  out << "\nTop functions (samples):\n";
+  out << std::right << std::setw(8) << "Self" << std::setw(8) << "Total" << "  Function\n";
+  for (const SampledFunction& function : functions) {
+    out << std::setw(8) << function.self << std::setw(8) << function.total << "  "
+        << function.name << "\n";
+  }
+  out << std::left;
+
+  // One line per distinct stack, outermost frame first, for flame graph tools
+  out << "\nFolded stacks:\n";
+  for (const auto& stack : stacks) {
+    out << stack.first << " " << stack.second << "\n";
+  }
+}
+
+static void PrintStackSamples(ReportWriter& writer, const StackSampleInfo& info) {
+  writer.ObjectStart("stackSamples");
+  writer.KeyValue("interval", info.interval);
+  writer.KeyValue("samples", static_cast<unsigned long long>(info.count));
+  writer.KeyValue("skipped", static_cast<unsigned long long>(info.skipped));
+  writer.KeyValue("duration", info.duration / 1e6);
+  std::vector<SampledFunction> functions;
+  std::vector<std::pair<std::string, unsigned int> > stacks;
+  AggregateStackSamples(info, &functions, &stacks);
+  writer.ArrayStart("topFunctions");
+  for (const SampledFunction& function : functions) {
+    writer.ObjectStart();
+    writer.KeyValue("name", function.name);
+    writer.KeyValue("self", function.self);
+    writer.KeyValue("total", function.total);
+    writer.ObjectEnd();
+  }
+  writer.ArrayEnd();
+  writer.ArrayStart("foldedStacks");
+  for (const auto& stack : stacks) {
+    writer.Element(stack.first + " " + std::to_string(stack.second));
+  }
+  writer.ArrayEnd();
+  writer.ObjectEnd();
+}
+
+/*******************************************************************************
+ * Functions to print the libuv threadpool size and the queue-to-start latency
+ * histogram recorded by the threadpool probe.
+ *
+ ******************************************************************************/
+static void PrintThreadpoolProbe(std::ostream& out, const ThreadpoolProbeInfo& info) {
+  out << "\n================================================================================";
+  out << "\n==== libuv Threadpool ==========================================================\n\n";
+  out << "Threadpool size: " << info.pool_size;
+  if (info.size_setting != nullptr) {
+    out << " (UV_THREADPOOL_SIZE=" << info.size_setting << ")\n";
+  } else {
+    out << " (UV_THREADPOOL_SIZE not set)\n";
+  }
+  char buf[64];
+  snprintf(buf, sizeof(buf), "%.3f", info.duration / 1e9);
+  out << "Probe interval: " << info.interval << " ms, " << info.probes << " probes over "
+      << buf << " s\n";
+  if (info.probes != 0) {
+    out << "Queue-to-start latency: ";
+    snprintf(buf, sizeof(buf), "%.3f", info.last_latency / 1e6);
+    out << "last " << buf << " ms, ";
+    snprintf(buf, sizeof(buf), "%.3f", info.total_latency / 1e6 / info.probes);
+    out << "mean " << buf << " ms, ";
+    snprintf(buf, sizeof(buf), "%.3f", info.max_latency / 1e6);
+    out << "max " << buf << " ms\n";
+  }
+  if (info.waiting != 0) {
+    snprintf(buf, sizeof(buf), "%.3f", info.waiting / 1e6);
+    out << "Probe waiting for a thread for " << buf << " ms\n";
+  }
+  if (info.probes == 0) {
+    return;
+  }
+
+  // Only the range of buckets with probes in them is shown
+  unsigned int first = 0;
+  unsigned int last = NR_PROBE_BUCKETS - 1;
+  while (info.histogram[first] == 0) first++;
+  while (info.histogram[last] == 0) last--;
+  out << "\nQueue-to-start latency histogram (microseconds):\n";
+  out << std::right << std::setw(10) << "From" << std::setw(10) << "To" << std::setw(10)
+      << "Probes" << "\n";
+  for (unsigned int bucket = first; bucket <= last; bucket++) {
+    out << std::setw(10) << (bucket == 0 ? 0 : 1ULL << bucket);
+    if (bucket == NR_PROBE_BUCKETS - 1) {
+      out << std::setw(10) << "-";
+    } else {
+      out << std::setw(10) << (2ULL << bucket);
+    }
+    out << std::setw(10) << info.histogram[bucket] << "\n";
+  }
+  out << std::left;
+}
+
+static void PrintThreadpoolProbe(ReportWriter& writer, const ThreadpoolProbeInfo& info) {
+  writer.ObjectStart("libuvThreadpool");
+  writer.KeyValue("threadpoolSize", info.pool_size);
+  if (info.size_setting != nullptr) {
+    writer.KeyValue("uvThreadpoolSize", info.size_setting);
+  }
+  writer.KeyValue("probeInterval", info.interval);
+  writer.KeyValue("probes", static_cast<unsigned long long>(info.probes));
+  writer.KeyValue("duration", info.duration / 1e6);
+  if (info.probes != 0) {
+    writer.KeyValue("lastLatency", info.last_latency / 1e6);
+    writer.KeyValue("meanLatency", info.total_latency / 1e6 / info.probes);
+    writer.KeyValue("maxLatency", info.max_latency / 1e6);
+  }
+  if (info.waiting != 0) {
+    writer.KeyValue("waitingLatency", info.waiting / 1e6);
+  }
+  writer.ArrayStart("latencyHistogram");
+  for (unsigned int bucket = 0; bucket < NR_PROBE_BUCKETS; bucket++) {
+    if (info.histogram[bucket] == 0) {
+      continue;
+    }
+    writer.ObjectStart();
+    writer.KeyValue("from", bucket == 0 ? 0ULL : 1ULL << bucket);
+    if (bucket != NR_PROBE_BUCKETS - 1) {
+      writer.KeyValue("to", 2ULL << bucket);
+    }
+    writer.KeyValue("probes", static_cast<unsigned long long>(info.histogram[bucket]));
+    writer.ObjectEnd();
+  }
+  writer.ArrayEnd();
+  writer.ObjectEnd();
+}
+
+/*******************************************************************************
+ * Functions to record the garbage collection history.
+ *
+ * The V8 GC prologue and epilogue callbacks run on the event loop thread at
+ * the start and end of each collection. They record the pause and the heap
+ * usage in a fixed size ring buffer, without allocating, so that latency
+ * spikes can be matched with garbage collections when a report is written.
+ ******************************************************************************/
+static GCRecord gc_history[NR_GC_HISTORY_SIZE];
+static uint64_t gc_count = 0;
+static uint64_t gc_total_pause = 0;
+static uint64_t gc_start_time = 0;  // 0 if no collection is in progress
+static size_t gc_used_before = 0;
+static Isolate* gc_history_isolate = nullptr;  // the isolate with the GC callbacks
+
+static void OnGCPrologue(Isolate* isolate, v8::GCType type, v8::GCCallbackFlags flags) {
+  HeapStatistics v8_heap_stats;
+  isolate->GetHeapStatistics(&v8_heap_stats);
+  gc_used_before = v8_heap_stats.used_heap_size();
+  gc_start_time = uv_hrtime();
+}
+
+static void OnGCEpilogue(Isolate* isolate, v8::GCType type, v8::GCCallbackFlags flags) {
+  if (gc_start_time == 0) {
+    return;  // callbacks were added during a collection
+  }
+  GCRecord* record = &gc_history[gc_count % NR_GC_HISTORY_SIZE];
+  record->start = gc_start_time;
+  record->duration = uv_hrtime() - gc_start_time;
+  record->type = type;
+  record->used_before = gc_used_before;
+  HeapStatistics v8_heap_stats;
+  isolate->GetHeapStatistics(&v8_heap_stats);
+  record->used_after = v8_heap_stats.used_heap_size();
+  gc_total_pause += record->duration;
+  gc_count++;
+  gc_start_time = 0;
+}
+
+void SetupGCHistory(Isolate* isolate) {
+  if (gc_history_isolate == nullptr) {
+    isolate->AddGCPrologueCallback(OnGCPrologue);
+    isolate->AddGCEpilogueCallback(OnGCEpilogue);
+    gc_history_isolate = isolate;
+  }
+}
+
+static const char* GCTypeName(v8::GCType type) {
+  switch (type) {
+  case v8::kGCTypeScavenge: return "scavenge";
+  case v8::kGCTypeMarkSweepCompact: return "mark-sweep-compact";
+  case v8::kGCTypeIncrementalMarking: return "incremental-marking";
+  case v8::kGCTypeProcessWeakCallbacks: return "weak-callbacks";
+  default: return "other";
+  }
+}
+
+// Total, maximum and 99th percentile (nearest rank) pause of the GC history
+static void GetGCPauseSummary(const std::vector<GCRecord>& history, uint64_t* total,
+                              uint64_t* max, uint64_t* p99) {
+  std::vector<uint64_t> pauses;
+  pauses.reserve(history.size());
+  *total = 0;
+  for (const GCRecord& record : history) {
+    pauses.push_back(record.duration);
+    *total += record.duration;
+  }
+  std::sort(pauses.begin(), pauses.end());
+  *max = pauses.empty() ? 0 : pauses.back();
+  *p99 = pauses.empty() ? 0 : pauses[(pauses.size() * 99 + 99) / 100 - 1];
+}
+
+/*******************************************************************************
+ * Functions to capture and print V8 JavaScript heap information.
+ *
+ * This uses the existing V8 HeapStatistics and HeapSpaceStatistics APIs,
+ * together with the GC history recorded by the GC callbacks above.
+ ******************************************************************************/
+static void CaptureHeapStatistics(HeapInfo* heap, Isolate* isolate) {
+  HeapStatistics v8_heap_stats;
+  isolate->GetHeapStatistics(&v8_heap_stats);
+  heap->total_heap_size = v8_heap_stats.total_heap_size();
+  heap->total_physical_size = v8_heap_stats.total_physical_size();
+  heap->used_heap_size = v8_heap_stats.used_heap_size();
+  heap->total_available_size = v8_heap_stats.total_available_size();
+  heap->heap_size_limit = v8_heap_stats.heap_size_limit();
+
+  HeapSpaceStatistics v8_heap_space_stats;
+  // Loop through heap spaces
+  heap->spaces.resize(isolate->NumberOfHeapSpaces());
+  for (size_t i = 0; i < heap->spaces.size(); i++) {
+    isolate->GetHeapSpaceStatistics(&v8_heap_space_stats, i);
+    HeapSpaceInfo& space = heap->spaces[i];
+    space.name = v8_heap_space_stats.space_name();
+    space.size = v8_heap_space_stats.space_size();
+    space.committed = v8_heap_space_stats.physical_space_size();
+    space.used = v8_heap_space_stats.space_used_size();
+    space.available = v8_heap_space_stats.space_available_size();
+  }
+  heap->capture_time = uv_hrtime();
+  heap->gc_count = 0;
+  heap->gc_total_pause = 0;
+  heap->gc_history.clear();
+}
+
+static void CaptureGCStatistics(HeapInfo* heap, Isolate* isolate) {
+  CaptureHeapStatistics(heap, isolate);
+  if (isolate != gc_history_isolate) {
+    return;  // the GC history is only recorded for the main thread
+  }
+  heap->gc_count = gc_count;
+  heap->gc_total_pause = gc_total_pause;
+  const uint64_t begin = gc_count > NR_GC_HISTORY_SIZE ? gc_count - NR_GC_HISTORY_SIZE : 0;
+  heap->gc_history.reserve(static_cast<size_t>(gc_count - begin));
+  for (uint64_t i = begin; i < gc_count; i++) {
+    heap->gc_history.push_back(gc_history[i % NR_GC_HISTORY_SIZE]);
+  }
+}
+
+static void PrintGCStatistics(std::ostream& out, const HeapInfo& heap) {
+  out << "\n================================================================================";
+  out << "\n==== JavaScript Heap and Garbage Collector =====================================\n";
+  for (size_t i = 0; i < heap.spaces.size(); i++) {
+    const HeapSpaceInfo& space = heap.spaces[i];
+    out << "\nHeap space name: " << space.name;
+    out << "\n    Memory size: ";
+    WriteInteger(out, space.size);
+    out << " bytes, committed memory: ";
+    WriteInteger(out, space.committed);
+    out << " bytes\n    Capacity: ";
+    WriteInteger(out, space.used + space.available);
+    out << " bytes, used: ";
+    WriteInteger(out, space.used);
+    out << " bytes, available: ";
+    WriteInteger(out, space.available);
+    out << " bytes";
+  }
+
+  out << "\n\nTotal heap memory size: ";
+  WriteInteger(out, heap.total_heap_size);
+  out << " bytes\nTotal heap committed memory: ";
+  WriteInteger(out, heap.total_physical_size);
+  out << " bytes\nTotal used heap memory: ";
+  WriteInteger(out, heap.used_heap_size);
+  out << " bytes\nTotal available heap memory: ";
+  WriteInteger(out, heap.total_available_size);
+  out << " bytes\n\nHeap memory limit: ";
+  WriteInteger(out, heap.heap_size_limit);
+  out << "\n";
+  PrintGCHistory(out, heap);
+}
+
+static std::string FormatInteger(size_t value) {
+  std::ostringstream out;
+  WriteInteger(out, value);
+  return out.str();
+}
+
+static void PrintGCHistory(std::ostream& out, const HeapInfo& heap) {
+  char buf[128];
+  snprintf(buf, sizeof(buf), "%.3f", heap.gc_total_pause / 1e6);
+  out << "\nGarbage collections: " << heap.gc_count << ", total pause " << buf << " ms\n";
+  if (heap.gc_history.empty()) {
+    return;
+  }
+
+  uint64_t total, max, p99;
+  GetGCPauseSummary(heap.gc_history, &total, &max, &p99);
+  snprintf(buf, sizeof(buf), "total pause %.3f ms, max pause %.3f ms, 99th percentile %.3f ms",
+           total / 1e6, max / 1e6, p99 / 1e6);
+  out << "\nRecent garbage collections: " << heap.gc_history.size() << ", " << buf << "\n";
+  snprintf(buf, sizeof(buf), "  %12s  %-20s %10s %16s %16s\n",
+           "Ago (ms)", "Type", "Pause (ms)", "Used before", "Used after");
+  out << buf;
+  for (const GCRecord& record : heap.gc_history) {
+    snprintf(buf, sizeof(buf), "  %12.3f  %-20s %10.3f %16s %16s\n",
+             (heap.capture_time - record.start) / 1e6, GCTypeName(record.type),
+             record.duration / 1e6, FormatInteger(record.used_before).c_str(),
+             FormatInteger(record.used_after).c_str());
+    out << buf;
+  }
+}
+
+static void PrintGCStatistics(ReportWriter& writer, const HeapInfo& heap) {
+  writer.ObjectStart("javascriptHeap");
+  writer.KeyValue("totalMemory", heap.total_heap_size);
+  writer.KeyValue("totalCommittedMemory", heap.total_physical_size);
+  writer.KeyValue("usedMemory", heap.used_heap_size);
+  writer.KeyValue("availableMemory", heap.total_available_size);
+  writer.KeyValue("memoryLimit", heap.heap_size_limit);
+  writer.ObjectStart("heapSpaces");
+  for (size_t i = 0; i < heap.spaces.size(); i++) {
+    const HeapSpaceInfo& space = heap.spaces[i];
+    writer.ObjectStart(space.name.c_str());
+    writer.KeyValue("memorySize", space.size);
+    writer.KeyValue("committedMemory", space.committed);
+    writer.KeyValue("capacity", space.used + space.available);
+    writer.KeyValue("used", space.used);
+    writer.KeyValue("available", space.available);
+    writer.ObjectEnd();
+  }
+  writer.ObjectEnd();
+  PrintGCHistory(writer, heap);
+  writer.ObjectEnd();
+}
+
+static void PrintGCHistory(ReportWriter& writer, const HeapInfo& heap) {
+  uint64_t total, max, p99;
+  GetGCPauseSummary(heap.gc_history, &total, &max, &p99);
+  writer.ObjectStart("garbageCollection");
+  writer.KeyValue("collections", static_cast<unsigned long long>(heap.gc_count));
+  writer.KeyValue("totalPause", heap.gc_total_pause / 1e6);
+  writer.KeyValue("recentTotalPause", total / 1e6);
+  writer.KeyValue("recentMaxPause", max / 1e6);
+  writer.KeyValue("recentP99Pause", p99 / 1e6);
+  writer.ArrayStart("recent");
+  for (const GCRecord& record : heap.gc_history) {
+    writer.ObjectStart();
+    writer.KeyValue("type", GCTypeName(record.type));
+    writer.KeyValue("ago", (heap.capture_time - record.start) / 1e6);
+    writer.KeyValue("pause", record.duration / 1e6);
+    writer.KeyValue("usedBefore", record.used_before);
+    writer.KeyValue("usedAfter", record.used_after);
+    writer.ObjectEnd();
+  }
+  writer.ArrayEnd();
+  writer.ObjectEnd();
+}
+
+#ifndef _WIN32
+/*******************************************************************************
+ * Function to print process and event loop thread resource usage (Linux/OSX
+ * only).
+ *
+ ******************************************************************************/
+static void PrintResourceUsage(std::ostream& out, const ReportSnapshot& snapshot) {
+  char buf[64];
+  double cpu_abs;
+  double cpu_percentage;
+  time_t current_time; // current time absolute
+  time(&current_time);
+  auto uptime = difftime(current_time, load_time);
+  if (uptime == 0)
+    uptime = 1; // avoid division by zero.
+  out << "\n================================================================================";
+  out << "\n==== Resource Usage ============================================================\n";
+
+  // Process and current thread usage statistics
+  struct rusage stats;
+  out << "\nProcess total resource usage:";
+  if (getrusage(RUSAGE_SELF, &stats) == 0) {
+#if defined(__APPLE__) || defined(_AIX) || defined(__MVS__)
+    snprintf( buf, sizeof(buf), "%ld.%06d", stats.ru_utime.tv_sec, stats.ru_utime.tv_usec);
+    out << "\n  User mode CPU: " << buf << " secs";
+    snprintf( buf, sizeof(buf), "%ld.%06d", stats.ru_stime.tv_sec, stats.ru_stime.tv_usec);
+    out << "\n  Kernel mode CPU: " << buf << " secs";
+#else
+    snprintf( buf, sizeof(buf), "%ld.%06ld", stats.ru_utime.tv_sec, stats.ru_utime.tv_usec);
+    out << "\n  User mode CPU: " << buf << " secs";
+    snprintf( buf, sizeof(buf), "%ld.%06ld", stats.ru_stime.tv_sec, stats.ru_stime.tv_usec);
+    out << "\n  Kernel mode CPU: " << buf << " secs";
+#endif
+    cpu_abs = stats.ru_utime.tv_sec + 0.000001 * stats.ru_utime.tv_usec + stats.ru_stime.tv_sec + 0.000001 *  stats.ru_stime.tv_usec;
+    cpu_percentage = (cpu_abs / uptime) * 100.0;
+    out << "\n  Average CPU Consumption : "<< cpu_percentage << "%";
+    out << "\n  Maximum resident set size: ";
+#if !defined(__MVS__)
+    WriteInteger(out, stats.ru_maxrss * 1024);
+    out << " bytes\n  Page faults: " << stats.ru_majflt << " (I/O required) "
+        << stats.ru_minflt << " (no I/O required)";
+    out << "\n  Filesystem activity: " << stats.ru_inblock << " reads "
+        <<  stats.ru_oublock << " writes";
+#endif
+  }
+  const ThreadUsage& usage = snapshot.loop_thread_usage;
+  if (usage.valid) {
+    out << "\n\nEvent loop thread resource usage:";
+#if defined(__APPLE__) || defined(_AIX)
+    snprintf( buf, sizeof(buf), "%ld.%06d", usage.utime.tv_sec, usage.utime.tv_usec);
+    out << "\n  User mode CPU: " << buf << " secs";
+    snprintf( buf, sizeof(buf), "%ld.%06d", usage.stime.tv_sec, usage.stime.tv_usec);
+    out << "\n  Kernel mode CPU: " << buf << " secs";
+#else
+    snprintf( buf, sizeof(buf), "%ld.%06ld", usage.utime.tv_sec, usage.utime.tv_usec);
+    out << "\n  User mode CPU: " << buf << " secs";
+    snprintf( buf, sizeof(buf), "%ld.%06ld", usage.stime.tv_sec, usage.stime.tv_usec);
+    out << "\n  Kernel mode CPU: " << buf << " secs";
+#endif
+    cpu_abs = usage.utime.tv_sec + 0.000001 * usage.utime.tv_usec + usage.stime.tv_sec + 0.000001 * usage.stime.tv_usec;
+    cpu_percentage = (cpu_abs / uptime) * 100.0;
+    out << "\n  Average CPU Consumption : " << cpu_percentage << "%";
+    if (usage.has_io) {
+      out << "\n  Filesystem activity: " << usage.inblock << " reads "
+          << usage.oublock << " writes";
+    }
+  }
+  out << std::endl;
+}
+
+static void PrintResourceUsage(ReportWriter& writer, const ReportSnapshot& snapshot) {
+  time_t current_time; // current time absolute
+  time(&current_time);
+  auto uptime = difftime(current_time, load_time);
+  if (uptime == 0)
+    uptime = 1; // avoid division by zero.
+
+  struct rusage stats;
+  if (getrusage(RUSAGE_SELF, &stats) == 0) {
+    const double user_cpu = stats.ru_utime.tv_sec + 0.000001 * stats.ru_utime.tv_usec;
+    const double kernel_cpu = stats.ru_stime.tv_sec + 0.000001 * stats.ru_stime.tv_usec;
+    writer.ObjectStart("resourceUsage");
+    writer.KeyValue("userCpuSeconds", user_cpu);
+    writer.KeyValue("kernelCpuSeconds", kernel_cpu);
+    writer.KeyValue("cpuConsumptionPercent", ((user_cpu + kernel_cpu) / uptime) * 100.0);
+#if !defined(__MVS__)
+    writer.KeyValue("maxRss", static_cast<unsigned long long>(stats.ru_maxrss) * 1024);
+    writer.ObjectStart("pageFaults");
+    writer.KeyValue("IORequired", stats.ru_majflt);
+    writer.KeyValue("IONotRequired", stats.ru_minflt);
+    writer.ObjectEnd();
+    writer.ObjectStart("fsActivity");
+    writer.KeyValue("reads", stats.ru_inblock);
+    writer.KeyValue("writes", stats.ru_oublock);
+    writer.ObjectEnd();
+#endif
+    writer.ObjectEnd();
+  }
+
+  const ThreadUsage& usage = snapshot.loop_thread_usage;
+  if (usage.valid) {
+    const double user_cpu = usage.utime.tv_sec + 0.000001 * usage.utime.tv_usec;
+    const double kernel_cpu = usage.stime.tv_sec + 0.000001 * usage.stime.tv_usec;
+    writer.ObjectStart("eventLoopThreadResourceUsage");
+    writer.KeyValue("userCpuSeconds", user_cpu);
+    writer.KeyValue("kernelCpuSeconds", kernel_cpu);
+    writer.KeyValue("cpuConsumptionPercent", ((user_cpu + kernel_cpu) / uptime) * 100.0);
+    if (usage.has_io) {
+      writer.ObjectStart("fsActivity");
+      writer.KeyValue("reads", usage.inblock);
+      writer.KeyValue("writes", usage.oublock);
+      writer.ObjectEnd();
+    }
+    writer.ObjectEnd();
+  }
+}
+
+#ifdef NR_THREAD_TABLE
+/*******************************************************************************
+ * Functions to capture and print the CPU usage of every thread in the process,
+ * with the threads running JavaScript identified (Linux only). The table is
+ * read when the snapshot is captured, and is left out of delta reports.
+ *
+ ******************************************************************************/
+static void GetThreadRoles(std::unordered_map<long, std::string>* roles) {
+  uv_once(&threads_once, InitReportThreads);
+  uv_mutex_lock(&threads_mutex);
+  for (const RegisteredThread& thread : report_threads) {
+    if (thread.os_thread_id != 0) {
+      (*roles)[thread.os_thread_id] = "thread " + std::to_string(thread.id) +
+          (thread.main_thread ? " (main thread)" : " (worker thread)");
+    }
+  }
+  uv_mutex_unlock(&threads_mutex);
+}
+
+static void CaptureThreadCpuTable(ReportSnapshot* snapshot) {
+  snapshot->has_thread_cpu = ReadThreadCpuTable(&snapshot->thread_cpu);
+  if (snapshot->has_thread_cpu) {
+    GetThreadRoles(&snapshot->thread_roles);
+  }
+}
+
+static void PrintThreadCpuTable(std::ostream& out, const ReportSnapshot& snapshot) {
+  if (!snapshot.has_thread_cpu) {
+    return;
+  }
+  const std::vector<ThreadCpuInfo>& threads = snapshot.thread_cpu;
+  const std::unordered_map<long, std::string>& roles = snapshot.thread_roles;
+  char buf[64];
+  out << "\nThread CPU usage, " << threads.size()
+      << " threads (CPU% is since the previous report):\n";
+  out << std::right << std::setw(9) << "TID" << "  " << std::left << std::setw(17) << "Name"
+      << std::setw(7) << "State" << std::right << std::setw(12) << "User CPU"
+      << std::setw(12) << "Kernel CPU" << std::setw(8) << "CPU%" << std::setw(10) << "Last CPU"
+      << std::setw(12) << "Voluntary" << std::setw(13) << "Involuntary" << "  Role\n";
+  for (const ThreadCpuInfo& thread : threads) {
+    out << std::right << std::setw(9) << thread.tid << "  " << std::left << std::setw(17)
+        << thread.name << std::setw(7) << thread.state << std::right;
+    snprintf(buf, sizeof(buf), "%.2f", thread.user_cpu);
+    out << std::setw(12) << buf;
+    snprintf(buf, sizeof(buf), "%.2f", thread.kernel_cpu);
+    out << std::setw(12) << buf;
+    if (thread.has_cpu_percent) {
+      snprintf(buf, sizeof(buf), "%.1f", thread.cpu_percent);
+    } else {
+      snprintf(buf, sizeof(buf), "-");
+    }
+    out << std::setw(8) << buf << std::setw(10) << thread.last_cpu;
+    if (thread.has_switches) {
+      out << std::setw(12) << thread.voluntary_switches << std::setw(13)
+          << thread.involuntary_switches;
+    } else {
+      out << std::setw(12) << "-" << std::setw(13) << "-";
+    }
+    auto role = roles.find(thread.tid);
+    if (role != roles.end()) {
+      out << "  " << role->second;
+    }
+    out << "\n";
+  }
+  out << std::left;
+}
+
+static void PrintThreadCpuTable(ReportWriter& writer, const ReportSnapshot& snapshot) {
+  if (!snapshot.has_thread_cpu) {
+    return;
+  }
+  const std::vector<ThreadCpuInfo>& threads = snapshot.thread_cpu;
+  const std::unordered_map<long, std::string>& roles = snapshot.thread_roles;
+  writer.ArrayStart("threadCpuUsage");
+  for (const ThreadCpuInfo& thread : threads) {
+    writer.ObjectStart();
+    writer.KeyValue("tid", thread.tid);
+    writer.KeyValue("name", thread.name);
+    writer.KeyValue("state", std::string(1, thread.state));
+    writer.KeyValue("userCpuSeconds", thread.user_cpu);
+    writer.KeyValue("kernelCpuSeconds", thread.kernel_cpu);
+    if (thread.has_cpu_percent) {
+      writer.KeyValue("cpuConsumptionPercent", thread.cpu_percent);
+    }
+    writer.KeyValue("lastCpu", thread.last_cpu);
+    if (thread.has_switches) {
+      writer.KeyValue("voluntaryContextSwitches", thread.voluntary_switches);
+      writer.KeyValue("involuntaryContextSwitches", thread.involuntary_switches);
+    }
+    auto role = roles.find(thread.tid);
+    if (role != roles.end()) {
+      writer.KeyValue("role", role->second);
+    }
+    writer.ObjectEnd();
+  }
+  writer.ArrayEnd();
+}
+#endif
+
+#ifdef NR_FD_INVENTORY
+/*******************************************************************************
+ * Functions to capture the descriptors owned by libuv and print the inventory
+ * of open file descriptors (Linux only).
+ *
+ ******************************************************************************/
+static void walkHandleDescriptor(uv_handle_t* h, void* arg) {
+  std::vector<int>* fds = static_cast<std::vector<int>*>(arg);
+  uv_os_fd_t fd;
+  if (uv_fileno(h, &fd) == 0) {
+    fds->push_back(fd);
+  }
+}
+
+static void CaptureHandleDescriptors(uv_loop_t* loop, std::vector<int>* fds) {
+  uv_walk(loop, walkHandleDescriptor, fds);
+  const int backend_fd = uv_backend_fd(loop);
+  if (backend_fd >= 0) {
+    fds->push_back(backend_fd);
+  }
+}
+
+// Descriptors owned by libuv on the reporting thread and the other threads
+static void OwnedDescriptors(const ReportSnapshot& snapshot, std::vector<int>* owned) {
+  *owned = snapshot.handle_fds;
+  for (const ThreadReport& thread : snapshot.threads) {
+    owned->insert(owned->end(), thread.handle_fds.begin(), thread.handle_fds.end());
+  }
+}
+
+static void PrintFdInventory(std::ostream& out, const ReportSnapshot& snapshot) {
+  out << "\n================================================================================";
+  out << "\n==== File Descriptors ==========================================================\n\n";
+  std::vector<int> owned;
+  OwnedDescriptors(snapshot, &owned);
+  FdInventory info;
+  if (!ReadFdInventory(owned, &info, NR_FD_TOP_TARGETS)) {
+    out << "Unable to read /proc/self/fd\n";
+    return;
+  }
+  out << "Open file descriptors: ";
+  WriteInteger(out, info.count);
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY) {
+    out << " of a soft limit of ";
+    WriteInteger(out, limit.rlim_cur);
+  }
+  out << "\nNot owned by a libuv handle or event loop: ";
+  WriteInteger(out, info.not_owned);
+  out << "\n";
+  if (info.examined < info.count) {
+    out << "Descriptors not classified, beyond the first " << NR_FD_EXAMINE_LIMIT << ": ";
+    WriteInteger(out, info.count - info.examined);
+    out << "\n";
+  }
+
+  out << "\nDescriptors by type:\n";
+  out << std::right << std::setw(10) << "Count" << std::setw(12) << "Not owned" << "  Type\n";
+  for (const FdTypeCount& type : info.types) {
+    out << std::setw(10) << type.count << std::setw(12) << type.not_owned << "  " << type.type
+        << "\n";
+  }
+  if (!info.targets.empty()) {
+    out << "\nFiles and devices with the most descriptors:\n";
+    out << std::setw(10) << "Count" << std::setw(12) << "Not owned" << "  Path\n";
+    for (const FdTarget& target : info.targets) {
+      out << std::setw(10) << target.count << std::setw(12) << target.not_owned << "  "
+          << target.path << "\n";
+    }
+  }
+  out << std::left;
+}
+
+static void PrintFdInventory(ReportWriter& writer, const ReportSnapshot& snapshot) {
+  std::vector<int> owned;
+  OwnedDescriptors(snapshot, &owned);
+  FdInventory info;
+  if (!ReadFdInventory(owned, &info, NR_FD_TOP_TARGETS)) {
+    return;
+  }
+  writer.ObjectStart("fileDescriptors");
+  writer.KeyValue("open", static_cast<unsigned long long>(info.count));
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY) {
+    writer.KeyValue("softLimit", static_cast<unsigned long long>(limit.rlim_cur));
+  }
+  writer.KeyValue("notOwned", static_cast<unsigned long long>(info.not_owned));
+  writer.KeyValue("classified", static_cast<unsigned long long>(info.examined));
+  writer.ArrayStart("types");
+  for (const FdTypeCount& type : info.types) {
+    writer.ObjectStart();
+    writer.KeyValue("type", type.type);
+    writer.KeyValue("count", static_cast<unsigned long long>(type.count));
+    writer.KeyValue("notOwned", static_cast<unsigned long long>(type.not_owned));
+    writer.ObjectEnd();
+  }
+  writer.ArrayEnd();
+  writer.ArrayStart("targets");
+  for (const FdTarget& target : info.targets) {
+    writer.ObjectStart();
+    writer.KeyValue("path", target.path);
+    writer.KeyValue("count", static_cast<unsigned long long>(target.count));
+    writer.KeyValue("notOwned", static_cast<unsigned long long>(target.not_owned));
+    writer.ObjectEnd();
+  }
+  writer.ArrayEnd();
+  writer.ObjectEnd();
+}
+#endif
+
+#ifdef NR_MEMORY_MAP
+/*******************************************************************************
+ * Functions to print the memory map of the process, with totals and the
+ * objects with the largest resident set (Linux only).
+ *
+ ******************************************************************************/
+static void PrintMemoryMap(std::ostream& out) {
+  out << "\n================================================================================";
+  out << "\n==== Memory Map ================================================================\n";
+  MemoryMapInfo info;
+  if (!ReadMemoryMap(&info, NR_MEMORY_MAP_TOP)) {
+    out << "\nUnable to read /proc/self/smaps\n";
+    return;
+  }
+  out << "\nTotals from /proc/self/" << (info.rollup ? "smaps_rollup" : "smaps") << ":";
+  out << "\n  Mapped: ";
+  WriteInteger(out, info.totals.size);
+  out << " bytes\n  Resident set size (Rss): ";
+  WriteInteger(out, info.totals.rss);
+  out << " bytes\n  Proportional set size (Pss): ";
+  WriteInteger(out, info.totals.pss);
+  out << " bytes\n  Anonymous: ";
+  WriteInteger(out, info.totals.anonymous);
+  out << " bytes\n  Swap: ";
+  WriteInteger(out, info.totals.swap);
+  out << " bytes\n  Transparent huge pages: ";
+  WriteInteger(out, info.totals.anon_huge_pages);
+  out << " bytes\n\nMappings: " << info.mappings << ", grouped into " << info.objects << " objects\n";
+
+  out << "\nLargest objects by Rss (bytes):\n";
+  out << std::right << std::setw(16) << "Rss" << std::setw(16) << "Pss"
+      << std::setw(16) << "Anonymous" << std::setw(16) << "Swap"
+      << std::setw(8) << "Maps" << "  Object\n";
+  for (const MemoryObject& object : info.largest) {
+    const uint64_t values[] = {object.usage.rss, object.usage.pss,
+                               object.usage.anonymous, object.usage.swap};
+    for (uint64_t value : values) {
+      std::ostringstream formatted;
+      WriteInteger(formatted, value);
+      out << std::setw(16) << formatted.str();
+    }
+    out << std::setw(8) << object.mappings << "  " << object.name
+        << (object.library ? " (loaded library)" : "") << "\n";
+  }
+  out << std::left;
+}
+
+static void PrintMemoryMap(ReportWriter& writer) {
+  MemoryMapInfo info;
+  if (!ReadMemoryMap(&info, NR_MEMORY_MAP_TOP)) {
+    return;
+  }
+  writer.ObjectStart("memoryMap");
+  writer.KeyValue("source", info.rollup ? "smaps_rollup" : "smaps");
+  writer.ObjectStart("totals");
+  writer.KeyValue("mapped", static_cast<unsigned long long>(info.totals.size));
+  writer.KeyValue("rss", static_cast<unsigned long long>(info.totals.rss));
+  writer.KeyValue("pss", static_cast<unsigned long long>(info.totals.pss));
+  writer.KeyValue("anonymous", static_cast<unsigned long long>(info.totals.anonymous));
+  writer.KeyValue("swap", static_cast<unsigned long long>(info.totals.swap));
+  writer.KeyValue("transparentHugePages",
+                  static_cast<unsigned long long>(info.totals.anon_huge_pages));
+  writer.ObjectEnd();
+  writer.KeyValue("mappings", static_cast<unsigned long long>(info.mappings));
+  writer.KeyValue("objects", static_cast<unsigned long long>(info.objects));
+  writer.ArrayStart("largestObjects");
+  for (const MemoryObject& object : info.largest) {
+    writer.ObjectStart();
+    writer.KeyValue("name", object.name);
+    writer.KeyValue("loadedLibrary", object.library);
+    writer.KeyValue("mappings", static_cast<unsigned long long>(object.mappings));
+    writer.KeyValue("rss", static_cast<unsigned long long>(object.usage.rss));
+    writer.KeyValue("pss", static_cast<unsigned long long>(object.usage.pss));
+    writer.KeyValue("anonymous", static_cast<unsigned long long>(object.usage.anonymous));
+    writer.KeyValue("swap", static_cast<unsigned long long>(object.usage.swap));
+    writer.ObjectEnd();
+  }
+  writer.ArrayEnd();
+  writer.ObjectEnd();
+}
+#endif
+
+/*******************************************************************************
+ * Function to capture resource usage of the current (event loop) thread
+ * (Linux/OSX only).
+ *
+ ******************************************************************************/
+static void CaptureThreadUsage(ThreadUsage* usage) {
+  memset(usage, 0, sizeof(*usage));
+#ifdef RUSAGE_THREAD
+  struct rusage stats;
+  memset(&stats, 0, sizeof(stats));
+  if (getrusage(RUSAGE_THREAD, &stats) == 0) {
+    usage->valid = true;
+    usage->has_io = true;
+    usage->utime = stats.ru_utime;
+    usage->stime = stats.ru_stime;
+    usage->inblock = stats.ru_inblock;
+    usage->oublock = stats.ru_oublock;
+  }
+#elif defined(__APPLE__)
+  // Currently RUSAGE_THREAD is not currently supported on Mac.
+  mach_msg_type_number_t count = THREAD_BASIC_INFO_COUNT;
+  mach_port_t thread = pthread_mach_thread_np(pthread_self());
+  thread_basic_info thr_info;
+
+  kern_return_t rc = thread_info(thread, THREAD_BASIC_INFO, (thread_info_t) &thr_info, &count);
+
+  if (rc == KERN_SUCCESS) {
+    usage->valid = true;
+    usage->utime.tv_sec = thr_info.user_time.seconds;
+    usage->utime.tv_usec = thr_info.user_time.microseconds;
+    usage->stime.tv_sec = thr_info.system_time.seconds;
+    usage->stime.tv_usec = thr_info.system_time.microseconds;
+  }
+#endif // RUSAGE_THREAD
+}
+#endif
+
+/*******************************************************************************
+ * Functions to print operating system information: environment variables,
+ * resource limits and loaded libraries.
+ ******************************************************************************/
+#ifndef _WIN32
+const static struct {
+  const char* description;
+  const char* key;
+  int id;
+} rlimit_strings[] = {
+  {"core file size (blocks)       ", "core_file_size_blocks", RLIMIT_CORE},
+  {"data seg size (kbytes)        ", "data_seg_size_kbytes", RLIMIT_DATA},
+  {"file size (blocks)            ", "file_size_blocks", RLIMIT_FSIZE},
+#if !(defined(_AIX) || defined(__sun) || defined(__MVS__))
+  {"max locked memory (bytes)     ", "max_locked_memory_bytes", RLIMIT_MEMLOCK},
+#endif
+#if !(defined(__sun) || defined(__MVS__))
+  {"max memory size (kbytes)      ", "max_memory_size_kbytes", RLIMIT_RSS},
+#endif
+  {"open files                    ", "open_files", RLIMIT_NOFILE},
+  {"stack size (bytes)            ", "stack_size_bytes", RLIMIT_STACK},
+  {"cpu time (seconds)            ", "cpu_time_seconds", RLIMIT_CPU},
+#if !(defined(__sun) || defined(__MVS__))
+  {"max user processes            ", "max_user_processes", RLIMIT_NPROC},
+#endif
+  {"virtual memory (kbytes)       ", "virtual_memory_kbytes", RLIMIT_AS}
+};
+#endif
+
+static void PrintEnvironmentVariables(std::ostream& out, const std::vector<std::string>& variables) {
+  out << "\nEnvironment variables\n";
+  for (const std::string& variable : variables) {
+    out << "  " << variable << "\n";
+  }
+}
+
+static void PrintEnvironmentVariables(ReportWriter& writer, const std::vector<std::string>& variables) {
+  writer.ObjectStart("environmentVariables");
+  for (const std::string& variable : variables) {
+    // Windows keeps per-drive working directories in variables named "=C:".
+    size_t separator = variable.find('=', 1);
+    if (separator == std::string::npos) {
+      writer.KeyValue(variable.c_str(), "");
+    } else {
+      writer.KeyValue(variable.substr(0, separator).c_str(),
+                      variable.substr(separator + 1));
+    }
+  }
+  writer.ObjectEnd();
+}
+
+#ifndef _WIN32
+// Print one row of the resource limits table, index is into rlimit_strings
+static void PrintUserLimit(std::ostream& out, size_t index, const struct rlimit& limit) {
+  char buf[64];
+  out << "  " << rlimit_strings[index].description << " ";
+  if (limit.rlim_cur == RLIM_INFINITY) {
+    out << "       unlimited";
+  } else {
+#if defined(_AIX) || defined(__sun)
+    snprintf(buf, sizeof(buf), "%16ld", limit.rlim_cur);
+    out << buf;
+#elif (defined(__linux__) && !defined(__GLIBC__))
+    snprintf(buf, sizeof(buf), "%16lld", limit.rlim_cur);
+    out << buf;
+#else
+    snprintf(buf, sizeof(buf), "%16" PRIu64, limit.rlim_cur);
+    out << buf;
+#endif
+  }
+  if (limit.rlim_max == RLIM_INFINITY) {
+    out << "       unlimited\n";
+  } else {
+#if defined(_AIX)
+    snprintf(buf, sizeof(buf), "%16ld\n", limit.rlim_max);
+    out << buf;
+#elif (defined(__linux__) && !defined(__GLIBC__))
+    snprintf(buf, sizeof(buf), "%16lld\n", limit.rlim_max);
+    out << buf;
+#else
+    snprintf(buf, sizeof(buf), "%16" PRIu64 "\n", limit.rlim_max);
+    out << buf;
+#endif
+  }
+}
+
+static void PrintUserLimit(ReportWriter& writer, size_t index, const struct rlimit& limit) {
+  writer.ObjectStart(rlimit_strings[index].key);
+  if (limit.rlim_cur == RLIM_INFINITY) {
+    writer.KeyValue("soft", "unlimited");
+  } else {
+    writer.KeyValue("soft", static_cast<unsigned long long>(limit.rlim_cur));
+  }
+  if (limit.rlim_max == RLIM_INFINITY) {
+    writer.KeyValue("hard", "unlimited");
+  } else {
+    writer.KeyValue("hard", static_cast<unsigned long long>(limit.rlim_max));
+  }
+  writer.ObjectEnd();
+}
+
+static void PrintUserLimits(std::ostream& out) {
+  out << "\nResource limits                        soft limit      hard limit\n";
+  struct rlimit limit;
+  for (size_t i = 0; i < arraysize(rlimit_strings); i++) {
+    if (getrlimit(rlimit_strings[i].id, &limit) == 0) {
+      PrintUserLimit(out, i, limit);
+    }
+  }
+}
+
+static void PrintUserLimits(ReportWriter& writer) {
+  writer.ObjectStart("userLimits");
+  struct rlimit limit;
+  for (size_t i = 0; i < arraysize(rlimit_strings); i++) {
+    if (getrlimit(rlimit_strings[i].id, &limit) == 0) {
+      PrintUserLimit(writer, i, limit);
+    }
+  }
+  writer.ObjectEnd();
+}
+#endif
+
+static void PrintLoadedLibraries(std::ostream& out) {
+  out << "\nLoaded libraries\n";
+  std::vector<std::string> libraries;
+  if (GetLoadedLibraries(&libraries)) {
+    for (const std::string& library : libraries) {
+      out << "  " << library << "\n";
+    }
+  } else {
+    out << "No library information available\n";
+  }
+  out << std::flush;
+}
+
+static void PrintLoadedLibraries(ReportWriter& writer) {
+  std::vector<std::string> libraries;
+  GetLoadedLibraries(&libraries);
+  writer.ArrayStart("sharedObjects");
+  for (const std::string& library : libraries) {
+    writer.Element(library);
+  }
+  writer.ArrayEnd();
+}
+
+/*******************************************************************************
+ * Function to collect the process environment as "name=value" strings.
+ *
+ ******************************************************************************/
+static void GetEnvironmentVariables(std::vector<std::string>* variables) {
+#ifdef _WIN32
+  LPTSTR lpszVariable;
+  LPTCH lpvEnv;
+
+  // Get pointer to the environment block
+  lpvEnv = GetEnvironmentStrings();
+  if (lpvEnv != nullptr) {
+    // Variable strings are separated by null bytes, and the block is terminated by a null byte.
+    lpszVariable = reinterpret_cast<LPTSTR>(lpvEnv);
+    while (*lpszVariable) {
+      variables->push_back(lpszVariable);
+      lpszVariable += lstrlen(lpszVariable) + 1;
+    }
+    FreeEnvironmentStrings(lpvEnv);
+  }
 #else
-        snprintf(buf, sizeof(buf), "%16" PRIu64, limit.rlim_cur);
-        out << buf;
+  for (char** env_var = environ; *env_var != nullptr; env_var++) {
+    variables->push_back(*env_var);
+  }
 #endif
-      }
-      if (limit.rlim_max == RLIM_INFINITY) {
-        out << "       unlimited\n";
+}
+
+/*******************************************************************************
+ * Functions to collect a list of loaded native libraries. Returns false if the
+ * library information could not be obtained.
+ *
+ ******************************************************************************/
+#ifdef __linux__
+static int LibraryListCallback(struct dl_phdr_info *info, size_t size, void *data) {
+  std::vector<std::string>* libraries = reinterpret_cast<std::vector<std::string>*>(data);
+  if (info->dlpi_name != nullptr && *info->dlpi_name != '\0') {
+    libraries->push_back(info->dlpi_name);
+  }
+  return 0;
+}
+#endif
+
+static bool GetLoadedLibraries(std::vector<std::string>* libraries) {
+#ifdef __linux__
+  dl_iterate_phdr(LibraryListCallback, libraries);
+#elif __APPLE__
+  int i = 0;
+  const char *name = _dyld_get_image_name(i);
+  while (name != nullptr) {
+    libraries->push_back(name);
+    i++;
+    name = _dyld_get_image_name(i);
+  }
+#elif _AIX
+  // We can't tell in advance how large the buffer needs to be.
+  // Retry until we reach too large a size (1Mb).
+  const unsigned int buffer_inc = 4096;
+  unsigned int buffer_size = buffer_inc;
+  char* buffer = (char*) malloc(buffer_size);
+  int rc = -1;
+  while (buffer != nullptr && rc != 0 && buffer_size < 1024 * 1024) {
+    rc = loadquery(L_GETINFO, buffer, buffer_size);
+    if (rc == 0) {
+      break;
+    }
+    free(buffer);
+    buffer_size += buffer_inc;
+    buffer = (char*) malloc(buffer_size);
+  }
+  if (buffer == nullptr) {
+    return true; // Don't try to free the buffer.
+  }
+  if (rc == 0) {
+    char* buf = buffer;
+    ld_info* cur_info = nullptr;
+    do {
+      cur_info = (ld_info*) buf;
+      char* member_name = cur_info->ldinfo_filename
+        + strlen(cur_info->ldinfo_filename) + 1;
+      if (*member_name != '\0') {
+        libraries->push_back(std::string(cur_info->ldinfo_filename) + "(" + member_name + ")");
       } else {
-#if defined(_AIX)
-        snprintf(buf, sizeof(buf), "%16ld\n", limit.rlim_max);
-        out << buf;
-#elif (defined(__linux__) && !defined(__GLIBC__))
-        snprintf(buf, sizeof(buf), "%16lld\n", limit.rlim_max);
-        out << buf;
-#else
-        snprintf(buf, sizeof(buf), "%16" PRIu64 "\n", limit.rlim_max);
-        out << buf;
+        libraries->push_back(cur_info->ldinfo_filename);
+      }
+      buf += cur_info->ldinfo_next;
+    } while (cur_info->ldinfo_next != 0);
+  }
+  free(buffer);
+#elif __sun
+  Link_map *p;
+
+  if (dlinfo(RTLD_SELF, RTLD_DI_LINKMAP, &p) != -1) {
+    for (Link_map *l = p; l != NULL; l = l->l_next) {
+      libraries->push_back(l->l_name);
+    }
+  }
+
+#elif _WIN32
+  // Windows implementation - get a handle to the process.
+  HANDLE process_handle = OpenProcess(PROCESS_QUERY_INFORMATION | PROCESS_VM_READ,
+                                      FALSE, GetCurrentProcessId());
+  if (process_handle == NULL) {
+    return false;
+  }
+  // Get a list of all the modules in this process
+  DWORD size_1 = 0, size_2 = 0;
+  bool found = false;
+  // First call to get the size of module array needed
+  if (EnumProcessModules(process_handle, NULL, 0, &size_1)) {
+    HMODULE* modules = (HMODULE*) malloc(size_1);
+    if (modules == NULL) {
+      CloseHandle(process_handle);
+      return true;  // bail out if malloc failed
+    }
+    found = true;
+    // Second call to populate the module array
+    if (EnumProcessModules(process_handle, modules, size_1, &size_2)) {
+      for (int i = 0;
+           i < (size_1 / sizeof(HMODULE)) && i < (size_2 / sizeof(HMODULE));
+           i++) {
+        TCHAR module_name[MAX_PATH];
+        // Obtain the full pathname for each module
+        if (GetModuleFileNameEx(process_handle, modules[i], module_name,
+                                sizeof(module_name) / sizeof(TCHAR))) {
+          libraries->push_back(module_name);
+        }
+      }
+    }
+    free(modules);
+  }
+  // Release the handle to the process.
+  CloseHandle(process_handle);
+  return found;
+
+#elif __MVS__
+  void *dlcb = 0;
+  const int max_path = 1024;
+  char buffer[max_path];
+  char filename[max_path];
+  char *libpath = __getenv("LIBPATH");
+  while (dlcb = __dlcb_next(dlcb), dlcb) {
+    int len = __dlcb_entry_name(buffer, sizeof(buffer), dlcb);
+    void *addr = __dlcb_entry_addr(dlcb);
+    if (0 == addr)
+      continue;
+    if (buffer[0] != '/' && libpath && __find_file_in_path(filename, sizeof(filename), libpath, buffer) > 0) {
+      snprintf(buffer + len, sizeof(buffer) - len, " => %s (0x%p)", filename, addr);
+    } else
+      snprintf(buffer + len, sizeof(buffer) - len, " (0x%p)", addr);
+    libraries->push_back(buffer);
+  }
+#endif
+  return true;
+}
+
+/*******************************************************************************
+ * Functions to write delta reports, with only the changes since the base
+ * report, the previous report written to file.
+ *  - ComputeReportDelta() - compare a report with the base report, and make
+ *    it the base report for the next one
+ *  - Print*Changes() - print the changes in a report section
+ ******************************************************************************/
+static void InitReportDelta() {
+  if (uv_mutex_init(&delta_mutex) != 0) {
+    abort();
+  }
+}
+
+// Summarise the state shown in the report sections that can be compared
+static void SummariseReport(const ReportSnapshot& snapshot, ReportSummary* summary) {
+  summary->filename = snapshot.filename;
+  summary->time = uv_hrtime();
+  summary->sections = snapshot.sections;
+  if (snapshot.sections & NR_SECTION_HEAP) {
+    summary->heap = snapshot.heap;
+    summary->heap.gc_history.clear();
+  }
+#ifndef _WIN32
+  if (snapshot.sections & NR_SECTION_RESOURCES) {
+    summary->has_usage = getrusage(RUSAGE_SELF, &summary->usage) == 0;
+    summary->loop_thread_usage = snapshot.loop_thread_usage;
+  }
+  if (snapshot.sections & NR_SECTION_LIMITS) {
+    summary->limits.resize(arraysize(rlimit_strings));
+    for (size_t i = 0; i < arraysize(rlimit_strings); i++) {
+      summary->limits[i].first = getrlimit(rlimit_strings[i].id, &summary->limits[i].second) == 0;
+    }
+  }
 #endif
+  if (snapshot.sections & NR_SECTION_HANDLES) {
+    for (const HandleInfo& handle : snapshot.handles) {
+      summary->handles[handle.address] = handle.type;
+    }
+    summary->handles_aggregated = snapshot.handle_aggregate.limit != 0;
+  }
+  if (snapshot.sections & NR_SECTION_ENVIRONMENT) {
+    for (const std::string& variable : snapshot.environment) {
+      summary->environment[variable.substr(0, variable.find('=', 1))] =
+          std::hash<std::string>()(variable);
+    }
+  }
+  if (snapshot.sections & NR_SECTION_LIBRARIES) {
+    std::vector<std::string> libraries;
+    GetLoadedLibraries(&libraries);
+    summary->libraries.insert(libraries.begin(), libraries.end());
+  }
+}
+
+/*******************************************************************************
+ * Compare a report about to be written to file with the base report. Every
+ * report written to file becomes the base for the next, but only reports for
+ * events that can recur (signal, stall and API call) are written as deltas.
+ * Returns false if the report is to be written in full.
+ ******************************************************************************/
+static bool ComputeReportDelta(const ReportSnapshot& snapshot, ReportDelta* delta) {
+  uv_once(&delta_once, InitReportDelta);
+  ReportSummary current;
+  SummariseReport(snapshot, &current);
+
+  uv_mutex_lock(&delta_mutex);
+  const bool have_base = delta_base_available && snapshot.delta_allowed;
+  if (have_base) {
+    std::swap(delta->base, delta_base);
+  }
+  delta_base = current;
+  delta_base_available = true;
+  uv_mutex_unlock(&delta_mutex);
+  if (!have_base) {
+    return false;
+  }
+  std::swap(delta->current, current);
+  const ReportSummary& base = delta->base;
+  delta->sections = base.sections & delta->current.sections &
+                    (NR_SECTION_HEAP | NR_SECTION_RESOURCES | NR_SECTION_HANDLES |
+                     NR_SECTION_ENVIRONMENT | NR_SECTION_LIMITS | NR_SECTION_LIBRARIES);
+  if (base.handles_aggregated || delta->current.handles_aggregated) {
+    // The handle lists are incomplete, so write the aggregated summary instead
+    delta->sections &= ~NR_SECTION_HANDLES;
+  }
+
+  if (delta->sections & NR_SECTION_HANDLES) {
+    for (const HandleInfo& handle : snapshot.handles) {
+      auto found = base.handles.find(handle.address);
+      if (found == base.handles.end() || found->second != handle.type) {
+        delta->handles_added.push_back(&handle);
+      }
+    }
+    for (const auto& handle : base.handles) {
+      auto found = delta->current.handles.find(handle.first);
+      if (found == delta->current.handles.end() || found->second != handle.second) {
+        delta->handles_removed.push_back(handle);
+      }
+    }
+  }
+  if (delta->sections & NR_SECTION_ENVIRONMENT) {
+    for (const std::string& variable : snapshot.environment) {
+      auto found = base.environment.find(variable.substr(0, variable.find('=', 1)));
+      if (found == base.environment.end() ||
+          found->second != std::hash<std::string>()(variable)) {
+        delta->environment_set.push_back(variable);
+      }
+    }
+    for (const auto& variable : base.environment) {
+      if (delta->current.environment.count(variable.first) == 0) {
+        delta->environment_removed.push_back(variable.first);
+      }
+    }
+    std::sort(delta->environment_removed.begin(), delta->environment_removed.end());
+  }
+#ifndef _WIN32
+  if (delta->sections & NR_SECTION_LIMITS) {
+    for (size_t i = 0; i < arraysize(rlimit_strings); i++) {
+      const std::pair<bool, struct rlimit>& before = base.limits[i];
+      const std::pair<bool, struct rlimit>& after = delta->current.limits[i];
+      if (before.first != after.first ||
+          (after.first && (before.second.rlim_cur != after.second.rlim_cur ||
+                           before.second.rlim_max != after.second.rlim_max))) {
+        delta->limits_changed.push_back(i);
       }
     }
   }
-#endif
+#endif
+  if (delta->sections & NR_SECTION_LIBRARIES) {
+    std::set_difference(delta->current.libraries.begin(), delta->current.libraries.end(),
+                        base.libraries.begin(), base.libraries.end(),
+                        std::back_inserter(delta->libraries_added));
+    std::set_difference(base.libraries.begin(), base.libraries.end(),
+                        delta->current.libraries.begin(), delta->current.libraries.end(),
+                        std::back_inserter(delta->libraries_removed));
+  }
+  return true;
+}
+
+// Format a change in value as a signed integer with thousands separators
+static std::string FormatChange(size_t before, size_t after) {
+  std::ostringstream out;
+  out << (after < before ? "-" : "+");
+  WriteInteger(out, after < before ? before - after : after - before);
+  return out.str();
+}
+
+// Write a value and the change from the base report as a JSON object
+static void WriteChange(ReportWriter& writer, const char* key, size_t before, size_t after) {
+  writer.ObjectStart(key);
+  writer.KeyValue("value", static_cast<unsigned long long>(after));
+  writer.KeyValue("change", static_cast<long long>(after) - static_cast<long long>(before));
+  writer.ObjectEnd();
+}
+
+static std::string FormatAddress(const void* address) {
+  char buf[2 + 2 * sizeof(void*) + 1];
+  snprintf(buf, sizeof(buf), "0x%0*llx", static_cast<int>(2 * sizeof(void*)),
+           static_cast<unsigned long long>(reinterpret_cast<uintptr_t>(address)));
+  return buf;
+}
+
+// Find a heap space in the base report, returns nullptr if it is new
+static const HeapSpaceInfo* FindHeapSpace(const HeapInfo& heap, const std::string& name) {
+  for (const HeapSpaceInfo& space : heap.spaces) {
+    if (space.name == name) {
+      return &space;
+    }
+  }
+  return nullptr;
+}
+
+// Copy of the heap information with only the collections since the base report
+static HeapInfo GCHistorySince(const HeapInfo& heap, uint64_t base_count) {
+  HeapInfo since = heap;
+  const uint64_t first = heap.gc_count - heap.gc_history.size();
+  if (base_count > first) {
+    const size_t skip = static_cast<size_t>(std::min<uint64_t>(base_count - first, heap.gc_history.size()));
+    since.gc_history.erase(since.gc_history.begin(), since.gc_history.begin() + skip);
+  }
+  return since;
+}
+
+static void PrintHeapChanges(std::ostream& out, const HeapInfo& heap, const ReportDelta& delta) {
+  const HeapInfo& base = delta.base.heap;
+  static const HeapSpaceInfo empty_space = {"", 0, 0, 0, 0};
+  out << "\n================================================================================";
+  out << "\n==== JavaScript Heap and Garbage Collector =====================================\n";
+  size_t changed = 0;
+  for (const HeapSpaceInfo& space : heap.spaces) {
+    const HeapSpaceInfo* before = FindHeapSpace(base, space.name);
+    if (before == nullptr) {
+      before = &empty_space;
+    } else if (before->size == space.size && before->used == space.used) {
+      continue;
+    }
+    changed++;
+    out << "\nHeap space name: " << space.name;
+    out << "\n    Memory size: ";
+    WriteInteger(out, space.size);
+    out << " bytes (" << FormatChange(before->size, space.size) << "), used: ";
+    WriteInteger(out, space.used);
+    out << " bytes (" << FormatChange(before->used, space.used) << ")";
+  }
+  if (changed == 0) {
+    out << "\nNo heap space changes since the base report";
+  }
+
+  out << "\n\nTotal heap memory size: ";
+  WriteInteger(out, heap.total_heap_size);
+  out << " bytes (" << FormatChange(base.total_heap_size, heap.total_heap_size)
+      << ")\nTotal heap committed memory: ";
+  WriteInteger(out, heap.total_physical_size);
+  out << " bytes (" << FormatChange(base.total_physical_size, heap.total_physical_size)
+      << ")\nTotal used heap memory: ";
+  WriteInteger(out, heap.used_heap_size);
+  out << " bytes (" << FormatChange(base.used_heap_size, heap.used_heap_size)
+      << ")\nTotal available heap memory: ";
+  WriteInteger(out, heap.total_available_size);
+  out << " bytes (" << FormatChange(base.total_available_size, heap.total_available_size) << ")\n";
+  if (heap.heap_size_limit != base.heap_size_limit) {
+    out << "\nHeap memory limit: ";
+    WriteInteger(out, heap.heap_size_limit);
+    out << " (" << FormatChange(base.heap_size_limit, heap.heap_size_limit) << ")\n";
+  }
+
+  char buf[64];
+  snprintf(buf, sizeof(buf), "%.3f", (heap.gc_total_pause - base.gc_total_pause) / 1e6);
+  out << "\nGarbage collections since the base report: " << (heap.gc_count - base.gc_count)
+      << ", total pause " << buf << " ms\n";
+  PrintGCHistory(out, GCHistorySince(heap, base.gc_count));
+}
+
+static void PrintHeapChanges(ReportWriter& writer, const HeapInfo& heap, const ReportDelta& delta) {
+  const HeapInfo& base = delta.base.heap;
+  static const HeapSpaceInfo empty_space = {"", 0, 0, 0, 0};
+  writer.ObjectStart("javascriptHeapChanges");
+  WriteChange(writer, "totalMemory", base.total_heap_size, heap.total_heap_size);
+  WriteChange(writer, "totalCommittedMemory", base.total_physical_size, heap.total_physical_size);
+  WriteChange(writer, "usedMemory", base.used_heap_size, heap.used_heap_size);
+  WriteChange(writer, "availableMemory", base.total_available_size, heap.total_available_size);
+  WriteChange(writer, "memoryLimit", base.heap_size_limit, heap.heap_size_limit);
+  writer.ObjectStart("heapSpaces");
+  for (const HeapSpaceInfo& space : heap.spaces) {
+    const HeapSpaceInfo* before = FindHeapSpace(base, space.name);
+    if (before == nullptr) {
+      before = &empty_space;
+    } else if (before->size == space.size && before->used == space.used) {
+      continue;
+    }
+    writer.ObjectStart(space.name.c_str());
+    WriteChange(writer, "memorySize", before->size, space.size);
+    WriteChange(writer, "used", before->used, space.used);
+    writer.ObjectEnd();
+  }
+  writer.ObjectEnd();
+  writer.KeyValue("collectionsSinceBase",
+                  static_cast<unsigned long long>(heap.gc_count - base.gc_count));
+  writer.KeyValue("pauseSinceBase", (heap.gc_total_pause - base.gc_total_pause) / 1e6);
+  PrintGCHistory(writer, GCHistorySince(heap, base.gc_count));
+  writer.ObjectEnd();
+}
+
+#ifndef _WIN32
+static double Seconds(const struct timeval& time) {
+  return time.tv_sec + 0.000001 * time.tv_usec;
+}
+
+static void PrintResourceUsageChanges(std::ostream& out, const ReportDelta& delta) {
+  const ReportSummary& base = delta.base;
+  const ReportSummary& current = delta.current;
+  char buf[64];
+  double interval = (current.time - base.time) / 1e9;
+  if (interval <= 0)
+    interval = 1e-9; // avoid division by zero.
+  out << "\n================================================================================";
+  out << "\n==== Resource Usage ============================================================\n";
+
+  snprintf(buf, sizeof(buf), "%.3f", interval);
+  out << "\nProcess resource usage since the base report, " << buf << " secs ago:";
+  if (base.has_usage && current.has_usage) {
+    const double user_cpu = Seconds(current.usage.ru_utime) - Seconds(base.usage.ru_utime);
+    const double kernel_cpu = Seconds(current.usage.ru_stime) - Seconds(base.usage.ru_stime);
+    snprintf(buf, sizeof(buf), "%.6f", user_cpu);
+    out << "\n  User mode CPU: " << buf << " secs";
+    snprintf(buf, sizeof(buf), "%.6f", kernel_cpu);
+    out << "\n  Kernel mode CPU: " << buf << " secs";
+    out << "\n  Average CPU Consumption : " << ((user_cpu + kernel_cpu) / interval) * 100.0 << "%";
+#if !defined(__MVS__)
+    out << "\n  Maximum resident set size: ";
+    WriteInteger(out, current.usage.ru_maxrss * 1024);
+    out << " bytes (" << FormatChange(base.usage.ru_maxrss * 1024, current.usage.ru_maxrss * 1024)
+        << ")\n  Page faults: " << (current.usage.ru_majflt - base.usage.ru_majflt)
+        << " (I/O required) " << (current.usage.ru_minflt - base.usage.ru_minflt)
+        << " (no I/O required)";
+    out << "\n  Filesystem activity: " << (current.usage.ru_inblock - base.usage.ru_inblock)
+        << " reads " << (current.usage.ru_oublock - base.usage.ru_oublock) << " writes";
+#endif
+  }
+  const ThreadUsage& before = base.loop_thread_usage;
+  const ThreadUsage& after = current.loop_thread_usage;
+  if (before.valid && after.valid) {
+    const double user_cpu = Seconds(after.utime) - Seconds(before.utime);
+    const double kernel_cpu = Seconds(after.stime) - Seconds(before.stime);
+    out << "\n\nEvent loop thread resource usage since the base report:";
+    snprintf(buf, sizeof(buf), "%.6f", user_cpu);
+    out << "\n  User mode CPU: " << buf << " secs";
+    snprintf(buf, sizeof(buf), "%.6f", kernel_cpu);
+    out << "\n  Kernel mode CPU: " << buf << " secs";
+    out << "\n  Average CPU Consumption : " << ((user_cpu + kernel_cpu) / interval) * 100.0 << "%";
+    if (before.has_io && after.has_io) {
+      out << "\n  Filesystem activity: " << (after.inblock - before.inblock) << " reads "
+          << (after.oublock - before.oublock) << " writes";
+    }
+  }
+  out << std::endl;
+}
+
+static void PrintResourceUsageChanges(ReportWriter& writer, const ReportDelta& delta) {
+  const ReportSummary& base = delta.base;
+  const ReportSummary& current = delta.current;
+  double interval = (current.time - base.time) / 1e9;
+  if (interval <= 0)
+    interval = 1e-9; // avoid division by zero.
+
+  if (base.has_usage && current.has_usage) {
+    const double user_cpu = Seconds(current.usage.ru_utime) - Seconds(base.usage.ru_utime);
+    const double kernel_cpu = Seconds(current.usage.ru_stime) - Seconds(base.usage.ru_stime);
+    writer.ObjectStart("resourceUsageChanges");
+    writer.KeyValue("intervalSeconds", interval);
+    writer.KeyValue("userCpuSeconds", user_cpu);
+    writer.KeyValue("kernelCpuSeconds", kernel_cpu);
+    writer.KeyValue("cpuConsumptionPercent", ((user_cpu + kernel_cpu) / interval) * 100.0);
+#if !defined(__MVS__)
+    WriteChange(writer, "maxRss", base.usage.ru_maxrss * 1024, current.usage.ru_maxrss * 1024);
+    writer.ObjectStart("pageFaults");
+    writer.KeyValue("IORequired", current.usage.ru_majflt - base.usage.ru_majflt);
+    writer.KeyValue("IONotRequired", current.usage.ru_minflt - base.usage.ru_minflt);
+    writer.ObjectEnd();
+    writer.ObjectStart("fsActivity");
+    writer.KeyValue("reads", current.usage.ru_inblock - base.usage.ru_inblock);
+    writer.KeyValue("writes", current.usage.ru_oublock - base.usage.ru_oublock);
+    writer.ObjectEnd();
+#endif
+    writer.ObjectEnd();
+  }
+
+  const ThreadUsage& before = base.loop_thread_usage;
+  const ThreadUsage& after = current.loop_thread_usage;
+  if (before.valid && after.valid) {
+    const double user_cpu = Seconds(after.utime) - Seconds(before.utime);
+    const double kernel_cpu = Seconds(after.stime) - Seconds(before.stime);
+    writer.ObjectStart("eventLoopThreadResourceUsageChanges");
+    writer.KeyValue("userCpuSeconds", user_cpu);
+    writer.KeyValue("kernelCpuSeconds", kernel_cpu);
+    writer.KeyValue("cpuConsumptionPercent", ((user_cpu + kernel_cpu) / interval) * 100.0);
+    if (before.has_io && after.has_io) {
+      writer.ObjectStart("fsActivity");
+      writer.KeyValue("reads", after.inblock - before.inblock);
+      writer.KeyValue("writes", after.oublock - before.oublock);
+      writer.ObjectEnd();
+    }
+    writer.ObjectEnd();
+  }
+}
+
+static void PrintUserLimitChanges(std::ostream& out, const ReportDelta& delta) {
+  out << "\nResource limit changes                 soft limit      hard limit\n";
+  for (size_t i : delta.limits_changed) {
+    const std::pair<bool, struct rlimit>& limit = delta.current.limits[i];
+    if (limit.first) {
+      PrintUserLimit(out, i, limit.second);
+    } else {
+      out << "  " << rlimit_strings[i].description << "  not available\n";
+    }
+  }
+  if (delta.limits_changed.empty()) {
+    out << "  No changes since the base report\n";
+  }
+}
+
+static void PrintUserLimitChanges(ReportWriter& writer, const ReportDelta& delta) {
+  writer.ObjectStart("userLimitChanges");
+  for (size_t i : delta.limits_changed) {
+    const std::pair<bool, struct rlimit>& limit = delta.current.limits[i];
+    if (limit.first) {
+      PrintUserLimit(writer, i, limit.second);
+    } else {
+      writer.KeyValue(rlimit_strings[i].key, "not available");
+    }
+  }
+  writer.ObjectEnd();
+}
+#endif
+
+static void PrintHandleChanges(std::ostream& out, const ReportDelta& delta) {
+  out << "\nHandles: " << delta.current.handles.size() << ", " << delta.handles_added.size()
+      << " added and " << delta.handles_removed.size() << " removed since the base report\n";
+  if (!delta.handles_added.empty()) {
+    out << "\n(Flags: R=Ref, A=Active)\n";
+    out << std::left << std::setw(7) << "Flags" << std::setw(10) << "Type"
+        << std::setw(4 + 2 * sizeof(void*)) << "Address" << "Details"
+        << std::endl;
+    for (const HandleInfo* handle : delta.handles_added) {
+      PrintHandle(out, *handle);
+    }
+  }
+  if (!delta.handles_removed.empty()) {
+    out << "\nRemoved handles:\n";
+    for (const auto& handle : delta.handles_removed) {
+      out << "       " << std::left << std::setw(10) << handleTypeName(handle.second)
+          << FormatAddress(handle.first) << "\n";
+    }
+  }
+}
 
-  out << "\nLoaded libraries\n";
-  PrintLoadedLibraries(out, isolate);
+static void PrintHandleChanges(ReportWriter& writer, const ReportDelta& delta) {
+  writer.ObjectStart("libuvHandleChanges");
+  writer.KeyValue("count", static_cast<unsigned long long>(delta.current.handles.size()));
+  writer.ArrayStart("added");
+  for (const HandleInfo* handle : delta.handles_added) {
+    PrintHandle(writer, *handle);
+  }
+  writer.ArrayEnd();
+  writer.ArrayStart("removed");
+  for (const auto& handle : delta.handles_removed) {
+    writer.ObjectStart();
+    writer.KeyValue("type", handleTypeName(handle.second));
+    writer.KeyValue("address", FormatAddress(handle.first));
+    writer.ObjectEnd();
+  }
+  writer.ArrayEnd();
+  writer.ObjectEnd();
+}
+
+static void PrintEnvironmentChanges(std::ostream& out, const ReportDelta& delta) {
+  out << "\nEnvironment variable changes\n";
+  for (const std::string& variable : delta.environment_set) {
+    out << "  + " << variable << "\n";
+  }
+  for (const std::string& name : delta.environment_removed) {
+    out << "  - " << name << "\n";
+  }
+  if (delta.environment_set.empty() && delta.environment_removed.empty()) {
+    out << "  No changes since the base report\n";
+  }
+}
+
+static void PrintEnvironmentChanges(ReportWriter& writer, const ReportDelta& delta) {
+  writer.ObjectStart("environmentVariableChanges");
+  writer.ObjectStart("set");
+  for (const std::string& variable : delta.environment_set) {
+    size_t separator = variable.find('=', 1);
+    if (separator == std::string::npos) {
+      writer.KeyValue(variable.c_str(), "");
+    } else {
+      writer.KeyValue(variable.substr(0, separator).c_str(), variable.substr(separator + 1));
+    }
+  }
+  writer.ObjectEnd();
+  writer.ArrayStart("removed");
+  for (const std::string& name : delta.environment_removed) {
+    writer.Element(name);
+  }
+  writer.ArrayEnd();
+  writer.ObjectEnd();
+}
+
+static void PrintLibraryChanges(std::ostream& out, const ReportDelta& delta) {
+  out << "\nLoaded library changes\n";
+  for (const std::string& library : delta.libraries_added) {
+    out << "  + " << library << "\n";
+  }
+  for (const std::string& library : delta.libraries_removed) {
+    out << "  - " << library << "\n";
+  }
+  if (delta.libraries_added.empty() && delta.libraries_removed.empty()) {
+    out << "  No changes since the base report\n";
+  }
+  out << std::flush;
+}
+
+static void PrintLibraryChanges(ReportWriter& writer, const ReportDelta& delta) {
+  writer.ObjectStart("sharedObjectChanges");
+  writer.ArrayStart("added");
+  for (const std::string& library : delta.libraries_added) {
+    writer.Element(library);
+  }
+  writer.ArrayEnd();
+  writer.ArrayStart("removed");
+  for (const std::string& library : delta.libraries_removed) {
+    writer.Element(library);
+  }
+  writer.ArrayEnd();
+  writer.ObjectEnd();
+}
+
+/*******************************************************************************
+ * Functions to complete, print and publish the report timings.
+ *  - FinishReportTimings() - set the total and event loop blocked times
+ *  - PrintReportTimings() - print the timings, in milliseconds
+ *  - PublishReportTimings() - save the timings for GetLastReportTimings()
+ ******************************************************************************/
+static void FinishReportTimings(ReportTimings* timings) {
+  uint64_t now = uv_hrtime();
+  timings->total = now - timings->start_time;
+  timings->loop_blocked = timings->loop_released != 0 ?
+                          timings->loop_released - timings->start_time :
+                          timings->total;
+}
+
+static void PrintReportTimings(std::ostream& out, const ReportTimings& timings) {
+  char buf[64];
+  out << "\n================================================================================";
+  out << "\n==== Report Timings ============================================================\n";
+  out << "\nSection                               time (ms)\n";
+  for (const SectionTiming& section : timings.sections) {
+    snprintf(buf, sizeof(buf), "  %-30s %14.3f\n", section.name, section.duration / 1e6);
+    out << buf;
+  }
+  snprintf(buf, sizeof(buf), "\nEvent loop blocked time (ms)   %16.3f\n", timings.loop_blocked / 1e6);
+  out << buf;
+  snprintf(buf, sizeof(buf), "Total report time (ms)         %16.3f\n", timings.total / 1e6);
+  out << buf;
+}
+
+static void PrintReportTimings(ReportWriter& writer, const ReportTimings& timings) {
+  writer.ObjectStart("reportTimings");
+  writer.ObjectStart("sections");
+  for (const SectionTiming& section : timings.sections) {
+    writer.KeyValue(section.name, section.duration / 1e6);
+  }
+  writer.ObjectEnd();
+  writer.KeyValue("loopBlocked", timings.loop_blocked / 1e6);
+  writer.KeyValue("total", timings.total / 1e6);
+  writer.ObjectEnd();
+}
+
+static void InitTimingsMutex() {
+  if (uv_mutex_init(&timings_mutex) != 0) {
+    abort();
+  }
+}
+
+static void PublishReportTimings(const ReportTimings& timings) {
+  uv_once(&timings_once, InitTimingsMutex);
+  uv_mutex_lock(&timings_mutex);
+  last_report_timings = timings;
+  timings_available = true;
+  uv_mutex_unlock(&timings_mutex);
+}
+
+/*******************************************************************************
+ * External function to obtain the timings of the last completed report.
+ * Returns false if no report has been completed.
+ ******************************************************************************/
+bool GetLastReportTimings(ReportTimings* timings) {
+  uv_once(&timings_once, InitTimingsMutex);
+  uv_mutex_lock(&timings_mutex);
+  bool available = timings_available;
+  if (available) {
+    *timings = last_report_timings;
+  }
+  uv_mutex_unlock(&timings_mutex);
+  return available;
+}
+
+#ifdef NR_EMERGENCY_REPORT
+/*******************************************************************************
+ * Emergency report for fatal errors (Linux/OSX only).
+ *
+ * A fatal error is usually a JavaScript heap out of memory condition, when
+ * there may be no native heap available either. The report is rendered into
+ * an arena reserved at module initialisation and written with write(2), with
+ * no heap allocation after the fatal error. The text layout is the same as a
+ * normal report, except that native symbols are not demangled and the libuv
+ * endpoints are shown as numeric addresses.
+ ******************************************************************************/
+static char* emergency_arena = nullptr;
+static size_t emergency_arena_size = 0;
+static const char *(*libc_version)() = nullptr;  // resolved at initialisation
+
+struct ArenaStream {
+  int fd;
+  size_t used;  // bytes of the arena waiting to be written
+};
+
+static void ArenaFlush(ArenaStream* stream) {
+  size_t written = 0;
+  while (written < stream->used) {
+    ssize_t rc = write(stream->fd, emergency_arena + written, stream->used - written);
+    if (rc < 0) {
+      if (errno == EINTR) continue;
+      break;
+    }
+    written += rc;
+  }
+  stream->used = 0;
+}
+
+static void ArenaWrite(ArenaStream* stream, const char* data, size_t length) {
+  while (length > 0) {
+    if (stream->used == emergency_arena_size) {
+      ArenaFlush(stream);
+    }
+    size_t chunk = emergency_arena_size - stream->used;
+    if (chunk > length) {
+      chunk = length;
+    }
+    memcpy(emergency_arena + stream->used, data, chunk);
+    stream->used += chunk;
+    data += chunk;
+    length -= chunk;
+  }
+}
+
+static void ArenaWrite(ArenaStream* stream, const char* str) {
+  ArenaWrite(stream, str, strlen(str));
+}
+
+// Formats directly into the free space in the arena, flushing and retrying
+// once if there is not enough. Output longer than the arena is truncated.
+static void ArenaPrintf(ArenaStream* stream, const char* format, ...) {
+  for (int attempt = 0; attempt < 2; attempt++) {
+    const size_t space = emergency_arena_size - stream->used;
+    va_list args;
+    va_start(args, format);
+    const int length = vsnprintf(emergency_arena + stream->used, space, format, args);
+    va_end(args);
+    if (length < 0) {
+      return;
+    }
+    if (static_cast<size_t>(length) < space) {
+      stream->used += length;
+      return;
+    }
+    if (attempt == 0) {
+      ArenaFlush(stream);
+    } else {
+      stream->used = emergency_arena_size - 1;
+    }
+  }
+}
+
+// Equivalent of WriteInteger(), with commas for readability.
+static void ArenaInteger(ArenaStream* stream, size_t value) {
+  char digits[32];
+  char buf[48];
+  const int count = snprintf(digits, sizeof(digits), "%zu", value);
+  int pos = 0;
+  for (int i = 0; i < count; i++) {
+    if (i > 0 && (count - i) % 3 == 0) {
+      buf[pos++] = ',';
+    }
+    buf[pos++] = digits[i];
+  }
+  ArenaWrite(stream, buf, pos);
+}
+
+static void ArenaBanner(ArenaStream* stream, const char* banner) {
+  ArenaWrite(stream, "\n================================================================================");
+  ArenaWrite(stream, banner);
+}
+
+static bool EmergencyReportAvailable() {
+  return emergency_arena != nullptr;
+}
+
+/*******************************************************************************
+ * Function to reserve the emergency report arena. A size of zero releases the
+ * arena, and fatal error reports then use the normal report path.
+ *
+ ******************************************************************************/
+void SetEmergencyArenaSize(size_t size) {
+  if (size != 0 && size < NR_ARENA_SIZE_MIN) {
+    size = NR_ARENA_SIZE_MIN;
+  }
+  if (size == emergency_arena_size) {
+    return;
+  }
+  free(emergency_arena);
+  emergency_arena = nullptr;
+  emergency_arena_size = 0;
+  if (size == 0) {
+    return;
+  }
+  emergency_arena = static_cast<char*>(malloc(size));
+  if (emergency_arena == nullptr) {
+    std::cerr << "node-report: unable to reserve emergency report arena of " << size << " bytes\n";
+    return;
+  }
+  // Touch the arena so the pages are committed now rather than on first use.
+  memset(emergency_arena, 0, size);
+  emergency_arena_size = size;
+
+  // The first call to backtrace() loads the unwinder, which allocates, and
+  // dlsym() may allocate, so do both now.
+  void* frames[2];
+  backtrace(frames, arraysize(frames));
+  *(void**)(&libc_version) = dlsym(RTLD_DEFAULT, "gnu_get_libc_version");
 }
 
 /*******************************************************************************
- * Functions to print a list of loaded native libraries.
+ * Functions to print libuv handles and loaded libraries into the arena.
  *
  ******************************************************************************/
+static void ArenaEndpoint(ArenaStream* stream, const SocketAddress& address, const char* prefix) {
+  const int family = address.sa.sa_family;
+  const void* src = family == AF_INET ?
+                    static_cast<const void*>(&(address.in4.sin_addr)) :
+                    static_cast<const void*>(&(address.in6.sin6_addr));
+  char host[INET6_ADDRSTRLEN];
+  if (uv_inet_ntop(family, src, host, sizeof(host)) == 0) {
+    ArenaPrintf(stream, "%s%s:%d", prefix, host,
+                ntohs(family == AF_INET ? address.in4.sin_port : address.in6.sin6_port));
+  }
+}
+
+static void ArenaWalkHandle(uv_handle_t* h, void* arg) {
+  ArenaStream* stream = static_cast<ArenaStream*>(arg);
+  HandleInfo info = HandleInfo();
+  captureHandle(h, &info, false);
+
+  ArenaPrintf(stream, "[%c%c]   %-10s0x%0*" PRIxPTR "  ",
+              info.has_ref ? 'R' : '-', info.is_active ? 'A' : '-',
+              handleTypeName(info.type), static_cast<int>(2 * sizeof(void*)),
+              reinterpret_cast<uintptr_t>(info.address));
+  switch (info.type) {
+    case UV_FS_EVENT:
+    case UV_FS_POLL: {
+      char path[NR_MAXPATH + 1];
+      size_t size = sizeof(path) - 1;
+      uv_any_handle* handle = reinterpret_cast<uv_any_handle*>(h);
+      int rc = info.type == UV_FS_EVENT ?
+               uv_fs_event_getpath(&handle->fs_event, path, &size) :
+               uv_fs_poll_getpath(&handle->fs_poll, path, &size);
+      if (rc == 0) {
+        path[size] = '\0';
+        ArenaPrintf(stream, "filename: %s", path);
+      }
+      break;
+    }
+    case UV_PROCESS:
+      ArenaPrintf(stream, "pid: %d", info.pid);
+      break;
+    case UV_TCP:
+    case UV_UDP:
+      if (info.local_rc == 0) {
+        ArenaEndpoint(stream, info.local, "");
+        if (info.type == UV_TCP) {
+          if (info.peer_rc == 0) {
+            ArenaEndpoint(stream, info.peer, " connected to ");
+          } else if (info.peer_rc == UV_ENOTCONN) {
+            ArenaWrite(stream, " (not connected)");
+          }
+        }
+      }
+      break;
+    case UV_TIMER:
+      ArenaPrintf(stream, "repeat: %" PRIu64, info.timer_repeat);
+      if (info.timer_due > info.timer_now) {
+        ArenaPrintf(stream, ", timeout in: %" PRIu64 " ms", info.timer_due - info.timer_now);
+      } else {
+        ArenaPrintf(stream, ", timeout expired: %" PRIu64 " ms ago", info.timer_now - info.timer_due);
+      }
+      break;
+    case UV_TTY:
+      if (info.tty_rc == 0) {
+        ArenaPrintf(stream, "width: %d, height: %d", info.tty_width, info.tty_height);
+      }
+      break;
+    case UV_SIGNAL:
+      ArenaPrintf(stream, "signum: %d (%s)", info.signum, SignoString(info.signum));
+      break;
+    default: break;
+  }
+  if (info.has_buffer_sizes) {
+    ArenaPrintf(stream, "%ssend buffer size: %d, recv buffer size: %d",
+                info.type == UV_TCP || info.type == UV_UDP ? ", " : "",
+                info.send_buffer_size, info.recv_buffer_size);
+  }
+  if (info.fd >= 0) {
+    switch (info.fd) {
+      case 0: ArenaWrite(stream, ", stdin"); break;
+      case 1: ArenaWrite(stream, ", stdout"); break;
+      case 2: ArenaWrite(stream, ", stderr"); break;
+      default: ArenaPrintf(stream, ", file descriptor: %d", info.fd); break;
+    }
+  }
+  if (info.is_stream) {
+    ArenaPrintf(stream, ", write queue size: %zu%s%s", info.write_queue_size,
+                info.readable ? ", readable" : "", info.writable ? ", writable" : "");
+  }
+  ArenaWrite(stream, "\n");
+}
+
 #ifdef __linux__
-static int LibraryPrintCallback(struct dl_phdr_info *info, size_t size, void *data) {
-  std::ostream* out = reinterpret_cast<std::ostream*>(data);
+static int ArenaLibraryCallback(struct dl_phdr_info *info, size_t size, void *data) {
   if (info->dlpi_name != nullptr && *info->dlpi_name != '\0') {
-    *out << "  " << info->dlpi_name << "\n";
+    ArenaPrintf(static_cast<ArenaStream*>(data), "  %s\n", info->dlpi_name);
   }
   return 0;
 }
 #endif
 
-static void PrintLoadedLibraries(std::ostream& out, Isolate* isolate) {
-#ifdef __linux__
-  dl_iterate_phdr(LibraryPrintCallback, &out);
-#elif __APPLE__
-  int i = 0;
-  const char *name = _dyld_get_image_name(i);
-  while (name != nullptr) {
-    out << "  " << name << "\n";
-    i++;
-    name = _dyld_get_image_name(i);
-  }
-#elif _AIX
-  // We can't tell in advance how large the buffer needs to be.
-  // Retry until we reach too large a size (1Mb).
-  const unsigned int buffer_inc = 4096;
-  unsigned int buffer_size = buffer_inc;
-  char* buffer = (char*) malloc(buffer_size);
-  int rc = -1;
-  while (buffer != nullptr && rc != 0 && buffer_size < 1024 * 1024) {
-    rc = loadquery(L_GETINFO, buffer, buffer_size);
-    if (rc == 0) {
-      break;
+// Write the suppressed report counts in the header, as TakeSuppressedReports()
+// does for other reports, without allocating
+static void ArenaSuppressedReports(ArenaStream* out) {
+  bool first = true;
+  for (size_t i = 0; i < arraysize(rate_limit_events); i++) {
+    const unsigned long long count = report_buckets[i].suppressed.exchange(0);
+    if (count != 0) {
+      ArenaPrintf(out, "%s%s %llu", first ? "Reports suppressed: " : ", ",
+                  rate_limit_events[i], count);
+      first = false;
     }
-    free(buffer);
-    buffer_size += buffer_inc;
-    buffer = (char*) malloc(buffer_size);
   }
-  if (buffer == nullptr) {
-    return; // Don't try to free the buffer.
+  if (!first) {
+    ArenaWrite(out, "\n");
   }
-  if (rc == 0) {
-    char* buf = buffer;
-    ld_info* cur_info = nullptr;
-    do {
-      cur_info = (ld_info*) buf;
-      char* member_name = cur_info->ldinfo_filename
-        + strlen(cur_info->ldinfo_filename) + 1;
-      if (*member_name != '\0') {
-        out << "  " << cur_info->ldinfo_filename << "(" << member_name << ")\n";
+}
+
+/*******************************************************************************
+ * Function to write the emergency report for a fatal error. The report file is
+ * opened first, so that everything after the open() is rendered in the arena.
+ *
+ ******************************************************************************/
+static void WriteEmergencyReport(Isolate* isolate, const char* message, const char* location,
+                                 const char* filename, const TIME_TYPE* tm_struct,
+                                 const char* directory, unsigned int sections) {
+  ArenaStream out = {STDOUT_FILENO, 0};
+  bool close_fd = false;
+  if (!strncmp(filename, "stdout", sizeof("stdout") - 1)) {
+    out.fd = STDOUT_FILENO;
+  } else if (!strncmp(filename, "stderr", sizeof("stderr") - 1)) {
+    out.fd = STDERR_FILENO;
+  } else {
+    // Regular file. Append filename to directory path if one was specified
+    char pathname[NR_MAXPATH + NR_MAXNAME + 1];
+    if (strlen(directory) > 0) {
+      snprintf(pathname, sizeof(pathname), "%s/%s", directory, filename);
+    } else {
+      snprintf(pathname, sizeof(pathname), "%s", filename);
+    }
+    out.fd = open(pathname, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    ArenaStream err = {STDERR_FILENO, 0};
+    if (out.fd < 0) {
+      if (strlen(directory) > 0) {
+        ArenaPrintf(&err, "\nFailed to open Node.js report file: %s directory: %s (errno: %d)\n",
+                    filename, directory, errno);
       } else {
-        out << "  " << cur_info->ldinfo_filename << "\n";
+        ArenaPrintf(&err, "\nFailed to open Node.js report file: %s (errno: %d)\n", filename, errno);
       }
-      buf += cur_info->ldinfo_next;
-    } while (cur_info->ldinfo_next != 0);
+      ArenaFlush(&err);
+      return;
+    }
+    close_fd = true;
+    ArenaPrintf(&err, "\nWriting Node.js report to file: %s\n", filename);
+    ArenaFlush(&err);
   }
-  free(buffer);
-#elif __sun
-  Link_map *p;
 
-  if (dlinfo(RTLD_SELF, RTLD_DI_LINKMAP, &p) != -1) {
-    for (Link_map *l = p; l != NULL; l = l->l_next) {
-      out << "  " << l->l_name << "\n";
+  // Title and header information (event, filename, timestamp and pid)
+  ArenaWrite(&out, "================================================================================\n");
+  ArenaWrite(&out, "==== Node Report ===============================================================\n");
+  ArenaPrintf(&out, "\nEvent: %s, location: \"%s\"\n", message, location);
+  if (close_fd) {
+    ArenaPrintf(&out, "Filename: %s\n", filename);
+  }
+  ArenaSuppressedReports(&out);
+  char timebuf[64];
+  FormatTime(tm_struct, timebuf, sizeof(timebuf));
+  ArenaPrintf(&out, "Dump event time:  %s\n", timebuf);
+  FormatTime(&loadtime_tm_struct, timebuf, sizeof(timebuf));
+  ArenaPrintf(&out, "Module load time: %s\n", timebuf);
+  ArenaPrintf(&out, "Process ID: %d\n", static_cast<int>(getpid()));
+  if (!commandline_string.empty()) {
+    ArenaPrintf(&out, "Command line: %s\n", commandline_string.c_str());
+  }
+
+  // Node.js and OS version information
+  ArenaPrintf(&out, "\n%s\nnode-report version: %s (built against Node.js v%s",
+              version_string.c_str(), NODEREPORT_VERSION, NODE_VERSION_STRING);
+#if defined(__GLIBC__)
+  ArenaPrintf(&out, ", glibc %d.%d", __GLIBC__, __GLIBC_MINOR__);
+#endif
+  ArenaPrintf(&out, ", %d bit)\n", static_cast<int>(sizeof(void*) * 8));
+  struct utsname os_info;
+  if (uname(&os_info) >= 0) {
+    ArenaPrintf(&out, "\nOS version: %s %s %s\n", os_info.sysname, os_info.release, os_info.version);
+    if (libc_version != nullptr) {
+      ArenaPrintf(&out, "(glibc: %s)\n", libc_version());
     }
+    ArenaPrintf(&out, "\nMachine: %s %s\n", os_info.nodename, os_info.machine);
   }
 
-#elif _WIN32
-  // Windows implementation - get a handle to the process.
-  HANDLE process_handle = OpenProcess(PROCESS_QUERY_INFORMATION | PROCESS_VM_READ,
-                                      FALSE, GetCurrentProcessId());
-  if (process_handle == NULL) {
-    out << "No library information available\n";
-    return;
+  // The JavaScript stack is not available on a fatal error
+  if (sections & NR_SECTION_JSSTACK) {
+    ArenaBanner(&out, "\n==== JavaScript Stack Trace ====================================================\n\n");
+    ArenaWrite(&out, "No stack trace available\n");
   }
-  // Get a list of all the modules in this process
-  DWORD size_1 = 0, size_2 = 0;
-  // First call to get the size of module array needed
-  if (EnumProcessModules(process_handle, NULL, 0, &size_1)) {
-    HMODULE* modules = (HMODULE*) malloc(size_1);
-    if (modules == NULL) {
-      return;  // bail out if malloc failed
+
+  // Native stack, omitting the top frames as they are in node-report code
+  if (sections & NR_SECTION_NATIVESTACK) {
+    ArenaBanner(&out, "\n==== Native Stack Trace ========================================================\n\n");
+    void* frames[NR_MAXFRAMES];
+    const int size = backtrace(frames, arraysize(frames));
+    if (size <= 0) {
+      ArenaPrintf(&out, "Native backtrace failed, error %d\n", size);
+    } else if (size <= 2) {
+      ArenaWrite(&out, "No frames to print\n");
     }
-    // Second call to populate the module array
-    if (EnumProcessModules(process_handle, modules, size_1, &size_2)) {
-      for (int i = 0;
-           i < (size_1 / sizeof(HMODULE)) && i < (size_2 / sizeof(HMODULE));
-           i++) {
-        TCHAR module_name[MAX_PATH];
-        // Obtain and print the full pathname for each module
-        if (GetModuleFileNameEx(process_handle, modules[i], module_name,
-                                sizeof(module_name) / sizeof(TCHAR))) {
-          out << "  " << module_name << "\n";
+    for (int i = 2; i < size; i++) {
+      ArenaPrintf(&out, "%2d: [pc=%p] ", i - 2, frames[i]);
+      Dl_info info;
+      if (dladdr(frames[i], &info)) {
+        if (info.dli_sname != nullptr) {
+          ArenaWrite(&out, info.dli_sname);
+        }
+        if (info.dli_fname != nullptr) {
+          ArenaPrintf(&out, " [%s]", info.dli_fname);
         }
       }
+      ArenaWrite(&out, "\n");
     }
-    free(modules);
-  } else {
-    out << "No library information available\n";
   }
-  // Release the handle to the process.
-  CloseHandle(process_handle);
 
-#elif __MVS__
-  void *dlcb = 0;
-  const int max_path = 1024;
-  char buffer[max_path];
-  char filename[max_path];
-  char *libpath = __getenv("LIBPATH");
-  while (dlcb = __dlcb_next(dlcb), dlcb) {
-    int len = __dlcb_entry_name(buffer, sizeof(buffer), dlcb);
-    void *addr = __dlcb_entry_addr(dlcb);
-    if (0 == addr)
-      continue;
-    if (buffer[0] != '/' && libpath && __find_file_in_path(filename, sizeof(filename), libpath, buffer) > 0) {
-      snprintf(buffer + len, sizeof(buffer) - len, " => %s (0x%p)", filename, addr);
-    } else
-      snprintf(buffer + len, sizeof(buffer) - len, " (0x%p)", addr);
-    out << "  " << buffer << std::endl;
+  // V8 Heap and Garbage Collector information
+  if (sections & NR_SECTION_HEAP) {
+    ArenaBanner(&out, "\n==== JavaScript Heap and Garbage Collector =====================================\n");
+    HeapSpaceStatistics v8_heap_space_stats;
+    for (size_t i = 0; i < isolate->NumberOfHeapSpaces(); i++) {
+      isolate->GetHeapSpaceStatistics(&v8_heap_space_stats, i);
+      ArenaPrintf(&out, "\nHeap space name: %s\n    Memory size: ", v8_heap_space_stats.space_name());
+      ArenaInteger(&out, v8_heap_space_stats.space_size());
+      ArenaWrite(&out, " bytes, committed memory: ");
+      ArenaInteger(&out, v8_heap_space_stats.physical_space_size());
+      ArenaWrite(&out, " bytes\n    Capacity: ");
+      ArenaInteger(&out, v8_heap_space_stats.space_used_size() + v8_heap_space_stats.space_available_size());
+      ArenaWrite(&out, " bytes, used: ");
+      ArenaInteger(&out, v8_heap_space_stats.space_used_size());
+      ArenaWrite(&out, " bytes, available: ");
+      ArenaInteger(&out, v8_heap_space_stats.space_available_size());
+      ArenaWrite(&out, " bytes");
+    }
+    HeapStatistics v8_heap_stats;
+    isolate->GetHeapStatistics(&v8_heap_stats);
+    ArenaWrite(&out, "\n\nTotal heap memory size: ");
+    ArenaInteger(&out, v8_heap_stats.total_heap_size());
+    ArenaWrite(&out, " bytes\nTotal heap committed memory: ");
+    ArenaInteger(&out, v8_heap_stats.total_physical_size());
+    ArenaWrite(&out, " bytes\nTotal used heap memory: ");
+    ArenaInteger(&out, v8_heap_stats.used_heap_size());
+    ArenaWrite(&out, " bytes\nTotal available heap memory: ");
+    ArenaInteger(&out, v8_heap_stats.total_available_size());
+    ArenaWrite(&out, " bytes\n\nHeap memory limit: ");
+    ArenaInteger(&out, v8_heap_stats.heap_size_limit());
+    ArenaWrite(&out, "\n");
   }
-  out << std::flush;
+
+  // Process and event loop thread resource usage
+  if (sections & NR_SECTION_RESOURCES) {
+    ArenaBanner(&out, "\n==== Resource Usage ============================================================\n");
+    time_t current_time;
+    time(&current_time);
+    double uptime = difftime(current_time, load_time);
+    if (uptime == 0)
+      uptime = 1; // avoid division by zero.
+    struct rusage stats;
+    ArenaWrite(&out, "\nProcess total resource usage:");
+    if (getrusage(RUSAGE_SELF, &stats) == 0) {
+      const double cpu_abs = stats.ru_utime.tv_sec + 0.000001 * stats.ru_utime.tv_usec +
+                             stats.ru_stime.tv_sec + 0.000001 * stats.ru_stime.tv_usec;
+      ArenaPrintf(&out, "\n  User mode CPU: %ld.%06ld secs\n  Kernel mode CPU: %ld.%06ld secs"
+                  "\n  Average CPU Consumption : %g%%\n  Maximum resident set size: ",
+                  static_cast<long>(stats.ru_utime.tv_sec), static_cast<long>(stats.ru_utime.tv_usec),
+                  static_cast<long>(stats.ru_stime.tv_sec), static_cast<long>(stats.ru_stime.tv_usec),
+                  (cpu_abs / uptime) * 100.0);
+      ArenaInteger(&out, stats.ru_maxrss * 1024);
+      ArenaPrintf(&out, " bytes\n  Page faults: %ld (I/O required) %ld (no I/O required)"
+                  "\n  Filesystem activity: %ld reads %ld writes",
+                  stats.ru_majflt, stats.ru_minflt, stats.ru_inblock, stats.ru_oublock);
+    }
+    ThreadUsage usage;
+    CaptureThreadUsage(&usage);
+    if (usage.valid) {
+      const double cpu_abs = usage.utime.tv_sec + 0.000001 * usage.utime.tv_usec +
+                             usage.stime.tv_sec + 0.000001 * usage.stime.tv_usec;
+      ArenaPrintf(&out, "\n\nEvent loop thread resource usage:"
+                  "\n  User mode CPU: %ld.%06ld secs\n  Kernel mode CPU: %ld.%06ld secs"
+                  "\n  Average CPU Consumption : %g%%",
+                  static_cast<long>(usage.utime.tv_sec), static_cast<long>(usage.utime.tv_usec),
+                  static_cast<long>(usage.stime.tv_sec), static_cast<long>(usage.stime.tv_usec),
+                  (cpu_abs / uptime) * 100.0);
+      if (usage.has_io) {
+        ArenaPrintf(&out, "\n  Filesystem activity: %ld reads %ld writes",
+                    usage.inblock, usage.oublock);
+      }
+    }
+    ArenaWrite(&out, "\n");
+  }
+
+  // libuv handle summary
+  if (sections & NR_SECTION_HANDLES) {
+    ArenaBanner(&out, "\n==== Node.js libuv Handle Summary ==============================================\n");
+    ArenaWrite(&out, "\n(Flags: R=Ref, A=Active)\n");
+    ArenaPrintf(&out, "%-7s%-10s%-*s%s\n", "Flags", "Type",
+                static_cast<int>(4 + 2 * sizeof(void*)), "Address", "Details");
+    uv_walk(uv_default_loop(), ArenaWalkHandle, &out);
+  }
+
+  // Operating system information
+  if (sections & (NR_SECTION_ENVIRONMENT | NR_SECTION_LIMITS | NR_SECTION_LIBRARIES)) {
+    ArenaBanner(&out, "\n==== System Information ========================================================\n");
+  }
+  if (sections & NR_SECTION_ENVIRONMENT) {
+    ArenaWrite(&out, "\nEnvironment variables\n");
+    for (char** env_var = environ; *env_var != nullptr; env_var++) {
+      ArenaPrintf(&out, "  %s\n", *env_var);
+    }
+  }
+  if (sections & NR_SECTION_LIMITS) {
+    ArenaWrite(&out, "\nResource limits                        soft limit      hard limit\n");
+    struct rlimit limit;
+    for (size_t i = 0; i < arraysize(rlimit_strings); i++) {
+      if (getrlimit(rlimit_strings[i].id, &limit) == 0) {
+        ArenaPrintf(&out, "  %s ", rlimit_strings[i].description);
+        if (limit.rlim_cur == RLIM_INFINITY) {
+          ArenaWrite(&out, "       unlimited");
+        } else {
+          ArenaPrintf(&out, "%16" PRIu64, static_cast<uint64_t>(limit.rlim_cur));
+        }
+        if (limit.rlim_max == RLIM_INFINITY) {
+          ArenaWrite(&out, "       unlimited\n");
+        } else {
+          ArenaPrintf(&out, "%16" PRIu64 "\n", static_cast<uint64_t>(limit.rlim_max));
+        }
+      }
+    }
+  }
+  if (sections & NR_SECTION_LIBRARIES) {
+    ArenaWrite(&out, "\nLoaded libraries\n");
+#ifdef __linux__
+    dl_iterate_phdr(ArenaLibraryCallback, &out);
+#elif __APPLE__
+    for (uint32_t i = 0; const char* name = _dyld_get_image_name(i); i++) {
+      ArenaPrintf(&out, "  %s\n", name);
+    }
 #endif
+  }
+
+  ArenaWrite(&out, "\n================================================================================\n");
+  ArenaFlush(&out);
+  if (close_fd) {
+    close(out.fd);
+  }
+
+  ArenaStream err = {STDERR_FILENO, 0};
+  ArenaWrite(&err, "Node.js report completed\n");
+  ArenaFlush(&err);
+}
+#else
+void SetEmergencyArenaSize(size_t size) {
+  // Fatal error reports always use the normal report path on this platform.
 }
+#endif
 
 }  // namespace nodereport
@@ -2,12 +2,19 @@
 #define SRC_NODE_REPORT_H_
 
 #include "nan.h"
+#include "report_writer.h"
+#include "thread_usage.h"
+#include "threadpool_probe.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <iostream>
 #include <sstream>
 #include <iomanip>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #ifdef _WIN32
 #include <time.h>
@@ -36,12 +43,118 @@ using v8::MaybeLocal;
 #define NR_FATALERROR 0x02
 #define NR_SIGNAL     0x04
 #define NR_APICALL    0x08
+#define NR_STALL      0x10
+#define NR_HEAPPRESSURE 0x20
+
+// Bit-flags for node-report sections. The header section is always included.
+#define NR_SECTION_JSSTACK     0x01  // JavaScript stack and exception details
+#define NR_SECTION_NATIVESTACK 0x02
+#define NR_SECTION_HEAP        0x04
+#define NR_SECTION_RESOURCES   0x08
+#define NR_SECTION_HANDLES     0x10
+#define NR_SECTION_ENVIRONMENT 0x20
+#define NR_SECTION_LIMITS      0x40
+#define NR_SECTION_LIBRARIES   0x80
+#define NR_SECTION_SAMPLES     0x100  // only present when the stack sampler is running
+#define NR_SECTION_MEMORY      0x200  // Linux only
+#define NR_SECTION_THREADPOOL  0x400  // only present when the threadpool probe is running
+#define NR_SECTION_FDS         0x800  // Linux only
+#define NR_SECTION_ALL         0xfff
 
 // Maximum file and path name lengths
 #define NR_MAXNAME 64
 #define NR_MAXPATH 1024
 
-enum DumpEvent {kException, kFatalError, kSignal_JS, kSignal_UV, kJavaScript};
+// Maximum number of native stack frames captured for a report
+#define NR_MAXFRAMES 256
+
+// Emergency report arena, see WriteEmergencyReport(). Fatal error reports are
+// rendered into the arena without allocating, on platforms where the native
+// stack, library list and OS information can be obtained without malloc().
+#if (defined(__linux__) && defined(__GLIBC__)) || defined(__APPLE__)
+#define NR_EMERGENCY_REPORT
+#endif
+#define NR_ARENA_SIZE_DEFAULT (64 * 1024)
+#define NR_ARENA_SIZE_MIN 4096
+
+// Event loop stall threshold, see ReportStallThreadMain()
+#define NR_STALL_THRESHOLD_DEFAULT 1000  // milliseconds
+#define NR_STALL_THRESHOLD_MIN 10
+
+// Heap pressure trigger, see OnNearHeapLimit(). V8 near heap limit callbacks
+// are available from Node.js 10.
+#if NODE_MAJOR_VERSION >= 10
+#define NR_HEAP_PRESSURE
+#endif
+#define NR_HEAP_EXTENSION_MIN (16 * 1024 * 1024)  // temporary heap limit increase
+
+// Number of garbage collections kept in the GC history, see SetupGCHistory()
+#define NR_GC_HISTORY_SIZE 128
+
+// Time allowed for the other threads running JavaScript to capture their part
+// of a report, see CaptureThreads()
+#define NR_THREAD_CAPTURE_TIMEOUT 1000  // milliseconds
+
+// Host names found by the resolver thread, see LookupHostName()
+#define NR_HOST_NAME_TTL 300  // seconds
+#define NR_HOST_NAME_CACHE_SIZE 4096
+
+// Objects listed by Rss in the memory map section, see ReadMemoryMap()
+#define NR_MEMORY_MAP_TOP 20
+
+// Files and devices listed by descriptor count, see ReadFdInventory()
+#define NR_FD_TOP_TARGETS 20
+
+// Handles listed by write queue size in the aggregated handle summary, see
+// CaptureHandles()
+#define NR_HANDLE_BUSIEST 10
+
+// TCP connection summary, see CaptureHandles(). Round trip time bucket n
+// counts times from 2^n to 2^(n+1) microseconds, except that the first starts
+// at 0 and the last is open ended.
+#define NR_TCP_RTT_BUCKETS 24
+#define NR_TCP_MOST_RETRANSMITS 10
+
+enum DumpEvent {kException, kFatalError, kSignal_JS, kSignal_UV, kJavaScript, kStall, kHeapPressure};
+
+enum ReportFormat {kText, kJSON, kBinary};
+
+enum ReportCompression {kUncompressed, kGzip};
+
+// Report sections for each trigger event, see ProcessNodeReportSections()
+struct SectionMasks {
+  unsigned int exception;
+  unsigned int fatalerror;
+  unsigned int signal;
+  unsigned int apicall;
+  unsigned int stall;
+  unsigned int heappressure;
+};
+
+// Report rate limit for a trigger event, see ProcessNodeReportRateLimits().
+// Up to 'reports' reports are written in a burst, and the allowance is then
+// replenished at 'reports' per 'seconds'. A limit of 0 reports means no limit.
+struct RateLimit {
+  unsigned int reports;
+  unsigned int seconds;
+};
+
+// Retention policy for report files in the report directory, see
+// ProcessNodeReportRetention(). A limit of 0 means no limit.
+struct RetentionPolicy {
+  unsigned int max_files;
+  unsigned long long max_bytes;
+  unsigned int max_age;        // seconds since the file was last modified
+};
+
+struct RateLimits {
+  RateLimit exception;
+  RateLimit fatalerror;
+  RateLimit signal;
+  RateLimit apicall;
+  RateLimit stall;
+  RateLimit heappressure;
+};
 
 #ifdef _WIN32
 typedef SYSTEMTIME TIME_TYPE;
@@ -49,6 +162,242 @@ typedef SYSTEMTIME TIME_TYPE;
 typedef struct tm TIME_TYPE;
 #endif
 
+// Socket address storage, large enough for IPv4 and IPv6 endpoints
+union SocketAddress {
+  struct sockaddr sa;
+  struct sockaddr_in in4;
+  struct sockaddr_in6 in6;
+};
+
+// Kernel statistics for a tcp socket, from getsockopt(TCP_INFO) (Linux only)
+struct TcpInfo {
+  bool listening;
+  bool connected;              // established, or closing after being established
+  uint32_t rtt;                // smoothed round trip time, microseconds
+  uint32_t rtt_var;            // round trip time variation, microseconds
+  uint32_t retransmits;        // segments retransmitted over the connection
+  uint32_t cwnd;               // congestion window, segments
+  uint32_t unacked;            // segments sent and not yet acknowledged
+  uint64_t bytes_in_flight;
+  uint32_t accept_queue;       // listening sockets: connections waiting for accept()
+  uint32_t accept_backlog;
+};
+
+// Information about a libuv handle. This is captured on the event loop thread
+// by CaptureHandles() and formatted later by PrintHandle(), which may run on the
+// report writer thread after the handle has been closed.
+struct HandleInfo {
+  uv_handle_type type;
+  const void* address;
+  bool has_ref;
+  bool is_active;
+  int fd;                      // file descriptor, -1 if not available
+  // tcp and udp
+  int local_rc;                // result of getsockname(), 0 if available
+  int peer_rc;                 // result of getpeername() (tcp only)
+  SocketAddress local;
+  SocketAddress peer;
+  // tcp, udp and pipe
+  bool has_buffer_sizes;
+  int send_buffer_size;
+  int recv_buffer_size;
+  // tcp
+  bool has_tcp_info;
+  TcpInfo tcp_info;
+  // tcp, pipe and tty streams
+  bool is_stream;
+  size_t write_queue_size;
+  bool readable;
+  bool writable;
+  // fs_event and fs_poll
+  bool has_path;
+  std::string path;
+  // type specific values: process, timer, tty and signal
+  int pid;
+  uint64_t timer_repeat;
+  uint64_t timer_due;
+  uint64_t timer_now;
+  int tty_rc;
+  int tty_width;
+  int tty_height;
+  int signum;
+};
+
+// Handles with the same type, flags and remote address, see CaptureHandles()
+struct HandleGroup {
+  uv_handle_type type;
+  bool has_ref;
+  bool is_active;
+  std::string peer;            // remote address of connected tcp handles, otherwise empty
+  size_t count;
+  size_t write_queue_size;     // total for the group
+};
+
+// Round trip times and retransmits of the connected tcp handles on an event
+// loop, including those beyond the handle limit, see CaptureHandles()
+struct TcpSummary {
+  size_t examined = 0;         // tcp handles, connected or not
+  size_t connections = 0;
+  uint64_t rtt_histogram[NR_TCP_RTT_BUCKETS] = {};
+  std::vector<HandleInfo> most_retransmits;  // most first, only those with retransmits
+};
+
+// Aggregated handle summary, used when an event loop has more handles than
+// the handle limit. Only the first handles up to the limit are captured in
+// detail, so the cost of a report stays bounded. The tcp summary covers all
+// the tcp handles.
+struct HandleAggregate {
+  size_t count = 0;            // all handles on the event loop
+  size_t limit = 0;            // handle limit when captured, 0 if not aggregated
+  std::vector<HandleGroup> groups;  // largest first, at most 'limit' groups
+  size_t groups_omitted = 0;
+  std::vector<HandleInfo> busiest;  // largest write queues first
+  TcpSummary tcp;
+};
+
+// V8 heap space usage, copied from v8::HeapSpaceStatistics
+struct HeapSpaceInfo {
+  std::string name;
+  size_t size;
+  size_t committed;
+  size_t used;
+  size_t available;
+};
+
+// Garbage collection, recorded by the V8 GC prologue and epilogue callbacks
+struct GCRecord {
+  uint64_t start;              // uv_hrtime() at the start of the pause
+  uint64_t duration;           // nanoseconds
+  v8::GCType type;
+  size_t used_before;          // used heap size before and after the collection
+  size_t used_after;
+};
+
+// V8 heap usage, copied from v8::HeapStatistics, and the GC history
+struct HeapInfo {
+  std::vector<HeapSpaceInfo> spaces;
+  size_t total_heap_size;
+  size_t total_physical_size;
+  size_t used_heap_size;
+  size_t total_available_size;
+  size_t heap_size_limit;
+  uint64_t capture_time;       // uv_hrtime() when the heap information was captured
+  uint64_t gc_count;           // collections since the GC history was set up
+  uint64_t gc_total_pause;     // nanoseconds, for all gc_count collections
+  std::vector<GCRecord> gc_history;  // most recent collections, oldest first
+};
+
+#ifndef _WIN32
+// CPU and I/O usage of the event loop thread. This can only be obtained on
+// the thread itself, so it is captured along with the isolate data.
+struct ThreadUsage {
+  bool valid;
+  bool has_io;
+  struct timeval utime;
+  struct timeval stime;
+  long inblock;
+  long oublock;
+};
+#endif
+
+// Sample counts for a function in the stack sampler ring buffer
+struct SampledFunction {
+  std::string name;
+  unsigned int self;           // samples with the function as the innermost frame
+  unsigned int total;          // samples with the function anywhere on the stack
+};
+
+// Stack samples copied when the report is captured, see CaptureStackSamples().
+// The JIT code names are looked up then, the native frames when it is written.
+struct StackSampleInfo {
+  unsigned int interval;       // milliseconds, 0 if the sampler is not running
+  size_t count;
+  uint64_t skipped;
+  uint64_t duration;           // nanoseconds from the first to the last sample
+  std::vector<void*> frames;   // of every sample in turn, innermost frame first
+  std::vector<unsigned int> frame_counts;  // frames in each sample
+  std::unordered_map<void*, std::string> code_names;  // JIT code frames only
+};
+
+// Time taken to capture or write one section of a report, in nanoseconds
+struct SectionTiming {
+  const char* name;
+  uint64_t duration;
+};
+
+// Timings for a report, from uv_hrtime(). The report is timed from the start
+// of the capture until the last section is written. The event loop is blocked
+// for the whole report, unless it is handed over to the report writer thread.
+struct ReportTimings {
+  uint64_t start_time;
+  uint64_t loop_released;      // time the report was queued, 0 if synchronous
+  uint64_t total;
+  uint64_t loop_blocked;
+  std::vector<SectionTiming> sections;
+};
+
+// JavaScript stack, heap and handles of another thread running JavaScript,
+// captured on that thread when a report is triggered, see CaptureThreads()
+struct ThreadReport {
+  unsigned int id;             // node-report thread number, 0 for the main thread
+  bool main_thread;
+  long os_thread_id;           // 0 if not available
+  bool captured;               // false if the thread did not respond in time
+  bool idle;                   // captured while the event loop was waiting for events
+  unsigned int sections;       // NR_SECTION_* flags for the data captured
+  std::string javascript_stack;
+  HeapInfo heap;               // without the GC history
+  std::vector<HandleInfo> handles;
+  HandleAggregate handle_aggregate;
+  std::vector<int> handle_fds;  // descriptors of the libuv handles and event loop
+};
+
+// Differences from the previous report, see ComputeReportDelta()
+struct ReportDelta;
+
+// Report content bound to the isolate or the event loop. CaptureSnapshot()
+// fills this in on the event loop thread, then WriteNodeReport() formats it
+// together with the process-wide information, on the event loop thread for a
+// synchronous report or on the report writer thread for an asynchronous one.
+struct ReportSnapshot {
+  DumpEvent event;
+  ReportFormat format;
+  ReportCompression compression;  // applies to reports written to file
+  unsigned int sections;       // NR_SECTION_* flags for the trigger event
+  std::string message;
+  std::string location;
+  std::string filename;        // empty if the report is not written to file
+  std::vector<std::pair<std::string, unsigned long long> > suppressed;  // rate limited triggers by event
+  TIME_TYPE tm_struct;
+  std::string javascript_stack;
+  std::string exception_details;  // empty if no Error object was supplied
+  void* native_frames[NR_MAXFRAMES];
+  int native_frame_count;
+  HeapInfo heap;
+#ifndef _WIN32
+  ThreadUsage loop_thread_usage;
+#endif
+#ifdef NR_THREAD_TABLE
+  bool has_thread_cpu = false;  // /proc/self/task was read
+  std::vector<ThreadCpuInfo> thread_cpu;
+  std::unordered_map<long, std::string> thread_roles;  // threads running JavaScript, by tid
+#endif
+  std::vector<HandleInfo> handles;
+  HandleAggregate handle_aggregate;
+  std::vector<int> handle_fds;  // descriptors of the libuv handles and event loop
+  std::vector<std::string> environment;  // "name=value", environ is not read off the loop thread
+  StackSampleInfo samples;
+  ThreadpoolProbeInfo threadpool;
+  ReportTimings timings;
+  unsigned int thread_id;      // node-report thread number of the triggering thread
+  std::vector<ThreadReport> threads;  // the other threads, for repeatable events only
+  uint64_t threads_generation = 0;  // capture requested from the other threads, 0 if none
+  uint64_t threads_deadline = 0;  // uv_hrtime() when they are listed as not captured
+  std::vector<unsigned int> threads_requested;  // collected when the report is written
+  bool delta_allowed;          // trigger event can be written as a delta report
+  ReportDelta* delta = nullptr;  // set while a delta report is being written
+};
+
 // NODEREPORT_VERSION is defined in binding.gyp
 #if !defined(NODEREPORT_VERSION)
 #define NODEREPORT_VERSION "dev"
@@ -58,26 +407,63 @@ typedef struct tm TIME_TYPE;
 // Function declarations - functions in src/node_report.cc
 void TriggerNodeReport(Isolate* isolate, DumpEvent event, const char* message, const char* location, char* name, v8::MaybeLocal<v8::Value> error);
 void GetNodeReport(Isolate* isolate, DumpEvent event, const char* message, const char* location, v8::MaybeLocal<v8::Value> error, std::ostream& out);
+void SetEmergencyArenaSize(size_t size);
+bool GetLastReportTimings(ReportTimings* timings);
+void ResetReportRateLimits();
+void CountSuppressedReport(DumpEvent event);
+void SetReportRetention(const RetentionPolicy& policy);
+void SetupGCHistory(Isolate* isolate);
+bool RegisterReportThread(Isolate* isolate);
 
 // Function declarations - utility functions in src/utilities.cc
 unsigned int ProcessNodeReportEvents(const char* args);
+void ProcessNodeReportSections(const char* args, SectionMasks* masks);
+void ProcessNodeReportRateLimits(const char* args, RateLimits* limits);
+bool ProcessNodeReportRetention(const char* args, RetentionPolicy* policy);
 unsigned int ProcessNodeReportSignal(const char* args);
 void ProcessNodeReportFileName(const char* args);
 void ProcessNodeReportDirectory(const char* args);
 unsigned int ProcessNodeReportVerboseSwitch(const char* args);
+unsigned int ProcessNodeReportAsyncSwitch(const char* args);
+unsigned int ProcessNodeReportDeltaSwitch(const char* args);
+unsigned int ProcessNodeReportResolveNamesSwitch(const char* args);
+size_t ProcessNodeReportHandleLimit(const char* args);
+ReportFormat ProcessNodeReportFormat(const char* args);
+ReportCompression ProcessNodeReportCompression(const char* args);
+size_t ProcessNodeReportArenaSize(const char* args);
+unsigned int ProcessNodeReportSamplingInterval(const char* args);
+unsigned int ProcessNodeReportThreadpoolProbeInterval(const char* args);
+unsigned int ProcessNodeReportStallThreshold(const char* args);
 void SetLoadTime();
 void SetVersionString(Isolate* isolate);
 void SetCommandLine();
-void reportEndpoints(uv_handle_t* h, std::ostringstream& out);
-void reportPath(uv_handle_t* h, std::ostringstream& out);
-void walkHandle(uv_handle_t* h, void* arg);
+void captureHandle(uv_handle_t* h, HandleInfo* info, bool capture_path);
+void CaptureHandles(uv_loop_t* loop, std::vector<HandleInfo>* handles,
+                    HandleAggregate* aggregate);
+const char* handleTypeName(uv_handle_type type);
+void PrintHandle(std::ostream& out, const HandleInfo& info);
+void PrintHandle(ReportWriter& writer, const HandleInfo& info);
+void PrintHandles(std::ostream& out, const std::vector<HandleInfo>& handles,
+                  const HandleAggregate& aggregate);
+void PrintHandles(ReportWriter& writer, const std::vector<HandleInfo>& handles,
+                  const HandleAggregate& aggregate);
 void WriteInteger(std::ostream& out, size_t value);
 const char *SignoString(int signo);
 
 // Global variable declarations - definitions are in src/node-report.c
+extern unsigned int nodereport_async;
+extern unsigned int nodereport_delta;
+extern unsigned int nodereport_resolve_names;
+extern size_t nodereport_handle_limit;
+extern ReportFormat nodereport_format;
+extern ReportCompression nodereport_compression;
+extern SectionMasks nodereport_sections;
+extern RateLimits nodereport_rate_limits;
 extern char report_filename[NR_MAXNAME + 1];
 extern char report_directory[NR_MAXPATH + 1];
 extern std::string version_string;
+extern std::string nodejs_version;
+extern std::vector<std::pair<std::string, std::string> > component_versions;
 extern std::string commandline_string;
 extern TIME_TYPE loadtime_tm_struct;
 extern time_t load_time;
@@ -0,0 +1,288 @@
+#include "report_writer.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <utility>
+
+namespace nodereport {
+
+JSONWriter::JSONWriter(std::ostream& out) : out_(out), indent_(0), first_(true) {
+}
+
+/*******************************************************************************
+ * Functions to start and end JSON objects and arrays.
+ ******************************************************************************/
+void JSONWriter::ObjectStart() {
+  if (indent_ > 0) {
+    NewLine();
+  }
+  out_ << '{';
+  indent_ += 2;
+  first_ = true;
+}
+
+void JSONWriter::ObjectStart(const char* key) {
+  Key(key);
+  out_ << '{';
+  indent_ += 2;
+  first_ = true;
+}
+
+void JSONWriter::ObjectEnd() {
+  indent_ -= 2;
+  if (!first_) {
+    out_ << '\n' << std::string(indent_, ' ');
+  }
+  out_ << '}';
+  if (indent_ == 0) {
+    out_ << '\n';
+  }
+  first_ = false;
+}
+
+void JSONWriter::ArrayStart(const char* key) {
+  Key(key);
+  out_ << '[';
+  indent_ += 2;
+  first_ = true;
+}
+
+void JSONWriter::ArrayEnd() {
+  indent_ -= 2;
+  if (!first_) {
+    out_ << '\n' << std::string(indent_, ' ');
+  }
+  out_ << ']';
+  first_ = false;
+}
+
+/*******************************************************************************
+ * Functions to write keyed values within an object.
+ ******************************************************************************/
+void JSONWriter::KeyValue(const char* key, const char* value) {
+  Key(key);
+  if (value == nullptr) {
+    out_ << "null";
+  } else {
+    String(value, strlen(value));
+  }
+}
+
+void JSONWriter::KeyValue(const char* key, const std::string& value) {
+  Key(key);
+  String(value.data(), value.size());
+}
+
+void JSONWriter::KeyValue(const char* key, bool value) {
+  Key(key);
+  out_ << (value ? "true" : "false");
+}
+
+void JSONWriter::KeyValue(const char* key, double value) {
+  Key(key);
+  if (isfinite(value)) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%.15g", value);
+    out_ << buf;
+  } else {
+    out_ << "null";
+  }
+}
+
+void JSONWriter::KeyValue(const char* key, long long value) {
+  Key(key);
+  out_ << value;
+}
+
+void JSONWriter::KeyValue(const char* key, unsigned long long value) {
+  Key(key);
+  out_ << value;
+}
+
+/*******************************************************************************
+ * Functions to write elements within an array.
+ ******************************************************************************/
+void JSONWriter::Element(const char* value) {
+  NewLine();
+  String(value, strlen(value));
+}
+
+void JSONWriter::Element(const std::string& value) {
+  NewLine();
+  String(value.data(), value.size());
+}
+
+/*******************************************************************************
+ * Internal functions for separators, keys and string escaping.
+ ******************************************************************************/
+void JSONWriter::NewLine() {
+  if (!first_) {
+    out_ << ',';
+  }
+  out_ << '\n' << std::string(indent_, ' ');
+  first_ = false;
+}
+
+void JSONWriter::Key(const char* key) {
+  NewLine();
+  String(key, strlen(key));
+  out_ << ": ";
+}
+
+void JSONWriter::String(const char* value, size_t length) {
+  out_ << '"';
+  const char* run = value;  // start of characters not needing an escape
+  for (size_t i = 0; i < length; i++) {
+    const unsigned char c = static_cast<unsigned char>(value[i]);
+    if (c >= 0x20 && c != '"' && c != '\\') {
+      continue;
+    }
+    out_.write(run, &value[i] - run);
+    run = &value[i + 1];
+    switch (c) {
+      case '"': out_ << "\\\""; break;
+      case '\\': out_ << "\\\\"; break;
+      case '\b': out_ << "\\b"; break;
+      case '\f': out_ << "\\f"; break;
+      case '\n': out_ << "\\n"; break;
+      case '\r': out_ << "\\r"; break;
+      case '\t': out_ << "\\t"; break;
+      default: {
+        char buf[8];
+        snprintf(buf, sizeof(buf), "\\u%04x", c);
+        out_ << buf;
+      }
+    }
+  }
+  out_.write(run, &value[length] - run);
+  out_ << '"';
+}
+
+BinaryWriter::BinaryWriter(std::ostream& out) : out_(out) {
+  out_.write("NRB\x01", 4);
+}
+
+/*******************************************************************************
+ * Functions to start and end binary objects and arrays.
+ ******************************************************************************/
+void BinaryWriter::ObjectStart() {
+  Item(kObjectStart, nullptr);
+}
+
+void BinaryWriter::ObjectStart(const char* key) {
+  Item(kObjectStart, key);
+}
+
+void BinaryWriter::ObjectEnd() {
+  Item(kObjectEnd, nullptr);
+}
+
+void BinaryWriter::ArrayStart(const char* key) {
+  Item(kArrayStart, key);
+}
+
+void BinaryWriter::ArrayEnd() {
+  Item(kArrayEnd, nullptr);
+}
+
+/*******************************************************************************
+ * Functions to write keyed values and array elements.
+ ******************************************************************************/
+void BinaryWriter::KeyValue(const char* key, const char* value) {
+  if (value == nullptr) {
+    Item(kNull, key);
+  } else {
+    const size_t length = strlen(value);
+    Item(kString, key);
+    StringRef(value, length, length <= kMaxInternedValue);
+  }
+}
+
+void BinaryWriter::KeyValue(const char* key, const std::string& value) {
+  Item(kString, key);
+  StringRef(value.data(), value.size(), value.size() <= kMaxInternedValue);
+}
+
+void BinaryWriter::KeyValue(const char* key, bool value) {
+  Item(value ? kTrue : kFalse, key);
+}
+
+void BinaryWriter::KeyValue(const char* key, double value) {
+  Item(kDouble, key);
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  char buf[8];
+  for (int i = 0; i < 8; i++) {
+    buf[i] = static_cast<char>(bits >> (8 * i));
+  }
+  out_.write(buf, sizeof(buf));
+}
+
+void BinaryWriter::KeyValue(const char* key, long long value) {
+  Item(kInt, key);
+  // Zigzag encoding keeps small negative values small.
+  const uint64_t bits = static_cast<uint64_t>(value);
+  Varint((bits << 1) ^ (value < 0 ? ~static_cast<uint64_t>(0) : 0));
+}
+
+void BinaryWriter::KeyValue(const char* key, unsigned long long value) {
+  Item(kUint, key);
+  Varint(value);
+}
+
+void BinaryWriter::Element(const char* value) {
+  const size_t length = strlen(value);
+  Item(kString, nullptr);
+  StringRef(value, length, length <= kMaxInternedValue);
+}
+
+void BinaryWriter::Element(const std::string& value) {
+  Item(kString, nullptr);
+  StringRef(value.data(), value.size(), value.size() <= kMaxInternedValue);
+}
+
+/*******************************************************************************
+ * Internal functions for tags, varints and the string table.
+ ******************************************************************************/
+void BinaryWriter::Item(Tag tag, const char* key) {
+  out_.put(static_cast<char>(tag));
+  if (key != nullptr) {
+    StringRef(key, strlen(key), true);
+  }
+}
+
+void BinaryWriter::Varint(uint64_t value) {
+  char buf[10];
+  size_t length = 0;
+  while (value >= 0x80) {
+    buf[length++] = static_cast<char>((value & 0x7f) | 0x80);
+    value >>= 7;
+  }
+  buf[length++] = static_cast<char>(value);
+  out_.write(buf, length);
+}
+
+void BinaryWriter::StringRef(const char* value, size_t length, bool intern) {
+  if (intern) {
+    std::string string(value, length);
+    auto entry = strings_.find(string);
+    if (entry != strings_.end()) {
+      Varint(entry->second + 2);
+      return;
+    }
+    if (strings_.size() < kMaxStrings) {
+      const uint64_t index = strings_.size();
+      strings_.emplace(std::move(string), index);
+      Varint(1);
+      Varint(length);
+      out_.write(value, length);
+      return;
+    }
+  }
+  Varint(0);
+  Varint(length);
+  out_.write(value, length);
+}
+
+}  // namespace nodereport
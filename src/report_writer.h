@@ -0,0 +1,150 @@
+#ifndef SRC_REPORT_WRITER_H_
+#define SRC_REPORT_WRITER_H_
+
+#include <stdint.h>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+
+namespace nodereport {
+
+/*******************************************************************************
+ * Interface used by the section printers to write a structured report.
+ *
+ * Values are written to the output stream as they are supplied, no document
+ * tree is built. The caller is responsible for balancing the ObjectStart/
+ * ObjectEnd and ArrayStart/ArrayEnd calls, and for using the keyed methods
+ * inside objects and the Element() methods inside arrays.
+ ******************************************************************************/
+class ReportWriter {
+ public:
+  virtual ~ReportWriter() {}
+
+  virtual void ObjectStart() = 0;
+  virtual void ObjectStart(const char* key) = 0;
+  virtual void ObjectEnd() = 0;
+  virtual void ArrayStart(const char* key) = 0;
+  virtual void ArrayEnd() = 0;
+
+  virtual void KeyValue(const char* key, const char* value) = 0;
+  virtual void KeyValue(const char* key, const std::string& value) = 0;
+  virtual void KeyValue(const char* key, bool value) = 0;
+  virtual void KeyValue(const char* key, double value) = 0;
+  virtual void KeyValue(const char* key, long long value) = 0;
+  virtual void KeyValue(const char* key, unsigned long long value) = 0;
+  void KeyValue(const char* key, int value) { KeyValue(key, static_cast<long long>(value)); }
+  void KeyValue(const char* key, unsigned int value) { KeyValue(key, static_cast<unsigned long long>(value)); }
+  void KeyValue(const char* key, long value) { KeyValue(key, static_cast<long long>(value)); }
+  void KeyValue(const char* key, unsigned long value) { KeyValue(key, static_cast<unsigned long long>(value)); }
+
+  virtual void Element(const char* value) = 0;
+  virtual void Element(const std::string& value) = 0;
+};
+
+/*******************************************************************************
+ * Streaming JSON writer, used for the JSON report format. Integer values are
+ * written as raw JSON numbers.
+ ******************************************************************************/
+class JSONWriter : public ReportWriter {
+ public:
+  explicit JSONWriter(std::ostream& out);
+
+  using ReportWriter::KeyValue;
+
+  void ObjectStart() override;
+  void ObjectStart(const char* key) override;
+  void ObjectEnd() override;
+  void ArrayStart(const char* key) override;
+  void ArrayEnd() override;
+
+  void KeyValue(const char* key, const char* value) override;
+  void KeyValue(const char* key, const std::string& value) override;
+  void KeyValue(const char* key, bool value) override;
+  void KeyValue(const char* key, double value) override;
+  void KeyValue(const char* key, long long value) override;
+  void KeyValue(const char* key, unsigned long long value) override;
+
+  void Element(const char* value) override;
+  void Element(const std::string& value) override;
+
+ private:
+  void NewLine();
+  void Key(const char* key);
+  void String(const char* value, size_t length);
+
+  std::ostream& out_;
+  int indent_;
+  bool first_;  // no members written yet in the current object or array
+};
+
+/*******************************************************************************
+ * Streaming writer for the compact binary report format. The stream contains
+ * the same tree of objects, arrays and values as the JSON format, encoded as:
+ *
+ *   file    := "NRB" version(0x01) value
+ *   value   := tag [key] payload     (key present only for object members)
+ *   key     := string-ref
+ *   string-ref := varint 0, varint length, bytes      literal
+ *               | varint 1, varint length, bytes      literal, added to table
+ *               | varint n (n >= 2)                   table entry n - 2
+ *
+ * Payloads by tag: kString a string-ref, kInt a zigzag varint, kUint a varint,
+ * kDouble 8 bytes IEEE 754 little-endian, and no payload for the others.
+ * kObjectEnd and kArrayEnd never carry a key. Varints are unsigned LEB128.
+ *
+ * Keys and short string values are added to the string table on first use,
+ * up to kMaxStrings entries, so repeated handle and environment entries cost
+ * a few bytes each. bin/node-report-decode.js converts the binary format back
+ * to the text or JSON layout.
+ ******************************************************************************/
+class BinaryWriter : public ReportWriter {
+ public:
+  enum Tag {
+    kObjectStart = 0x01,
+    kObjectEnd = 0x02,
+    kArrayStart = 0x03,
+    kArrayEnd = 0x04,
+    kString = 0x05,
+    kTrue = 0x06,
+    kFalse = 0x07,
+    kNull = 0x08,
+    kDouble = 0x09,
+    kInt = 0x0a,
+    kUint = 0x0b
+  };
+
+  explicit BinaryWriter(std::ostream& out);
+
+  using ReportWriter::KeyValue;
+
+  void ObjectStart() override;
+  void ObjectStart(const char* key) override;
+  void ObjectEnd() override;
+  void ArrayStart(const char* key) override;
+  void ArrayEnd() override;
+
+  void KeyValue(const char* key, const char* value) override;
+  void KeyValue(const char* key, const std::string& value) override;
+  void KeyValue(const char* key, bool value) override;
+  void KeyValue(const char* key, double value) override;
+  void KeyValue(const char* key, long long value) override;
+  void KeyValue(const char* key, unsigned long long value) override;
+
+  void Element(const char* value) override;
+  void Element(const std::string& value) override;
+
+ private:
+  static const size_t kMaxStrings = 4096;
+  static const size_t kMaxInternedValue = 24;  // longest value string interned
+
+  void Item(Tag tag, const char* key);
+  void Varint(uint64_t value);
+  void StringRef(const char* value, size_t length, bool intern);
+
+  std::ostream& out_;
+  std::unordered_map<std::string, uint64_t> strings_;
+};
+
+}  // namespace nodereport
+
+#endif  // SRC_REPORT_WRITER_H_
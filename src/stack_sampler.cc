@@ -0,0 +1,241 @@
+#include "stack_sampler.h"
+#include "node.h"
+#include "uv.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <map>
+
+namespace nodereport {
+
+// Name and size of a JIT code object, keyed by start address in code_map
+struct CodeEntry {
+  size_t size;
+  std::string name;
+};
+
+static uv_once_t sampler_once = UV_ONCE_INIT;
+static uv_mutex_t sampler_mutex;
+static uv_cond_t sampler_cond;  // signalled to stop the sampler thread
+static uv_thread_t sampler_thread;
+static bool sampler_thread_running = false;
+static bool sampler_stop = false;
+static bool cleanup_hook_added = false;
+static unsigned int sampler_interval = 0;  // milliseconds, 0 if stopped
+static v8::Isolate* sampler_isolate = nullptr;
+
+// Ring buffer of samples. There is a single writer, the interrupt callback on
+// the event loop thread, and the sample count is published after each write.
+static StackSample* sample_ring = nullptr;
+static std::atomic<uint64_t> sample_count(0);
+static std::atomic<uint64_t> samples_skipped(0);
+static std::atomic<bool> interrupt_pending(false);
+static std::atomic<uint64_t> interrupt_time(0);
+
+// Code objects logged by V8. Code events may be sent from GC helper threads.
+static uv_mutex_t code_map_mutex;
+static std::map<uintptr_t, CodeEntry> code_map;
+
+static void InitStackSampler() {
+  if (uv_mutex_init(&sampler_mutex) != 0 || uv_cond_init(&sampler_cond) != 0 ||
+      uv_mutex_init(&code_map_mutex) != 0) {
+    abort();
+  }
+}
+
+/*******************************************************************************
+ * V8 code event handler, maintains the map of code object names
+ *
+ ******************************************************************************/
+static void CodeEventHandler(const v8::JitCodeEvent* event) {
+  const uintptr_t start = reinterpret_cast<uintptr_t>(event->code_start);
+  uv_mutex_lock(&code_map_mutex);
+  switch (event->type) {
+  case v8::JitCodeEvent::CODE_ADDED: {
+    // Drop any stale entries for code that previously occupied the range
+    code_map.erase(code_map.lower_bound(start), code_map.lower_bound(start + event->code_len));
+    CodeEntry& entry = code_map[start];
+    entry.size = event->code_len;
+    entry.name.assign(event->name.str, event->name.len);
+    break;
+  }
+  case v8::JitCodeEvent::CODE_MOVED: {
+    auto entry = code_map.find(start);
+    if (entry != code_map.end()) {
+      CodeEntry moved = entry->second;
+      code_map.erase(entry);
+      const uintptr_t new_start = reinterpret_cast<uintptr_t>(event->new_code_start);
+      code_map.erase(code_map.lower_bound(new_start), code_map.lower_bound(new_start + moved.size));
+      code_map[new_start] = moved;
+    }
+    break;
+  }
+  case v8::JitCodeEvent::CODE_REMOVED:
+    code_map.erase(start);
+    break;
+  default:
+    break;
+  }
+  uv_mutex_unlock(&code_map_mutex);
+}
+
+bool GetCodeName(void* pc, std::string* name) {
+  const uintptr_t address = reinterpret_cast<uintptr_t>(pc);
+  bool found = false;
+  uv_once(&sampler_once, InitStackSampler);
+  uv_mutex_lock(&code_map_mutex);
+  auto entry = code_map.upper_bound(address);
+  if (entry != code_map.begin()) {
+    --entry;
+    if (address < entry->first + entry->second.size) {
+      *name = entry->second.name;
+      found = true;
+    }
+  }
+  uv_mutex_unlock(&code_map_mutex);
+  return found;
+}
+
+/*******************************************************************************
+ * Interrupt callback, runs on the event loop thread while JavaScript is
+ * executing. Only the instruction addresses are recorded here.
+ ******************************************************************************/
+static void SampleInterrupt(v8::Isolate* isolate, void* data) {
+  interrupt_pending.store(false);
+  if (sampler_interval == 0) {
+    return;  // sampler stopped since the interrupt was requested
+  }
+  // If the interrupt was delayed, the event loop was idle or blocked in native
+  // code, and the stack is just whatever JavaScript happened to run next.
+  const uint64_t now = uv_hrtime();
+  if (now - interrupt_time.load() > 2 * sampler_interval * 1000000ULL) {
+    samples_skipped++;
+    return;
+  }
+
+  v8::RegisterState state;
+  v8::SampleInfo info;
+  state.pc = nullptr;
+  state.fp = &state;
+  state.sp = &state;
+
+  const uint64_t count = sample_count.load(std::memory_order_relaxed);
+  StackSample* sample = &sample_ring[count % NR_SAMPLE_BUFFER_SIZE];
+  isolate->GetStackSample(state, sample->frames, NR_SAMPLE_FRAMES, &info);
+  sample->frame_count = static_cast<unsigned int>(info.frames_count);
+  sample->time = now;
+  sample_count.store(count + 1, std::memory_order_release);
+}
+
+/*******************************************************************************
+ * Sampler thread, requests an interrupt every sampling interval. Only one
+ * interrupt is outstanding at a time, so they do not queue up while the event
+ * loop is idle.
+ ******************************************************************************/
+static void SamplerThreadMain(void* unused) {
+  uv_mutex_lock(&sampler_mutex);
+  while (!sampler_stop) {
+    const uint64_t timeout = sampler_interval * 1000000ULL;
+    if (uv_cond_timedwait(&sampler_cond, &sampler_mutex, timeout) != UV_ETIMEDOUT) {
+      continue;  // stop requested, or a spurious wakeup
+    }
+    if (!interrupt_pending.exchange(true)) {
+      interrupt_time.store(uv_hrtime());
+      sampler_isolate->RequestInterrupt(SampleInterrupt, nullptr);
+    }
+  }
+  uv_mutex_unlock(&sampler_mutex);
+}
+
+static void StopSamplerThread() {
+  if (!sampler_thread_running) {
+    return;
+  }
+  uv_mutex_lock(&sampler_mutex);
+  sampler_stop = true;
+  uv_cond_signal(&sampler_cond);
+  uv_mutex_unlock(&sampler_mutex);
+  uv_thread_join(&sampler_thread);
+  sampler_thread_running = false;
+}
+
+// The sampler thread must not request interrupts once the isolate is disposed
+static void SamplerCleanupHook(void* unused) {
+  StopSamplerThread();
+}
+
+/*******************************************************************************
+ * External functions to control the sampler and read the samples
+ *
+ ******************************************************************************/
+void SetStackSamplerInterval(v8::Isolate* isolate, unsigned int interval) {
+  uv_once(&sampler_once, InitStackSampler);
+  if (interval == sampler_interval) {
+    return;
+  }
+  StopSamplerThread();
+
+  if (interval == 0) {
+    isolate->SetJitCodeEventHandler(v8::kJitCodeEventDefault, nullptr);
+    uv_mutex_lock(&code_map_mutex);
+    code_map.clear();
+    uv_mutex_unlock(&code_map_mutex);
+    sampler_interval = 0;
+    return;
+  }
+
+  if (sampler_interval == 0) {
+    // Starting the sampler, discard any samples from a previous run
+    if (sample_ring == nullptr) {
+      sample_ring = new StackSample[NR_SAMPLE_BUFFER_SIZE];
+    }
+    sample_count.store(0);
+    samples_skipped.store(0);
+    isolate->SetJitCodeEventHandler(v8::kJitCodeEventEnumExisting, CodeEventHandler);
+  }
+  if (!cleanup_hook_added) {
+#if NODE_MAJOR_VERSION >= 10
+    node::AddEnvironmentCleanupHook(isolate, SamplerCleanupHook, nullptr);
+#else
+    node::AtExit(SamplerCleanupHook, nullptr);
+#endif
+    cleanup_hook_added = true;
+  }
+  sampler_isolate = isolate;
+  sampler_interval = interval;
+  sampler_stop = false;
+  if (uv_thread_create(&sampler_thread, SamplerThreadMain, nullptr) == 0) {
+    sampler_thread_running = true;
+  } else {
+    fprintf(stderr, "node-report: unable to start the stack sampler thread\n");
+  }
+}
+
+unsigned int GetStackSamplerInterval() {
+  return sampler_interval;
+}
+
+uint64_t GetStackSamples(std::vector<StackSample>* samples) {
+  samples->clear();
+  if (sample_ring == nullptr) {
+    return 0;
+  }
+  const uint64_t end = sample_count.load(std::memory_order_acquire);
+  uint64_t begin = end > NR_SAMPLE_BUFFER_SIZE ? end - NR_SAMPLE_BUFFER_SIZE : 0;
+  samples->reserve(static_cast<size_t>(end - begin));
+  for (uint64_t i = begin; i < end; i++) {
+    samples->push_back(sample_ring[i % NR_SAMPLE_BUFFER_SIZE]);
+  }
+  // Drop any samples overwritten while they were being copied
+  const uint64_t latest = sample_count.load(std::memory_order_acquire);
+  if (latest > begin + NR_SAMPLE_BUFFER_SIZE) {
+    const uint64_t overwritten = latest - begin - NR_SAMPLE_BUFFER_SIZE;
+    samples->erase(samples->begin(),
+                   samples->begin() + static_cast<size_t>(std::min<uint64_t>(overwritten, samples->size())));
+  }
+  return samples_skipped.load();
+}
+
+}  // namespace nodereport
@@ -0,0 +1,47 @@
+#ifndef SRC_STACK_SAMPLER_H_
+#define SRC_STACK_SAMPLER_H_
+
+#include "v8.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace nodereport {
+
+// Number of frames recorded per sample and number of samples kept. At the
+// default 10ms interval the buffer holds the last 10 seconds of samples.
+#define NR_SAMPLE_FRAMES 64
+#define NR_SAMPLE_BUFFER_SIZE 1024
+#define NR_SAMPLE_INTERVAL_MAX 60000  // milliseconds
+
+// JavaScript stack sample, as raw instruction addresses
+struct StackSample {
+  uint64_t time;               // uv_hrtime() when the sample was taken
+  unsigned int frame_count;
+  void* frames[NR_SAMPLE_FRAMES];  // innermost frame first
+};
+
+/*******************************************************************************
+ * Start, stop or change the interval of the JavaScript stack sampler. A
+ * sampler thread requests an isolate interrupt every interval milliseconds,
+ * and the interrupt records the stack addresses in a ring buffer. The names of
+ * the code objects are tracked so that the addresses can be resolved when a
+ * report is written. An interval of 0 stops the sampler and discards the
+ * samples. Must be called on the main thread, as the sampler is process wide
+ * and must not outlive a worker's isolate.
+ ******************************************************************************/
+void SetStackSamplerInterval(v8::Isolate* isolate, unsigned int interval);
+unsigned int GetStackSamplerInterval();
+
+// Copy the samples in the ring buffer, oldest first. Returns the number of
+// samples discarded because no JavaScript was running when they were due.
+uint64_t GetStackSamples(std::vector<StackSample>* samples);
+
+// Look up the name of the JIT code object containing an address, as logged by
+// V8. Returns false if the address is not in a known code object.
+bool GetCodeName(void* pc, std::string* name);
+
+}  // namespace nodereport
+
+#endif  // SRC_STACK_SAMPLER_H_
@@ -0,0 +1,171 @@
+#include "thread_usage.h"
+#include "linux_dirent.h"
+
+#ifdef NR_THREAD_TABLE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <unordered_map>
+#include <utility>
+
+#include "uv.h"
+
+namespace nodereport {
+
+// Buffer for the task directory listing, enough for about 100 threads a call
+#define NR_TASK_DIRENT_BUFFER_SIZE 4096
+// Buffer for the stat and status files, both are under 2k
+#define NR_TASK_FILE_BUFFER_SIZE 4096
+
+// Total CPU time of each thread when the previous table was read
+static uv_once_t previous_once = UV_ONCE_INIT;
+static uv_mutex_t previous_mutex;
+static std::unordered_map<long, double> previous_cpu;
+static uint64_t previous_time = 0;  // uv_hrtime(), 0 if no table has been read
+
+static void InitPrevious() {
+  if (uv_mutex_init(&previous_mutex) != 0) {
+    abort();
+  }
+}
+
+// Read a file relative to the task directory into the buffer, NUL terminated
+static bool ReadTaskFile(int task_fd, const char* path, char* buffer, size_t size) {
+  const int fd = openat(task_fd, path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  size_t used = 0;
+  while (used < size - 1) {
+    const ssize_t bytes = read(fd, buffer + used, size - 1 - used);
+    if (bytes < 0 && errno == EINTR) {
+      continue;
+    }
+    if (bytes <= 0) {
+      break;
+    }
+    used += bytes;
+  }
+  close(fd);
+  buffer[used] = '\0';
+  return used > 0;
+}
+
+// Parse /proc/self/task/<tid>/stat. The name is in brackets and may contain
+// spaces or brackets itself, so the fields are counted from the last ')'.
+static bool ParseTaskStat(const char* stat, ThreadCpuInfo* info, long ticks_per_second) {
+  const char* name_start = strchr(stat, '(');
+  const char* name_end = strrchr(stat, ')');
+  if (name_start == nullptr || name_end == nullptr || name_end < name_start ||
+      name_end[1] != ' ') {
+    return false;
+  }
+  info->name.assign(name_start + 1, name_end - name_start - 1);
+  info->state = name_end[2];
+
+  // Field 3 is the state, utime and stime are fields 14 and 15, and the
+  // processor is field 39
+  const char* cursor = name_end + 2;
+  unsigned long long utime = 0;
+  unsigned long long stime = 0;
+  for (int field = 3; field <= 39 && *cursor != '\0'; field++) {
+    if (field == 14) {
+      utime = strtoull(cursor, nullptr, 10);
+    } else if (field == 15) {
+      stime = strtoull(cursor, nullptr, 10);
+    } else if (field == 39) {
+      info->last_cpu = static_cast<int>(strtol(cursor, nullptr, 10));
+    }
+    cursor = strchr(cursor, ' ');
+    if (cursor == nullptr) {
+      break;
+    }
+    cursor++;
+  }
+  info->user_cpu = static_cast<double>(utime) / ticks_per_second;
+  info->kernel_cpu = static_cast<double>(stime) / ticks_per_second;
+  return true;
+}
+
+// Parse the context switch counts from /proc/self/task/<tid>/status
+static void ParseTaskStatus(const char* status, ThreadCpuInfo* info) {
+  const char* voluntary = strstr(status, "\nvoluntary_ctxt_switches:");
+  const char* involuntary = strstr(status, "\nnonvoluntary_ctxt_switches:");
+  if (voluntary != nullptr && involuntary != nullptr) {
+    info->voluntary_switches =
+        strtoul(voluntary + sizeof("\nvoluntary_ctxt_switches:") - 1, nullptr, 10);
+    info->involuntary_switches =
+        strtoul(involuntary + sizeof("\nnonvoluntary_ctxt_switches:") - 1, nullptr, 10);
+    info->has_switches = true;
+  }
+}
+
+static bool LowerThreadId(const ThreadCpuInfo& a, const ThreadCpuInfo& b) {
+  return a.tid < b.tid;
+}
+
+bool ReadThreadCpuTable(std::vector<ThreadCpuInfo>* threads) {
+  const int task_fd = open("/proc/self/task", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (task_fd < 0) {
+    return false;
+  }
+  std::vector<long> tids;
+  char dirents[NR_TASK_DIRENT_BUFFER_SIZE];
+  ForEachNumericEntry(task_fd, dirents, sizeof(dirents), [&](const char* name) {
+    tids.push_back(strtol(name, nullptr, 10));
+  });
+
+  const long ticks_per_second = sysconf(_SC_CLK_TCK);
+  threads->clear();
+  threads->reserve(tids.size());
+  char buffer[NR_TASK_FILE_BUFFER_SIZE];
+  char path[64];
+  for (long tid : tids) {
+    ThreadCpuInfo info = ThreadCpuInfo();
+    info.tid = tid;
+    info.last_cpu = -1;
+    // The thread may have exited since the directory was listed
+    snprintf(path, sizeof(path), "%ld/stat", tid);
+    if (!ReadTaskFile(task_fd, path, buffer, sizeof(buffer)) ||
+        !ParseTaskStat(buffer, &info, ticks_per_second)) {
+      continue;
+    }
+    snprintf(path, sizeof(path), "%ld/status", tid);
+    if (ReadTaskFile(task_fd, path, buffer, sizeof(buffer))) {
+      ParseTaskStatus(buffer, &info);
+    }
+    threads->push_back(std::move(info));
+  }
+  close(task_fd);
+  std::sort(threads->begin(), threads->end(), LowerThreadId);
+
+  // CPU consumption since the previous table
+  uv_once(&previous_once, InitPrevious);
+  const uint64_t now = uv_hrtime();
+  uv_mutex_lock(&previous_mutex);
+  const double elapsed = (now - previous_time) / 1e9;
+  std::unordered_map<long, double> current;
+  for (ThreadCpuInfo& info : *threads) {
+    const double cpu = info.user_cpu + info.kernel_cpu;
+    auto previous = previous_cpu.find(info.tid);
+    if (previous_time != 0 && elapsed > 0 && previous != previous_cpu.end()) {
+      info.has_cpu_percent = true;
+      // CPU times are in clock ticks, so short intervals can overshoot
+      info.cpu_percent = std::min(100.0, std::max(0.0, cpu - previous->second) / elapsed * 100.0);
+    }
+    current[info.tid] = cpu;
+  }
+  previous_cpu.swap(current);
+  previous_time = now;
+  uv_mutex_unlock(&previous_mutex);
+  return true;
+}
+
+}  // namespace nodereport
+
+#endif  // NR_THREAD_TABLE
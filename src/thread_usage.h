@@ -0,0 +1,43 @@
+#ifndef SRC_THREAD_USAGE_H_
+#define SRC_THREAD_USAGE_H_
+
+#include <string>
+#include <vector>
+
+// The thread table is read from /proc/self/task, which only Linux provides.
+#if defined(__linux__)
+#define NR_THREAD_TABLE
+#endif
+
+namespace nodereport {
+
+#ifdef NR_THREAD_TABLE
+// CPU usage and scheduling information for a thread, from
+// /proc/self/task/<tid>/stat and /proc/self/task/<tid>/status
+struct ThreadCpuInfo {
+  long tid;
+  std::string name;            // as set by pthread_setname_np(), 15 characters at most
+  char state;                  // R, S, D and so on, see proc(5)
+  double user_cpu;             // seconds
+  double kernel_cpu;           // seconds
+  int last_cpu;                // processor the thread last ran on
+  bool has_cpu_percent;        // the thread was present in the previous table
+  double cpu_percent;          // CPU consumption since the previous table
+  bool has_switches;
+  unsigned long voluntary_switches;
+  unsigned long involuntary_switches;
+};
+
+/*******************************************************************************
+ * Read the CPU usage of every thread in the process, in thread id order. The
+ * task directory is listed with getdents64() and each thread's files are read
+ * into fixed size buffers, so the cost is two small reads per thread. CPU
+ * percentages are computed against the previous call, for threads present in
+ * both. Returns false if /proc/self/task cannot be read.
+ ******************************************************************************/
+bool ReadThreadCpuTable(std::vector<ThreadCpuInfo>* threads);
+#endif
+
+}  // namespace nodereport
+
+#endif  // SRC_THREAD_USAGE_H_
@@ -0,0 +1,190 @@
+#include "threadpool_probe.h"
+#include "node.h"
+#include "uv.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace nodereport {
+
+// libuv sizes the threadpool from UV_THREADPOOL_SIZE when it first starts
+#define NR_THREADPOOL_SIZE_DEFAULT 4
+#if UV_VERSION_HEX >= 0x011e00
+#define NR_THREADPOOL_SIZE_MAX 1024
+#else
+#define NR_THREADPOOL_SIZE_MAX 128
+#endif
+
+static uv_once_t probe_once = UV_ONCE_INIT;
+static bool cleanup_hook_added = false;
+static unsigned int probe_interval = 0;  // milliseconds, 0 if stopped
+static uv_timer_t* probe_timer = nullptr;
+
+// The work request is only used on the event loop thread, and only one probe
+// is outstanding at a time, including after the probe has been stopped
+static uv_work_t probe_request;
+static bool probe_outstanding = false;
+
+// Latencies, recorded by the work callback on a threadpool thread
+static uv_mutex_t probe_mutex;
+static uint64_t probe_start_time = 0;
+static uint64_t probe_queued_time = 0;  // 0 if no probe is waiting for a thread
+static uint64_t probe_count = 0;
+static uint64_t probe_total_latency = 0;
+static uint64_t probe_max_latency = 0;
+static uint64_t probe_last_latency = 0;
+static uint64_t probe_histogram[NR_PROBE_BUCKETS];
+
+static void InitThreadpoolProbe() {
+  if (uv_mutex_init(&probe_mutex) != 0) {
+    abort();
+  }
+}
+
+static unsigned int HistogramBucket(uint64_t latency) {
+  uint64_t micros = latency / 1000;
+  unsigned int bucket = 0;
+  while (micros > 1 && bucket < NR_PROBE_BUCKETS - 1) {
+    micros >>= 1;
+    bucket++;
+  }
+  return bucket;
+}
+
+/*******************************************************************************
+ * Work callback, runs on a threadpool thread as soon as one is free. The time
+ * since the request was queued is the latency any other work queued at the
+ * same time would have seen.
+ ******************************************************************************/
+static void ProbeWork(uv_work_t* request) {
+  const uint64_t now = uv_hrtime();
+  uv_mutex_lock(&probe_mutex);
+  if (probe_queued_time != 0) {
+    const uint64_t latency = now - probe_queued_time;
+    probe_queued_time = 0;
+    probe_count++;
+    probe_total_latency += latency;
+    if (latency > probe_max_latency) {
+      probe_max_latency = latency;
+    }
+    probe_last_latency = latency;
+    probe_histogram[HistogramBucket(latency)]++;
+  }
+  uv_mutex_unlock(&probe_mutex);
+}
+
+static void ProbeAfterWork(uv_work_t* request, int status) {
+  probe_outstanding = false;
+}
+
+static void ProbeTimerCallback(uv_timer_t* timer) {
+  if (probe_outstanding) {
+    return;  // the previous probe is still waiting for a thread
+  }
+  uv_mutex_lock(&probe_mutex);
+  probe_queued_time = uv_hrtime();
+  uv_mutex_unlock(&probe_mutex);
+  if (uv_queue_work(timer->loop, &probe_request, ProbeWork, ProbeAfterWork) == 0) {
+    probe_outstanding = true;
+  } else {
+    uv_mutex_lock(&probe_mutex);
+    probe_queued_time = 0;
+    uv_mutex_unlock(&probe_mutex);
+  }
+}
+
+static void StopProbeTimer() {
+  if (probe_timer != nullptr) {
+    uv_timer_stop(probe_timer);
+  }
+}
+
+// The timer must not queue work once the environment is being torn down
+static void ProbeCleanupHook(void* unused) {
+  StopProbeTimer();
+  probe_interval = 0;
+}
+
+/*******************************************************************************
+ * External functions to control the probe and read the latencies
+ *
+ ******************************************************************************/
+void SetThreadpoolProbeInterval(v8::Isolate* isolate, unsigned int interval) {
+  uv_once(&probe_once, InitThreadpoolProbe);
+  if (interval == probe_interval) {
+    return;
+  }
+  StopProbeTimer();
+  if (interval == 0) {
+    probe_interval = 0;
+    return;
+  }
+
+  if (probe_timer == nullptr) {
+    probe_timer = new uv_timer_t;
+    if (uv_timer_init(uv_default_loop(), probe_timer) != 0) {
+      delete probe_timer;
+      probe_timer = nullptr;
+      fprintf(stderr, "node-report: unable to start the threadpool probe\n");
+      return;
+    }
+    uv_unref(reinterpret_cast<uv_handle_t*>(probe_timer));
+  }
+  if (!cleanup_hook_added) {
+#if NODE_MAJOR_VERSION >= 10
+    node::AddEnvironmentCleanupHook(isolate, ProbeCleanupHook, nullptr);
+#else
+    node::AtExit(ProbeCleanupHook, nullptr);
+#endif
+    cleanup_hook_added = true;
+  }
+  if (probe_interval == 0) {
+    // Starting the probe, discard any latencies from a previous run
+    uv_mutex_lock(&probe_mutex);
+    probe_start_time = uv_hrtime();
+    probe_queued_time = 0;
+    probe_count = 0;
+    probe_total_latency = 0;
+    probe_max_latency = 0;
+    probe_last_latency = 0;
+    memset(probe_histogram, 0, sizeof(probe_histogram));
+    uv_mutex_unlock(&probe_mutex);
+  }
+  probe_interval = interval;
+  // The first probe is queued on the next loop iteration
+  uv_timer_start(probe_timer, ProbeTimerCallback, 0, interval);
+}
+
+unsigned int GetThreadpoolProbeInterval() {
+  return probe_interval;
+}
+
+void GetThreadpoolProbeInfo(ThreadpoolProbeInfo* info) {
+  uv_once(&probe_once, InitThreadpoolProbe);
+  info->interval = probe_interval;
+  info->size_setting = getenv("UV_THREADPOOL_SIZE");
+  long size = NR_THREADPOOL_SIZE_DEFAULT;
+  if (info->size_setting != nullptr) {
+    size = atoi(info->size_setting);
+    if (size <= 0) {
+      size = 1;
+    } else if (size > NR_THREADPOOL_SIZE_MAX) {
+      size = NR_THREADPOOL_SIZE_MAX;
+    }
+  }
+  info->pool_size = static_cast<unsigned int>(size);
+
+  const uint64_t now = uv_hrtime();
+  uv_mutex_lock(&probe_mutex);
+  info->duration = probe_start_time != 0 ? now - probe_start_time : 0;
+  info->probes = probe_count;
+  info->total_latency = probe_total_latency;
+  info->max_latency = probe_max_latency;
+  info->last_latency = probe_last_latency;
+  info->waiting = probe_queued_time != 0 ? now - probe_queued_time : 0;
+  memcpy(info->histogram, probe_histogram, sizeof(probe_histogram));
+  uv_mutex_unlock(&probe_mutex);
+}
+
+}  // namespace nodereport
@@ -0,0 +1,47 @@
+#ifndef SRC_THREADPOOL_PROBE_H_
+#define SRC_THREADPOOL_PROBE_H_
+
+#include "v8.h"
+
+#include <stdint.h>
+
+namespace nodereport {
+
+#define NR_PROBE_INTERVAL_MAX 60000  // milliseconds
+// Latency histogram buckets, bucket n counts latencies from 2^n to 2^(n+1)
+// microseconds, except that the first starts at 0 and the last is open ended
+#define NR_PROBE_BUCKETS 24
+
+// Threadpool size and queue-to-start latencies of the probes since the probe
+// was started. Latencies are in nanoseconds.
+struct ThreadpoolProbeInfo {
+  unsigned int interval;       // milliseconds, 0 if the probe is not running
+  unsigned int pool_size;      // as libuv sizes the pool from UV_THREADPOOL_SIZE
+  const char* size_setting;    // UV_THREADPOOL_SIZE, nullptr if not set
+  uint64_t duration;           // since the probe was started
+  uint64_t probes;             // probes that have started running
+  uint64_t total_latency;
+  uint64_t max_latency;
+  uint64_t last_latency;
+  uint64_t waiting;            // time the outstanding probe has been queued, 0 if none
+  uint64_t histogram[NR_PROBE_BUCKETS];
+};
+
+/*******************************************************************************
+ * Start, stop or change the interval of the libuv threadpool probe. A timer
+ * on the default event loop submits a no-op work request every interval
+ * milliseconds, and the work callback records how long the request waited in
+ * the threadpool queue before a thread picked it up. Only one probe is queued
+ * at a time. The timer is unreferenced, so it does not keep the process
+ * alive. An interval of 0 stops the probe and discards the latencies. Must be
+ * called on the main thread.
+ ******************************************************************************/
+void SetThreadpoolProbeInterval(v8::Isolate* isolate, unsigned int interval);
+unsigned int GetThreadpoolProbeInterval();
+
+// Copy the latency histogram and the state of the outstanding probe
+void GetThreadpoolProbeInfo(ThreadpoolProbeInfo* info);
+
+}  // namespace nodereport
+
+#endif  // SRC_THREADPOOL_PROBE_H_
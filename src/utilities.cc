@@ -1,5 +1,19 @@
 #include "node_report.h"
+#include "stack_sampler.h"
 
+#include <inttypes.h>
+#include <limits.h>
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+
+#ifdef __linux__
+#include <netinet/in.h>
+#include <netinet/tcp.h>  // TCP_INFO
+#endif
 #ifdef __APPLE__
 #include <crt_externs.h>  // _NSGetArgv() and _NSGetArgc()
 #endif
@@ -38,6 +52,12 @@ unsigned int ProcessNodeReportEvents(const char* args) {
     } else if (!strncmp(cursor, "apicall", sizeof("apicall") - 1)) {
       event_flags |= NR_APICALL;
       cursor += sizeof("apicall") - 1;
+    } else if (!strncmp(cursor, "stall", sizeof("stall") - 1)) {
+      event_flags |= NR_STALL;
+      cursor += sizeof("stall") - 1;
+    } else if (!strncmp(cursor, "heappressure", sizeof("heappressure") - 1)) {
+      event_flags |= NR_HEAPPRESSURE;
+      cursor += sizeof("heappressure") - 1;
     } else {
       std::cerr << "Unrecognised argument for node-report events option: " << cursor << "\n";
       return 0;
@@ -49,6 +69,161 @@ unsigned int ProcessNodeReportEvents(const char* args) {
   return event_flags;
 }
 
+/*******************************************************************************
+ * Function to process node-report config: selection of report sections. The
+ * argument is a comma-separated list of '+'-separated section names, each
+ * list optionally prefixed by the trigger event it applies to, for example
+ * "jsstack+heap,fatalerror:all". A list without a prefix applies to all
+ * events. The masks are left unchanged if the argument is not valid.
+ ******************************************************************************/
+const static struct {
+  const char* name;
+  unsigned int flag;
+} section_names[] = {
+  {"jsstack", NR_SECTION_JSSTACK},
+  {"nativestack", NR_SECTION_NATIVESTACK},
+  {"heap", NR_SECTION_HEAP},
+  {"resources", NR_SECTION_RESOURCES},
+  {"handles", NR_SECTION_HANDLES},
+  {"environment", NR_SECTION_ENVIRONMENT},
+  {"limits", NR_SECTION_LIMITS},
+  {"libraries", NR_SECTION_LIBRARIES},
+  {"samples", NR_SECTION_SAMPLES},
+  {"memory", NR_SECTION_MEMORY},
+  {"threadpool", NR_SECTION_THREADPOOL},
+  {"fds", NR_SECTION_FDS},
+  {"all", NR_SECTION_ALL}
+};
+
+static bool MatchToken(const char* token, size_t length, const char* name) {
+  return length == strlen(name) && !strncmp(token, name, length);
+}
+
+// Parse an optional trigger event prefix, up to a ':' separator, and advance
+// the cursor past it. Returns false if the event is not recognised.
+static bool ParseEventPrefix(const char** cursor, unsigned int* event_flags) {
+  *event_flags = NR_EXCEPTION | NR_FATALERROR | NR_SIGNAL | NR_APICALL | NR_STALL |
+                 NR_HEAPPRESSURE;
+  const char* token = *cursor;
+  size_t length = strcspn(token, ":,");
+  if (token[length] != ':') {
+    return true;
+  }
+  if (MatchToken(token, length, "exception")) {
+    *event_flags = NR_EXCEPTION;
+  } else if (MatchToken(token, length, "fatalerror")) {
+    *event_flags = NR_FATALERROR;
+  } else if (MatchToken(token, length, "signal")) {
+    *event_flags = NR_SIGNAL;
+  } else if (MatchToken(token, length, "apicall")) {
+    *event_flags = NR_APICALL;
+  } else if (MatchToken(token, length, "stall")) {
+    *event_flags = NR_STALL;
+  } else if (MatchToken(token, length, "heappressure")) {
+    *event_flags = NR_HEAPPRESSURE;
+  } else {
+    return false;
+  }
+  *cursor += length + 1;  // Hop over the ':' separator
+  return true;
+}
+
+void ProcessNodeReportSections(const char* args, SectionMasks* masks) {
+  SectionMasks result = *masks;
+  const char* cursor = args;
+  while (*cursor != '\0') {
+    unsigned int event_flags;
+    if (!ParseEventPrefix(&cursor, &event_flags)) {
+      std::cerr << "Unrecognised event for node-report sections option: " << cursor << "\n";
+      return;
+    }
+
+    // Section names, up to the ',' separator or the end of the argument
+    unsigned int section_flags = 0;
+    size_t length;
+    while (*cursor != '\0' && *cursor != ',') {
+      length = strcspn(cursor, "+,");
+      size_t i = 0;
+      while (i < arraysize(section_names) && !MatchToken(cursor, length, section_names[i].name)) {
+        i++;
+      }
+      if (i == arraysize(section_names)) {
+        std::cerr << "Unrecognised argument for node-report sections option: " << cursor << "\n";
+        return;
+      }
+      section_flags |= section_names[i].flag;
+      cursor += length;
+      if (*cursor == '+') {
+        cursor++;  // Hop over the '+' separator
+      }
+    }
+    if (*cursor == ',') {
+      cursor++;  // Hop over the ',' separator
+    }
+
+    if (event_flags & NR_EXCEPTION) result.exception = section_flags;
+    if (event_flags & NR_FATALERROR) result.fatalerror = section_flags;
+    if (event_flags & NR_SIGNAL) result.signal = section_flags;
+    if (event_flags & NR_APICALL) result.apicall = section_flags;
+    if (event_flags & NR_STALL) result.stall = section_flags;
+    if (event_flags & NR_HEAPPRESSURE) result.heappressure = section_flags;
+  }
+  *masks = result;
+}
+
+/*******************************************************************************
+ * Function to process node-report config: report rate limits. The argument is
+ * a comma-separated list of limits in the form <reports>/<seconds>, or "none",
+ * each optionally prefixed by the trigger event it applies to, for example
+ * "signal:3/60,apicall:10/1". A limit without a prefix applies to all events.
+ * The limits are left unchanged if the argument is not valid.
+ ******************************************************************************/
+void ProcessNodeReportRateLimits(const char* args, RateLimits* limits) {
+  RateLimits result = *limits;
+  const char* cursor = args;
+  while (*cursor != '\0') {
+    unsigned int event_flags;
+    if (!ParseEventPrefix(&cursor, &event_flags)) {
+      std::cerr << "Unrecognised event for node-report rate limit option: " << cursor << "\n";
+      return;
+    }
+
+    RateLimit limit = {0, 0};
+    size_t length = strcspn(cursor, ",");
+    if (!MatchToken(cursor, length, "none")) {
+      char* suffix = nullptr;
+      unsigned long reports = strtoul(cursor, &suffix, 10);
+      unsigned long seconds = 0;
+      if (suffix != cursor && *suffix == '/') {
+        const char* period = suffix + 1;
+        seconds = strtoul(period, &suffix, 10);
+        if (suffix == period) {
+          seconds = 0;
+        }
+      }
+      if (reports == 0 || seconds == 0 || suffix != cursor + length ||
+          reports > UINT_MAX || seconds > UINT_MAX) {
+        std::cerr << "Unrecognised argument for node-report rate limit option: " << cursor << "\n";
+        return;
+      }
+      limit.reports = static_cast<unsigned int>(reports);
+      limit.seconds = static_cast<unsigned int>(seconds);
+    }
+    cursor += length;
+    if (*cursor == ',') {
+      cursor++;  // Hop over the ',' separator
+    }
+
+    if (event_flags & NR_EXCEPTION) result.exception = limit;
+    if (event_flags & NR_FATALERROR) result.fatalerror = limit;
+    if (event_flags & NR_SIGNAL) result.signal = limit;
+    if (event_flags & NR_APICALL) result.apicall = limit;
+    if (event_flags & NR_STALL) result.stall = limit;
+    if (event_flags & NR_HEAPPRESSURE) result.heappressure = limit;
+  }
+  *limits = result;
+}
+
 /*******************************************************************************
  * Function to process node-report config: selection of trigger signal.
  ******************************************************************************/
@@ -121,6 +296,282 @@ unsigned int ProcessNodeReportVerboseSwitch(const char* args) {
   return 0;  // Default is verbose mode off
 }
 
+/*******************************************************************************
+ * Function to process node-report config: selection of report format.
+ ******************************************************************************/
+ReportFormat ProcessNodeReportFormat(const char* args) {
+  if (strlen(args) == 0) {
+    std::cerr << "Missing argument for node-report format option\n";
+    return kText;
+  }
+  // Parse the supplied format
+  if (!strncmp(args, "text", sizeof("text") - 1)) {
+    return kText;
+  } else if (!strncmp(args, "json", sizeof("json") - 1)) {
+    return kJSON;
+  } else if (!strncmp(args, "binary", sizeof("binary") - 1)) {
+    return kBinary;
+  } else {
+    std::cerr << "Unrecognised argument for node-report format option: " << args << "\n";
+  }
+  return kText;  // Default is the text format
+}
+
+/*******************************************************************************
+ * Function to process node-report config: compression of report files.
+ ******************************************************************************/
+ReportCompression ProcessNodeReportCompression(const char* args) {
+  if (strlen(args) == 0) {
+    std::cerr << "Missing argument for node-report compression option\n";
+    return kUncompressed;
+  }
+  // Parse the supplied compression
+  if (!strncmp(args, "none", sizeof("none") - 1)) {
+    return kUncompressed;
+  } else if (!strncmp(args, "gzip", sizeof("gzip") - 1)) {
+    return kGzip;
+  } else {
+    std::cerr << "Unrecognised argument for node-report compression option: " << args << "\n";
+  }
+  return kUncompressed;  // Default is no compression
+}
+
+/*******************************************************************************
+ * Function to process node-report config: emergency report arena size, in
+ * bytes with an optional k or m suffix. Zero disables the emergency report.
+ ******************************************************************************/
+size_t ProcessNodeReportArenaSize(const char* args) {
+  if (strlen(args) == 0) {
+    std::cerr << "Missing argument for node-report emergency arena option\n";
+    return NR_ARENA_SIZE_DEFAULT;
+  }
+  // Parse the supplied size
+  char* suffix = nullptr;
+  unsigned long long size = strtoull(args, &suffix, 10);
+  if (suffix == args) {
+    std::cerr << "Unrecognised argument for node-report emergency arena option: " << args << "\n";
+    return NR_ARENA_SIZE_DEFAULT;
+  }
+  if (!strcmp(suffix, "k") || !strcmp(suffix, "K")) {
+    size *= 1024;
+  } else if (!strcmp(suffix, "m") || !strcmp(suffix, "M")) {
+    size *= 1024 * 1024;
+  } else if (*suffix != '\0') {
+    std::cerr << "Unrecognised argument for node-report emergency arena option: " << args << "\n";
+    return NR_ARENA_SIZE_DEFAULT;
+  }
+  return static_cast<size_t>(size);
+}
+
+/*******************************************************************************
+ * Function to process node-report config: report file retention. The argument
+ * is "none" or a comma-separated list of limits: files=<count>,
+ * bytes=<size>[k|m|g] and age=<time>[s|m|h|d], for example
+ * "files=20,bytes=100m,age=7d". Limits that are not given are not applied.
+ * Returns false, leaving the policy unchanged, if the argument is not valid.
+ ******************************************************************************/
+bool ProcessNodeReportRetention(const char* args, RetentionPolicy* policy) {
+  if (strlen(args) == 0) {
+    std::cerr << "Missing argument for node-report retention option\n";
+    return false;
+  }
+  RetentionPolicy result = {0, 0, 0};
+  const char* cursor = args;
+  while (*cursor != '\0' && strcmp(args, "none") != 0) {
+    const size_t length = strcspn(cursor, ",");
+    const size_t name_length = strcspn(cursor, "=,");
+    char* suffix = nullptr;
+    unsigned long long value = 0;
+    if (cursor[name_length] == '=') {
+      value = strtoull(cursor + name_length + 1, &suffix, 10);
+    }
+    if (suffix == nullptr || suffix == cursor + name_length + 1) {
+      std::cerr << "Unrecognised argument for node-report retention option: " << cursor << "\n";
+      return false;
+    }
+    const size_t suffix_length = cursor + length - suffix;
+    unsigned long long multiplier = 0;
+    if (MatchToken(cursor, name_length, "files")) {
+      multiplier = suffix_length == 0 ? 1 : 0;
+    } else if (MatchToken(cursor, name_length, "bytes")) {
+      multiplier = suffix_length == 0 ? 1 :
+                   MatchToken(suffix, suffix_length, "k") ? 1024ULL :
+                   MatchToken(suffix, suffix_length, "m") ? 1024ULL * 1024 :
+                   MatchToken(suffix, suffix_length, "g") ? 1024ULL * 1024 * 1024 : 0;
+    } else if (MatchToken(cursor, name_length, "age")) {
+      multiplier = suffix_length == 0 || MatchToken(suffix, suffix_length, "s") ? 1 :
+                   MatchToken(suffix, suffix_length, "m") ? 60 :
+                   MatchToken(suffix, suffix_length, "h") ? 60 * 60 :
+                   MatchToken(suffix, suffix_length, "d") ? 24 * 60 * 60 : 0;
+    }
+    const bool bytes = MatchToken(cursor, name_length, "bytes");
+    if (multiplier == 0 || value > (bytes ? ULLONG_MAX : UINT_MAX) / multiplier) {
+      std::cerr << "Unrecognised argument for node-report retention option: " << cursor << "\n";
+      return false;
+    }
+    if (bytes) {
+      result.max_bytes = value * multiplier;
+    } else if (MatchToken(cursor, name_length, "files")) {
+      result.max_files = static_cast<unsigned int>(value);
+    } else {
+      result.max_age = static_cast<unsigned int>(value * multiplier);
+    }
+    cursor += length;
+    if (*cursor == ',') {
+      cursor++;  // Hop over the ',' separator
+    }
+  }
+  *policy = result;
+  return true;
+}
+
+/*******************************************************************************
+ * Function to process node-report config: stack sampling interval.
+ * Interval in milliseconds, 0 to turn the sampler off.
+ ******************************************************************************/
+unsigned int ProcessNodeReportSamplingInterval(const char* args) {
+  if (strlen(args) == 0) {
+    std::cerr << "Missing argument for node-report sampling interval option\n";
+    return 0;
+  }
+  char* suffix = nullptr;
+  unsigned long interval = strtoul(args, &suffix, 10);
+  if (suffix == args || *suffix != '\0') {
+    std::cerr << "Unrecognised argument for node-report sampling interval option: " << args << "\n";
+    return 0;
+  }
+  if (interval > NR_SAMPLE_INTERVAL_MAX) {
+    std::cerr << "Sampling interval for node-report must not exceed " << NR_SAMPLE_INTERVAL_MAX
+              << " milliseconds: " << args << "\n";
+    return 0;
+  }
+  return static_cast<unsigned int>(interval);
+}
+
+/*******************************************************************************
+ * Function to process node-report config: threadpool probe interval.
+ * Interval in milliseconds, 0 to turn the probe off.
+ ******************************************************************************/
+unsigned int ProcessNodeReportThreadpoolProbeInterval(const char* args) {
+  if (strlen(args) == 0) {
+    std::cerr << "Missing argument for node-report threadpool probe option\n";
+    return 0;
+  }
+  char* suffix = nullptr;
+  unsigned long interval = strtoul(args, &suffix, 10);
+  if (suffix == args || *suffix != '\0') {
+    std::cerr << "Unrecognised argument for node-report threadpool probe option: " << args << "\n";
+    return 0;
+  }
+  if (interval > NR_PROBE_INTERVAL_MAX) {
+    std::cerr << "Threadpool probe interval for node-report must not exceed " << NR_PROBE_INTERVAL_MAX
+              << " milliseconds: " << args << "\n";
+    return 0;
+  }
+  return static_cast<unsigned int>(interval);
+}
+
+/*******************************************************************************
+ * Function to process node-report config: handle limit. Number of handles
+ * listed in detail before the handle summary is aggregated, 0 for no limit.
+ ******************************************************************************/
+size_t ProcessNodeReportHandleLimit(const char* args) {
+  if (strlen(args) == 0) {
+    std::cerr << "Missing argument for node-report handle limit option\n";
+    return 0;
+  }
+  if (!strcmp(args, "none")) {
+    return 0;
+  }
+  char* suffix = nullptr;
+  unsigned long limit = strtoul(args, &suffix, 10);
+  if (suffix == args || *suffix != '\0' || limit == 0) {
+    std::cerr << "Unrecognised argument for node-report handle limit option: " << args << "\n";
+    return 0;
+  }
+  return static_cast<size_t>(limit);
+}
+
+/*******************************************************************************
+ * Function to process node-report config: event loop stall threshold.
+ * Threshold in milliseconds, the default is used if the argument is invalid.
+ ******************************************************************************/
+unsigned int ProcessNodeReportStallThreshold(const char* args) {
+  if (strlen(args) == 0) {
+    std::cerr << "Missing argument for node-report stall threshold option\n";
+    return NR_STALL_THRESHOLD_DEFAULT;
+  }
+  char* suffix = nullptr;
+  unsigned long threshold = strtoul(args, &suffix, 10);
+  if (suffix == args || *suffix != '\0') {
+    std::cerr << "Unrecognised argument for node-report stall threshold option: " << args << "\n";
+    return NR_STALL_THRESHOLD_DEFAULT;
+  }
+  if (threshold < NR_STALL_THRESHOLD_MIN) {
+    std::cerr << "Stall threshold for node-report must be at least " << NR_STALL_THRESHOLD_MIN
+              << " milliseconds: " << args << "\n";
+    return NR_STALL_THRESHOLD_DEFAULT;
+  }
+  return static_cast<unsigned int>(threshold);
+}
+
+/*******************************************************************************
+ * Function to process node-report config: asynchronous report writing switch.
+ ******************************************************************************/
+unsigned int ProcessNodeReportAsyncSwitch(const char* args) {
+  if (strlen(args) == 0) {
+    std::cerr << "Missing argument for node-report async switch option\n";
+    return 0;
+  }
+  // Parse the supplied switch
+  if (!strncmp(args, "yes", sizeof("yes") - 1) || !strncmp(args, "true", sizeof("true") - 1)) {
+    return 1;
+  } else if (!strncmp(args, "no", sizeof("no") - 1) || !strncmp(args, "false", sizeof("false") - 1)) {
+    return 0;
+  } else {
+    std::cerr << "Unrecognised argument for node-report async switch option: " << args << "\n";
+  }
+  return 0;  // Default is synchronous report writing
+}
+
+/*******************************************************************************
+ * Function to process node-report config: delta report switch.
+ ******************************************************************************/
+unsigned int ProcessNodeReportDeltaSwitch(const char* args) {
+  if (strlen(args) == 0) {
+    std::cerr << "Missing argument for node-report delta switch option\n";
+    return 0;
+  }
+  // Parse the supplied switch
+  if (!strncmp(args, "yes", sizeof("yes") - 1) || !strncmp(args, "true", sizeof("true") - 1)) {
+    return 1;
+  } else if (!strncmp(args, "no", sizeof("no") - 1) || !strncmp(args, "false", sizeof("false") - 1)) {
+    return 0;
+  } else {
+    std::cerr << "Unrecognised argument for node-report delta switch option: " << args << "\n";
+  }
+  return 0;  // Default is full reports
+}
+
+/*******************************************************************************
+ * Function to process node-report config: resolve names switch.
+ ******************************************************************************/
+unsigned int ProcessNodeReportResolveNamesSwitch(const char* args) {
+  if (strlen(args) == 0) {
+    std::cerr << "Missing argument for node-report resolve names switch option\n";
+    return 0;
+  }
+  // Parse the supplied switch
+  if (!strncmp(args, "yes", sizeof("yes") - 1) || !strncmp(args, "true", sizeof("true") - 1)) {
+    return 1;
+  } else if (!strncmp(args, "no", sizeof("no") - 1) || !strncmp(args, "false", sizeof("false") - 1)) {
+    return 0;
+  } else {
+    std::cerr << "Unrecognised argument for node-report resolve names switch option: " << args << "\n";
+  }
+  return 0;  // Default is numeric addresses
+}
+
 /*******************************************************************************
  * Function to save the node and subcomponent version strings. This is called
  * during node-report module initialisation.
@@ -129,6 +580,8 @@ void SetVersionString(Isolate* isolate) {
   // Catch anything thrown and gracefully return
   Nan::TryCatch trycatch;
   version_string = UNKNOWN_NODEVERSION_STRING;
+  nodejs_version = "";
+  component_versions.clear();
 
   // Retrieve the process object
   v8::Local<v8::String> process_prop;
@@ -148,6 +601,7 @@ void SetVersionString(Isolate* isolate) {
   // e.g. Node.js version: v6.9.1
   if (version->IsString()) {
     Nan::Utf8String node_version(version);
+    nodejs_version = *node_version;
     version_string = "Node.js version: ";
     version_string += *node_version;
     version_string += "\n";
@@ -181,11 +635,14 @@ void SetVersionString(Isolate* isolate) {
     if (!strcmp("node", *component_name)) {
       // Put the Node.js version on the first line, if we didn't already have it
       if (version_string == UNKNOWN_NODEVERSION_STRING) {
+        nodejs_version = std::string("v") + *component_version;
         version_string = "Node.js version: v";
         version_string += *component_version;
         version_string += "\n";
       }
     } else {
+      component_versions.push_back(std::make_pair(std::string(*component_name),
+                                                  std::string(*component_version)));
       // Other component versions follow, comma separated, wrapped at 80 characters
       std::string comp_version_string = *component_name;
       comp_version_string += ": ";
@@ -298,71 +755,232 @@ void SetCommandLine() {
 }
 
 /*******************************************************************************
- * Utility function to format socket information.
- *******************************************************************************/
-void reportEndpoint(uv_handle_t* h, struct sockaddr* addr, const char* prefix,
-                    std::ostringstream& out) {
-  uv_getnameinfo_t endpoint;
-  if (uv_getnameinfo(h->loop, &endpoint, nullptr, addr, NI_NUMERICSERV) == 0) {
+ * Functions to maintain the host name cache used by the resolve names option.
+ *  - LookupHostName() - return a cached name, queueing a lookup on a miss
+ *  - ResolverThreadMain() - implementation of the resolver thread
+ *
+ * Reports never wait for a reverse DNS lookup. Addresses missing from the
+ * cache are resolved by the resolver thread, and the names are kept for
+ * NR_HOST_NAME_TTL seconds for later reports to use.
+ ******************************************************************************/
+struct HostName {
+  std::string name;  // empty if the address has no name
+  time_t expires;    // 0 while the lookup is pending
+};
+struct HostNameLookup {
+  std::string host;  // numeric address, the cache key
+  SocketAddress address;
+};
+static uv_once_t resolver_once = UV_ONCE_INIT;
+static bool resolver_initialised = false;
+static uv_thread_t resolver_thread;
+static uv_mutex_t resolver_mutex;
+static uv_cond_t resolver_cond;  // signalled when a lookup is queued
+static std::deque<HostNameLookup> resolver_queue;
+static std::unordered_map<std::string, HostName> host_names;
+
+static socklen_t addressSize(const SocketAddress& address) {
+  return address.sa.sa_family == AF_INET6 ? sizeof(address.in6)
+                                          : sizeof(address.in4);
+}
+
+static void ResolverThreadMain(void* unused) {
+  uv_mutex_lock(&resolver_mutex);
+  for (;;) {
+    while (resolver_queue.empty()) {
+      uv_cond_wait(&resolver_cond, &resolver_mutex);
+    }
+    HostNameLookup lookup = resolver_queue.front();
+    resolver_queue.pop_front();
+    uv_mutex_unlock(&resolver_mutex);
+
+    char name_buf[NI_MAXHOST];
+    const int rc = getnameinfo(&lookup.address.sa, addressSize(lookup.address),
+                               name_buf, sizeof(name_buf), nullptr, 0, NI_NAMEREQD);
 #ifdef __MVS__
-    if (__isASCII() == 0) {
-      __e2a_s(endpoint.host);
-      __e2a_s(endpoint.service);
+    if (rc == 0 && __isASCII() == 0) {
+      __e2a_s(name_buf);
     }
 #endif
-    out << prefix << endpoint.host << ":" << endpoint.service;
+
+    uv_mutex_lock(&resolver_mutex);
+    HostName& entry = host_names[lookup.host];
+    entry.name = rc == 0 ? name_buf : "";
+    entry.expires = time(nullptr) + NR_HOST_NAME_TTL;
+  }
+}
+
+static void InitResolver() {
+  if (uv_mutex_init(&resolver_mutex) != 0 || uv_cond_init(&resolver_cond) != 0 ||
+      uv_thread_create(&resolver_thread, ResolverThreadMain, nullptr) != 0) {
+    std::cerr << "node-report: unable to start host name resolver thread\n";
+    return;
+  }
+  resolver_initialised = true;
+}
+
+static void LookupHostName(const std::string& host, const SocketAddress& address,
+                           std::string* name) {
+  uv_once(&resolver_once, InitResolver);
+  if (!resolver_initialised) {
+    return;
+  }
+  const time_t now = time(nullptr);
+  uv_mutex_lock(&resolver_mutex);
+  auto entry = host_names.find(host);
+  if (entry != host_names.end() && (entry->second.expires == 0 || entry->second.expires > now)) {
+    // Cached, or the lookup is still pending
+    if (!entry->second.name.empty()) {
+      *name = entry->second.name;
+    }
   } else {
-    char host[INET6_ADDRSTRLEN];
-    const int family = addr->sa_family;
-    const void* src = family == AF_INET ?
-                      static_cast<void*>(
-                        &(reinterpret_cast<sockaddr_in*>(addr)->sin_addr)) :
-                      static_cast<void*>(
-                        &(reinterpret_cast<sockaddr_in6*>(addr)->sin6_addr));
-    if (uv_inet_ntop(family, src, host, sizeof(host)) == 0) {
-      const int port = ntohs(family == AF_INET ?
-                             reinterpret_cast<sockaddr_in*>(addr)->sin_port :
-                             reinterpret_cast<sockaddr_in6*>(addr)->sin6_port);
-#ifdef __MVS__
-      if (__isASCII() == 0) {
-        __e2a_s(host);
+    if (entry == host_names.end() && host_names.size() >= NR_HOST_NAME_CACHE_SIZE) {
+      for (auto it = host_names.begin(); it != host_names.end();) {
+        if (it->second.expires != 0 && it->second.expires <= now) {
+          it = host_names.erase(it);
+        } else {
+          ++it;
+        }
       }
-#endif
-      out << prefix << host << ":" << port;
+    }
+    if (entry != host_names.end() || host_names.size() < NR_HOST_NAME_CACHE_SIZE) {
+      host_names[host].expires = 0;
+      HostNameLookup lookup;
+      lookup.host = host;
+      lookup.address = address;
+      resolver_queue.push_back(lookup);
+      uv_cond_signal(&resolver_cond);
     }
   }
+  uv_mutex_unlock(&resolver_mutex);
 }
 
 /*******************************************************************************
- * Utility function to format libuv socket information.
+ * Utility function to resolve socket information. The address is formatted
+ * numerically, or with a cached host name if the resolve names option is set.
+ *******************************************************************************/
+static bool resolveEndpoint(const SocketAddress& address, std::string* host,
+                            int* port) {
+  const int family = address.sa.sa_family;
+  const void* src = family == AF_INET ?
+                    static_cast<const void*>(&(address.in4.sin_addr)) :
+                    static_cast<const void*>(&(address.in6.sin6_addr));
+  char host_buf[INET6_ADDRSTRLEN];
+  if (uv_inet_ntop(family, src, host_buf, sizeof(host_buf)) != 0) {
+    return false;
+  }
+#ifdef __MVS__
+  if (__isASCII() == 0) {
+    __e2a_s(host_buf);
+  }
+#endif
+  *host = host_buf;
+  *port = ntohs(family == AF_INET ? address.in4.sin_port : address.in6.sin6_port);
+  if (nodereport_resolve_names) {
+    LookupHostName(host_buf, address, host);
+  }
+  return true;
+}
+
+/*******************************************************************************
+ * Utility function to format socket information.
+ *******************************************************************************/
+static void reportEndpoint(const SocketAddress& address, const char* prefix,
+                           std::ostream& out) {
+  std::string host;
+  int port;
+  if (resolveEndpoint(address, &host, &port)) {
+    out << prefix << host << ":" << port;
+  }
+}
+
+/*******************************************************************************
+ * Utility function to write socket information as a JSON object.
+ *******************************************************************************/
+static void reportEndpoint(const SocketAddress& address, const char* key,
+                           ReportWriter& writer) {
+  std::string host;
+  int port;
+  if (resolveEndpoint(address, &host, &port)) {
+    writer.ObjectStart(key);
+    writer.KeyValue("host", host);
+    writer.KeyValue("port", port);
+    writer.ObjectEnd();
+  }
+}
+
+/*******************************************************************************
+ * Utility function to capture the kernel statistics for a tcp socket. For a
+ * listening socket the kernel reports the accept queue length and backlog in
+ * place of the unacknowledged and selectively acknowledged segment counts.
+ *******************************************************************************/
+static bool captureTcpInfo(uv_handle_t* h, TcpInfo* info) {
+#ifdef __linux__
+  uv_os_fd_t fd;
+  struct tcp_info tcp;
+  socklen_t length = sizeof(tcp);
+  if (uv_fileno(h, &fd) != 0 || getsockopt(fd, IPPROTO_TCP, TCP_INFO, &tcp, &length) != 0) {
+    return false;
+  }
+  info->listening = tcp.tcpi_state == TCP_LISTEN;
+  info->connected = tcp.tcpi_state != TCP_LISTEN && tcp.tcpi_state != TCP_CLOSE &&
+                    tcp.tcpi_state != TCP_SYN_SENT && tcp.tcpi_state != TCP_SYN_RECV;
+  if (info->listening) {
+    info->accept_queue = tcp.tcpi_unacked;
+    info->accept_backlog = tcp.tcpi_sacked;
+    return true;
+  }
+  info->rtt = tcp.tcpi_rtt;
+  info->rtt_var = tcp.tcpi_rttvar;
+  info->retransmits = tcp.tcpi_total_retrans;
+  info->cwnd = tcp.tcpi_snd_cwnd;
+  info->unacked = tcp.tcpi_unacked;
+  // Segments in flight, as the kernel counts them for congestion control
+  const uint64_t left = static_cast<uint64_t>(tcp.tcpi_sacked) + tcp.tcpi_lost;
+  const uint64_t in_flight = tcp.tcpi_unacked > left ? tcp.tcpi_unacked - left : 0;
+  info->bytes_in_flight = (in_flight + tcp.tcpi_retrans) * tcp.tcpi_snd_mss;
+  return true;
+#else
+  return false;
+#endif
+}
+
+/*******************************************************************************
+ * Utility function to capture libuv socket information.
  *******************************************************************************/
-void reportEndpoints(uv_handle_t* h, std::ostringstream& out) {
-  struct sockaddr_storage addr_storage;
-  struct sockaddr* addr = (sockaddr*)&addr_storage;
+static void captureEndpoints(uv_handle_t* h, HandleInfo* info) {
   uv_any_handle* handle = (uv_any_handle*)h;
-  int addr_size = sizeof(addr_storage);
-  int rc = -1;
+  int addr_size = sizeof(info->local);
 
   switch (h->type) {
     case UV_UDP: {
-      rc = uv_udp_getsockname(&(handle->udp), addr, &addr_size);
+      info->local_rc = uv_udp_getsockname(&(handle->udp), &info->local.sa, &addr_size);
       break;
     }
     case UV_TCP: {
-      rc = uv_tcp_getsockname(&(handle->tcp), addr, &addr_size);
+      info->local_rc = uv_tcp_getsockname(&(handle->tcp), &info->local.sa, &addr_size);
+      if (info->local_rc == 0) {
+        // Get the remote end of the connection.
+        addr_size = sizeof(info->peer);
+        info->peer_rc = uv_tcp_getpeername(&(handle->tcp), &info->peer.sa, &addr_size);
+      }
       break;
     }
     default: break;
   }
-  if (rc == 0) {
-    reportEndpoint(h, addr, "", out);
+}
 
-    if (h->type == UV_TCP) {
-      // Get the remote end of the connection.
-      rc = uv_tcp_getpeername(&(handle->tcp), addr, &addr_size);
-      if (rc == 0) {
-        reportEndpoint(h, addr, " connected to ", out);
-      } else if (rc == UV_ENOTCONN) {
+/*******************************************************************************
+ * Utility function to format libuv socket information.
+ *******************************************************************************/
+static void reportEndpoints(const HandleInfo& info, std::ostream& out) {
+  if (info.local_rc == 0) {
+    reportEndpoint(info.local, "", out);
+
+    if (info.type == UV_TCP) {
+      if (info.peer_rc == 0) {
+        reportEndpoint(info.peer, " connected to ", out);
+      } else if (info.peer_rc == UV_ENOTCONN) {
         out << " (not connected)";
       }
     }
@@ -370,9 +988,9 @@ void reportEndpoints(uv_handle_t* h, std::ostringstream& out) {
 }
 
 /*******************************************************************************
- * Utility function to format libuv path information.
+ * Utility function to capture libuv path information.
  *******************************************************************************/
-void reportPath(uv_handle_t* h, std::ostringstream& out) {
+static void capturePath(uv_handle_t* h, HandleInfo* info) {
   char *buffer = nullptr;
   int rc = -1;
   size_t size = 0;
@@ -408,63 +1026,226 @@ void reportPath(uv_handle_t* h, std::ostringstream& out) {
       if (__isASCII() == 0) {
         char *tmpbuf = (char*)malloc(size);
         _convert_e2a(tmpbuf, buffer, size);
-        std::string name(tmpbuf, size);
+        info->path.assign(tmpbuf, size);
         free(tmpbuf);
-        out << "filename: " << name;
       } else {
-        std::string name(buffer, size);
-        out << "filename: " << name;
+        info->path.assign(buffer, size);
       }
 #else
-      std::string name(buffer, size);
-      out << "filename: " << name;
+      info->path.assign(buffer, size);
 #endif
+      info->has_path = true;
     }
     free(buffer);
   }
 }
 
 /*******************************************************************************
- * Utility function to walk libuv handles.
+ * Functions to capture the libuv handles on an event loop.
+ *  - CaptureHandles() - walk the handles, aggregating them if there are more
+ *    than nodereport_handle_limit
+ *  - walkHandle() - uv_walk() callback
+ *
+ * Every handle is counted into a group by type, flags and remote address, but
+ * only the first handles up to the limit are captured in detail, avoiding the
+ * buffer size and file descriptor calls for the rest. The handles with the
+ * largest write queues are captured in detail after the walk.
  *******************************************************************************/
-void walkHandle(uv_handle_t* h, void* arg) {
-  std::string type;
-  std::ostringstream data;
-  std::ostream* out = reinterpret_cast<std::ostream*>(arg);
+typedef std::tuple<uv_handle_type, bool, bool, std::string> HandleGroupKey;
+struct HandleWalk {
+  std::vector<HandleInfo>* handles;
+  HandleAggregate* aggregate;
+  size_t limit;
+  std::map<HandleGroupKey, HandleGroup> groups;
+  std::vector<std::pair<size_t, uv_handle_t*> > busiest;  // min-heap on write queue size
+  std::vector<std::pair<size_t, uv_handle_t*> > most_retransmits;  // min-heap on retransmits
+};
+
+static std::string peerAddress(uv_handle_t* h, const HandleInfo* info) {
+  SocketAddress peer;
+  if (info != nullptr) {
+    if (info->peer_rc != 0) {
+      return "";
+    }
+    peer = info->peer;
+  } else {
+    int addr_size = sizeof(peer);
+    if (uv_tcp_getpeername(reinterpret_cast<uv_tcp_t*>(h), &peer.sa, &addr_size) != 0) {
+      return "";
+    }
+  }
+  const int family = peer.sa.sa_family;
+  const void* src = family == AF_INET ?
+                    static_cast<const void*>(&(peer.in4.sin_addr)) :
+                    static_cast<const void*>(&(peer.in6.sin6_addr));
+  char host_buf[INET6_ADDRSTRLEN];
+  if (uv_inet_ntop(family, src, host_buf, sizeof(host_buf)) != 0) {
+    return "";
+  }
+#ifdef __MVS__
+  if (__isASCII() == 0) {
+    __e2a_s(host_buf);
+  }
+#endif
+  return host_buf;
+}
+
+static bool busierHandle(const std::pair<size_t, uv_handle_t*>& a,
+                         const std::pair<size_t, uv_handle_t*>& b) {
+  return a.first > b.first;
+}
+
+// Keep the 'size' largest handles in a min-heap
+static void keepLargest(std::vector<std::pair<size_t, uv_handle_t*> >* heap, size_t value,
+                        uv_handle_t* h, size_t size) {
+  heap->push_back(std::make_pair(value, h));
+  std::push_heap(heap->begin(), heap->end(), busierHandle);
+  if (heap->size() > size) {
+    std::pop_heap(heap->begin(), heap->end(), busierHandle);
+    heap->pop_back();
+  }
+}
+
+static unsigned int rttBucket(uint32_t rtt) {
+  unsigned int bucket = 0;
+  while (rtt > 1 && bucket < NR_TCP_RTT_BUCKETS - 1) {
+    rtt >>= 1;
+    bucket++;
+  }
+  return bucket;
+}
+
+// Add a tcp handle to the connection summary. Handles beyond the handle limit
+// are summarised too, as reading TCP_INFO takes one getsockopt() call and no
+// allocation.
+static void summariseTcp(uv_handle_t* h, bool has_tcp_info, const TcpInfo& tcp,
+                         HandleWalk* walk) {
+  TcpSummary& summary = walk->aggregate->tcp;
+  summary.examined++;
+  if (!has_tcp_info || !tcp.connected) {
+    return;
+  }
+  summary.connections++;
+  summary.rtt_histogram[rttBucket(tcp.rtt)]++;
+  if (tcp.retransmits > 0) {
+    keepLargest(&walk->most_retransmits, tcp.retransmits, h, NR_TCP_MOST_RETRANSMITS);
+  }
+}
+
+// Capture the handles kept in a min-heap, largest first. The handles are
+// still open, as no callbacks have run since the walk.
+static void captureLargest(std::vector<std::pair<size_t, uv_handle_t*> >* heap,
+                           std::vector<HandleInfo>* handles) {
+  std::sort_heap(heap->begin(), heap->end(), busierHandle);
+  for (const auto& largest : *heap) {
+    handles->push_back(HandleInfo());
+    captureHandle(largest.second, &handles->back(), true);
+  }
+}
+
+static void walkHandle(uv_handle_t* h, void* arg) {
+  HandleWalk* walk = static_cast<HandleWalk*>(arg);
+  const size_t index = walk->aggregate->count++;
+  const HandleInfo* info = nullptr;
+  if (walk->limit == 0 || index < walk->limit) {
+    walk->handles->push_back(HandleInfo());
+    captureHandle(h, &walk->handles->back(), true);
+    info = &walk->handles->back();
+    if (h->type == UV_TCP) {
+      summariseTcp(h, info->has_tcp_info, info->tcp_info, walk);
+    }
+  } else if (h->type == UV_TCP) {
+    TcpInfo tcp = TcpInfo();
+    const bool has_tcp_info = captureTcpInfo(h, &tcp);
+    summariseTcp(h, has_tcp_info, tcp, walk);
+  }
+  if (walk->limit == 0) {
+    return;
+  }
+
+  const bool has_ref = uv_has_ref(h);
+  const bool is_active = uv_is_active(h);
+  const std::string peer = h->type == UV_TCP ? peerAddress(h, info) : "";
+  size_t write_queue_size = 0;
+  if (h->type == UV_TCP || h->type == UV_NAMED_PIPE || h->type == UV_TTY) {
+    write_queue_size = reinterpret_cast<uv_stream_t*>(h)->write_queue_size;
+  }
+  HandleGroup& group = walk->groups[HandleGroupKey(h->type, has_ref, is_active, peer)];
+  if (group.count == 0) {
+    group.type = h->type;
+    group.has_ref = has_ref;
+    group.is_active = is_active;
+    group.peer = peer;
+  }
+  group.count++;
+  group.write_queue_size += write_queue_size;
+
+  if (write_queue_size > 0) {
+    keepLargest(&walk->busiest, write_queue_size, h, NR_HANDLE_BUSIEST);
+  }
+}
+
+static bool largerGroup(const HandleGroup& a, const HandleGroup& b) {
+  return a.count > b.count;
+}
+
+void CaptureHandles(uv_loop_t* loop, std::vector<HandleInfo>* handles,
+                    HandleAggregate* aggregate) {
+  HandleWalk walk;
+  walk.handles = handles;
+  walk.aggregate = aggregate;
+  walk.limit = nodereport_handle_limit;
+  uv_walk(loop, walkHandle, &walk);
+  captureLargest(&walk.most_retransmits, &aggregate->tcp.most_retransmits);
+  if (walk.limit == 0 || aggregate->count <= walk.limit) {
+    return;
+  }
+
+  aggregate->limit = walk.limit;
+  aggregate->groups.reserve(walk.groups.size());
+  for (const auto& group : walk.groups) {
+    aggregate->groups.push_back(group.second);
+  }
+  std::stable_sort(aggregate->groups.begin(), aggregate->groups.end(), largerGroup);
+  if (aggregate->groups.size() > walk.limit) {
+    aggregate->groups_omitted = aggregate->groups.size() - walk.limit;
+    aggregate->groups.resize(walk.limit);
+  }
+  captureLargest(&walk.busiest, &aggregate->busiest);
+}
+
+/*******************************************************************************
+ * Utility function to capture the information for a libuv handle. The path of
+ * fs_event and fs_poll handles is only captured if requested, as it requires a
+ * heap allocation. The HandleInfo must be value-initialised.
+ *******************************************************************************/
+void captureHandle(uv_handle_t* h, HandleInfo* info, bool capture_path) {
   uv_any_handle* handle = (uv_any_handle*)h;
+  info->type = h->type;
+  info->address = h;
+  info->has_ref = uv_has_ref(h);
+  info->is_active = uv_is_active(h);
+  info->fd = -1;
+  info->local_rc = -1;
+  info->peer_rc = -1;
 
-  // List all the types so we get a compile warning if we've missed one,
-  // (using default: supresses the compiler warning).
   switch (h->type) {
-    case UV_UNKNOWN_HANDLE: type = "unknown"; break;
-    case UV_ASYNC: type = "async"; break;
-    case UV_CHECK: type = "check"; break;
-    case UV_FS_EVENT: {
-      type = "fs_event";
-      reportPath(h, data);
+    case UV_FS_EVENT:
+    case UV_FS_POLL:
+      if (capture_path) {
+        capturePath(h, info);
+      }
       break;
-    }
-    case UV_FS_POLL: {
-      type = "fs_poll";
-      reportPath(h, data);
+    case UV_PROCESS:
+      info->pid = handle->process.pid;
       break;
-    }
-    case UV_HANDLE: type = "handle"; break;
-    case UV_IDLE: type = "idle"; break;
-    case UV_NAMED_PIPE: type = "pipe"; break;
-    case UV_POLL: type = "poll"; break;
-    case UV_PREPARE: type = "prepare"; break;
-    case UV_PROCESS: {
-      type = "process";
-      data << "pid: " << handle->process.pid;
+    case UV_TCP:
+      captureEndpoints(h, info);
+      info->has_tcp_info = captureTcpInfo(h, &info->tcp_info);
       break;
-    }
-    case UV_STREAM: type = "stream"; break;
-    case UV_TCP: {
-      type = "tcp";
-      reportEndpoints(h, data);
+    case UV_UDP:
+      captureEndpoints(h, info);
       break;
-    }
     case UV_TIMER: {
       // TODO timeout/due is not actually public however it is present
       // in all current versions of libuv. Once uv_timer_get_timeout is
@@ -474,45 +1255,22 @@ void walkHandle(uv_handle_t* h, void* arg) {
       // On Windows in libuv 1.22 and later the `due` member was renamed
       // to `timeout` for consistency with the other platforms.
 #if defined(_WIN32) && (UV_VERSION_HEX < ((1 << 16) | (22 << 8)))
-      uint64_t due = handle->timer.due;
+      info->timer_due = handle->timer.due;
 #else
-      uint64_t due = handle->timer.timeout;
+      info->timer_due = handle->timer.timeout;
 #endif
-      uint64_t now = uv_now(handle->timer.loop);
-      type = "timer";
-      data << "repeat: " << uv_timer_get_repeat(&(handle->timer));
-      if (due > now) {
-          data << ", timeout in: " << (due - now) << " ms";
-      } else {
-          data << ", timeout expired: " << (now - due) << " ms ago";
-      }
+      info->timer_now = uv_now(handle->timer.loop);
+      info->timer_repeat = uv_timer_get_repeat(&(handle->timer));
       break;
     }
-    case UV_TTY: {
-      int height, width, rc;
-      type = "tty";
-      rc = uv_tty_get_winsize(&(handle->tty), &width, &height);
-      if (rc == 0) {
-        data << "width: " << width << ", height: " << height;
-      }
+    case UV_TTY:
+      info->tty_rc = uv_tty_get_winsize(&(handle->tty), &info->tty_width,
+                                        &info->tty_height);
       break;
-    }
-    case UV_UDP: {
-      type = "udp";
-      reportEndpoints(h, data);
-      break;
-    }
-    case UV_SIGNAL: {
-      // SIGWINCH is used by libuv so always appears.
-      // See http://docs.libuv.org/en/v1.x/signal.html
-      type = "signal";
-      data << "signum: " << handle->signal.signum
-           << " (" << SignoString(handle->signal.signum) << ")";
+    case UV_SIGNAL:
+      info->signum = handle->signal.signum;
       break;
-    }
-    case UV_FILE: type = "file"; break;
-    // We shouldn't see "max" type
-    case UV_HANDLE_TYPE_MAX : type = "max"; break;
+    default: break;
   }
 
   if (h->type == UV_TCP || h->type == UV_UDP
@@ -522,56 +1280,418 @@ void walkHandle(uv_handle_t* h, void* arg) {
       ) {
     // These *must* be 0 or libuv will set the buffer sizes to the non-zero
     // values they contain.
-    int send_size = 0;
-    int recv_size = 0;
-    if (h->type == UV_TCP || h->type == UV_UDP) {
-      data << ", ";
-    }
-    uv_send_buffer_size(h, &send_size);
-    uv_recv_buffer_size(h, &recv_size);
-    data << "send buffer size: " << send_size
-         << ", recv buffer size: " << recv_size;
+    info->send_buffer_size = 0;
+    info->recv_buffer_size = 0;
+    uv_send_buffer_size(h, &info->send_buffer_size);
+    uv_recv_buffer_size(h, &info->recv_buffer_size);
+    info->has_buffer_sizes = true;
   }
 
+#ifndef _WIN32
+  // uv_os_fd_t is an int on Unix and HANDLE on Windows.
   if (h->type == UV_TCP || h->type == UV_NAMED_PIPE || h->type == UV_TTY ||
       h->type == UV_UDP || h->type == UV_POLL) {
     uv_os_fd_t fd_v;
-    uv_os_fd_t* fd = &fd_v;
-    int rc  = uv_fileno(h, fd);
-    // uv_os_fd_t is an int on Unix and HANDLE on Windows.
-#ifndef _WIN32
-    if (rc == 0) {
-      switch (fd_v) {
-      case 0:
-        data << ", stdin"; break;
-      case 1:
-        data << ", stdout"; break;
-      case 2:
-        data << ", stderr"; break;
-      default:
-        data << ", file descriptor: " << static_cast<int>(fd_v);
-        break;
-      }
+    if (uv_fileno(h, &fd_v) == 0) {
+      info->fd = static_cast<int>(fd_v);
     }
-#endif
   }
+#endif
 
   if (h->type == UV_TCP || h->type == UV_NAMED_PIPE || h->type == UV_TTY) {
+    info->is_stream = true;
+    info->write_queue_size = handle->stream.write_queue_size;
+    info->readable = uv_is_readable(&handle->stream);
+    info->writable = uv_is_writable(&handle->stream);
+  }
+}
+
+/*******************************************************************************
+ * Utility function to name a libuv handle type.
+ *******************************************************************************/
+const char* handleTypeName(uv_handle_type type) {
+  // List all the types so we get a compile warning if we've missed one,
+  // (using default: supresses the compiler warning).
+  switch (type) {
+    case UV_UNKNOWN_HANDLE: return "unknown";
+    case UV_ASYNC: return "async";
+    case UV_CHECK: return "check";
+    case UV_FS_EVENT: return "fs_event";
+    case UV_FS_POLL: return "fs_poll";
+    case UV_HANDLE: return "handle";
+    case UV_IDLE: return "idle";
+    case UV_NAMED_PIPE: return "pipe";
+    case UV_POLL: return "poll";
+    case UV_PREPARE: return "prepare";
+    case UV_PROCESS: return "process";
+    case UV_STREAM: return "stream";
+    case UV_TCP: return "tcp";
+    case UV_TIMER: return "timer";
+    case UV_TTY: return "tty";
+    case UV_UDP: return "udp";
+    case UV_SIGNAL: return "signal";
+    case UV_FILE: return "file";
+    // We shouldn't see "max" type
+    case UV_HANDLE_TYPE_MAX : return "max";
+  }
+  return "unknown";
+}
+
+/*******************************************************************************
+ * Utility function to print the information captured for a libuv handle.
+ *******************************************************************************/
+void PrintHandle(std::ostream& out, const HandleInfo& info) {
+  std::ostringstream data;
+
+  switch (info.type) {
+    case UV_FS_EVENT:
+    case UV_FS_POLL: {
+      if (info.has_path) {
+        data << "filename: " << info.path;
+      }
+      break;
+    }
+    case UV_PROCESS: {
+      data << "pid: " << info.pid;
+      break;
+    }
+    case UV_TCP:
+    case UV_UDP: {
+      reportEndpoints(info, data);
+      break;
+    }
+    case UV_TIMER: {
+      data << "repeat: " << info.timer_repeat;
+      if (info.timer_due > info.timer_now) {
+          data << ", timeout in: " << (info.timer_due - info.timer_now) << " ms";
+      } else {
+          data << ", timeout expired: " << (info.timer_now - info.timer_due) << " ms ago";
+      }
+      break;
+    }
+    case UV_TTY: {
+      if (info.tty_rc == 0) {
+        data << "width: " << info.tty_width << ", height: " << info.tty_height;
+      }
+      break;
+    }
+    case UV_SIGNAL: {
+      // SIGWINCH is used by libuv so always appears.
+      // See http://docs.libuv.org/en/v1.x/signal.html
+      data << "signum: " << info.signum
+           << " (" << SignoString(info.signum) << ")";
+      break;
+    }
+    default: break;
+  }
+
+  if (info.has_buffer_sizes) {
+    if (info.type == UV_TCP || info.type == UV_UDP) {
+      data << ", ";
+    }
+    data << "send buffer size: " << info.send_buffer_size
+         << ", recv buffer size: " << info.recv_buffer_size;
+  }
+
+  if (info.fd >= 0) {
+    switch (info.fd) {
+    case 0:
+      data << ", stdin"; break;
+    case 1:
+      data << ", stdout"; break;
+    case 2:
+      data << ", stderr"; break;
+    default:
+      data << ", file descriptor: " << info.fd;
+      break;
+    }
+  }
+
+  if (info.is_stream) {
 
     data << ", write queue size: "
-         << handle->stream.write_queue_size;
-    data << (uv_is_readable(&handle->stream) ? ", readable" : "")
-         << (uv_is_writable(&handle->stream) ? ", writable": "");
+         << info.write_queue_size;
+    data << (info.readable ? ", readable" : "")
+         << (info.writable ? ", writable": "");
+
+  }
+
+  if (info.has_tcp_info) {
+    const TcpInfo& tcp = info.tcp_info;
+    if (tcp.listening) {
+      data << ", accept queue: " << tcp.accept_queue << " of " << tcp.accept_backlog;
+    } else if (tcp.connected) {
+      char rtt[64];
+      snprintf(rtt, sizeof(rtt), "%.3f ms (variation %.3f ms)", tcp.rtt / 1e3, tcp.rtt_var / 1e3);
+      data << ", rtt: " << rtt << ", retransmits: " << tcp.retransmits
+           << ", cwnd: " << tcp.cwnd << ", unacked: " << tcp.unacked
+           << ", bytes in flight: " << tcp.bytes_in_flight;
+    }
+  }
+
+  out << std::left << "[" << (info.has_ref ? 'R' : '-')
+      << (info.is_active ? 'A' : '-') << "]   " << std::setw(10)
+      << handleTypeName(info.type)
+      << std::internal << std::setw(2 + 2 * sizeof(void*));
+  char prev_fill = out.fill('0');
+  out << info.address << std::left;
+  out.fill(prev_fill);
+  out << "  " << std::left << data.str() << std::endl;
+}
+
+/*******************************************************************************
+ * Utility function to write the information captured for a libuv handle as a
+ * JSON object.
+ *******************************************************************************/
+void PrintHandle(ReportWriter& writer, const HandleInfo& info) {
+  char address[2 + 2 * sizeof(void*) + 1];
+  snprintf(address, sizeof(address), "0x%0*" PRIxPTR,
+           static_cast<int>(2 * sizeof(void*)),
+           reinterpret_cast<uintptr_t>(info.address));
+
+  writer.ObjectStart();
+  writer.KeyValue("type", handleTypeName(info.type));
+  writer.KeyValue("address", address);
+  writer.KeyValue("ref", info.has_ref);
+  writer.KeyValue("active", info.is_active);
+
+  switch (info.type) {
+    case UV_FS_EVENT:
+    case UV_FS_POLL: {
+      if (info.has_path) {
+        writer.KeyValue("filename", info.path);
+      }
+      break;
+    }
+    case UV_PROCESS: {
+      writer.KeyValue("pid", info.pid);
+      break;
+    }
+    case UV_TCP:
+    case UV_UDP: {
+      if (info.local_rc == 0) {
+        reportEndpoint(info.local, "localEndpoint", writer);
+        if (info.type == UV_TCP) {
+          if (info.peer_rc == 0) {
+            reportEndpoint(info.peer, "remoteEndpoint", writer);
+          } else if (info.peer_rc == UV_ENOTCONN) {
+            writer.KeyValue("connected", false);
+          }
+        }
+      }
+      break;
+    }
+    case UV_TIMER: {
+      writer.KeyValue("repeat", static_cast<unsigned long long>(info.timer_repeat));
+      if (info.timer_due > info.timer_now) {
+        writer.KeyValue("timeoutIn",
+                        static_cast<unsigned long long>(info.timer_due - info.timer_now));
+      } else {
+        writer.KeyValue("expiredAgo",
+                        static_cast<unsigned long long>(info.timer_now - info.timer_due));
+      }
+      break;
+    }
+    case UV_TTY: {
+      if (info.tty_rc == 0) {
+        writer.KeyValue("width", info.tty_width);
+        writer.KeyValue("height", info.tty_height);
+      }
+      break;
+    }
+    case UV_SIGNAL: {
+      writer.KeyValue("signum", info.signum);
+      writer.KeyValue("signal", SignoString(info.signum));
+      break;
+    }
+    default: break;
+  }
+
+  if (info.has_buffer_sizes) {
+    writer.KeyValue("sendBufferSize", info.send_buffer_size);
+    writer.KeyValue("recvBufferSize", info.recv_buffer_size);
+  }
+
+  if (info.fd >= 0) {
+    writer.KeyValue("fd", info.fd);
+  }
+
+  if (info.is_stream) {
+    writer.KeyValue("writeQueueSize", static_cast<unsigned long long>(info.write_queue_size));
+    writer.KeyValue("readable", info.readable);
+    writer.KeyValue("writable", info.writable);
+  }
+
+  if (info.has_tcp_info && (info.tcp_info.listening || info.tcp_info.connected)) {
+    const TcpInfo& tcp = info.tcp_info;
+    writer.ObjectStart("tcpInfo");
+    if (tcp.listening) {
+      writer.KeyValue("acceptQueue", tcp.accept_queue);
+      writer.KeyValue("acceptBacklog", tcp.accept_backlog);
+    } else {
+      writer.KeyValue("rtt", tcp.rtt / 1e3);
+      writer.KeyValue("rttVariation", tcp.rtt_var / 1e3);
+      writer.KeyValue("retransmits", tcp.retransmits);
+      writer.KeyValue("congestionWindow", tcp.cwnd);
+      writer.KeyValue("unacked", tcp.unacked);
+      writer.KeyValue("bytesInFlight", static_cast<unsigned long long>(tcp.bytes_in_flight));
+    }
+    writer.ObjectEnd();
+  }
+  writer.ObjectEnd();
+}
+
+/*******************************************************************************
+ * Utility functions to print the handles captured by CaptureHandles(), with
+ * the aggregated summary if there were more handles than the handle limit.
+ *******************************************************************************/
+static void PrintHandleTable(std::ostream& out, const std::vector<HandleInfo>& handles) {
+  out << std::left << std::setw(7) << "Flags" << std::setw(10) << "Type"
+      << std::setw(4 + 2 * sizeof(void*)) << "Address" << "Details"
+      << std::endl;
+  for (const HandleInfo& handle : handles) {
+    PrintHandle(out, handle);
+  }
+}
+
+// Round trip time histogram and the connections with the most retransmits,
+// for all the tcp handles on the event loop
+static void PrintTcpSummary(std::ostream& out, const TcpSummary& summary) {
+  if (summary.connections == 0) {
+    return;
+  }
+  out << "\nTCP connections: ";
+  WriteInteger(out, summary.connections);
+  out << "\n\nRound trip times (microseconds):\n";
+  out << std::right << std::setw(10) << "From" << std::setw(10) << "To" << std::setw(13)
+      << "Connections" << "\n";
+  // Only the range of buckets with connections in them is shown
+  unsigned int first = 0;
+  unsigned int last = NR_TCP_RTT_BUCKETS - 1;
+  while (summary.rtt_histogram[first] == 0) first++;
+  while (summary.rtt_histogram[last] == 0) last--;
+  for (unsigned int bucket = first; bucket <= last; bucket++) {
+    out << std::setw(10) << (bucket == 0 ? 0 : 1ULL << bucket);
+    if (bucket == NR_TCP_RTT_BUCKETS - 1) {
+      out << std::setw(10) << "-";
+    } else {
+      out << std::setw(10) << (2ULL << bucket);
+    }
+    out << std::setw(13) << summary.rtt_histogram[bucket] << "\n";
+  }
+  out << std::left;
+  if (summary.most_retransmits.empty()) {
+    out << "\nNo retransmits on any connection\n";
+  } else {
+    out << "\nConnections with the most retransmits:\n";
+    PrintHandleTable(out, summary.most_retransmits);
+  }
+}
+
+static void PrintTcpSummary(ReportWriter& writer, const HandleAggregate& aggregate) {
+  const TcpSummary& summary = aggregate.tcp;
+  if (summary.connections == 0) {
+    return;
+  }
+  writer.ObjectStart("tcpSummary");
+  writer.KeyValue("connections", static_cast<unsigned long long>(summary.connections));
+  writer.KeyValue("examined", static_cast<unsigned long long>(summary.examined));
+  if (aggregate.limit != 0) {
+    writer.KeyValue("limit", static_cast<unsigned long long>(aggregate.limit));
+  }
+  writer.ArrayStart("rttHistogram");
+  for (unsigned int bucket = 0; bucket < NR_TCP_RTT_BUCKETS; bucket++) {
+    if (summary.rtt_histogram[bucket] == 0) {
+      continue;
+    }
+    writer.ObjectStart();
+    writer.KeyValue("from", bucket == 0 ? 0ULL : 1ULL << bucket);
+    if (bucket != NR_TCP_RTT_BUCKETS - 1) {
+      writer.KeyValue("to", 2ULL << bucket);
+    }
+    writer.KeyValue("connections", static_cast<unsigned long long>(summary.rtt_histogram[bucket]));
+    writer.ObjectEnd();
+  }
+  writer.ArrayEnd();
+  writer.ArrayStart("mostRetransmits");
+  for (const HandleInfo& handle : summary.most_retransmits) {
+    PrintHandle(writer, handle);
+  }
+  writer.ArrayEnd();
+  writer.ObjectEnd();
+}
 
+void PrintHandles(std::ostream& out, const std::vector<HandleInfo>& handles,
+                  const HandleAggregate& aggregate) {
+  if (aggregate.limit == 0) {
+    PrintHandleTable(out, handles);
+    PrintTcpSummary(out, aggregate.tcp);
+    return;
+  }
+  out << "Handles: ";
+  WriteInteger(out, aggregate.count);
+  out << ", more than the handle limit of " << aggregate.limit
+      << ", grouped by type, flags and remote address\n\n";
+  out << std::left << std::setw(7) << "Flags" << std::setw(10) << "Type"
+      << std::setw(14) << "Count" << std::setw(14) << "Write queue"
+      << "Remote address" << std::endl;
+  for (const HandleGroup& group : aggregate.groups) {
+    std::ostringstream count;
+    std::ostringstream write_queue_size;
+    WriteInteger(count, group.count);
+    WriteInteger(write_queue_size, group.write_queue_size);
+    out << "[" << (group.has_ref ? 'R' : '-') << (group.is_active ? 'A' : '-') << "]   "
+        << std::left << std::setw(10) << handleTypeName(group.type)
+        << std::setw(14) << count.str() << std::setw(14) << write_queue_size.str()
+        << group.peer << std::endl;
+  }
+  if (aggregate.groups_omitted > 0) {
+    out << "(" << aggregate.groups_omitted << " smaller groups not shown)\n";
+  }
+  if (!aggregate.busiest.empty()) {
+    out << "\nLargest write queues:\n";
+    PrintHandleTable(out, aggregate.busiest);
   }
+  out << "\nFirst " << handles.size() << " handles:\n";
+  PrintHandleTable(out, handles);
+  PrintTcpSummary(out, aggregate.tcp);
+}
 
-  *out << std::left << "[" << (uv_has_ref(h) ? 'R' : '-')
-       << (uv_is_active(h) ? 'A' : '-') << "]   " << std::setw(10) << type
-       << std::internal << std::setw(2 + 2 * sizeof(void*));
-  char prev_fill = out->fill('0');
-  *out << static_cast<void*>(h) << std::left;
-  out->fill(prev_fill);
-  *out << "  " << std::left << data.str() << std::endl;
+void PrintHandles(ReportWriter& writer, const std::vector<HandleInfo>& handles,
+                  const HandleAggregate& aggregate) {
+  writer.ArrayStart("libuvHandles");
+  for (const HandleInfo& handle : handles) {
+    PrintHandle(writer, handle);
+  }
+  writer.ArrayEnd();
+  PrintTcpSummary(writer, aggregate);
+  if (aggregate.limit == 0) {
+    return;
+  }
+  writer.ObjectStart("libuvHandleSummary");
+  writer.KeyValue("count", static_cast<unsigned long long>(aggregate.count));
+  writer.KeyValue("limit", static_cast<unsigned long long>(aggregate.limit));
+  writer.ArrayStart("groups");
+  for (const HandleGroup& group : aggregate.groups) {
+    writer.ObjectStart();
+    writer.KeyValue("type", handleTypeName(group.type));
+    writer.KeyValue("ref", group.has_ref);
+    writer.KeyValue("active", group.is_active);
+    if (!group.peer.empty()) {
+      writer.KeyValue("remoteAddress", group.peer);
+    }
+    writer.KeyValue("count", static_cast<unsigned long long>(group.count));
+    writer.KeyValue("writeQueueSize", static_cast<unsigned long long>(group.write_queue_size));
+    writer.ObjectEnd();
+  }
+  writer.ArrayEnd();
+  writer.KeyValue("groupsOmitted", static_cast<unsigned long long>(aggregate.groups_omitted));
+  writer.ArrayStart("largestWriteQueues");
+  for (const HandleInfo& handle : aggregate.busiest) {
+    PrintHandle(writer, handle);
+  }
+  writer.ArrayEnd();
+  writer.ObjectEnd();
 }
 
 /*******************************************************************************
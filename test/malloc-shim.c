@@ -0,0 +1,119 @@
+/*
+ * LD_PRELOAD shim for test-fatal-error-noalloc.js (glibc only).
+ *
+ * Once the thread handling a fatal error opens a node-report file, every
+ * malloc() family call made on that thread fails and is counted. The count is
+ * written to stderr when the report file is closed.
+ */
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t count, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+extern void* __libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void* ptr);
+
+static __thread int report_fd = -1;
+static __thread unsigned long failed_allocations = 0;
+
+static int failing(void) {
+  if (report_fd < 0) return 0;
+  failed_allocations++;
+  errno = ENOMEM;
+  return 1;
+}
+
+void* malloc(size_t size) {
+  return failing() ? NULL : __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+  return failing() ? NULL : __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+  return failing() ? NULL : __libc_realloc(ptr, size);
+}
+
+void* memalign(size_t alignment, size_t size) {
+  return failing() ? NULL : __libc_memalign(alignment, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size) {
+  return failing() ? NULL : __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void** ptr, size_t alignment, size_t size) {
+  if (failing()) return ENOMEM;
+  *ptr = __libc_memalign(alignment, size);
+  return *ptr == NULL ? ENOMEM : 0;
+}
+
+void free(void* ptr) {
+  __libc_free(ptr);
+}
+
+static int track_open(const char* path, int fd) {
+  const char* name = strrchr(path, '/');
+  name = name == NULL ? path : name + 1;
+  if (fd >= 0 && strncmp(name, "node-report.", sizeof("node-report.") - 1) == 0) {
+    report_fd = fd;
+    failed_allocations = 0;
+  }
+  return fd;
+}
+
+int open(const char* path, int flags, ...) {
+  static int (*real_open)(const char*, int, ...) = NULL;
+  mode_t mode = 0;
+  if (flags & O_CREAT) {
+    va_list args;
+    va_start(args, flags);
+    mode = va_arg(args, mode_t);
+    va_end(args);
+  }
+  if (real_open == NULL) {
+    *(void**)(&real_open) = dlsym(RTLD_NEXT, "open");
+  }
+  return track_open(path, real_open(path, flags, mode));
+}
+
+int open64(const char* path, int flags, ...) {
+  static int (*real_open64)(const char*, int, ...) = NULL;
+  mode_t mode = 0;
+  if (flags & O_CREAT) {
+    va_list args;
+    va_start(args, flags);
+    mode = va_arg(args, mode_t);
+    va_end(args);
+  }
+  if (real_open64 == NULL) {
+    *(void**)(&real_open64) = dlsym(RTLD_NEXT, "open64");
+  }
+  return track_open(path, real_open64(path, flags, mode));
+}
+
+int close(int fd) {
+  static int (*real_close)(int) = NULL;
+  if (real_close == NULL) {
+    *(void**)(&real_close) = dlsym(RTLD_NEXT, "close");
+  }
+  if (fd >= 0 && fd == report_fd) {
+    char buf[96];
+    int length = snprintf(buf, sizeof(buf),
+                          "malloc-shim: %lu allocations while writing report\n",
+                          failed_allocations);
+    report_fd = -1;
+    if (write(STDERR_FILENO, buf, length) < 0) {
+      /* nothing more we can do */
+    }
+  }
+  return real_close(fd);
+}
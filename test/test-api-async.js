@@ -0,0 +1,40 @@
+'use strict';
+
+// Testcase to produce report via API call, written on the report writer thread
+if (process.argv[2] === 'child') {
+  const nodereport = require('../');
+  nodereport.setAsync('yes');
+  process.env.NODEREPORT_ASYNC_TEST = 'before';
+  const filename = nodereport.triggerReport();
+  // The environment is captured when the report is triggered.
+  process.env.NODEREPORT_ASYNC_TEST = 'after';
+  // The report filename is returned before the report has been written.
+  console.log(filename);
+} else {
+  const common = require('./common.js');
+  const fs = require('fs');
+  const spawn = require('child_process').spawn;
+  const tap = require('tap');
+
+  const child = spawn(process.execPath, [__filename, 'child']);
+  let stdout = '';
+  child.stdout.on('data', (chunk) => { stdout += chunk; });
+  let stderr = '';
+  child.stderr.on('data', (chunk) => { stderr += chunk; });
+  child.on('exit', (code) => {
+    tap.plan(6);
+    tap.equal(code, 0, 'Process exited cleanly');
+    tap.match(stderr, /Node.js report completed/,
+              'Report written before process exit');
+    const reports = common.findReports(child.pid);
+    tap.equal(reports.length, 1, 'Found reports ' + reports);
+    const report = reports[0];
+    tap.equal(stdout.trim(), report, 'Report filename returned by API');
+    tap.match(common.getSection(fs.readFileSync(report, 'utf8'), 'System Information'),
+              /\n {2}NODEREPORT_ASYNC_TEST=before\n/,
+              'Environment is captured when the report is triggered');
+    common.validate(tap, report, {pid: child.pid,
+      commandline: child.spawnargs.join(' ')
+    });
+  });
+}
@@ -0,0 +1,41 @@
+'use strict';
+
+// Testcase for producing a binary format report via API call, and converting
+// it back to the text layout with the bundled decoder
+if (process.argv[2] === 'child') {
+  const nodereport = require('../');
+  nodereport.setFormat('binary');
+  nodereport.triggerReport();
+} else {
+  const common = require('./common.js');
+  const fs = require('fs');
+  const path = require('path');
+  const spawnSync = require('child_process').spawnSync;
+  const tap = require('tap');
+
+  const decoder = path.join(__dirname, '..', 'bin', 'node-report-decode.js');
+  const args = [__filename, 'child'];
+  const child = spawnSync(process.execPath, args);
+  const filePattern =
+    new RegExp('^node-report\\.\\d+\\.\\d+\\.' + child.pid + '\\.\\d+\\.nrb$');
+  const reports = fs.readdirSync('.').filter((file) => filePattern.test(file));
+  tap.plan(6);
+  tap.equal(child.status, 0, 'Process exited cleanly');
+  tap.equal(reports.length, 1, 'Found reports ' + reports);
+
+  const decoded = spawnSync(process.execPath, [decoder, reports[0]]);
+  tap.equal(decoded.status, 0, 'Decoder exited cleanly');
+  tap.test('Validating decoded report content', (t) => {
+    common.validateContent(decoded.stdout, t, { pid: child.pid,
+      commandline: process.execPath + ' ' + args.join(' ')
+    });
+  });
+
+  const json = spawnSync(process.execPath, [decoder, '--json', reports[0]]);
+  const report = JSON.parse(json.stdout.toString());
+  tap.equal(report.header.processId, child.pid,
+            'Checking process ID decoded as JSON');
+
+  const bad = spawnSync(process.execPath, [decoder, __filename]);
+  tap.notEqual(bad.status, 0, 'Decoder rejects a file in another format');
+}
@@ -0,0 +1,64 @@
+'use strict';
+
+// Testcase for delta reports, enabled via the NODEREPORT_DELTA environment
+// variable. The first report is written in full and each later report only
+// shows the changes since the previous one.
+if (process.argv[2] === 'child') {
+  const nodereport = require('../');
+  const names = [nodereport.triggerReport()];
+  process.env.NODEREPORT_DELTA_TEST = 'changed';
+  const server = require('net').createServer().listen(0);
+  names.push(nodereport.triggerReport());
+  nodereport.setFormat('json');
+  names.push(nodereport.triggerReport());
+  server.close();
+  console.log(JSON.stringify(names));
+} else {
+  const common = require('./common.js');
+  const decoder = require('../bin/node-report-decode.js');
+  const fs = require('fs');
+  const os = require('os');
+  const path = require('path');
+  const spawnSync = require('child_process').spawnSync;
+  const tap = require('tap');
+
+  const directory = fs.mkdtempSync(path.join(os.tmpdir(), 'node-report-'));
+  const env = Object.assign({}, process.env, {
+    NODEREPORT_DIRECTORY: directory,
+    NODEREPORT_DELTA: 'yes',
+  });
+  const args = [__filename, 'child'];
+  const child = spawnSync(process.execPath, args, { env: env });
+  tap.plan(11);
+  tap.equal(child.status, 0, 'Process exited cleanly');
+  const names = JSON.parse(child.stdout.toString());
+  const reports = names.map((name) => path.join(directory, name));
+
+  // The first report has no base report
+  common.validate(tap, reports[0], {pid: child.pid,
+    commandline: process.execPath + ' ' + args.join(' ')
+  });
+
+  const delta = fs.readFileSync(reports[1], 'utf8');
+  tap.match(delta, new RegExp('Delta from: ' + names[0].replace(/\./g, '\\.')),
+            'Second report names the first report as its base');
+  tap.notMatch(delta, /Command line:/, 'Delta report leaves out the command line');
+  tap.match(common.getSection(delta, 'System Information'),
+            /Environment variable changes\n {2}\+ NODEREPORT_DELTA_TEST=changed\n\n/,
+            'Delta report lists only the changed environment variable');
+  tap.match(common.getSection(delta, 'Node.js libuv Handle Summary'),
+            /Handles: \d+, [1-9]\d* added and \d+ removed since the base report[^]*tcp/,
+            'Delta report lists the added tcp handle');
+  tap.notMatch(delta, /Thread CPU usage/, 'Delta report leaves out the thread CPU table');
+
+  const json = JSON.parse(fs.readFileSync(reports[2], 'utf8'));
+  tap.equal(json.header.deltaFrom, names[1], 'JSON report names its base report');
+  tap.same(json.environmentVariableChanges, { set: {}, removed: [] },
+           'No environment changes since the second report');
+  tap.equal(json.threadCpuUsage, undefined, 'JSON delta report leaves out the thread CPU table');
+  tap.match(decoder.render(json), /Delta from: [^]*Garbage collections since the base report/,
+            'Decoder renders the delta report');
+
+  reports.forEach((report) => fs.unlinkSync(report));
+  fs.rmdirSync(directory);
+}
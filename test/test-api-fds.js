@@ -0,0 +1,58 @@
+'use strict';
+
+// Testcase for the file descriptor inventory, Linux only
+if (process.argv[2] === 'child') {
+  const fs = require('fs');
+  const net = require('net');
+  const nodereport = require('../');
+  // Descriptors opened outside libuv's handles, and a listening socket
+  for (let i = 0; i < 50; i++) {
+    fs.openSync(__filename, 'r');
+  }
+  const server = net.createServer().listen(0, '127.0.0.1', () => {
+    const text = nodereport.getReport();
+    nodereport.setFormat('json');
+    const json = JSON.parse(nodereport.getReport());
+    nodereport.setSections('jsstack+heap');
+    const omitted = JSON.parse(nodereport.getReport());
+    console.log(JSON.stringify({ text: text, json: json,
+                                 omitted: Object.keys(omitted) }));
+    server.close();
+  });
+} else {
+  const common = require('./common.js');
+  const decoder = require('../bin/node-report-decode.js');
+  const spawnSync = require('child_process').spawnSync;
+  const tap = require('tap');
+
+  if (process.platform !== 'linux') {
+    tap.fail('Unsupported on ' + process.platform, { skip: true });
+    return;
+  }
+
+  const child = spawnSync(process.execPath, [__filename, 'child']);
+  tap.plan(8);
+  tap.equal(child.status, 0, 'Process exited cleanly');
+  const result = JSON.parse(child.stdout.toString());
+
+  const section = common.getSection(result.text, 'File Descriptors');
+  tap.match(section, /Open file descriptors: [1-9][\d,]*/,
+            'File descriptor section counts the open descriptors');
+  tap.match(section, /Descriptors by type:\n +Count +Not owned +Type\n[^]* +\d+ +\d+ {2}epoll\n/,
+            'File descriptor section lists the types');
+  const escaped = __filename.replace(/[.*+?^${}()|[\]\\]/g, '\\$&');
+  tap.match(section, new RegExp('\\n +5\\d +5\\d {2}' + escaped + '\\n'),
+            'Files opened with fs.openSync() are listed and not owned by libuv');
+
+  const fds = result.json.fileDescriptors;
+  const socket = fds.types.find((type) => type.type === 'socket');
+  tap.ok(socket && socket.count > socket.notOwned,
+         'Listening socket is owned by a libuv handle');
+  tap.ok(fds.open === fds.classified &&
+         fds.types.reduce((total, type) => total + type.count, 0) === fds.open,
+         'JSON types account for every descriptor');
+  tap.match(decoder.render(result.json), /==== File Descriptors[^]*Descriptors by type/,
+            'Decoder renders the file descriptor section');
+  tap.notOk(result.omitted.includes('fileDescriptors'),
+            'File descriptor section is omitted when the section is not selected');
+}
@@ -0,0 +1,49 @@
+'use strict';
+
+// Testcase for the garbage collection history in the JavaScript Heap and
+// Garbage Collector section, in text and JSON format reports
+if (process.argv[2] === 'child') {
+  const nodereport = require('../');
+
+  let objects = [];
+  for (let i = 0; i < 200000; i++) {
+    objects.push({ index: i });
+    if (objects.length > 50000) {
+      objects = [];
+    }
+  }
+  global.gc();
+  const text = nodereport.getReport();
+  nodereport.setFormat('json');
+  const json = JSON.parse(nodereport.getReport());
+  console.log(JSON.stringify({ text: text, heap: json.javascriptHeap }));
+} else {
+  const common = require('./common.js');
+  const spawnSync = require('child_process').spawnSync;
+  const tap = require('tap');
+
+  const child = spawnSync(process.execPath,
+                          ['--expose-gc', __filename, 'child']);
+  tap.plan(7);
+  tap.equal(child.status, 0, 'Process exited cleanly');
+  const result = JSON.parse(child.stdout.toString());
+  const heapSection =
+    common.getSection(result.text, 'JavaScript Heap and Garbage Collector');
+  tap.match(heapSection, /Garbage collections: \d+, total pause [\d.]+ ms/,
+            'Text report contains the garbage collection count');
+  tap.match(heapSection,
+            /Recent garbage collections: \d+, [^]*\n +[\d.]+ +mark-sweep-compact +[\d.]+ +[\d,]+ +[\d,]+$/m,
+            'Text report contains the forced mark-sweep-compact collection');
+
+  const gc = result.heap.garbageCollection;
+  tap.ok(gc.recent.length > 0 && gc.recent.length <= gc.collections,
+         'Checking recent collection count ' + gc.recent.length);
+  tap.equal(gc.recent[gc.recent.length - 1].type, 'mark-sweep-compact',
+            'Most recent collection is the forced one');
+  tap.ok(gc.recentMaxPause >= gc.recentP99Pause &&
+         gc.recentTotalPause >= gc.recentMaxPause,
+         'Checking pause summary');
+  tap.ok(gc.recent.every((collection, i) => i === 0 ||
+                         collection.ago <= gc.recent[i - 1].ago),
+         'Collections are listed oldest first');
+}
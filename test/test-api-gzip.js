@@ -0,0 +1,46 @@
+'use strict';
+
+// Testcase for gzip compressed report files, selected via the
+// NODEREPORT_COMPRESSION environment variable
+if (process.argv[2] === 'child') {
+  const nodereport = require('../');
+  console.log(nodereport.triggerReport());
+  nodereport.setFormat('binary');
+  console.log(nodereport.triggerReport());
+} else {
+  const common = require('./common.js');
+  const fs = require('fs');
+  const path = require('path');
+  const spawnSync = require('child_process').spawnSync;
+  const tap = require('tap');
+  const zlib = require('zlib');
+
+  const decoder = path.join(__dirname, '..', 'bin', 'node-report-decode.js');
+  const env = Object.assign({}, process.env, { NODEREPORT_COMPRESSION: 'gzip' });
+  const args = [__filename, 'child'];
+  const child = spawnSync(process.execPath, args, { env: env });
+  tap.plan(7);
+  tap.equal(child.status, 0, 'Process exited cleanly');
+  const names = child.stdout.toString().trim().split('\n');
+  const filePattern = new RegExp('^node-report\\.\\d+\\.\\d+\\.' + child.pid +
+                                 '\\.\\d+\\.(txt|nrb)\\.gz$');
+  tap.ok(names.length === 2 && names.every((name) => filePattern.test(name)),
+         'Report filenames have a .gz suffix ' + names);
+
+  const text = zlib.gunzipSync(fs.readFileSync(names[0]));
+  tap.test('Validating decompressed report content', (t) => {
+    common.validateContent(text, t, { pid: child.pid,
+      commandline: process.execPath + ' ' + args.join(' ')
+    });
+  });
+
+  const decoded = spawnSync(process.execPath, [decoder, '--json', names[1]]);
+  tap.equal(decoded.status, 0, 'Decoder exited cleanly');
+  const report = JSON.parse(decoded.stdout.toString());
+  tap.equal(report.header.processId, child.pid,
+            'Checking process ID decoded from compressed binary report');
+  tap.ok(fs.statSync(names[0]).size < text.length / 2,
+         'Report file is compressed');
+  tap.ok(fs.statSync(names[0]).size < zlib.gzipSync(text).length * 1.1,
+         'Report file is compressed about as well as gzip compresses it in one pass');
+}
@@ -0,0 +1,66 @@
+'use strict';
+
+// Testcase for the aggregated handle summary, used when there are more
+// handles than the limit set with setHandleLimit(). One connection has a
+// write that the peer is not reading, so its write queue is not empty.
+if (process.argv[2] === 'child') {
+  const nodereport = require('../');
+  const net = require('net');
+  const CONNECTIONS = 20;
+  const clients = [];
+  const accepted = [];
+  let connected = 0;
+  const server = net.createServer((socket) => {
+    socket.pause();
+    accepted.push(socket);
+    if (++connected === 2 * CONNECTIONS) report();
+  }).listen(0, () => {
+    for (let i = 0; i < CONNECTIONS; i++) {
+      clients.push(net.connect(server.address().port, () => {
+        if (++connected === 2 * CONNECTIONS) report();
+      }));
+    }
+  });
+
+  function report() {
+    clients[0].write(Buffer.alloc(64 * 1024 * 1024));
+    nodereport.setHandleLimit('5');
+    const text = nodereport.getReport();
+    nodereport.setFormat('json');
+    const json = JSON.parse(nodereport.getReport());
+    nodereport.setHandleLimit('none');
+    const full = JSON.parse(nodereport.getReport());
+    clients.concat(accepted).forEach((socket) => socket.destroy());
+    server.close();
+    console.log(JSON.stringify({ text: text, json: json, full: full }));
+  }
+} else {
+  const common = require('./common.js');
+  const decoder = require('../bin/node-report-decode.js');
+  const spawnSync = require('child_process').spawnSync;
+  const tap = require('tap');
+
+  const child = spawnSync(process.execPath, [__filename, 'child'],
+                          { maxBuffer: 64 * 1024 * 1024 });
+  tap.plan(8);
+  tap.equal(child.status, 0, 'Process exited cleanly');
+  const result = JSON.parse(child.stdout.toString());
+
+  const handles = common.getSection(result.text, 'Node.js libuv Handle Summary');
+  tap.match(handles, /Handles: \d+, more than the handle limit of 5, grouped by/,
+            'Handle summary is aggregated');
+  tap.match(handles, /\] +tcp +\d+ +[\d,]+ +(::ffff:)?127\.0\.0\.1\n/,
+            'Connections are grouped by remote address');
+  tap.match(handles, /Largest write queues:\n.*\n\[.A\] +tcp +.*write queue size: [1-9]/,
+            'Connection with the largest write queue is listed');
+  const detail = handles.split('First 5 handles:\n')[1].split('\n\nTCP connections:')[0];
+  tap.equal(detail.split('\n').length, 6,
+            'Only 5 handles are listed in detail');
+
+  const summary = result.json.libuvHandleSummary;
+  tap.equal(summary.count, result.full.libuvHandles.length,
+            'Aggregated summary counts every handle');
+  tap.equal(result.json.libuvHandles.length, 5, 'JSON report lists 5 handles');
+  tap.match(decoder.render(result.json), /more than the handle limit of 5[^]*First 5 handles/,
+            'Decoder renders the aggregated handle summary');
+}
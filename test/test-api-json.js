@@ -0,0 +1,52 @@
+'use strict';
+
+// Testcase for producing a JSON format report via API calls
+if (process.argv[2] === 'child') {
+  const nodereport = require('../');
+  nodereport.setFormat('json');
+  nodereport.triggerReport();
+  console.log(nodereport.getReport());
+} else {
+  const fs = require('fs');
+  const spawnSync = require('child_process').spawnSync;
+  const tap = require('tap');
+
+  const args = [__filename, 'child'];
+  const child = spawnSync(process.execPath, args);
+  const filePattern =
+    new RegExp('^node-report\\.\\d+\\.\\d+\\.' + child.pid + '\\.\\d+\\.json$');
+  const reports = fs.readdirSync('.').filter((file) => filePattern.test(file));
+  tap.plan(4);
+  tap.equal(child.status, 0, 'Process exited cleanly');
+  tap.equal(reports.length, 1, 'Found reports ' + reports);
+
+  const checkReport = (t, text) => {
+    let report;
+    try {
+      report = JSON.parse(text);
+    } catch (err) {
+      t.fail('Report is not valid JSON: ' + err.message);
+      t.end();
+      return;
+    }
+    t.equal(report.header.processId, child.pid, 'Checking report pid');
+    t.equal(report.header.commandLine, process.execPath + ' ' + args.join(' '),
+            'Checking report command line');
+    t.equal(report.header.nodejsVersion, process.version,
+            'Checking Node.js version');
+    t.ok(Array.isArray(report.javascriptStack), 'Checking JavaScript stack');
+    t.ok(report.javascriptHeap.heapSpaces, 'Checking JavaScript heap');
+    t.ok(Array.isArray(report.libuvHandles), 'Checking libuv handles');
+    t.ok(report.libuvHandles.some((handle) => handle.type === 'timer'),
+         'Checking libuv timer handle');
+    t.ok(report.environmentVariables, 'Checking environment variables');
+    t.ok(Array.isArray(report.sharedObjects), 'Checking shared objects');
+    t.end();
+  };
+  tap.test('Validating report file content', (t) => {
+    checkReport(t, fs.readFileSync(reports[0], 'utf8'));
+  });
+  tap.test('Validating getReport() content', (t) => {
+    checkReport(t, child.stdout.toString());
+  });
+}
@@ -0,0 +1,47 @@
+'use strict';
+
+// Testcase for the memory map section, Linux only
+if (process.argv[2] === 'child') {
+  const nodereport = require('../');
+  const text = nodereport.getReport();
+  nodereport.setFormat('json');
+  const json = JSON.parse(nodereport.getReport());
+  nodereport.setSections('jsstack+heap');
+  const omitted = JSON.parse(nodereport.getReport());
+  console.log(JSON.stringify({ text: text, json: json,
+                               omitted: Object.keys(omitted) }));
+} else {
+  const common = require('./common.js');
+  const decoder = require('../bin/node-report-decode.js');
+  const spawnSync = require('child_process').spawnSync;
+  const tap = require('tap');
+
+  if (process.platform !== 'linux') {
+    tap.fail('Unsupported on ' + process.platform, { skip: true });
+    return;
+  }
+
+  const child = spawnSync(process.execPath, [__filename, 'child']);
+  tap.plan(8);
+  tap.equal(child.status, 0, 'Process exited cleanly');
+  const result = JSON.parse(child.stdout.toString());
+
+  const section = common.getSection(result.text, 'Memory Map');
+  tap.match(section, /Resident set size \(Rss\): [1-9][\d,]* bytes/,
+            'Memory map section shows the resident set size');
+  tap.match(section, /Largest objects by Rss[^]*\n +[1-9][\d,]* .*\d+ {2}.*node\n/,
+            'Memory map section lists the node executable');
+  tap.match(section, / \(loaded library\)\n/, 'Loaded libraries are marked');
+
+  const map = result.json.memoryMap;
+  tap.ok(map.totals.rss > 0 && map.totals.pss <= map.totals.rss,
+         'JSON report contains the Rss and Pss totals');
+  tap.ok(map.largestObjects.length > 0 && map.largestObjects.length <= 20 &&
+         map.largestObjects.every((object, i, objects) => {
+           return i === 0 || objects[i - 1].rss >= object.rss;
+         }), 'Largest objects are in Rss order');
+  tap.match(decoder.render(result.json), /==== Memory Map[^]*Largest objects by Rss/,
+            'Decoder renders the memory map section');
+  tap.notOk(result.omitted.includes('memoryMap'),
+            'Memory map is omitted when the section is not selected');
+}
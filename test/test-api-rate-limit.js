@@ -0,0 +1,43 @@
+'use strict';
+
+// Testcase for the report rate limit, set via the NODEREPORT_RATE_LIMIT
+// environment variable and removed with the setRateLimit() API call
+if (process.argv[2] === 'child') {
+  const nodereport = require('../');
+  const names = [];
+  for (let i = 0; i < 5; i++) {
+    names.push(nodereport.triggerReport());
+  }
+  nodereport.setRateLimit('none');
+  names.push(nodereport.triggerReport());
+  console.log(JSON.stringify(names));
+} else {
+  const common = require('./common.js');
+  const fs = require('fs');
+  const spawnSync = require('child_process').spawnSync;
+  const tap = require('tap');
+
+  const env = Object.assign({}, process.env, {
+    NODEREPORT_RATE_LIMIT: 'signal:1/1,apicall:2/60',
+  });
+  const args = [__filename, 'child'];
+  const child = spawnSync(process.execPath, args, { env: env });
+  tap.plan(7);
+  tap.equal(child.status, 0, 'Process exited cleanly');
+  const names = JSON.parse(child.stdout.toString());
+  tap.ok(names[0] && names[1], 'Reports written up to the limit');
+  tap.same(names.slice(2, 5), ['', '', ''],
+           'No report file names returned over the limit');
+  const reports = common.findReports(child.pid);
+  tap.equal(reports.length, 3, 'Found reports ' + reports);
+
+  const first = fs.readFileSync(names[0], 'utf8');
+  tap.notMatch(first, /Reports suppressed/,
+               'First report has no suppressed reports');
+  const last = fs.readFileSync(names[5], 'utf8');
+  tap.match(last, /\nReports suppressed: apicall 3\n/,
+            'Report after the limit is removed has the suppressed count');
+  common.validate(tap, names[5], {pid: child.pid,
+    commandline: process.execPath + ' ' + args.join(' ')
+  });
+}
@@ -0,0 +1,48 @@
+'use strict';
+
+// Testcase for socket endpoints in the handle summary. Addresses are numeric
+// by default. With the resolve names option set, names are looked up in the
+// background and shown in later reports, without delaying the report.
+if (process.argv[2] === 'child') {
+  const nodereport = require('../');
+  const dns = require('dns');
+  const server = require('net').createServer().listen(0, '127.0.0.1', () => {
+    const port = server.address().port;
+    const numeric = nodereport.getReport();
+    nodereport.setResolveNames('yes');
+    const first = nodereport.getReport();
+    dns.lookupService('127.0.0.1', port, (err, hostname) => {
+      const expected = err ? '127.0.0.1' : hostname;
+      const end = Date.now() + 5000;
+      const poll = () => {
+        const resolved = nodereport.getReport();
+        if (resolved.includes(expected + ':' + port) || Date.now() > end) {
+          server.close();
+          console.log(JSON.stringify({ port: port, expected: expected,
+                                       numeric: numeric, first: first,
+                                       resolved: resolved }));
+        } else {
+          setTimeout(poll, 50);
+        }
+      };
+      poll();
+    });
+  });
+} else {
+  const common = require('./common.js');
+  const spawnSync = require('child_process').spawnSync;
+  const tap = require('tap');
+
+  const child = spawnSync(process.execPath, [__filename, 'child']);
+  tap.plan(4);
+  tap.equal(child.status, 0, 'Process exited cleanly');
+  const result = JSON.parse(child.stdout.toString());
+  const endpoint = (host) => new RegExp('tcp +0x[0-9a-fA-F]+ +' +
+                                        host.replace(/\./g, '\\.') + ':' + result.port);
+  tap.match(common.getSection(result.numeric, 'Node.js libuv Handle Summary'),
+            endpoint('127.0.0.1'), 'Endpoint address is numeric by default');
+  tap.match(common.getSection(result.first, 'Node.js libuv Handle Summary'),
+            endpoint('127.0.0.1'), 'First report does not wait for the name lookup');
+  tap.match(common.getSection(result.resolved, 'Node.js libuv Handle Summary'),
+            endpoint(result.expected), 'Later report shows the cached host name');
+}
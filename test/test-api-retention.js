@@ -0,0 +1,43 @@
+'use strict';
+
+// Testcase for the report file retention policy, set via the
+// NODEREPORT_RETENTION environment variable
+if (process.argv[2] === 'child') {
+  const nodereport = require('../');
+  const names = [];
+  for (let i = 0; i < 5; i++) {
+    names.push(nodereport.triggerReport());
+  }
+  console.log(JSON.stringify(names));
+} else {
+  const fs = require('fs');
+  const os = require('os');
+  const path = require('path');
+  const spawnSync = require('child_process').spawnSync;
+  const tap = require('tap');
+
+  // An old report from a previous process, and a file that is not a report
+  const directory = fs.mkdtempSync(path.join(os.tmpdir(), 'node-report-'));
+  const oldReport = path.join(directory, 'node-report.20000101.000000.1.001.txt');
+  const otherFile = path.join(directory, 'keep.txt');
+  fs.writeFileSync(oldReport, 'old report');
+  fs.utimesSync(oldReport, new Date(2000, 0, 1), new Date(2000, 0, 1));
+  fs.writeFileSync(otherFile, 'not a report');
+
+  const env = Object.assign({}, process.env, {
+    NODEREPORT_DIRECTORY: directory,
+    NODEREPORT_RETENTION: 'files=3,age=1d',
+  });
+  const child = spawnSync(process.execPath, [__filename, 'child'], { env: env });
+  tap.plan(4);
+  tap.equal(child.status, 0, 'Process exited cleanly');
+  const names = JSON.parse(child.stdout.toString());
+  const files = fs.readdirSync(directory);
+  tap.same(files.filter((file) => file !== 'keep.txt').sort(), names.slice(2),
+           'Only the most recent reports are kept');
+  tap.notOk(fs.existsSync(oldReport), 'Old report was removed');
+  tap.ok(fs.existsSync(otherFile), 'Other file was not removed');
+
+  files.forEach((file) => fs.unlinkSync(path.join(directory, file)));
+  fs.rmdirSync(directory);
+}
@@ -0,0 +1,48 @@
+'use strict';
+
+// Testcase for the JavaScript stack sampler, enabled via the
+// NODEREPORT_SAMPLING_INTERVAL environment variable and switched off with the
+// setSamplingInterval() API call
+if (process.argv[2] === 'child') {
+  const nodereport = require('../');
+
+  function fibonacci(n) {
+    return n < 2 ? n : fibonacci(n - 1) + fibonacci(n - 2);
+  }
+  const end = Date.now() + 500;
+  while (Date.now() < end) {
+    fibonacci(20);
+  }
+  const text = nodereport.getReport();
+  nodereport.setFormat('json');
+  const json = JSON.parse(nodereport.getReport());
+  nodereport.setSamplingInterval('0');
+  const stopped = JSON.parse(nodereport.getReport());
+  console.log(JSON.stringify({ text: text,
+                               samples: json.stackSamples,
+                               stopped: Object.keys(stopped) }));
+} else {
+  const spawnSync = require('child_process').spawnSync;
+  const tap = require('tap');
+
+  const env = Object.assign({}, process.env, { NODEREPORT_SAMPLING_INTERVAL: '2' });
+  const child = spawnSync(process.execPath, [__filename, 'child'], { env: env });
+  tap.plan(8);
+  tap.equal(child.status, 0, 'Process exited cleanly');
+  const result = JSON.parse(child.stdout.toString());
+  tap.match(result.text, /==== Recent Stack Samples[^]*Sampling interval: 2 ms/,
+            'Text report contains Recent Stack Samples section');
+  tap.match(result.text, /Folded stacks:\n.*fibonacci.* \d+\n/,
+            'Text report contains folded stacks');
+
+  const samples = result.samples;
+  tap.equal(samples.interval, 2, 'Checking sampling interval');
+  tap.ok(samples.samples > 0 && samples.samples <= 1024,
+         'Checking sample count ' + samples.samples);
+  tap.match(samples.topFunctions[0].name, /fibonacci/,
+            'Busiest function is at the top of the samples');
+  tap.ok(samples.foldedStacks.every((line) => /^\S.* \d+$/.test(line)),
+         'Folded stacks end with a sample count');
+  tap.notOk(result.stopped.includes('stackSamples'),
+            'Samples are not reported after the sampler is stopped');
+}
@@ -0,0 +1,51 @@
+'use strict';
+
+// Testcase for selecting the report sections, via the NODEREPORT_SECTIONS
+// environment variable and the setSections() API call
+if (process.argv[2] === 'child') {
+  const nodereport = require('../');
+  nodereport.triggerReport();
+} else if (process.argv[2] === 'api') {
+  const nodereport = require('../');
+  nodereport.setFormat('json');
+  nodereport.setSections('heap,signal:all');
+  const heap = JSON.parse(nodereport.getReport());
+  nodereport.setSections('apicall:handles+unknown');
+  const unchanged = JSON.parse(nodereport.getReport());
+  console.log(JSON.stringify({ heap: Object.keys(heap),
+                               unchanged: Object.keys(unchanged) }));
+} else {
+  const common = require('./common.js');
+  const fs = require('fs');
+  const spawnSync = require('child_process').spawnSync;
+  const tap = require('tap');
+
+  const env = Object.assign({}, process.env, {
+    NODEREPORT_SECTIONS: 'all,apicall:jsstack+environment',
+  });
+  const child = spawnSync(process.execPath, [__filename, 'child'], { env: env });
+  const api = spawnSync(process.execPath, [__filename, 'api']);
+  tap.plan(10);
+  tap.equal(child.status, 0, 'Process exited cleanly');
+  const reports = common.findReports(child.pid);
+  tap.equal(reports.length, 1, 'Found reports ' + reports);
+  const report = fs.readFileSync(reports[0], 'utf8');
+  tap.match(report, /==== JavaScript Stack Trace/,
+            'Report contains JavaScript Stack Trace section');
+  tap.match(report, /==== System Information[^]*Environment variables/,
+            'Report contains environment variables');
+  tap.notMatch(report, /==== Native Stack Trace|==== JavaScript Heap/,
+               'Report does not contain stack or heap sections');
+  tap.notMatch(report, /==== Node.js libuv Handle Summary|Loaded libraries/,
+               'Report does not contain handles or loaded libraries');
+
+  tap.equal(api.status, 0, 'API process exited cleanly');
+  tap.match(api.stderr.toString(),
+            /Unrecognised argument for node-report sections option: unknown/,
+            'Unrecognised section is reported');
+  const sections = JSON.parse(api.stdout.toString());
+  tap.strictSame(sections.heap, ['header', 'javascriptHeap', 'reportTimings'],
+                 'Checking JSON report sections');
+  tap.strictSame(sections.unchanged, sections.heap,
+                 'Invalid sections option leaves the sections unchanged');
+}
@@ -0,0 +1,54 @@
+'use strict';
+
+// Testcase for the native symbol cache, which is kept across reports and
+// emptied when a shared library is loaded, and for the ELF symbolizer on Linux
+if (process.argv[2] === 'child') {
+  const fs = require('fs');
+  const os = require('os');
+  const path = require('path');
+  const nodereport = require('../');
+  nodereport.setFormat('json');
+  const first = JSON.parse(nodereport.getReport());
+  const second = JSON.parse(nodereport.getReport());
+
+  // Load a copy of the addon as a new shared library
+  const copy = path.join(os.tmpdir(), 'node-report-cache-' + process.pid + '.node');
+  fs.writeFileSync(copy, fs.readFileSync(require.resolve('../api.node')));
+  process.dlopen({ exports: {} }, copy);
+  fs.unlinkSync(copy);
+  const third = JSON.parse(nodereport.getReport());
+  console.log(JSON.stringify([first, second, third].map((report) => {
+    return { frames: report.nativeStack.length, cache: report.nativeSymbolCache,
+             stack: report.nativeStack };
+  })));
+} else {
+  const spawnSync = require('child_process').spawnSync;
+  const tap = require('tap');
+
+  if (process.platform !== 'linux' && process.platform !== 'darwin') {
+    tap.fail('Unsupported on this platform', { skip: true });
+    return;
+  }
+  const child = spawnSync(process.execPath, [__filename, 'child']);
+  tap.plan(process.platform === 'linux' ? 8 : 5);
+  tap.equal(child.status, 0, 'Process exited cleanly');
+  const reports = JSON.parse(child.stdout.toString());
+  tap.equal(reports[0].cache.hits + reports[0].cache.misses, reports[0].frames,
+            'Every frame is looked up in the symbol cache');
+  tap.ok(reports[1].cache.hits > 0, 'Second report has symbol cache hits');
+  tap.ok(reports[1].cache.entries >= reports[0].cache.entries,
+         'Symbol cache entries are kept across reports');
+  tap.equal(reports[2].cache.hits, 0,
+            'Symbol cache is emptied when a library is loaded');
+  if (process.platform === 'linux') {
+    // The symbolizer reads the symbol tables, so every frame has an offset
+    const stack = reports[0].stack;
+    tap.ok(stack.every((frame) => frame.symbol !== undefined),
+           'Every frame is symbolized');
+    tap.ok(stack.every((frame) => typeof frame.offset === 'number'),
+           'Every frame has an offset from its symbol');
+    const frame = stack.find((frame) => /GetReport/.test(frame.symbol));
+    tap.ok(frame && /api\.node$/.test(frame.library),
+           'GetReport frame is found in the addon');
+  }
+}
@@ -0,0 +1,76 @@
+'use strict';
+
+// Testcase for the TCP_INFO statistics in the handle summary, Linux only
+if (process.argv[2] === 'child') {
+  const net = require('net');
+  const nodereport = require('../');
+  const CONNECTIONS = 3;
+  const clients = [];
+  let connected = 0;
+  const server = net.createServer(() => {
+    if (++connected === 2 * CONNECTIONS) report();
+  }).listen(0, '127.0.0.1', () => {
+    for (let i = 0; i < CONNECTIONS; i++) {
+      clients.push(net.connect(server.address().port, '127.0.0.1', () => {
+        if (++connected === 2 * CONNECTIONS) report();
+      }));
+    }
+  });
+  function report() {
+    const text = nodereport.getReport();
+    nodereport.setFormat('json');
+    const json = JSON.parse(nodereport.getReport());
+    // The last handle, a client socket, is beyond the limit
+    nodereport.setHandleLimit(String(json.libuvHandles.length - 1));
+    const aggregated = JSON.parse(nodereport.getReport());
+    nodereport.setFormat('text');
+    const aggregatedText = nodereport.getReport();
+    console.log(JSON.stringify({ text: text, json: json, aggregated: aggregated,
+                                 aggregatedText: aggregatedText }));
+    clients.forEach((client) => client.destroy());
+    server.close();
+  }
+} else {
+  const common = require('./common.js');
+  const decoder = require('../bin/node-report-decode.js');
+  const spawnSync = require('child_process').spawnSync;
+  const tap = require('tap');
+
+  if (process.platform !== 'linux') {
+    tap.fail('Unsupported on ' + process.platform, { skip: true });
+    return;
+  }
+
+  const child = spawnSync(process.execPath, [__filename, 'child']);
+  tap.plan(10);
+  tap.equal(child.status, 0, 'Process exited cleanly');
+  const result = JSON.parse(child.stdout.toString());
+
+  const section = common.getSection(result.text, 'Node.js libuv Handle Summary');
+  tap.match(section, /tcp .*\(not connected\).*, accept queue: 0 of \d+\n/,
+            'Listening socket shows the accept queue');
+  tap.match(section, /tcp .* connected to .*, rtt: \d+\.\d{3} ms \(variation \d+\.\d{3} ms\), retransmits: \d+, cwnd: \d+, unacked: \d+, bytes in flight: \d+\n/,
+            'Connected sockets show the TCP_INFO statistics');
+  tap.match(section, /\nTCP connections: 6\n\nRound trip times \(microseconds\):\n +From +To +Connections\n/,
+            'Handle summary shows the round trip time histogram');
+
+  const tcp = result.json.tcpSummary;
+  tap.ok(tcp.connections === 6 && tcp.examined === 7 && tcp.limit === undefined &&
+         tcp.rttHistogram.reduce((total, bucket) => total + bucket.connections, 0) === 6,
+         'JSON round trip time histogram counts every connection');
+  tap.ok(result.json.libuvHandles.filter((handle) => {
+    return handle.tcpInfo && handle.tcpInfo.rtt !== undefined;
+  }).length === 6, 'JSON handles include the TCP_INFO statistics');
+  const aggregated = result.aggregated.tcpSummary;
+  tap.ok(aggregated.connections === 6 && aggregated.examined === 7 &&
+         aggregated.limit === result.aggregated.libuvHandleSummary.limit,
+         'Aggregated handle summary includes connections beyond the handle limit');
+  tap.equal(result.aggregated.libuvHandles.filter((handle) => {
+    return handle.tcpInfo && handle.tcpInfo.rtt !== undefined;
+  }).length, 5, 'Aggregated handle list stops at the handle limit');
+  tap.match(common.getSection(result.aggregatedText, 'Node.js libuv Handle Summary'),
+            /\nTCP connections: 6\n/,
+            'Aggregated text summary shows every connection');
+  tap.match(decoder.render(result.json), /TCP connections: 6\n[^]*Round trip times/,
+            'Decoder renders the TCP connection summary');
+}
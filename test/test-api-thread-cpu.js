@@ -0,0 +1,52 @@
+'use strict';
+
+// Testcase for the per-thread CPU table in the resource usage section, Linux only
+if (process.argv[2] === 'child') {
+  const nodereport = require('../');
+  const text = nodereport.getReport();
+  // Use some CPU on the main thread between the reports
+  const end = Date.now() + 200;
+  while (Date.now() < end);
+  nodereport.setFormat('json');
+  const json = JSON.parse(nodereport.getReport());
+  nodereport.setSections('jsstack+heap');
+  const omitted = JSON.parse(nodereport.getReport());
+  console.log(JSON.stringify({ text: text, json: json,
+                               omitted: Object.keys(omitted) }));
+} else {
+  const common = require('./common.js');
+  const decoder = require('../bin/node-report-decode.js');
+  const spawnSync = require('child_process').spawnSync;
+  const tap = require('tap');
+
+  if (process.platform !== 'linux') {
+    tap.fail('Unsupported on ' + process.platform, { skip: true });
+    return;
+  }
+
+  const child = spawnSync(process.execPath, [__filename, 'child']);
+  tap.plan(7);
+  tap.equal(child.status, 0, 'Process exited cleanly');
+  const result = JSON.parse(child.stdout.toString());
+
+  const section = common.getSection(result.text, 'Resource Usage');
+  tap.match(section, /Thread CPU usage, [2-9]\d* threads/,
+            'Resource usage section counts the threads');
+  const pattern = new RegExp('\\n +' + child.pid + ' {2}.* +- +\\d+ +\\d+ +\\d+' +
+                             ' {2}thread 0 \\(main thread\\)\\n');
+  tap.match(section, pattern,
+            'Main thread is listed, with no CPU% in the first report');
+
+  const threads = result.json.threadCpuUsage;
+  tap.ok(threads.every((thread, i) => i === 0 || threads[i - 1].tid < thread.tid),
+         'JSON threads are in thread id order');
+  const main = threads.find((thread) => thread.tid === child.pid);
+  tap.ok(main && main.role === 'thread 0 (main thread)' &&
+         main.cpuConsumptionPercent > 0 && main.userCpuSeconds > 0 &&
+         main.voluntaryContextSwitches >= 0,
+         'JSON main thread has CPU% since the previous report');
+  tap.match(decoder.render(result.json), /==== Resource Usage[^]*Thread CPU usage, /,
+            'Decoder renders the thread CPU table');
+  tap.notOk(result.omitted.includes('threadCpuUsage'),
+            'Thread CPU table is omitted when the section is not selected');
+}
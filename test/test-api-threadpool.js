@@ -0,0 +1,59 @@
+'use strict';
+
+// Testcase for the libuv threadpool probe
+if (process.argv[2] === 'child') {
+  const crypto = require('crypto');
+  const nodereport = require('../');
+  const before = nodereport.getReport();
+  nodereport.setThreadpoolProbe('10');
+  setTimeout(() => {
+    // Keep every thread in the pool busy, so the next probe has to wait
+    let running = 4;
+    for (let i = 0; i < 4; i++) {
+      crypto.pbkdf2('secret', 'salt', 500000, 32, 'sha256', () => {
+        if (--running === 0) {
+          const after = nodereport.getReport();
+          nodereport.setFormat('json');
+          const json = JSON.parse(nodereport.getReport());
+          nodereport.setSections('jsstack+heap');
+          const omitted = JSON.parse(nodereport.getReport());
+          console.log(JSON.stringify({ before: before, busy: busy, after: after, json: json,
+                                       omitted: Object.keys(omitted) }));
+        }
+      });
+    }
+    let busy;
+    setTimeout(() => { busy = nodereport.getReport(); }, 50);
+  }, 200);
+} else {
+  const common = require('./common.js');
+  const decoder = require('../bin/node-report-decode.js');
+  const spawnSync = require('child_process').spawnSync;
+  const tap = require('tap');
+
+  const env = Object.assign({}, process.env, { UV_THREADPOOL_SIZE: '4' });
+  const child = spawnSync(process.execPath, [__filename, 'child'], { env: env });
+  tap.plan(8);
+  tap.equal(child.status, 0, 'Process exited cleanly');
+  const result = JSON.parse(child.stdout.toString());
+
+  tap.notMatch(result.before, /==== libuv Threadpool/,
+               'No threadpool section before the probe is started');
+  const busy = common.getSection(result.busy, 'libuv Threadpool');
+  tap.match(busy, /Threadpool size: 4 \(UV_THREADPOOL_SIZE=4\)/,
+            'Threadpool section shows the pool size');
+  tap.match(busy, /Probe waiting for a thread for \d+\.\d{3} ms/,
+            'Probe is waiting while the pool is busy');
+  const after = common.getSection(result.after, 'libuv Threadpool');
+  tap.match(after, /Probe interval: 10 ms, [1-9]\d* probes[^]*Queue-to-start latency: last [^]*histogram \(microseconds\):\n +From +To +Probes\n +\d+ +\d+ +[1-9]/,
+            'Threadpool section shows the latency histogram');
+
+  const pool = result.json.libuvThreadpool;
+  tap.ok(pool.probes > 0 && pool.maxLatency >= pool.meanLatency &&
+         pool.latencyHistogram.reduce((total, bucket) => total + bucket.probes, 0) ===
+           pool.probes, 'JSON histogram counts every probe');
+  tap.match(decoder.render(result.json), /==== libuv Threadpool[^]*Probes\n/,
+            'Decoder renders the threadpool section');
+  tap.notOk(result.omitted.includes('libuvThreadpool'),
+            'Threadpool section is omitted when the section is not selected');
+}
@@ -0,0 +1,55 @@
+'use strict';
+
+// Testcase for an asynchronous report on a process with a worker thread that
+// is blocked in native code. The event loop of the triggering thread resumes
+// at once, and the worker is listed as not captured when the report is
+// written.
+if (process.argv[2] === 'child') {
+  const nodereport = require('../');
+  const Worker = require('worker_threads').Worker;
+  const path = require('path');
+
+  const blocked = `
+    require(${JSON.stringify(path.join(__dirname, '..'))});
+    const parentPort = require('worker_threads').parentPort;
+    parentPort.postMessage('ready');
+    require('child_process').execSync('sleep 2');
+  `;
+  const worker = new Worker(blocked, { eval: true });
+  worker.once('message', () => {
+    setTimeout(() => {
+      nodereport.setAsync('yes');
+      const start = Date.now();
+      const filename = nodereport.triggerReport();
+      console.log(JSON.stringify({ filename: filename, elapsed: Date.now() - start }));
+    }, 200);
+  });
+} else {
+  const common = require('./common.js');
+  const fs = require('fs');
+  const spawnSync = require('child_process').spawnSync;
+  const tap = require('tap');
+
+  let workerThreads = true;
+  try {
+    require('worker_threads');
+  } catch (e) {
+    workerThreads = false;
+  }
+  if (!workerThreads || common.isWindows()) {
+    tap.fail('Worker threads are not available', { skip: true });
+    return;
+  }
+
+  const child = spawnSync(process.execPath, [__filename, 'child']);
+  tap.plan(3);
+  tap.equal(child.status, 0, 'Process exited cleanly');
+  const result = JSON.parse(child.stdout.toString());
+  tap.ok(result.elapsed < 500,
+         'Event loop is not held up by the blocked worker, took ' + result.elapsed + ' ms');
+  const contents = fs.readFileSync(result.filename, 'utf8');
+  tap.match(common.getSection(contents, 'Threads'),
+            /Thread \d+ \(worker thread[^]*Not captured, the thread did not respond within 1000 ms/,
+            'Blocked worker is listed as not captured');
+  fs.unlinkSync(result.filename);
+}
@@ -0,0 +1,77 @@
+'use strict';
+
+// Testcase for reports on processes with worker threads. One worker is busy
+// running JavaScript and the other is waiting on its event loop, and both
+// are listed in the Threads section of a report triggered on the main thread.
+if (process.argv[2] === 'child') {
+  const nodereport = require('../');
+  const Worker = require('worker_threads').Worker;
+  const path = require('path');
+
+  const busy = `
+    require(${JSON.stringify(path.join(__dirname, '..'))});
+    const parentPort = require('worker_threads').parentPort;
+    const server = require('net').createServer().listen(0);
+    function busyWorker() {
+      const end = Date.now() + 2000;
+      while (Date.now() < end) {}
+    }
+    parentPort.postMessage('ready');
+    busyWorker();
+    server.close();
+  `;
+  const idle = `
+    require(${JSON.stringify(path.join(__dirname, '..'))});
+    const parentPort = require('worker_threads').parentPort;
+    parentPort.once('message', () => parentPort.close());
+    parentPort.postMessage('ready');
+  `;
+  const workers = [new Worker(busy, { eval: true }),
+                   new Worker(idle, { eval: true })];
+  let ready = 0;
+  workers.forEach((worker) => worker.once('message', () => {
+    if (++ready < workers.length) return;
+    const text = nodereport.getReport();
+    nodereport.setFormat('json');
+    const json = JSON.parse(nodereport.getReport());
+    workers[1].postMessage('exit');
+    console.log(JSON.stringify({ text: text, json: json }));
+  }));
+} else {
+  const common = require('./common.js');
+  const decoder = require('../bin/node-report-decode.js');
+  const spawnSync = require('child_process').spawnSync;
+  const tap = require('tap');
+
+  let workerThreads = true;
+  try {
+    require('worker_threads');
+  } catch (e) {
+    workerThreads = false;
+  }
+  if (!workerThreads) {
+    tap.fail('Worker threads are not available', { skip: true });
+    return;
+  }
+
+  const child = spawnSync(process.execPath, [__filename, 'child']);
+  tap.plan(8);
+  tap.equal(child.status, 0, 'Process exited cleanly');
+  const result = JSON.parse(child.stdout.toString());
+
+  const threads = common.getSection(result.text, 'Threads');
+  tap.match(threads, /other threads running JavaScript: 2\n/,
+            'Threads section counts both workers');
+  tap.match(threads, /Thread \d+ \(worker thread[^]*JavaScript stack:[^]*busyWorker/,
+            'Busy worker JavaScript stack is reported');
+  tap.match(threads, /Handles:[^]*\btcp\b/, 'Busy worker tcp handle is reported');
+  tap.match(threads, /Event loop idle/, 'Idle worker is reported as idle');
+
+  const others = result.json.threads.otherThreads;
+  tap.equal(others.length, 2, 'JSON report lists both workers');
+  tap.ok(others.every((thread) => thread.captured && !thread.mainThread &&
+                                  thread.javascriptHeap.totalMemory > 0),
+         'Both workers are captured with their heap usage');
+  tap.match(decoder.render(result.json), /==== Threads[^]*busyWorker/,
+            'Decoder renders the Threads section');
+}
@@ -0,0 +1,43 @@
+'use strict';
+
+// Testcase for the report section timings, in the report content and via the
+// getReportTimings() API call
+if (process.argv[2] === 'child') {
+  const nodereport = require('../');
+  const before = nodereport.getReportTimings();
+  const report = nodereport.getReport();
+  const timings = nodereport.getReportTimings();
+  nodereport.setFormat('json');
+  const json = JSON.parse(nodereport.getReport());
+  console.log(JSON.stringify({ before: before === undefined ? null : before,
+                               report: report,
+                               timings: timings,
+                               json: json.reportTimings }));
+} else {
+  const common = require('./common.js');
+  const spawnSync = require('child_process').spawnSync;
+  const tap = require('tap');
+
+  const child = spawnSync(process.execPath, [__filename, 'child']);
+  tap.plan(10);
+  tap.equal(child.status, 0, 'Process exited cleanly');
+  const result = JSON.parse(child.stdout.toString());
+  tap.equal(result.before, null, 'No timings before the first report');
+
+  const timings = result.timings;
+  tap.ok(timings.sections.captureNativeStack >= 0,
+         'Checking native stack capture time');
+  tap.ok(timings.sections.libuvHandles >= 0, 'Checking libuv handles time');
+  tap.ok(timings.sections.sharedObjects >= 0, 'Checking shared objects time');
+  tap.ok(timings.total > 0, 'Checking total report time');
+  tap.equal(timings.loopBlocked, timings.total,
+            'Synchronous report blocks the event loop throughout');
+
+  const section = common.getSection(result.report, 'Report Timings');
+  tap.match(section, /captureNativeStack\s+\d+\.\d{3}/,
+            'Report Timings section contains native stack capture time');
+  tap.match(section, /Total report time \(ms\)\s+\d+\.\d{3}/,
+            'Report Timings section contains total report time');
+  tap.ok(result.json.total > 0 && result.json.sections.header >= 0,
+         'Checking JSON report timings');
+}
@@ -0,0 +1,56 @@
+'use strict';
+
+// Testcase for options set on a worker thread, which are ignored because the
+// options and the stack sampler are process wide. The worker exits before
+// the main thread writes its report.
+if (process.argv[2] === 'child') {
+  const nodereport = require('../');
+  const Worker = require('worker_threads').Worker;
+  const path = require('path');
+
+  const options = `
+    const nodereport = require(${JSON.stringify(path.join(__dirname, '..'))});
+    nodereport.setSamplingInterval('1');
+    nodereport.setThreadpoolProbe('1');
+    nodereport.setEvents('stall');
+    nodereport.setFormat('json');
+    const end = Date.now() + 200;
+    while (Date.now() < end) {}
+  `;
+  const worker = new Worker(options, { eval: true });
+  worker.on('exit', () => {
+    setTimeout(() => {
+      console.log(JSON.stringify({ text: nodereport.getReport() }));
+    }, 100);
+  });
+} else {
+  const common = require('./common.js');
+  const spawnSync = require('child_process').spawnSync;
+  const tap = require('tap');
+
+  let workerThreads = true;
+  try {
+    require('worker_threads');
+  } catch (e) {
+    workerThreads = false;
+  }
+  if (!workerThreads) {
+    tap.fail('Worker threads are not available', { skip: true });
+    return;
+  }
+
+  const child = spawnSync(process.execPath, [__filename, 'child']);
+  tap.plan(6);
+  tap.equal(child.status, 0, 'Process exited cleanly');
+  const stderr = child.stderr.toString();
+  tap.match(stderr, /the sampling interval can only be set on the main thread/,
+            'Sampling interval set on a worker is rejected');
+  tap.match(stderr, /the threadpool probe can only be set on the main thread/,
+            'Threadpool probe set on a worker is rejected');
+  tap.equal(stderr.match(/can only be set on the main thread/g).length, 4,
+            'Each option set on the worker is rejected, loading the module is not');
+  const result = JSON.parse(child.stdout.toString());
+  tap.notMatch(result.text, /==== Recent Stack Samples/,
+               'Sampler is not started by the worker');
+  tap.notMatch(result.text, /^\s*\{/, 'Report format is not changed by the worker');
+}
@@ -0,0 +1,67 @@
+'use strict';
+
+// Testcase for a report queued for the writer thread when the process aborts
+// on an uncaught exception. A worker blocked in native code holds the writer
+// thread for up to a second, and the queued report is still written out
+// before the exception report.
+if (process.argv[2] === 'child') {
+  const nodereport = require('../');
+  const Worker = require('worker_threads').Worker;
+  const path = require('path');
+
+  const blocked = `
+    require(${JSON.stringify(path.join(__dirname, '..'))});
+    const parentPort = require('worker_threads').parentPort;
+    parentPort.postMessage('ready');
+    require('child_process').execSync('sleep 2');
+  `;
+  const worker = new Worker(blocked, { eval: true });
+  worker.once('message', () => {
+    setTimeout(() => {
+      nodereport.setAsync('yes');
+      nodereport.triggerReport();
+      myException();
+    }, 200);
+  });
+
+  function myException(request, response) {
+    const m = '*** test-exception-async.js: throwing uncaught Error';
+    throw new Error(m);
+  }
+
+} else {
+  const common = require('./common.js');
+  const fs = require('fs');
+  const spawn = require('child_process').spawn;
+  const tap = require('tap');
+
+  let workerThreads = true;
+  try {
+    require('worker_threads');
+  } catch (e) {
+    workerThreads = false;
+  }
+  if (!workerThreads || common.isWindows()) {
+    tap.fail('Worker threads are not available', { skip: true });
+    return;
+  }
+
+  const child = spawn(process.execPath,
+                      ['--abort-on-uncaught-exception', __filename, 'child']);
+  let stderr = '';
+  child.stderr.on('data', (chunk) => { stderr += chunk; });
+  child.on('exit', (code, signal) => {
+    tap.plan(4);
+    tap.notEqual(code, 0, 'Process aborted');
+    tap.equal((stderr.match(/Node.js report completed/g) || []).length, 2,
+              'Both reports completed before the process aborted');
+    const reports = common.findReports(child.pid);
+    tap.equal(reports.length, 2, 'Found reports ' + reports);
+    const events = reports.map((report) => {
+      return /\nEvent: ([^,]+),/.exec(fs.readFileSync(report, 'utf8'))[1];
+    });
+    tap.same(events.sort(), ['JavaScript API', 'exception'].sort(),
+             'Queued API report and exception report were written');
+    reports.forEach((report) => fs.unlinkSync(report));
+  });
+}
@@ -0,0 +1,63 @@
+'use strict';
+
+// Testcase to check that the report on fatal error (javascript heap OOM) is
+// written without heap allocation, using a malloc() shim that fails and counts
+// all allocations made while the report file is open
+if (process.argv[2] === 'child') {
+  require('../');
+
+  const list = [];
+  while (true) {
+    const record = new MyRecord();
+    list.push(record);
+  }
+
+  function MyRecord() {
+    this.name = 'foo';
+    this.id = 128;
+    this.account = 98454324;
+  }
+} else {
+  const common = require('./common.js');
+  const fs = require('fs');
+  const os = require('os');
+  const path = require('path');
+  const spawn = require('child_process').spawn;
+  const spawnSync = require('child_process').spawnSync;
+  const tap = require('tap');
+
+  // The shim relies on the glibc __libc_malloc() family
+  const ldd = spawnSync('ldd', ['--version'], { encoding: 'utf8' });
+  if (process.platform !== 'linux' ||
+      !/GNU|GLIBC/i.test((ldd.stdout || '') + (ldd.stderr || ''))) {
+    tap.fail('Unsupported on this platform', { skip: true });
+    return;
+  }
+  const shim = path.join(os.tmpdir(), 'node-report-malloc-shim-' + process.pid + '.so');
+  const cc = spawnSync(process.env.CC || 'cc',
+                       ['-shared', '-fPIC', '-o', shim,
+                        path.join(__dirname, 'malloc-shim.c'), '-ldl']);
+  if (cc.error || cc.status !== 0) {
+    tap.fail('Unable to build malloc shim, no C compiler', { skip: true });
+    return;
+  }
+
+  const args = ['--max-old-space-size=20', __filename, 'child'];
+  const env = Object.assign({}, process.env, { LD_PRELOAD: shim });
+  const child = spawn(process.execPath, args, { env: env });
+  let stderr = '';
+  child.stderr.on('data', (chunk) => { stderr += chunk; });
+  child.on('exit', (code) => {
+    fs.unlinkSync(shim);
+    tap.plan(4);
+    tap.notEqual(code, 0, 'Process should not exit cleanly');
+    tap.match(stderr, /malloc-shim: 0 allocations while writing report/,
+              'Report written without heap allocation');
+    const reports = common.findReports(child.pid);
+    tap.equal(reports.length, 1, 'Found reports ' + reports);
+    const report = reports[0];
+    common.validate(tap, report, {pid: child.pid,
+      commandline: child.spawnargs.join(' ')
+    });
+  });
+}
@@ -0,0 +1,59 @@
+'use strict';
+
+// Testcase to produce report when the JavaScript heap is near its limit,
+// before the fatal error (javascript heap OOM)
+if (process.argv[2] === 'child') {
+  require('../');
+
+  const list = [];
+  function growHeap() {
+    while (true) {
+      list.push(new MyRecord());
+    }
+  }
+
+  function MyRecord() {
+    this.name = 'foo';
+    this.id = 128;
+    this.account = 98454324;
+  }
+
+  growHeap();
+} else {
+  const common = require('./common.js');
+  const fs = require('fs');
+  const spawn = require('child_process').spawn;
+  const tap = require('tap');
+
+  // The near heap limit callback is available from Node.js 10
+  if (parseInt(process.versions.node.split('.')[0], 10) < 10) {
+    tap.fail('Unsupported on this Node.js version', { skip: true });
+    return;
+  }
+
+  const args = ['--max-old-space-size=20', __filename, 'child'];
+  const env = Object.assign({}, process.env, {
+    NODEREPORT_EVENTS: 'heappressure+fatalerror',
+  });
+  const child = spawn(process.execPath, args, { env: env });
+  child.on('exit', (code) => {
+    tap.plan(6);
+    tap.notEqual(code, 0, 'Process should not exit cleanly');
+    const reports = common.findReports(child.pid).sort();
+    tap.equal(reports.length, 2, 'Found reports ' + reports);
+    const pressure = fs.readFileSync(reports[0], 'utf8');
+    tap.match(pressure, /Event: JavaScript heap near limit/,
+              'First report is for heap pressure');
+    tap.match(common.getSection(pressure, 'JavaScript Stack Trace'), /growHeap/,
+              'JavaScript stack shows the function growing the heap');
+    tap.match(fs.readFileSync(reports[1], 'utf8'), /Event: Allocation failed/,
+              'Second report is for the fatal error');
+    const options = {pid: child.pid};
+    // Node.js currently overwrites the command line on AIX
+    // https://github.com/nodejs/node/issues/10607
+    if (!(common.isAIX() || common.isSunOS())) {
+      options.commandline = child.spawnargs.join(' ');
+    }
+    common.validate(tap, reports[0], options);
+  });
+}
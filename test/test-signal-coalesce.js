@@ -0,0 +1,30 @@
+'use strict';
+
+// Testcase for signals that arrive while a signal report is already pending,
+// which are merged with it and counted in the header of the report.
+if (process.argv[2] === 'child') {
+  require('../');
+  // The event loop is blocked, so the report for the first signal cannot be
+  // written until all five have arrived
+  require('child_process').execSync(
+    'for i in 1 2 3 4 5; do kill -USR2 ' + process.pid + '; sleep 0.1; done');
+  setTimeout(() => {}, 500);
+} else {
+  const common = require('./common.js');
+  const fs = require('fs');
+  const spawnSync = require('child_process').spawnSync;
+  const tap = require('tap');
+
+  if (common.isWindows()) {
+    tap.fail('Unsupported on Windows', { skip: true });
+    return;
+  }
+
+  const child = spawnSync(process.execPath, [__filename, 'child']);
+  tap.plan(3);
+  tap.equal(child.status, 0, 'Process exited cleanly');
+  const reports = common.findReports(child.pid);
+  tap.equal(reports.length, 1, 'Signals are coalesced into one report ' + reports);
+  tap.match(fs.readFileSync(reports[0], 'utf8'), /\nReports suppressed: signal 4\n/,
+            'Every coalesced signal is counted');
+}
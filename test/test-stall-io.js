@@ -0,0 +1,55 @@
+'use strict';
+
+// Testcase to produce report when the event loop is blocked inside an I/O
+// callback, which runs while the loop is in its poll phase.
+if (process.argv[2] === 'child') {
+  require('../');
+  const net = require('net');
+
+  function blockInConnection(ms) {
+    const end = Date.now() + ms;
+    while (Date.now() < end) {}
+  }
+
+  const server = net.createServer((socket) => {
+    blockInConnection(1500);
+    socket.destroy();
+    server.close();
+  }).listen(0, '127.0.0.1', () => {
+    // Leave the loop waiting for the connection first
+    setTimeout(() => {
+      net.connect(server.address().port, '127.0.0.1').on('error', () => {});
+    }, 500);
+  });
+} else {
+  const common = require('./common.js');
+  const fs = require('fs');
+  const spawn = require('child_process').spawn;
+  const tap = require('tap');
+
+  if (common.isWindows()) {
+    tap.fail('Unsupported on Windows', { skip: true });
+    return;
+  }
+
+  const env = Object.assign({}, process.env, {
+    NODEREPORT_EVENTS: 'stall',
+    NODEREPORT_STALL_THRESHOLD: '200',
+  });
+  const child = spawn(process.execPath, [__filename, 'child'], { env: env });
+  child.on('exit', (code) => {
+    tap.plan(5);
+    tap.equal(code, 0, 'Process exited cleanly');
+    const reports = common.findReports(child.pid);
+    tap.equal(reports.length, 1, 'Found reports ' + reports);
+    const report = reports[0];
+    const contents = fs.readFileSync(report, 'utf8');
+    tap.match(contents, /Event: event loop blocked for \d+ ms/,
+              'Report event is the event loop stall');
+    tap.match(common.getSection(contents, 'JavaScript Stack Trace'),
+              /blockInConnection/, 'JavaScript stack shows the blocking connection callback');
+    common.validate(tap, report, {pid: child.pid,
+      commandline: child.spawnargs.join(' ')
+    });
+  });
+}
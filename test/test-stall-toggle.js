@@ -0,0 +1,57 @@
+'use strict';
+
+// Testcase for stall reports turned off and back on with setEvents(). The
+// watchdog is idle while they are off, so the first block is not reported,
+// and it resumes watching the loop when they are turned back on.
+if (process.argv[2] === 'child') {
+  const nodereport = require('../');
+
+  function blockEventLoop(ms) {
+    const end = Date.now() + ms;
+    while (Date.now() < end) {}
+  }
+
+  function blockWhileOff() {
+    blockEventLoop(1000);
+  }
+
+  function blockWhileOn() {
+    blockEventLoop(1000);
+  }
+
+  nodereport.setEvents('exception');
+  setTimeout(() => {
+    blockWhileOff();
+    nodereport.setEvents('stall');
+    setTimeout(() => {
+      blockWhileOn();
+      setTimeout(() => {}, 500);
+    }, 500);
+  }, 500);
+} else {
+  const common = require('./common.js');
+  const fs = require('fs');
+  const spawn = require('child_process').spawn;
+  const tap = require('tap');
+
+  if (common.isWindows()) {
+    tap.fail('Unsupported on Windows', { skip: true });
+    return;
+  }
+
+  const env = Object.assign({}, process.env, {
+    NODEREPORT_EVENTS: 'stall',
+    NODEREPORT_STALL_THRESHOLD: '200',
+  });
+  const child = spawn(process.execPath, [__filename, 'child'], { env: env });
+  child.on('exit', (code) => {
+    tap.plan(3);
+    tap.equal(code, 0, 'Process exited cleanly');
+    const reports = common.findReports(child.pid);
+    tap.equal(reports.length, 1, 'Found reports ' + reports);
+    const contents = fs.readFileSync(reports[0], 'utf8');
+    tap.match(common.getSection(contents, 'JavaScript Stack Trace'),
+              /blockWhileOn/, 'Only the stall after stall reports are turned back on is reported');
+    reports.forEach((report) => fs.unlinkSync(report));
+  });
+}
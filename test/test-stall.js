@@ -0,0 +1,49 @@
+'use strict';
+
+// Testcase to produce report when the event loop is blocked for longer than
+// the stall threshold, showing the JavaScript stack of the blocking code. The
+// event loop is idle first, which must not be reported as a stall.
+if (process.argv[2] === 'child') {
+  require('../');
+
+  function blockEventLoop(ms) {
+    const end = Date.now() + ms;
+    while (Date.now() < end) {}
+  }
+
+  setTimeout(() => {
+    blockEventLoop(1000);
+    setTimeout(() => {}, 500);
+  }, 1000);
+} else {
+  const common = require('./common.js');
+  const fs = require('fs');
+  const spawn = require('child_process').spawn;
+  const tap = require('tap');
+
+  if (common.isWindows()) {
+    tap.fail('Unsupported on Windows', { skip: true });
+    return;
+  }
+
+  const env = Object.assign({}, process.env, {
+    NODEREPORT_EVENTS: 'stall',
+    NODEREPORT_STALL_THRESHOLD: '200',
+  });
+  const child = spawn(process.execPath, [__filename, 'child'], { env: env });
+  child.on('exit', (code) => {
+    tap.plan(5);
+    tap.equal(code, 0, 'Process exited cleanly');
+    const reports = common.findReports(child.pid);
+    tap.equal(reports.length, 1, 'Found reports ' + reports);
+    const report = reports[0];
+    const contents = fs.readFileSync(report, 'utf8');
+    tap.match(contents, /Event: event loop blocked for \d+ ms/,
+              'Report event is the event loop stall');
+    tap.match(common.getSection(contents, 'JavaScript Stack Trace'),
+              /blockEventLoop/, 'JavaScript stack shows the blocking function');
+    common.validate(tap, report, {pid: child.pid,
+      commandline: child.spawnargs.join(' ')
+    });
+  });
+}